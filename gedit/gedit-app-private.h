@@ -61,6 +61,19 @@ GMenuModel		*_gedit_app_get_line_col_menu		(GeditApp  *app);
 GeditMenuExtension	*_gedit_app_extend_menu			(GeditApp    *app,
 								 const gchar *extension_point);
 
+void			 _gedit_app_add_tab_location		(GeditApp  *app,
+								 GeditTab  *tab,
+								 GFile     *location);
+
+void			 _gedit_app_remove_tab_location		(GeditApp  *app,
+								 GeditTab  *tab,
+								 GFile     *location);
+
+GList			*_gedit_app_get_tabs_from_location	(GeditApp  *app,
+								 GFile     *location);
+
+GList			*_gedit_app_peek_documents		(GeditApp  *app);
+
 G_END_DECLS
 
 #endif /* __GEDIT_APP_PRIVATE_H__ */
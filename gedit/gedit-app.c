@@ -51,6 +51,9 @@
 #include "gedit-preferences-dialog.h"
 #include "gedit-tab.h"
 #include "gedit-tab-private.h"
+#include "gedit-document-private.h"
+#include "gedit-recovery-journal.h"
+#include "gedit-language-cache.h"
 
 #ifndef ENABLE_GVFS_METADATA
 #include "gedit-metadata-manager.h"
@@ -82,6 +85,12 @@ typedef struct
 	PeasExtensionSet  *extensions;
 	GNetworkMonitor   *monitor;
 
+	/* GFile -> GList of the GeditTabs with that location */
+	GHashTable        *tabs_by_location;
+
+	/* Whether the documents of a crashed gedit have been looked for. */
+	gboolean           recovery_done;
+
 	/* command line parsing */
 	gboolean new_window;
 	gboolean new_document;
@@ -204,6 +213,8 @@ gedit_app_dispose (GObject *object)
 	g_clear_object (&priv->tab_width_menu);
 	g_clear_object (&priv->line_col_menu);
 
+	g_clear_pointer (&priv->tabs_by_location, g_hash_table_unref);
+
 	G_OBJECT_CLASS (gedit_app_parent_class)->dispose (object);
 }
 
@@ -416,6 +427,181 @@ set_command_line_wait_doc (GeditDocument *doc,
 	set_command_line_wait (app, tab);
 }
 
+#define RECOVERED_DOCUMENT_KEY "GeditRecoveredDocument"
+
+static void
+set_recovered_text (GeditDocument *doc,
+		    const gchar   *text)
+{
+	/* Undoable, to get back the contents of the file. */
+	gtk_text_buffer_begin_user_action (GTK_TEXT_BUFFER (doc));
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (doc), text, -1);
+	gtk_text_buffer_end_user_action (GTK_TEXT_BUFFER (doc));
+
+	gedit_document_goto_line (doc, 0);
+}
+
+/* The journal is deleted once the contents are in a document. */
+static void
+open_recovered_text (GeditWindow            *window,
+		     GeditRecoveredDocument *recovered)
+{
+	GeditTab *tab;
+
+	tab = gedit_window_create_tab (window, FALSE);
+	set_recovered_text (gedit_tab_get_document (tab), recovered->text);
+
+	gedit_recovered_document_delete_journal (recovered);
+}
+
+static void recovered_document_loaded (GeditDocument *doc,
+				       GeditTab      *tab);
+
+static void recovered_tab_state_changed (GeditTab      *tab,
+					 GParamSpec    *pspec,
+					 GeditDocument *doc);
+
+static GeditRecoveredDocument *
+steal_recovered_document (GeditTab *tab)
+{
+	GeditDocument *doc = gedit_tab_get_document (tab);
+
+	g_signal_handlers_disconnect_by_func (doc, recovered_document_loaded, tab);
+	g_signal_handlers_disconnect_by_func (tab, recovered_tab_state_changed, doc);
+
+	return g_object_steal_data (G_OBJECT (doc), RECOVERED_DOCUMENT_KEY);
+}
+
+static void
+recovered_document_loaded (GeditDocument *doc,
+			   GeditTab      *tab)
+{
+	GeditRecoveredDocument *recovered;
+
+	recovered = steal_recovered_document (tab);
+
+	set_recovered_text (doc, recovered->text);
+	gedit_recovered_document_delete_journal (recovered);
+
+	gedit_recovered_document_free (recovered);
+}
+
+/* The file is shown by the mapped file viewer, without "loaded" signal: the
+ * recovered contents go to a new document. After a load error, the user can
+ * still choose another encoding; if the tab is closed instead, the journal is
+ * kept for the next start.
+ */
+static void
+recovered_tab_state_changed (GeditTab      *tab,
+			     GParamSpec    *pspec,
+			     GeditDocument *doc)
+{
+	GeditRecoveredDocument *recovered;
+	GtkWidget *toplevel;
+
+	if (gedit_tab_get_state (tab) != GEDIT_TAB_STATE_NORMAL ||
+	    !_gedit_tab_get_viewer_mode (tab))
+	{
+		return;
+	}
+
+	recovered = steal_recovered_document (tab);
+	toplevel = gtk_widget_get_toplevel (GTK_WIDGET (tab));
+
+	if (GEDIT_IS_WINDOW (toplevel))
+	{
+		open_recovered_text (GEDIT_WINDOW (toplevel), recovered);
+	}
+
+	gedit_recovered_document_free (recovered);
+}
+
+/* Opens the documents which were modified when a gedit process crashed, with
+ * their recovered contents. Returns whether some documents were recovered.
+ */
+static gboolean
+recover_documents (GeditApp    *app,
+		   GeditWindow *window)
+{
+	GeditAppPrivate *priv;
+	GSettings *editor_settings;
+	gboolean enabled;
+	GSList *recovered_docs;
+	GSList *l;
+	gboolean recovered_some;
+
+	priv = gedit_app_get_instance_private (app);
+
+	if (priv->recovery_done)
+	{
+		return FALSE;
+	}
+
+	priv->recovery_done = TRUE;
+
+	editor_settings = g_settings_new ("org.gnome.gedit.preferences.editor");
+	enabled = g_settings_get_boolean (editor_settings, GEDIT_SETTINGS_CRASH_RECOVERY);
+	g_object_unref (editor_settings);
+
+	if (!enabled)
+	{
+		return FALSE;
+	}
+
+	recovered_docs = gedit_recovery_journal_recover_all ();
+
+	for (l = recovered_docs; l != NULL; l = l->next)
+	{
+		GeditRecoveredDocument *recovered = l->data;
+		GeditTab *tab;
+		GeditDocument *doc;
+
+		if (recovered->location != NULL &&
+		    g_file_query_exists (recovered->location, NULL))
+		{
+			/* The contents are set once the file is loaded, to keep
+			 * its encoding and line endings.
+			 */
+			tab = gedit_window_create_tab_from_location (window,
+								     recovered->location,
+								     NULL,
+								     0,
+								     0,
+								     FALSE,
+								     FALSE);
+			doc = gedit_tab_get_document (tab);
+
+			g_object_set_data_full (G_OBJECT (doc),
+						RECOVERED_DOCUMENT_KEY,
+						recovered,
+						(GDestroyNotify) gedit_recovered_document_free);
+
+			g_signal_connect (doc,
+					  "loaded",
+					  G_CALLBACK (recovered_document_loaded),
+					  tab);
+
+			g_signal_connect (tab,
+					  "notify::state",
+					  G_CALLBACK (recovered_tab_state_changed),
+					  doc);
+
+			/* The viewer may already be open. */
+			recovered_tab_state_changed (tab, NULL, doc);
+		}
+		else
+		{
+			open_recovered_text (window, recovered);
+			gedit_recovered_document_free (recovered);
+		}
+	}
+
+	recovered_some = recovered_docs != NULL;
+	g_slist_free (recovered_docs);
+
+	return recovered_some;
+}
+
 static void
 open_files (GApplication            *application,
 	    gboolean                 new_window,
@@ -431,6 +617,7 @@ open_files (GApplication            *application,
 	GeditWindow *window = NULL;
 	GeditTab *tab;
 	gboolean doc_created = FALSE;
+	gboolean doc_recovered;
 
 	if (!new_window)
 	{
@@ -451,6 +638,8 @@ open_files (GApplication            *application,
 		gtk_window_parse_geometry (GTK_WINDOW (window), geometry);
 	}
 
+	doc_recovered = recover_documents (GEDIT_APP (application), window);
+
 	if (stdin_stream)
 	{
 		gedit_debug_message (DEBUG_APP, "Load stdin");
@@ -491,7 +680,7 @@ open_files (GApplication            *application,
 		g_slist_free (loaded);
 	}
 
-	if (!doc_created || new_document)
+	if ((!doc_created && !doc_recovered) || new_document)
 	{
 		gedit_debug_message (DEBUG_APP, "Create tab");
 		tab = gedit_window_create_tab (window, TRUE);
@@ -751,6 +940,7 @@ gedit_app_startup (GApplication *application)
 #ifndef ENABLE_GVFS_METADATA
 	const gchar *cache_dir;
 	gchar *metadata_filename;
+	GSettings *editor_settings;
 #endif
 
 	priv = gedit_app_get_instance_private (GEDIT_APP (application));
@@ -773,9 +963,16 @@ gedit_app_startup (GApplication *application)
 
 #ifndef ENABLE_GVFS_METADATA
 	cache_dir = gedit_dirs_get_user_cache_dir ();
-	metadata_filename = g_build_filename (cache_dir, "gedit-metadata.xml", NULL);
-	gedit_metadata_manager_init (metadata_filename);
+	metadata_filename = g_build_filename (cache_dir, "gedit-metadata.log", NULL);
+	editor_settings = g_settings_new ("org.gnome.gedit.preferences.editor");
+	gedit_metadata_manager_init (metadata_filename,
+				     g_settings_get_uint (editor_settings,
+							  GEDIT_SETTINGS_MAX_METADATA_ITEMS));
+	g_object_unref (editor_settings);
 	g_free (metadata_filename);
+
+	/* Off the critical path of the first document. */
+	gedit_metadata_manager_preload ();
 #endif
 
 	/* Load settings */
@@ -1249,13 +1446,18 @@ gedit_app_shutdown (GApplication *app)
 	save_page_setup (GEDIT_APP (app));
 	save_print_settings (GEDIT_APP (app));
 
+	gedit_recovery_journal_shutdown ();
+	gedit_language_cache_shutdown ();
+
 	/* GTK+ can still hold references to some gedit objects, for example
 	 * GeditDocument for the clipboard. So the metadata-manager should be
 	 * shutdown after.
 	 */
 	G_APPLICATION_CLASS (gedit_app_parent_class)->shutdown (app);
 
-#ifndef ENABLE_GVFS_METADATA
+#ifdef ENABLE_GVFS_METADATA
+	_gedit_document_flush_all_metadata ();
+#else
 	gedit_metadata_manager_shutdown ();
 #endif
 
@@ -1455,6 +1657,11 @@ gedit_app_init (GeditApp *app)
 	                  G_CALLBACK (get_network_available),
 	                  app);
 
+	priv->tabs_by_location = g_hash_table_new_full (g_file_hash,
+							(GEqualFunc) g_file_equal,
+							g_object_unref,
+							(GDestroyNotify) g_list_free);
+
 	g_application_add_main_option_entries (G_APPLICATION (app), options);
 
 #ifdef ENABLE_INTROSPECTION
@@ -1603,6 +1810,28 @@ gedit_app_get_documents	(GeditApp *app)
 	return res;
 }
 
+/* Like gedit_app_get_documents(), but the placeholder tabs are not loaded. */
+GList *
+_gedit_app_peek_documents (GeditApp *app)
+{
+	GList *res = NULL;
+	GList *windows, *l;
+
+	g_return_val_if_fail (GEDIT_IS_APP (app), NULL);
+
+	windows = gtk_application_get_windows (GTK_APPLICATION (app));
+	for (l = windows; l != NULL; l = g_list_next (l))
+	{
+		if (GEDIT_IS_WINDOW (l->data))
+		{
+			res = g_list_concat (res,
+			                     _gedit_window_peek_documents (GEDIT_WINDOW (l->data)));
+		}
+	}
+
+	return res;
+}
+
 /**
  * gedit_app_get_views:
  * @app: the #GeditApp
@@ -1953,4 +2182,101 @@ _gedit_app_extend_menu (GeditApp    *app,
 	return section != NULL ? gedit_menu_extension_new (G_MENU (section)) : NULL;
 }
 
+/* The tabs register their location, so that finding the tabs opened on a file
+ * doesn't need to walk all the tabs of all the windows.
+ */
+void
+_gedit_app_add_tab_location (GeditApp *app,
+			     GeditTab *tab,
+			     GFile    *location)
+{
+	GeditAppPrivate *priv;
+	GList *tabs;
+
+	g_return_if_fail (GEDIT_IS_APP (app));
+	g_return_if_fail (GEDIT_IS_TAB (tab));
+	g_return_if_fail (G_IS_FILE (location));
+
+	priv = gedit_app_get_instance_private (app);
+
+	if (priv->tabs_by_location == NULL)
+	{
+		return;
+	}
+
+	tabs = g_hash_table_lookup (priv->tabs_by_location, location);
+
+	if (tabs != NULL)
+	{
+		/* The list head doesn't change, the value can be kept. */
+		tabs = g_list_append (tabs, tab);
+	}
+	else
+	{
+		g_hash_table_insert (priv->tabs_by_location,
+				     g_object_ref (location),
+				     g_list_prepend (NULL, tab));
+	}
+}
+
+void
+_gedit_app_remove_tab_location (GeditApp *app,
+				GeditTab *tab,
+				GFile    *location)
+{
+	GeditAppPrivate *priv;
+	GFile *key;
+	GList *tabs;
+
+	g_return_if_fail (GEDIT_IS_APP (app));
+	g_return_if_fail (GEDIT_IS_TAB (tab));
+	g_return_if_fail (G_IS_FILE (location));
+
+	priv = gedit_app_get_instance_private (app);
+
+	if (priv->tabs_by_location == NULL ||
+	    !g_hash_table_lookup_extended (priv->tabs_by_location,
+					   location,
+					   (gpointer *) &key,
+					   (gpointer *) &tabs))
+	{
+		return;
+	}
+
+	g_hash_table_steal (priv->tabs_by_location, location);
+
+	tabs = g_list_remove (tabs, tab);
+
+	if (tabs != NULL)
+	{
+		g_hash_table_insert (priv->tabs_by_location, key, tabs);
+	}
+	else
+	{
+		g_object_unref (key);
+	}
+}
+
+/* Returns: (transfer none): the tabs, in all the windows, whose document has
+ * @location.
+ */
+GList *
+_gedit_app_get_tabs_from_location (GeditApp *app,
+				   GFile    *location)
+{
+	GeditAppPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_APP (app), NULL);
+	g_return_val_if_fail (G_IS_FILE (location), NULL);
+
+	priv = gedit_app_get_instance_private (app);
+
+	if (priv->tabs_by_location == NULL)
+	{
+		return NULL;
+	}
+
+	return g_hash_table_lookup (priv->tabs_by_location, location);
+}
+
 /* ex:set ts=8 noet: */
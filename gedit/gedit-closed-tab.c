@@ -0,0 +1,489 @@
+/*
+ * gedit-closed-tab.c
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* What is remembered of a closed tab, to reopen it. Besides the location and
+ * the cursor position, an unmodified local document keeps a compressed
+ * snapshot of its contents, in the encoding of its file. Reopening the tab
+ * loads the snapshot instead of the file, if the file has not changed since
+ * (same modification time and size).
+ *
+ * Only the text is copied when the tab is closed: it is converted and
+ * compressed in a thread. Until then, the tab is reopened from its file.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gedit-closed-tab.h"
+
+#include <string.h>
+
+#include "gedit-commands.h"
+#include "gedit-compression.h"
+#include "gedit-debug.h"
+#include "gedit-document-private.h"
+#include "gedit-tab-private.h"
+#include "gedit-window-private.h"
+
+/* Bigger documents are reopened from their file. */
+#define SNAPSHOT_MAX_CHARS (8 * 1024 * 1024)
+
+struct _GeditClosedTab
+{
+	GFile *location;
+
+	/* 1-based, as for gedit_commands_load_location(). */
+	gint line_pos;
+	gint column_pos;
+
+	/* The compressed contents, or NULL. */
+	GBytes *snapshot;
+	const GtkSourceEncoding *encoding;
+
+	/* While the snapshot is being taken. */
+	GCancellable *cancellable;
+	GeditClosedTabSnapshotFunc snapshot_func;
+	gpointer snapshot_func_data;
+
+	/* The file when the snapshot was taken. */
+	guint64 mtime;
+	guint32 mtime_usec;
+	goffset size;
+};
+
+typedef struct
+{
+	gchar *text;
+	gsize length;
+	gchar *charset;
+} SnapshotData;
+
+/* Zstd is much faster than zlib, which is used when gedit is built without
+ * it.
+ */
+static GConverter *
+snapshot_compressor_new (void)
+{
+#ifdef HAVE_ZSTD
+	return gedit_compression_compressor_new (GEDIT_COMPRESSION_FORMAT_ZSTD);
+#else
+	return G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, 1));
+#endif
+}
+
+static GConverter *
+snapshot_decompressor_new (void)
+{
+#ifdef HAVE_ZSTD
+	return gedit_compression_decompressor_new (GEDIT_COMPRESSION_FORMAT_ZSTD);
+#else
+	return G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+#endif
+}
+
+static gboolean
+query_file_stamp (GFile    *location,
+		  guint64  *mtime,
+		  guint32  *mtime_usec,
+		  goffset  *size)
+{
+	GFileInfo *info;
+
+	info = g_file_query_info (location,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC ","
+				  G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL,
+				  NULL);
+
+	if (info == NULL)
+	{
+		return FALSE;
+	}
+
+	*mtime = g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED);
+	*mtime_usec = g_file_info_get_attribute_uint32 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+	*size = g_file_info_get_size (info);
+
+	g_object_unref (info);
+	return TRUE;
+}
+
+/* The document must have the same contents as its file: the snapshot replaces
+ * the file when reopening.
+ */
+static gboolean
+can_take_snapshot (GeditTab *tab)
+{
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GtkSourceFile *file = gedit_document_get_file (doc);
+	GFile *location = gtk_source_file_get_location (file);
+	GeditTabState state = gedit_tab_get_state (tab);
+
+	return ((state == GEDIT_TAB_STATE_NORMAL || state == GEDIT_TAB_STATE_CLOSING) &&
+		!_gedit_tab_is_placeholder (tab) &&
+		!_gedit_tab_get_viewer_mode (tab) &&
+		!_gedit_tab_get_follow (tab) &&
+		!_gedit_document_get_hibernated (doc) &&
+		!gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (doc)) &&
+		g_file_is_native (location) &&
+		_gedit_document_get_file_encoding (doc) != NULL &&
+		gtk_source_file_get_compression_type (file) == GTK_SOURCE_COMPRESSION_TYPE_NONE &&
+		gedit_compression_format_from_location (location) == GEDIT_COMPRESSION_FORMAT_NONE &&
+		gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (doc)) <= SNAPSHOT_MAX_CHARS);
+}
+
+static void
+snapshot_data_free (SnapshotData *data)
+{
+	if (data != NULL)
+	{
+		g_free (data->text);
+		g_free (data->charset);
+		g_slice_free (SnapshotData, data);
+	}
+}
+
+static GBytes *
+compress (const gchar  *contents,
+	  gsize         length,
+	  GCancellable *cancellable,
+	  GError      **error)
+{
+	GConverter *compressor;
+	GOutputStream *memory_stream;
+	GOutputStream *stream;
+	GBytes *bytes = NULL;
+
+	compressor = snapshot_compressor_new ();
+	memory_stream = g_memory_output_stream_new_resizable ();
+	stream = g_converter_output_stream_new (memory_stream, compressor);
+
+	if (g_output_stream_write_all (stream, contents, length, NULL, cancellable, error) &&
+	    g_output_stream_close (stream, cancellable, error))
+	{
+		bytes = g_memory_output_stream_steal_as_bytes (G_MEMORY_OUTPUT_STREAM (memory_stream));
+	}
+
+	g_object_unref (stream);
+	g_object_unref (memory_stream);
+	g_object_unref (compressor);
+
+	return bytes;
+}
+
+static void
+snapshot_thread (GTask        *task,
+		 gpointer      source_object,
+		 SnapshotData *data,
+		 GCancellable *cancellable)
+{
+	const gchar *text = data->text;
+	gsize length = data->length;
+	gchar *converted = NULL;
+	GBytes *snapshot;
+	GError *error = NULL;
+
+	/* The loader detects the encoding and the line terminators again, so
+	 * the snapshot has the bytes of the file.
+	 */
+	if (g_ascii_strcasecmp (data->charset, "UTF-8") != 0)
+	{
+		converted = g_convert (text, length, data->charset, "UTF-8", NULL, &length, &error);
+
+		if (converted == NULL)
+		{
+			g_task_return_error (task, error);
+			return;
+		}
+
+		text = converted;
+	}
+
+	snapshot = compress (text, length, cancellable, &error);
+
+	gedit_debug_message (DEBUG_WINDOW, "Closed tab snapshot: %" G_GSIZE_FORMAT " bytes, %" G_GSIZE_FORMAT " compressed",
+			     length,
+			     snapshot != NULL ? g_bytes_get_size (snapshot) : 0);
+
+	g_free (converted);
+
+	if (snapshot == NULL)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	g_task_return_pointer (task, snapshot, (GDestroyNotify) g_bytes_unref);
+}
+
+/* @closed_tab is freed, or its snapshot dropped, if the task is cancelled. */
+static void
+snapshot_taken_cb (GObject        *source_object,
+		   GAsyncResult   *result,
+		   GeditClosedTab *closed_tab)
+{
+	GBytes *snapshot;
+	GError *error = NULL;
+
+	snapshot = g_task_propagate_pointer (G_TASK (result), &error);
+
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_error_free (error);
+		return;
+	}
+
+	g_clear_object (&closed_tab->cancellable);
+
+	if (snapshot == NULL)
+	{
+		gedit_debug_message (DEBUG_WINDOW, "Cannot take the snapshot: %s", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	closed_tab->snapshot = snapshot;
+
+	if (closed_tab->snapshot_func != NULL)
+	{
+		closed_tab->snapshot_func (closed_tab, closed_tab->snapshot_func_data);
+	}
+}
+
+static void
+take_snapshot (GeditClosedTab *closed_tab,
+	       GeditTab       *tab)
+{
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	SnapshotData *data;
+	GtkTextIter start;
+	GtkTextIter end;
+	GTask *task;
+
+	if (!can_take_snapshot (tab) ||
+	    !query_file_stamp (closed_tab->location,
+			       &closed_tab->mtime,
+			       &closed_tab->mtime_usec,
+			       &closed_tab->size))
+	{
+		return;
+	}
+
+	data = g_slice_new0 (SnapshotData);
+
+	gtk_text_buffer_get_bounds (GTK_TEXT_BUFFER (doc), &start, &end);
+	data->text = gtk_text_buffer_get_text (GTK_TEXT_BUFFER (doc), &start, &end, TRUE);
+
+	/* The loader removes it again. */
+	if (gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (doc)))
+	{
+		gchar *tmp = data->text;
+
+		data->text = g_strconcat (tmp, "\n", NULL);
+		g_free (tmp);
+	}
+
+	data->length = strlen (data->text);
+
+	closed_tab->encoding = _gedit_document_get_file_encoding (doc);
+	data->charset = g_strdup (gtk_source_encoding_get_charset (closed_tab->encoding));
+
+	closed_tab->cancellable = g_cancellable_new ();
+
+	task = g_task_new (NULL,
+			   closed_tab->cancellable,
+			   (GAsyncReadyCallback) snapshot_taken_cb,
+			   closed_tab);
+
+	g_task_set_task_data (task, data, (GDestroyNotify) snapshot_data_free);
+	g_task_run_in_thread (task, (GTaskThreadFunc) snapshot_thread);
+	g_object_unref (task);
+}
+
+/* Returns NULL if the tab cannot be reopened (no location). If
+ * @with_snapshot is set, the contents of the tab may be kept, and @func is
+ * called when the snapshot is taken.
+ */
+GeditClosedTab *
+gedit_closed_tab_new (GeditTab                   *tab,
+		      gboolean                    with_snapshot,
+		      GeditClosedTabSnapshotFunc  func,
+		      gpointer                    user_data)
+{
+	GeditClosedTab *closed_tab;
+	GeditDocument *doc;
+	GFile *location;
+	GtkTextIter iter;
+
+	g_return_val_if_fail (GEDIT_IS_TAB (tab), NULL);
+
+	doc = gedit_tab_get_document (tab);
+	location = gtk_source_file_get_location (gedit_document_get_file (doc));
+
+	if (location == NULL)
+	{
+		return NULL;
+	}
+
+	closed_tab = g_slice_new0 (GeditClosedTab);
+	closed_tab->location = g_object_ref (location);
+
+	gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (doc),
+					  &iter,
+					  gtk_text_buffer_get_insert (GTK_TEXT_BUFFER (doc)));
+
+	closed_tab->line_pos = gtk_text_iter_get_line (&iter) + 1;
+	closed_tab->column_pos = gtk_text_iter_get_line_offset (&iter) + 1;
+
+	if (with_snapshot)
+	{
+		closed_tab->snapshot_func = func;
+		closed_tab->snapshot_func_data = user_data;
+
+		take_snapshot (closed_tab, tab);
+	}
+
+	return closed_tab;
+}
+
+void
+gedit_closed_tab_free (GeditClosedTab *closed_tab)
+{
+	if (closed_tab != NULL)
+	{
+		gedit_closed_tab_drop_snapshot (closed_tab);
+		g_object_unref (closed_tab->location);
+
+		g_slice_free (GeditClosedTab, closed_tab);
+	}
+}
+
+GFile *
+gedit_closed_tab_get_location (GeditClosedTab *closed_tab)
+{
+	g_return_val_if_fail (closed_tab != NULL, NULL);
+
+	return closed_tab->location;
+}
+
+/* Whether the snapshot is taken or being taken. */
+gboolean
+gedit_closed_tab_has_snapshot (GeditClosedTab *closed_tab)
+{
+	g_return_val_if_fail (closed_tab != NULL, FALSE);
+
+	return closed_tab->snapshot != NULL || closed_tab->cancellable != NULL;
+}
+
+gsize
+gedit_closed_tab_get_snapshot_size (GeditClosedTab *closed_tab)
+{
+	g_return_val_if_fail (closed_tab != NULL, 0);
+
+	return closed_tab->snapshot != NULL ? g_bytes_get_size (closed_tab->snapshot) : 0;
+}
+
+void
+gedit_closed_tab_drop_snapshot (GeditClosedTab *closed_tab)
+{
+	g_return_if_fail (closed_tab != NULL);
+
+	if (closed_tab->cancellable != NULL)
+	{
+		g_cancellable_cancel (closed_tab->cancellable);
+		g_clear_object (&closed_tab->cancellable);
+	}
+
+	if (closed_tab->snapshot != NULL)
+	{
+		g_bytes_unref (closed_tab->snapshot);
+		closed_tab->snapshot = NULL;
+	}
+}
+
+static gboolean
+is_snapshot_up_to_date (GeditClosedTab *closed_tab)
+{
+	guint64 mtime;
+	guint32 mtime_usec;
+	goffset size;
+
+	return (closed_tab->snapshot != NULL &&
+		query_file_stamp (closed_tab->location, &mtime, &mtime_usec, &size) &&
+		mtime == closed_tab->mtime &&
+		mtime_usec == closed_tab->mtime_usec &&
+		size == closed_tab->size);
+}
+
+/* Reopens the tab from its snapshot if the file has not changed, or from the
+ * file otherwise.
+ */
+void
+gedit_closed_tab_reopen (GeditClosedTab *closed_tab,
+			 GeditWindow    *window)
+{
+	g_return_if_fail (closed_tab != NULL);
+	g_return_if_fail (GEDIT_IS_WINDOW (window));
+
+	if (gedit_window_get_tab_from_location (window, closed_tab->location) == NULL &&
+	    is_snapshot_up_to_date (closed_tab))
+	{
+		GConverter *decompressor;
+		GInputStream *memory_stream;
+		GInputStream *stream;
+		GTimeVal mtime;
+
+		gedit_debug_message (DEBUG_WINDOW, "Reopen the closed tab from its snapshot");
+
+		mtime.tv_sec = closed_tab->mtime;
+		mtime.tv_usec = closed_tab->mtime_usec;
+
+		/* The loader reads the stream in a thread, see
+		 * gedit-compression.c.
+		 */
+		decompressor = snapshot_decompressor_new ();
+		memory_stream = g_memory_input_stream_new_from_bytes (closed_tab->snapshot);
+		stream = g_converter_input_stream_new (memory_stream, decompressor);
+
+		_gedit_window_create_tab_from_snapshot (window,
+							closed_tab->location,
+							stream,
+							closed_tab->encoding,
+							&mtime,
+							closed_tab->line_pos,
+							closed_tab->column_pos);
+
+		g_object_unref (stream);
+		g_object_unref (memory_stream);
+		g_object_unref (decompressor);
+		return;
+	}
+
+	gedit_commands_load_location (window,
+				      closed_tab->location,
+				      NULL,
+				      closed_tab->line_pos,
+				      closed_tab->column_pos);
+}
+
+/* ex:set ts=8 noet: */
@@ -0,0 +1,55 @@
+/*
+ * gedit-closed-tab.h
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEDIT_CLOSED_TAB_H__
+#define __GEDIT_CLOSED_TAB_H__
+
+#include "gedit-window.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GeditClosedTab GeditClosedTab;
+
+typedef void (*GeditClosedTabSnapshotFunc) (GeditClosedTab *closed_tab,
+					    gpointer        user_data);
+
+GeditClosedTab	*gedit_closed_tab_new			(GeditTab                   *tab,
+							 gboolean                    with_snapshot,
+							 GeditClosedTabSnapshotFunc  func,
+							 gpointer                    user_data);
+
+void		 gedit_closed_tab_free			(GeditClosedTab *closed_tab);
+
+GFile		*gedit_closed_tab_get_location		(GeditClosedTab *closed_tab);
+
+gboolean	 gedit_closed_tab_has_snapshot		(GeditClosedTab *closed_tab);
+
+gsize		 gedit_closed_tab_get_snapshot_size	(GeditClosedTab *closed_tab);
+
+void		 gedit_closed_tab_drop_snapshot		(GeditClosedTab *closed_tab);
+
+void		 gedit_closed_tab_reopen		(GeditClosedTab *closed_tab,
+							 GeditWindow    *window);
+
+G_END_DECLS
+
+#endif /* __GEDIT_CLOSED_TAB_H__ */
+
+/* ex:set ts=8 noet: */
@@ -67,48 +67,6 @@ _gedit_cmd_file_new (GSimpleAction *action,
 	gedit_window_create_tab (window, TRUE);
 }
 
-static GeditTab *
-get_tab_from_file (GList *docs,
-		   GFile *file)
-{
-	GList *l;
-
-	for (l = docs; l != NULL; l = l->next)
-	{
-		GeditDocument *doc;
-		GtkSourceFile *source_file;
-		GFile *location;
-
-		doc = l->data;
-		source_file = gedit_document_get_file (doc);
-		location = gtk_source_file_get_location (source_file);
-
-		if (location != NULL && g_file_equal (location, file))
-		{
-			return gedit_tab_get_from_document (doc);
-		}
-	}
-
-	return NULL;
-}
-
-static gboolean
-is_duplicated_file (GSList *files,
-		    GFile  *file)
-{
-	GSList *l;
-
-	for (l = files; l != NULL; l = l->next)
-	{
-		if (g_file_equal (l->data, file))
-		{
-			return TRUE;
-		}
-	}
-
-	return FALSE;
-}
-
 /* File loading */
 static GSList *
 load_file_list (GeditWindow             *window,
@@ -118,7 +76,7 @@ load_file_list (GeditWindow             *window,
 		gint                     column_pos,
 		gboolean                 create)
 {
-	GList *win_docs;
+	GHashTable *files_to_load_set;
 	GSList *files_to_load = NULL;
 	GSList *loaded_files = NULL;
 	GeditTab *tab;
@@ -128,7 +86,7 @@ load_file_list (GeditWindow             *window,
 
 	gedit_debug (DEBUG_COMMANDS);
 
-	win_docs = gedit_window_get_documents (window);
+	files_to_load_set = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
 
 	/* Remove the files corresponding to documents already opened in
 	 * "window" and remove duplicates from the "files" list.
@@ -137,15 +95,16 @@ load_file_list (GeditWindow             *window,
 	{
 		GFile *file = l->data;
 
-		if (is_duplicated_file (files_to_load, file))
+		if (g_hash_table_contains (files_to_load_set, file))
 		{
 			continue;
 		}
 
-		tab = get_tab_from_file (win_docs, file);
+		tab = gedit_window_get_tab_from_location (window, file);
 
 		if (tab == NULL)
 		{
+			g_hash_table_add (files_to_load_set, file);
 			files_to_load = g_slist_prepend (files_to_load, file);
 		}
 		else
@@ -181,7 +140,7 @@ load_file_list (GeditWindow             *window,
 		}
 	}
 
-	g_list_free (win_docs);
+	g_hash_table_destroy (files_to_load_set);
 
 	if (files_to_load == NULL)
 	{
@@ -224,13 +183,28 @@ load_file_list (GeditWindow             *window,
 	{
 		g_return_val_if_fail (l->data != NULL, NULL);
 
-		tab = gedit_window_create_tab_from_location (window,
-							     l->data,
-							     encoding,
-							     line_pos,
-							     column_pos,
-							     create,
-							     jump_to);
+		/* The tabs opened in the background are loaded only when
+		 * they are shown, so that opening hundreds of files is fast.
+		 */
+		if (jump_to)
+		{
+			tab = gedit_window_create_tab_from_location (window,
+								     l->data,
+								     encoding,
+								     line_pos,
+								     column_pos,
+								     create,
+								     TRUE);
+		}
+		else
+		{
+			tab = _gedit_window_create_placeholder_tab (window,
+								    l->data,
+								    encoding,
+								    line_pos,
+								    column_pos,
+								    create);
+		}
 
 		if (tab != NULL)
 		{
@@ -246,6 +220,9 @@ load_file_list (GeditWindow             *window,
 
 	loaded_files = g_slist_reverse (loaded_files);
 
+	/* When several files are loaded, the window shows the loading progress
+	 * in the statusbar.
+	 */
 	if (num_loaded_files == 1)
 	{
 		GeditDocument *doc;
@@ -263,15 +240,6 @@ load_file_list (GeditWindow             *window,
 
 		g_free (uri_for_display);
 	}
-	else
-	{
-		gedit_statusbar_flash_message (GEDIT_STATUSBAR (window->priv->statusbar),
-					       window->priv->generic_message_cid,
-					       ngettext ("Loading %d file\342\200\246",
-							 "Loading %d files\342\200\246",
-							 num_loaded_files),
-					       num_loaded_files);
-	}
 
 	g_slist_free (files_to_load);
 
@@ -334,6 +302,37 @@ gedit_commands_load_locations (GeditWindow             *window,
 			       const GtkSourceEncoding *encoding,
 			       gint                     line_pos,
 			       gint                     column_pos)
+{
+	GSList *loaded;
+	GSList *l;
+
+	g_return_val_if_fail (GEDIT_IS_WINDOW (window), NULL);
+	g_return_val_if_fail (locations != NULL && locations->data != NULL, NULL);
+
+	loaded = _gedit_cmd_load_locations (window,
+					    locations,
+					    encoding,
+					    line_pos,
+					    column_pos);
+
+	/* The caller gets the documents, so it expects their contents: the
+	 * tabs opened in the background are loaded now instead of when they
+	 * are shown.
+	 */
+	for (l = loaded; l != NULL; l = g_slist_next (l))
+	{
+		_gedit_tab_materialize (gedit_tab_get_from_document (l->data));
+	}
+
+	return loaded;
+}
+
+GSList *
+_gedit_cmd_load_locations (GeditWindow             *window,
+			   const GSList            *locations,
+			   const GtkSourceEncoding *encoding,
+			   gint                     line_pos,
+			   gint                     column_pos)
 {
 	g_return_val_if_fail (GEDIT_IS_WINDOW (window), NULL);
 	g_return_val_if_fail (locations != NULL && locations->data != NULL, NULL);
@@ -407,11 +406,11 @@ open_dialog_response_cb (GeditFileChooserDialog *dialog,
 	/* Remember the folder we navigated to */
 	_gedit_window_set_default_location (window, files->data);
 
-	loaded = gedit_commands_load_locations (window,
-	                                        files,
-	                                        encoding,
-	                                        0,
-	                                        0);
+	loaded = _gedit_cmd_load_locations (window,
+	                                    files,
+	                                    encoding,
+	                                    0,
+	                                    0);
 
 	g_slist_free (loaded);
 	g_slist_free_full (files, g_object_unref);
@@ -518,12 +517,13 @@ _gedit_cmd_file_reopen_closed_tab (GSimpleAction *action,
 				   gpointer       user_data)
 {
 	GeditWindow *window = GEDIT_WINDOW (user_data);
-	GFile *file;
+	GeditClosedTab *closed_tab;
 
-	file = _gedit_window_pop_last_closed_doc (window);
-	if (file != NULL)
+	closed_tab = _gedit_window_pop_last_closed_tab (window);
+	if (closed_tab != NULL)
 	{
-		gedit_commands_load_location (window, file, NULL, 0, 0);
+		gedit_closed_tab_reopen (closed_tab, window);
+		gedit_closed_tab_free (closed_tab);
 	}
 }
 
@@ -904,14 +904,14 @@ save_as_tab_async (GeditTab            *tab,
 	}
 
 	/* Set suggested encoding and newline type. */
-	encoding = gtk_source_file_get_encoding (file);
+	encoding = _gedit_document_get_file_encoding (doc);
 
 	if (encoding == NULL)
 	{
 		encoding = gtk_source_encoding_get_utf8 ();
 	}
 
-	newline_type = gtk_source_file_get_newline_type (file);
+	newline_type = _gedit_document_get_file_newline_type (doc);
 
 	gedit_file_chooser_dialog_set_encoding (GEDIT_FILE_CHOOSER_DIALOG (save_dialog),
 						encoding);
@@ -999,6 +999,16 @@ gedit_commands_save_document_async (GeditDocument       *document,
 	tab = gedit_tab_get_from_document (document);
 	file = gedit_document_get_file (document);
 
+	if (_gedit_tab_get_viewer_mode (tab) ||
+	    _gedit_tab_get_follow (tab))
+	{
+		gedit_debug_message (DEBUG_COMMANDS, "Viewer or follow mode, nothing to save");
+
+		g_task_return_boolean (task, FALSE);
+		g_object_unref (task);
+		return;
+	}
+
 	if (gedit_document_is_untitled (document) ||
 	    gtk_source_file_is_readonly (file))
 	{
@@ -1117,6 +1127,16 @@ _gedit_cmd_file_save_as (GSimpleAction *action,
 	}
 }
 
+/* Whether the tabs of @window are closed because gedit quits. */
+gboolean
+_gedit_cmd_file_is_quitting (GeditWindow *window)
+{
+	g_return_val_if_fail (GEDIT_IS_WINDOW (window), FALSE);
+
+	return (GPOINTER_TO_BOOLEAN (g_object_get_data (G_OBJECT (window), GEDIT_IS_QUITTING)) ||
+		GPOINTER_TO_BOOLEAN (g_object_get_data (G_OBJECT (window), GEDIT_IS_QUITTING_ALL)));
+}
+
 static void
 quit_if_needed (GeditWindow *window)
 {
@@ -1256,13 +1276,222 @@ save_as_documents_list (SaveAsData *data)
 			   data);
 }
 
+/* Save All runs at most this number of saves at the same time. */
+#define MAX_PARALLEL_SAVES 4
+
+typedef struct _SaveAllData SaveAllData;
+
+struct _SaveAllData
+{
+	/* Reffed */
+	GeditWindow *window;
+
+	/* Reffed GeditTab's waiting for a free slot. */
+	GQueue pending_tabs;
+
+	guint n_running;
+	guint n_total;
+	guint n_saved;
+	guint n_failed;
+
+	/* The tabs which need a file chooser, handled once the other saves
+	 * are finished. NULL if none.
+	 */
+	SaveAsData *save_as_data;
+};
+
+typedef struct _SaveAllItem SaveAllItem;
+
+/* A save launched by Save All. It keeps its slot until it succeeds or
+ * reports an error, not until the user answers the info bar of the error.
+ */
+struct _SaveAllItem
+{
+	/* NULL once the slot is released. */
+	SaveAllData *data;
+
+	/* Reffed */
+	GeditTab *tab;
+
+	gulong state_notify_id;
+};
+
+static void save_all_launch_saves (SaveAllData *data);
+
+static void
+save_all_show_progress (SaveAllData *data)
+{
+	guint n_done = data->n_saved + data->n_failed;
+
+	if (n_done < data->n_total)
+	{
+		gedit_statusbar_flash_message (GEDIT_STATUSBAR (data->window->priv->statusbar),
+					       data->window->priv->generic_message_cid,
+					       _("Saving documents: %u of %u\342\200\246"),
+					       n_done,
+					       data->n_total);
+	}
+	else if (data->n_failed == 0)
+	{
+		gedit_statusbar_flash_message (GEDIT_STATUSBAR (data->window->priv->statusbar),
+					       data->window->priv->generic_message_cid,
+					       ngettext ("%u document saved",
+							 "%u documents saved",
+							 data->n_saved),
+					       data->n_saved);
+	}
+	else
+	{
+		gedit_statusbar_flash_message (GEDIT_STATUSBAR (data->window->priv->statusbar),
+					       data->window->priv->generic_message_cid,
+					       ngettext ("%u of %u document saved, %u failed",
+							 "%u of %u documents saved, %u failed",
+							 data->n_total),
+					       data->n_saved,
+					       data->n_total,
+					       data->n_failed);
+	}
+}
+
+static void
+save_all_finish (SaveAllData *data)
+{
+	gedit_debug_message (DEBUG_COMMANDS, "Save All: %u saved, %u failed",
+			     data->n_saved,
+			     data->n_failed);
+
+	if (data->n_total > 0)
+	{
+		save_all_show_progress (data);
+	}
+
+	if (data->save_as_data != NULL)
+	{
+		data->save_as_data->tabs_to_save_as = g_slist_reverse (data->save_as_data->tabs_to_save_as);
+		save_as_documents_list (data->save_as_data);
+	}
+
+	g_object_unref (data->window);
+	g_slice_free (SaveAllData, data);
+}
+
+static void
+save_all_release_slot (SaveAllItem *item,
+		       gboolean     saved)
+{
+	SaveAllData *data = item->data;
+
+	item->data = NULL;
+
+	g_signal_handler_disconnect (item->tab, item->state_notify_id);
+	item->state_notify_id = 0;
+
+	if (saved)
+	{
+		data->n_saved++;
+	}
+	else
+	{
+		data->n_failed++;
+	}
+
+	data->n_running--;
+
+	save_all_show_progress (data);
+	save_all_launch_saves (data);
+}
+
+/* An error is shown in its tab, and the save is finished only when the user
+ * answers it. The other saves go on meanwhile.
+ */
+static void
+save_all_tab_state_notify (GeditTab    *tab,
+			   GParamSpec  *pspec,
+			   SaveAllItem *item)
+{
+	if (gedit_tab_get_state (tab) == GEDIT_TAB_STATE_SAVING_ERROR)
+	{
+		save_all_release_slot (item, FALSE);
+	}
+}
+
+static void
+save_all_tab_ready_cb (GeditDocument *doc,
+		       GAsyncResult  *result,
+		       SaveAllItem   *item)
+{
+	gboolean saved;
+
+	saved = gedit_commands_save_document_finish (doc, result);
+
+	if (item->data != NULL)
+	{
+		save_all_release_slot (item, saved);
+	}
+
+	g_object_unref (item->tab);
+	g_slice_free (SaveAllItem, item);
+}
+
+static void
+save_all_launch_saves (SaveAllData *data)
+{
+	while (data->n_running < MAX_PARALLEL_SAVES &&
+	       !g_queue_is_empty (&data->pending_tabs))
+	{
+		GeditTab *tab = g_queue_pop_head (&data->pending_tabs);
+		GeditDocument *doc = gedit_tab_get_document (tab);
+		GeditTabState state = gedit_tab_get_state (tab);
+
+		/* The tab may have been closed or saved in the meantime. */
+		if ((state == GEDIT_TAB_STATE_NORMAL ||
+		     state == GEDIT_TAB_STATE_SHOWING_PRINT_PREVIEW) &&
+		    _gedit_document_needs_saving (doc))
+		{
+			SaveAllItem *item;
+
+			data->n_running++;
+
+			item = g_slice_new0 (SaveAllItem);
+			item->data = data;
+			item->tab = g_object_ref (tab);
+			item->state_notify_id = g_signal_connect (tab,
+								  "notify::state",
+								  G_CALLBACK (save_all_tab_state_notify),
+								  item);
+
+			gedit_commands_save_document_async (doc,
+							    data->window,
+							    NULL,
+							    (GAsyncReadyCallback) save_all_tab_ready_cb,
+							    item);
+		}
+		else
+		{
+			data->n_total--;
+		}
+
+		g_object_unref (tab);
+	}
+
+	if (data->n_running == 0)
+	{
+		save_all_finish (data);
+	}
+}
+
 /*
  * The docs in the list must belong to the same GeditWindow.
+ *
+ * The saves which don't need the user are done first, a few at a time. The
+ * untitled and read-only documents, for which a file chooser is shown, are
+ * saved at the end, one after the other.
  */
 static void
 save_documents_list (GeditWindow *window,
 		     GList       *docs)
 {
+	SaveAllData *save_all_data;
 	SaveAsData *data = NULL;
 	GList *l;
 
@@ -1270,6 +1499,10 @@ save_documents_list (GeditWindow *window,
 
 	g_return_if_fail ((gedit_window_get_state (window) & GEDIT_WINDOW_STATE_PRINTING) == 0);
 
+	save_all_data = g_slice_new0 (SaveAllData);
+	save_all_data->window = g_object_ref (window);
+	g_queue_init (&save_all_data->pending_tabs);
+
 	for (l = docs; l != NULL; l = l->next)
 	{
 		GeditDocument *doc;
@@ -1310,7 +1543,9 @@ save_documents_list (GeditWindow *window,
 				}
 				else
 				{
-					save_tab (tab, window);
+					g_queue_push_tail (&save_all_data->pending_tabs,
+							   g_object_ref (tab));
+					save_all_data->n_total++;
 				}
 			}
 		}
@@ -1348,11 +1583,8 @@ save_documents_list (GeditWindow *window,
 		}
 	}
 
-	if (data != NULL)
-	{
-		data->tabs_to_save_as = g_slist_reverse (data->tabs_to_save_as);
-		save_as_documents_list (data);
-	}
+	save_all_data->save_as_data = data;
+	save_all_launch_saves (save_all_data);
 }
 
 /**
@@ -1372,7 +1604,8 @@ gedit_commands_save_all_documents (GeditWindow *window)
 
 	gedit_debug (DEBUG_COMMANDS);
 
-	docs = gedit_window_get_documents (window);
+	/* A placeholder tab has nothing to save. */
+	docs = _gedit_window_peek_documents (window);
 
 	save_documents_list (window, docs);
 
@@ -30,6 +30,15 @@
 
 G_BEGIN_DECLS
 
+/* Like gedit_commands_load_locations(), but the tabs opened in the background
+ * are loaded only when they are shown.
+ */
+GSList	       *_gedit_cmd_load_locations		(GeditWindow             *window,
+							 const GSList            *locations,
+							 const GtkSourceEncoding *encoding,
+							 gint                     line_pos,
+							 gint                     column_pos) G_GNUC_WARN_UNUSED_RESULT;
+
 /* Create titled documens for non-existing URIs */
 GSList	       *_gedit_cmd_load_files_from_prompt	(GeditWindow             *window,
 							 GSList                  *files,
@@ -167,6 +176,8 @@ void		_gedit_cmd_file_close_tab 		(GeditTab    *tab,
 void		_gedit_cmd_file_close_notebook		(GeditWindow   *window,
 							 GeditNotebook *notebook);
 
+gboolean	_gedit_cmd_file_is_quitting		(GeditWindow   *window);
+
 G_END_DECLS
 
 #endif /* __GEDIT_COMMANDS_PRIVATE_H__ */
@@ -0,0 +1,830 @@
+/*
+ * gedit-compression.c
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Support of the xz and zstd compressed files. The formats are available only
+ * if the corresponding library was found at build time.
+ *
+ * The (de)compression is done by a GConverter, so it is streamed: a compressed
+ * file is loaded through a GConverterInputStream, which reads and decompresses
+ * the file chunk by chunk in a GIO worker thread. The document is saved from a
+ * copy of its text, converted and compressed in a worker thread too.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "gedit-compression.h"
+
+#include <string.h>
+#include <glib/gi18n.h>
+
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "gedit-debug.h"
+
+#define XZ_PRESET 6
+#define ZSTD_LEVEL 3
+
+#define GEDIT_TYPE_COMPRESSION_CONVERTER (gedit_compression_converter_get_type ())
+G_DECLARE_FINAL_TYPE (GeditCompressionConverter, gedit_compression_converter,
+		      GEDIT, COMPRESSION_CONVERTER, GObject)
+
+struct _GeditCompressionConverter
+{
+	GObject parent_instance;
+
+	GeditCompressionFormat format;
+	guint compress : 1;
+
+	/* The end of a zstd frame has been reached, and no input has been
+	 * consumed since.
+	 */
+	guint frame_finished : 1;
+
+#ifdef HAVE_LZMA
+	lzma_stream lzma;
+#endif
+
+#ifdef HAVE_ZSTD
+	ZSTD_CCtx *zstd_cctx;
+	ZSTD_DCtx *zstd_dctx;
+#endif
+};
+
+typedef struct _SaveData SaveData;
+
+struct _SaveData
+{
+	GFile *location;
+	gchar *text;
+	gchar *charset;
+	GtkSourceNewlineType newline_type;
+	GeditCompressionFormat format;
+
+	/* Set by the thread, for gedit_compression_save_finish(). */
+	GTimeVal mtime;
+
+	guint make_backup : 1;
+};
+
+static void gedit_compression_converter_iface_init (GConverterIface *iface);
+
+G_DEFINE_TYPE_WITH_CODE (GeditCompressionConverter,
+			 gedit_compression_converter,
+			 G_TYPE_OBJECT,
+			 G_IMPLEMENT_INTERFACE (G_TYPE_CONVERTER,
+						gedit_compression_converter_iface_init))
+
+static gboolean
+format_is_supported (GeditCompressionFormat format)
+{
+	switch (format)
+	{
+#ifdef HAVE_LZMA
+		case GEDIT_COMPRESSION_FORMAT_XZ:
+			return TRUE;
+#endif
+
+#ifdef HAVE_ZSTD
+		case GEDIT_COMPRESSION_FORMAT_ZSTD:
+			return TRUE;
+#endif
+
+		default:
+			return FALSE;
+	}
+}
+
+/* Returns NONE for a format not available in this build. */
+GeditCompressionFormat
+gedit_compression_format_from_content_type (const gchar *content_type)
+{
+	GeditCompressionFormat format = GEDIT_COMPRESSION_FORMAT_NONE;
+
+	if (content_type == NULL)
+	{
+		return GEDIT_COMPRESSION_FORMAT_NONE;
+	}
+
+	if (g_content_type_is_a (content_type, "application/x-xz"))
+	{
+		format = GEDIT_COMPRESSION_FORMAT_XZ;
+	}
+	else if (g_content_type_is_a (content_type, "application/zstd") ||
+		 g_content_type_is_a (content_type, "application/x-zstd"))
+	{
+		format = GEDIT_COMPRESSION_FORMAT_ZSTD;
+	}
+
+	return format_is_supported (format) ? format : GEDIT_COMPRESSION_FORMAT_NONE;
+}
+
+/* The format is chosen from the file name extension, so that it is known
+ * before reading the file. Returns NONE for a format not available in this
+ * build.
+ */
+GeditCompressionFormat
+gedit_compression_format_from_location (GFile *location)
+{
+	GeditCompressionFormat format = GEDIT_COMPRESSION_FORMAT_NONE;
+	gchar *basename;
+
+	if (location == NULL)
+	{
+		return GEDIT_COMPRESSION_FORMAT_NONE;
+	}
+
+	basename = g_file_get_basename (location);
+
+	if (basename == NULL)
+	{
+		return GEDIT_COMPRESSION_FORMAT_NONE;
+	}
+
+	if (g_str_has_suffix (basename, ".xz"))
+	{
+		format = GEDIT_COMPRESSION_FORMAT_XZ;
+	}
+	else if (g_str_has_suffix (basename, ".zst"))
+	{
+		format = GEDIT_COMPRESSION_FORMAT_ZSTD;
+	}
+
+	g_free (basename);
+
+	return format_is_supported (format) ? format : GEDIT_COMPRESSION_FORMAT_NONE;
+}
+
+#if defined (HAVE_LZMA) || defined (HAVE_ZSTD)
+static void
+set_invalid_data_error (GError      **error,
+			const gchar  *detail)
+{
+	g_set_error (error,
+		     G_IO_ERROR,
+		     G_IO_ERROR_INVALID_DATA,
+		     _("Invalid compressed data: %s"),
+		     detail);
+}
+
+static void
+set_partial_input_error (GError **error)
+{
+	g_set_error_literal (error,
+			     G_IO_ERROR,
+			     G_IO_ERROR_PARTIAL_INPUT,
+			     _("Need more input"));
+}
+#endif
+
+#ifdef HAVE_LZMA
+static gboolean
+lzma_init (GeditCompressionConverter *converter)
+{
+	lzma_stream init = LZMA_STREAM_INIT;
+	lzma_ret ret;
+
+	converter->lzma = init;
+
+	if (converter->compress)
+	{
+		ret = lzma_easy_encoder (&converter->lzma, XZ_PRESET, LZMA_CHECK_CRC64);
+	}
+	else
+	{
+		ret = lzma_stream_decoder (&converter->lzma, UINT64_MAX, LZMA_CONCATENATED);
+	}
+
+	return ret == LZMA_OK;
+}
+
+static GConverterResult
+lzma_convert (GeditCompressionConverter  *converter,
+	      const void                 *inbuf,
+	      gsize                       inbuf_size,
+	      void                       *outbuf,
+	      gsize                       outbuf_size,
+	      GConverterFlags             flags,
+	      gsize                      *bytes_read,
+	      gsize                      *bytes_written,
+	      GError                    **error)
+{
+	lzma_action action = LZMA_RUN;
+	lzma_ret ret;
+
+	if (flags & G_CONVERTER_INPUT_AT_END)
+	{
+		action = LZMA_FINISH;
+	}
+	else if ((flags & G_CONVERTER_FLUSH) && converter->compress)
+	{
+		action = LZMA_SYNC_FLUSH;
+	}
+
+	converter->lzma.next_in = inbuf;
+	converter->lzma.avail_in = inbuf_size;
+	converter->lzma.next_out = outbuf;
+	converter->lzma.avail_out = outbuf_size;
+
+	ret = lzma_code (&converter->lzma, action);
+
+	*bytes_read = inbuf_size - converter->lzma.avail_in;
+	*bytes_written = outbuf_size - converter->lzma.avail_out;
+
+	switch (ret)
+	{
+		case LZMA_OK:
+		case LZMA_BUF_ERROR:
+			if (*bytes_read == 0 && *bytes_written == 0)
+			{
+				if (outbuf_size == 0)
+				{
+					g_set_error_literal (error,
+							     G_IO_ERROR,
+							     G_IO_ERROR_NO_SPACE,
+							     _("Not enough space in destination"));
+				}
+				else if (action == LZMA_FINISH)
+				{
+					set_invalid_data_error (error, _("unexpected end of file"));
+				}
+				else
+				{
+					set_partial_input_error (error);
+				}
+
+				return G_CONVERTER_ERROR;
+			}
+
+			return G_CONVERTER_CONVERTED;
+
+		case LZMA_STREAM_END:
+			/* For a sync flush, the end of the flush. */
+			return action == LZMA_SYNC_FLUSH ? G_CONVERTER_FLUSHED : G_CONVERTER_FINISHED;
+
+		case LZMA_MEM_ERROR:
+		case LZMA_MEMLIMIT_ERROR:
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_FAILED,
+					     _("Not enough memory"));
+			return G_CONVERTER_ERROR;
+
+		case LZMA_FORMAT_ERROR:
+			set_invalid_data_error (error, _("not in the xz format"));
+			return G_CONVERTER_ERROR;
+
+		default:
+			set_invalid_data_error (error, _("corrupted xz data"));
+			return G_CONVERTER_ERROR;
+	}
+}
+#endif /* HAVE_LZMA */
+
+#ifdef HAVE_ZSTD
+static gboolean
+zstd_init (GeditCompressionConverter *converter)
+{
+	if (converter->compress)
+	{
+		converter->zstd_cctx = ZSTD_createCCtx ();
+
+		return (converter->zstd_cctx != NULL &&
+			!ZSTD_isError (ZSTD_CCtx_setParameter (converter->zstd_cctx,
+							       ZSTD_c_compressionLevel,
+							       ZSTD_LEVEL)));
+	}
+
+	converter->zstd_dctx = ZSTD_createDCtx ();
+	converter->frame_finished = TRUE;
+
+	return converter->zstd_dctx != NULL;
+}
+
+static GConverterResult
+zstd_convert (GeditCompressionConverter  *converter,
+	      const void                 *inbuf,
+	      gsize                       inbuf_size,
+	      void                       *outbuf,
+	      gsize                       outbuf_size,
+	      GConverterFlags             flags,
+	      gsize                      *bytes_read,
+	      gsize                      *bytes_written,
+	      GError                    **error)
+{
+	ZSTD_inBuffer in = { inbuf, inbuf_size, 0 };
+	ZSTD_outBuffer out = { outbuf, outbuf_size, 0 };
+	gsize ret;
+
+	if (converter->compress)
+	{
+		ZSTD_EndDirective mode = ZSTD_e_continue;
+
+		if (flags & G_CONVERTER_INPUT_AT_END)
+		{
+			mode = ZSTD_e_end;
+		}
+		else if (flags & G_CONVERTER_FLUSH)
+		{
+			mode = ZSTD_e_flush;
+		}
+
+		ret = ZSTD_compressStream2 (converter->zstd_cctx, &out, &in, mode);
+	}
+	else
+	{
+		/* The input may contain several frames, the stream ends at
+		 * the end of a frame.
+		 */
+		if (inbuf_size == 0 &&
+		    (flags & G_CONVERTER_INPUT_AT_END) &&
+		    converter->frame_finished)
+		{
+			*bytes_read = 0;
+			*bytes_written = 0;
+			return G_CONVERTER_FINISHED;
+		}
+
+		ret = ZSTD_decompressStream (converter->zstd_dctx, &out, &in);
+	}
+
+	*bytes_read = in.pos;
+	*bytes_written = out.pos;
+
+	if (ZSTD_isError (ret))
+	{
+		set_invalid_data_error (error, ZSTD_getErrorName (ret));
+		return G_CONVERTER_ERROR;
+	}
+
+	if (converter->compress)
+	{
+		if (ret == 0 && (flags & G_CONVERTER_INPUT_AT_END))
+		{
+			return G_CONVERTER_FINISHED;
+		}
+
+		if (ret == 0 && (flags & G_CONVERTER_FLUSH))
+		{
+			return G_CONVERTER_FLUSHED;
+		}
+	}
+	else
+	{
+		if (in.pos > 0)
+		{
+			converter->frame_finished = FALSE;
+		}
+
+		if (ret == 0)
+		{
+			converter->frame_finished = TRUE;
+
+			if ((flags & G_CONVERTER_INPUT_AT_END) && in.pos == in.size)
+			{
+				return G_CONVERTER_FINISHED;
+			}
+		}
+	}
+
+	if (in.pos == 0 && out.pos == 0)
+	{
+		if (outbuf_size == 0)
+		{
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_NO_SPACE,
+					     _("Not enough space in destination"));
+		}
+		else if (flags & G_CONVERTER_INPUT_AT_END)
+		{
+			set_invalid_data_error (error, _("unexpected end of file"));
+		}
+		else
+		{
+			set_partial_input_error (error);
+		}
+
+		return G_CONVERTER_ERROR;
+	}
+
+	return G_CONVERTER_CONVERTED;
+}
+#endif /* HAVE_ZSTD */
+
+static gboolean
+converter_init_state (GeditCompressionConverter *converter)
+{
+	switch (converter->format)
+	{
+#ifdef HAVE_LZMA
+		case GEDIT_COMPRESSION_FORMAT_XZ:
+			return lzma_init (converter);
+#endif
+
+#ifdef HAVE_ZSTD
+		case GEDIT_COMPRESSION_FORMAT_ZSTD:
+			return zstd_init (converter);
+#endif
+
+		default:
+			return FALSE;
+	}
+}
+
+static void
+converter_free_state (GeditCompressionConverter *converter)
+{
+#ifdef HAVE_LZMA
+	if (converter->format == GEDIT_COMPRESSION_FORMAT_XZ)
+	{
+		lzma_end (&converter->lzma);
+	}
+#endif
+
+#ifdef HAVE_ZSTD
+	if (converter->zstd_cctx != NULL)
+	{
+		ZSTD_freeCCtx (converter->zstd_cctx);
+		converter->zstd_cctx = NULL;
+	}
+
+	if (converter->zstd_dctx != NULL)
+	{
+		ZSTD_freeDCtx (converter->zstd_dctx);
+		converter->zstd_dctx = NULL;
+	}
+#endif
+}
+
+static GConverterResult
+gedit_compression_converter_convert (GConverter       *converter,
+				     const void       *inbuf,
+				     gsize             inbuf_size,
+				     void             *outbuf,
+				     gsize             outbuf_size,
+				     GConverterFlags   flags,
+				     gsize            *bytes_read,
+				     gsize            *bytes_written,
+				     GError          **error)
+{
+	GeditCompressionConverter *self = GEDIT_COMPRESSION_CONVERTER (converter);
+
+	switch (self->format)
+	{
+#ifdef HAVE_LZMA
+		case GEDIT_COMPRESSION_FORMAT_XZ:
+			return lzma_convert (self, inbuf, inbuf_size, outbuf, outbuf_size,
+					     flags, bytes_read, bytes_written, error);
+#endif
+
+#ifdef HAVE_ZSTD
+		case GEDIT_COMPRESSION_FORMAT_ZSTD:
+			return zstd_convert (self, inbuf, inbuf_size, outbuf, outbuf_size,
+					     flags, bytes_read, bytes_written, error);
+#endif
+
+		default:
+			g_set_error_literal (error,
+					     G_IO_ERROR,
+					     G_IO_ERROR_NOT_SUPPORTED,
+					     _("Compression format not supported"));
+			return G_CONVERTER_ERROR;
+	}
+}
+
+static void
+gedit_compression_converter_reset (GConverter *converter)
+{
+	GeditCompressionConverter *self = GEDIT_COMPRESSION_CONVERTER (converter);
+
+	converter_free_state (self);
+	converter_init_state (self);
+}
+
+static void
+gedit_compression_converter_finalize (GObject *object)
+{
+	converter_free_state (GEDIT_COMPRESSION_CONVERTER (object));
+
+	G_OBJECT_CLASS (gedit_compression_converter_parent_class)->finalize (object);
+}
+
+static void
+gedit_compression_converter_class_init (GeditCompressionConverterClass *klass)
+{
+	GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+	object_class->finalize = gedit_compression_converter_finalize;
+}
+
+static void
+gedit_compression_converter_iface_init (GConverterIface *iface)
+{
+	iface->convert = gedit_compression_converter_convert;
+	iface->reset = gedit_compression_converter_reset;
+}
+
+static void
+gedit_compression_converter_init (GeditCompressionConverter *converter)
+{
+}
+
+static GConverter *
+converter_new (GeditCompressionFormat format,
+	       gboolean               compress)
+{
+	GeditCompressionConverter *converter;
+
+	g_return_val_if_fail (format_is_supported (format), NULL);
+
+	converter = g_object_new (GEDIT_TYPE_COMPRESSION_CONVERTER, NULL);
+	converter->format = format;
+	converter->compress = compress != FALSE;
+
+	if (!converter_init_state (converter))
+	{
+		g_warning ("Cannot initialize the compression library");
+	}
+
+	return G_CONVERTER (converter);
+}
+
+GConverter *
+gedit_compression_decompressor_new (GeditCompressionFormat format)
+{
+	return converter_new (format, FALSE);
+}
+
+GConverter *
+gedit_compression_compressor_new (GeditCompressionFormat format)
+{
+	return converter_new (format, TRUE);
+}
+
+static void
+save_data_free (SaveData *data)
+{
+	if (data != NULL)
+	{
+		g_object_unref (data->location);
+		g_free (data->text);
+		g_free (data->charset);
+		g_slice_free (SaveData, data);
+	}
+}
+
+/* Converts all the line terminators to @newline, like the GtkSourceView file
+ * saver does.
+ */
+static GString *
+convert_newlines (const gchar *text,
+		  const gchar *newline)
+{
+	GString *str;
+	const gchar *p = text;
+
+	str = g_string_sized_new (strlen (text) + 1);
+
+	while (*p != '\0')
+	{
+		const gchar *end = strpbrk (p, "\r\n");
+
+		if (end == NULL)
+		{
+			g_string_append (str, p);
+			break;
+		}
+
+		g_string_append_len (str, p, end - p);
+		g_string_append (str, newline);
+
+		p = end + 1;
+
+		if (end[0] == '\r' && end[1] == '\n')
+		{
+			p++;
+		}
+	}
+
+	return str;
+}
+
+static void
+save_thread (GTask        *task,
+	     gpointer      source_object,
+	     SaveData     *data,
+	     GCancellable *cancellable)
+{
+	const gchar *newline;
+	GString *str;
+	gchar *converted = NULL;
+	const gchar *contents;
+	gsize length;
+	GFileOutputStream *file_stream;
+	GConverter *compressor = NULL;
+	GOutputStream *stream;
+	GFileInfo *info;
+	GError *error = NULL;
+
+	switch (data->newline_type)
+	{
+		case GTK_SOURCE_NEWLINE_TYPE_CR:
+			newline = "\r";
+			break;
+
+		case GTK_SOURCE_NEWLINE_TYPE_CR_LF:
+			newline = "\r\n";
+			break;
+
+		default:
+			newline = "\n";
+			break;
+	}
+
+	str = convert_newlines (data->text, newline);
+
+	if (g_ascii_strcasecmp (data->charset, "UTF-8") == 0)
+	{
+		contents = str->str;
+		length = str->len;
+	}
+	else
+	{
+		converted = g_convert (str->str, str->len,
+				       data->charset, "UTF-8",
+				       NULL, &length, &error);
+
+		if (converted == NULL)
+		{
+			g_string_free (str, TRUE);
+			g_task_return_error (task, error);
+			return;
+		}
+
+		contents = converted;
+	}
+
+	file_stream = g_file_replace (data->location,
+				      NULL,
+				      data->make_backup,
+				      G_FILE_CREATE_NONE,
+				      cancellable,
+				      &error);
+
+	if (file_stream == NULL)
+	{
+		g_string_free (str, TRUE);
+		g_free (converted);
+		g_task_return_error (task, error);
+		return;
+	}
+
+	if (data->format != GEDIT_COMPRESSION_FORMAT_NONE)
+	{
+		compressor = gedit_compression_compressor_new (data->format);
+		stream = g_converter_output_stream_new (G_OUTPUT_STREAM (file_stream), compressor);
+	}
+	else
+	{
+		stream = g_object_ref (file_stream);
+	}
+
+	if (g_output_stream_write_all (stream, contents, length, NULL, cancellable, &error))
+	{
+		g_output_stream_close (stream, cancellable, &error);
+	}
+	else
+	{
+		/* The replaced file is kept as it was. */
+		GCancellable *cancelled = g_cancellable_new ();
+
+		g_cancellable_cancel (cancelled);
+		g_output_stream_close (stream, cancelled, NULL);
+		g_object_unref (cancelled);
+	}
+
+	g_object_unref (stream);
+	g_clear_object (&compressor);
+	g_object_unref (file_stream);
+	g_string_free (str, TRUE);
+	g_free (converted);
+
+	if (error != NULL)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	/* Like the GtkSourceView saver, to know later if the file has been
+	 * modified by another program.
+	 */
+	info = g_file_query_info (data->location,
+				  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+				  G_FILE_QUERY_INFO_NONE,
+				  cancellable,
+				  NULL);
+
+	if (info != NULL)
+	{
+		if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+		{
+			g_file_info_get_modification_time (info, &data->mtime);
+		}
+
+		g_object_unref (info);
+	}
+
+	gedit_debug_message (DEBUG_UTILS, "File saved: %" G_GSIZE_FORMAT " bytes",
+			     length);
+
+	g_task_return_int (task, length);
+}
+
+/* Saves @text to @location, compressed with @format, or not compressed for
+ * %GEDIT_COMPRESSION_FORMAT_NONE. The text is taken over, and converted to
+ * @encoding and @newline_type in a worker thread.
+ */
+void
+gedit_compression_save_async (GFile                   *location,
+			      gchar                   *text,
+			      const GtkSourceEncoding *encoding,
+			      GtkSourceNewlineType     newline_type,
+			      gboolean                 make_backup,
+			      GeditCompressionFormat   format,
+			      GCancellable            *cancellable,
+			      GAsyncReadyCallback      callback,
+			      gpointer                 user_data)
+{
+	GTask *task;
+	SaveData *data;
+
+	g_return_if_fail (G_IS_FILE (location));
+	g_return_if_fail (text != NULL);
+	g_return_if_fail (encoding != NULL);
+	g_return_if_fail (format == GEDIT_COMPRESSION_FORMAT_NONE ||
+			  format_is_supported (format));
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+
+	data = g_slice_new0 (SaveData);
+	data->location = g_object_ref (location);
+	data->text = text;
+	data->charset = g_strdup (gtk_source_encoding_get_charset (encoding));
+	data->newline_type = newline_type;
+	data->format = format;
+	data->make_backup = make_backup != FALSE;
+
+	g_task_set_task_data (task, data, (GDestroyNotify) save_data_free);
+	g_task_run_in_thread (task, (GTaskThreadFunc) save_thread);
+	g_object_unref (task);
+}
+
+/* Returns the number of bytes saved, before the compression, or -1 on error.
+ * @mtime is set to the modification time of the saved file, or zeroed if it
+ * is unknown.
+ */
+gssize
+gedit_compression_save_finish (GAsyncResult  *result,
+			       GTimeVal      *mtime,
+			       GError       **error)
+{
+	SaveData *data;
+
+	g_return_val_if_fail (g_task_is_valid (result, NULL), -1);
+
+	data = g_task_get_task_data (G_TASK (result));
+
+	if (mtime != NULL)
+	{
+		*mtime = data->mtime;
+	}
+
+	return g_task_propagate_int (G_TASK (result), error);
+}
+
+/* ex:set ts=8 noet: */
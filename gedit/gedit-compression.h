@@ -0,0 +1,64 @@
+/*
+ * gedit-compression.h
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEDIT_COMPRESSION_H__
+#define __GEDIT_COMPRESSION_H__
+
+#include <gtksourceview/gtksource.h>
+
+G_BEGIN_DECLS
+
+/* The compression formats that GtkSourceView doesn't handle itself. Gzip is
+ * handled by the GtkSourceView file loader and saver.
+ */
+typedef enum
+{
+	GEDIT_COMPRESSION_FORMAT_NONE,
+	GEDIT_COMPRESSION_FORMAT_XZ,
+	GEDIT_COMPRESSION_FORMAT_ZSTD
+} GeditCompressionFormat;
+
+GeditCompressionFormat	 gedit_compression_format_from_content_type	(const gchar *content_type);
+
+GeditCompressionFormat	 gedit_compression_format_from_location	(GFile       *location);
+
+GConverter		*gedit_compression_decompressor_new	(GeditCompressionFormat format);
+
+GConverter		*gedit_compression_compressor_new	(GeditCompressionFormat format);
+
+void			 gedit_compression_save_async		(GFile                   *location,
+								 gchar                   *text,
+								 const GtkSourceEncoding *encoding,
+								 GtkSourceNewlineType     newline_type,
+								 gboolean                 make_backup,
+								 GeditCompressionFormat   format,
+								 GCancellable            *cancellable,
+								 GAsyncReadyCallback      callback,
+								 gpointer                 user_data);
+
+gssize			 gedit_compression_save_finish		(GAsyncResult            *result,
+								 GTimeVal                *mtime,
+								 GError                 **error);
+
+G_END_DECLS
+
+#endif /* __GEDIT_COMPRESSION_H__ */
+
+/* ex:set ts=8 noet: */
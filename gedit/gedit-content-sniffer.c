@@ -0,0 +1,632 @@
+/*
+ * gedit-content-sniffer.c
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Prepass run before a file is loaded. GtkSourceFileLoader tries the
+ * candidate encodings one after the other, and each failed attempt is a full
+ * conversion pass over the file. The file is scanned here in a worker thread
+ * to know whether it is pure ASCII, valid UTF-8, or UTF-16, which is enough
+ * to choose the encoding in most cases before the conversion starts.
+ *
+ * The first and the last blocks of the file are also checked for binary data,
+ * so that the user can be asked before loading a binary file by mistake.
+ */
+
+#include "gedit-content-sniffer.h"
+
+#include <string.h>
+
+#include "gedit-debug.h"
+
+#define SNIFF_CHUNK_SIZE (64 * 1024)
+
+/* The loading waits for the sniffing, so a bigger file is not validated
+ * entirely: the loader finds its encoding itself. The first and the last
+ * blocks are still checked.
+ */
+#define SNIFF_MAX_SIZE (1024 * 1024)
+
+/* Number of bytes of the first chunk looked at to guess UTF-16 without BOM. */
+#define UTF16_SNIFF_SIZE 4096
+
+#define ONES_WORD ((gsize) -1 / 0xff)
+#define HIGH_BITS_WORD (ONES_WORD * 0x80)
+#define CONTROL_WORD (ONES_WORD * 0x20)
+
+/* For the debug output, only touched in the main thread. */
+static guint n_pinned = 0;
+static guint n_fallbacks = 0;
+
+/* Returns the first byte which is not a non-nul ASCII char, reading a machine
+ * word at a time.
+ */
+static const guchar *
+skip_ascii (const guchar *p,
+	    const guchar *end)
+{
+	while (p < end && ((gsize) p & (sizeof (gsize) - 1)) != 0)
+	{
+		if (*p == '\0' || (*p & 0x80) != 0)
+		{
+			return p;
+		}
+
+		p++;
+	}
+
+	while ((gsize) (end - p) >= sizeof (gsize))
+	{
+		gsize word = *(const gsize *) p;
+
+		/* Non-ASCII byte, or nul byte. */
+		if ((word & HIGH_BITS_WORD) != 0 ||
+		    ((word - ONES_WORD) & ~word & HIGH_BITS_WORD) != 0)
+		{
+			break;
+		}
+
+		p += sizeof (gsize);
+	}
+
+	while (p < end && *p != '\0' && (*p & 0x80) == 0)
+	{
+		p++;
+	}
+
+	return p;
+}
+
+/* The control characters common in text files: tab, newline, vertical tab,
+ * form feed, carriage return, and escape for the terminal colors in logs.
+ */
+static gboolean
+is_text_control (guchar c)
+{
+	return (c == '\t' || c == '\n' || c == '\v' ||
+		c == '\f' || c == '\r' || c == 0x1b);
+}
+
+/* Returns whether the block contains a nul byte or more than @threshold
+ * percent of control characters. The words without any byte below 0x20 are
+ * skipped a machine word at a time.
+ */
+static gboolean
+is_binary_block (const guchar *data,
+		 gsize         length,
+		 guint         threshold)
+{
+	const guchar *p = data;
+	const guchar *end = data + length;
+	gsize n_controls = 0;
+
+	if (length == 0 || threshold == 0)
+	{
+		return FALSE;
+	}
+
+	while (p < end)
+	{
+		if (((gsize) p & (sizeof (gsize) - 1)) == 0 &&
+		    (gsize) (end - p) >= sizeof (gsize))
+		{
+			gsize word = *(const gsize *) p;
+
+			if (((word - CONTROL_WORD) & ~word & HIGH_BITS_WORD) == 0)
+			{
+				p += sizeof (gsize);
+				continue;
+			}
+		}
+
+		if (*p < 0x20 && !is_text_control (*p))
+		{
+			if (*p == '\0')
+			{
+				return TRUE;
+			}
+
+			n_controls++;
+		}
+
+		p++;
+	}
+
+	return n_controls * 100 > length * threshold;
+}
+
+/* Checks the last block of the file, then seeks back to @position. */
+static gboolean
+is_binary_end (GFileInputStream  *stream,
+	       goffset            position,
+	       guint              threshold,
+	       GCancellable      *cancellable,
+	       GError           **error)
+{
+	GSeekable *seekable = G_SEEKABLE (stream);
+	gboolean binary = FALSE;
+	gboolean ok;
+
+	if (threshold == 0 || !g_seekable_can_seek (seekable))
+	{
+		return FALSE;
+	}
+
+	ok = g_seekable_seek (seekable, 0, G_SEEK_END, cancellable, error);
+
+	if (ok && g_seekable_tell (seekable) > position)
+	{
+		goffset end = g_seekable_tell (seekable);
+		goffset start = MAX (position, end - SNIFF_CHUNK_SIZE);
+		guchar *block;
+		gsize n_read = 0;
+
+		block = g_malloc (end - start);
+
+		ok = (g_seekable_seek (seekable, start, G_SEEK_SET, cancellable, error) &&
+		      g_input_stream_read_all (G_INPUT_STREAM (stream),
+					       block,
+					       end - start,
+					       &n_read,
+					       cancellable,
+					       error));
+
+		if (ok)
+		{
+			binary = is_binary_block (block, n_read, threshold);
+		}
+
+		g_free (block);
+	}
+
+	/* Come back for the validation of the rest of the file. */
+	if (ok)
+	{
+		ok = g_seekable_seek (seekable, position, G_SEEK_SET, cancellable, error);
+	}
+
+	return ok && binary;
+}
+
+static GeditContentSnifferCharset
+guess_utf16 (const guchar *data,
+	     gsize         length)
+{
+	gsize n_pairs;
+	gsize zeros_even = 0;
+	gsize zeros_odd = 0;
+	gsize i;
+
+	length = MIN (length, UTF16_SNIFF_SIZE);
+	n_pairs = length / 2;
+
+	if (n_pairs < 4)
+	{
+		return GEDIT_CONTENT_SNIFFER_CHARSET_UNKNOWN;
+	}
+
+	for (i = 0; i < n_pairs; i++)
+	{
+		if (data[2 * i] == '\0')
+		{
+			zeros_even++;
+		}
+
+		if (data[2 * i + 1] == '\0')
+		{
+			zeros_odd++;
+		}
+	}
+
+	/* Text mostly in the Latin script: one of the two bytes of most code
+	 * units is nul, the other one almost never.
+	 */
+	if (zeros_odd * 10 >= n_pairs * 4 && zeros_even * 10 < n_pairs)
+	{
+		return GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_LE;
+	}
+
+	if (zeros_even * 10 >= n_pairs * 4 && zeros_odd * 10 < n_pairs)
+	{
+		return GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_BE;
+	}
+
+	return GEDIT_CONTENT_SNIFFER_CHARSET_UNKNOWN;
+}
+
+static gboolean
+sniff_bom (const guchar              *data,
+	   gsize                      length,
+	   GeditContentSnifferResult *result,
+	   gsize                     *bom_length)
+{
+	if (length >= 3 &&
+	    data[0] == 0xef && data[1] == 0xbb && data[2] == 0xbf)
+	{
+		result->charset = GEDIT_CONTENT_SNIFFER_CHARSET_UTF8;
+		*bom_length = 3;
+	}
+	else if (length >= 2 && data[0] == 0xff && data[1] == 0xfe)
+	{
+		result->charset = GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_LE;
+		*bom_length = 2;
+	}
+	else if (length >= 2 && data[0] == 0xfe && data[1] == 0xff)
+	{
+		result->charset = GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_BE;
+		*bom_length = 2;
+	}
+	else
+	{
+		return FALSE;
+	}
+
+	result->has_bom = TRUE;
+	return TRUE;
+}
+
+/* Validates [data, data + length). Returns the number of bytes at the end
+ * which are the beginning of an incomplete UTF-8 char, to be validated with
+ * the next chunk, or -1 if the data is not valid UTF-8.
+ */
+static gssize
+validate_chunk (const guchar *data,
+		gsize         length,
+		gboolean     *is_ascii)
+{
+	const guchar *p = data;
+	const guchar *end = data + length;
+
+	while (p < end)
+	{
+		gunichar c;
+
+		p = skip_ascii (p, end);
+
+		if (p == end)
+		{
+			break;
+		}
+
+		/* A nul byte is valid UTF-8, but the file is most probably
+		 * not text, or is UTF-16.
+		 */
+		if (*p == '\0')
+		{
+			return -1;
+		}
+
+		*is_ascii = FALSE;
+
+		c = g_utf8_get_char_validated ((const gchar *) p, end - p);
+
+		if (c == (gunichar) -2)
+		{
+			return end - p;
+		}
+
+		if (c == (gunichar) -1)
+		{
+			return -1;
+		}
+
+		p = (const guchar *) g_utf8_next_char (p);
+	}
+
+	return 0;
+}
+
+static void
+sniff_thread (GTask        *task,
+	      GFile        *location,
+	      gpointer      task_data,
+	      GCancellable *cancellable)
+{
+	guint binary_threshold = GPOINTER_TO_UINT (task_data);
+	GFileInputStream *stream;
+	GeditContentSnifferResult *result;
+	guchar *buffer;
+	gsize n_pending = 0;
+	gsize n_validated = 0;
+	gboolean first_chunk = TRUE;
+	gboolean is_ascii = TRUE;
+	GError *error = NULL;
+
+	stream = g_file_read (location, cancellable, &error);
+
+	if (error != NULL)
+	{
+		g_task_return_error (task, error);
+		return;
+	}
+
+	result = g_slice_new0 (GeditContentSnifferResult);
+	result->charset = GEDIT_CONTENT_SNIFFER_CHARSET_OTHER;
+
+	/* Room for the incomplete char at the end of the previous chunk. */
+	buffer = g_malloc (SNIFF_CHUNK_SIZE + 4);
+
+	while (TRUE)
+	{
+		gssize n_read;
+		gsize start = 0;
+		gssize n_incomplete;
+
+		n_read = g_input_stream_read (G_INPUT_STREAM (stream),
+					      buffer + n_pending,
+					      SNIFF_CHUNK_SIZE,
+					      cancellable,
+					      &error);
+
+		if (n_read < 0)
+		{
+			break;
+		}
+
+		if (n_read == 0)
+		{
+			/* A truncated char at the end of the file. */
+			if (n_pending == 0)
+			{
+				result->charset = is_ascii ?
+						  GEDIT_CONTENT_SNIFFER_CHARSET_ASCII :
+						  GEDIT_CONTENT_SNIFFER_CHARSET_UTF8;
+			}
+
+			break;
+		}
+
+		if (first_chunk)
+		{
+			gsize bom_length = 0;
+
+			first_chunk = FALSE;
+
+			if (sniff_bom (buffer, n_read, result, &bom_length))
+			{
+				if (result->charset != GEDIT_CONTENT_SNIFFER_CHARSET_UTF8)
+				{
+					break;
+				}
+
+				/* Validate the rest of the file. */
+				result->charset = GEDIT_CONTENT_SNIFFER_CHARSET_OTHER;
+				is_ascii = FALSE;
+				start = bom_length;
+			}
+			else
+			{
+				GeditContentSnifferCharset utf16;
+
+				utf16 = guess_utf16 (buffer, n_read);
+
+				if (utf16 != GEDIT_CONTENT_SNIFFER_CHARSET_UNKNOWN)
+				{
+					result->charset = utf16;
+					break;
+				}
+
+				if (is_binary_block (buffer, n_read, binary_threshold) ||
+				    is_binary_end (stream, n_read, binary_threshold, cancellable, &error))
+				{
+					/* The candidate encodings are kept as
+					 * they are, if the user loads the file
+					 * anyway.
+					 */
+					result->charset = GEDIT_CONTENT_SNIFFER_CHARSET_UNKNOWN;
+					result->binary = TRUE;
+					break;
+				}
+
+				if (error != NULL)
+				{
+					break;
+				}
+			}
+		}
+
+		n_incomplete = validate_chunk (buffer + start,
+					       n_pending + n_read - start,
+					       &is_ascii);
+
+		if (n_incomplete < 0)
+		{
+			break;
+		}
+
+		memmove (buffer,
+			 buffer + n_pending + n_read - n_incomplete,
+			 n_incomplete);
+		n_pending = n_incomplete;
+
+		n_validated += n_read;
+
+		if (n_validated >= SNIFF_MAX_SIZE)
+		{
+			result->charset = GEDIT_CONTENT_SNIFFER_CHARSET_UNKNOWN;
+			break;
+		}
+	}
+
+	g_free (buffer);
+	g_object_unref (stream);
+
+	if (error != NULL)
+	{
+		gedit_content_sniffer_result_free (result);
+		g_task_return_error (task, error);
+		return;
+	}
+
+	g_task_return_pointer (task,
+			       result,
+			       (GDestroyNotify) gedit_content_sniffer_result_free);
+}
+
+/* @binary_threshold: the percentage of control characters above which a block
+ * is considered binary, or 0 to not look for binary data.
+ */
+void
+gedit_content_sniffer_sniff_async (GFile               *location,
+				   guint                binary_threshold,
+				   GCancellable        *cancellable,
+				   GAsyncReadyCallback  callback,
+				   gpointer             user_data)
+{
+	GTask *task;
+
+	g_return_if_fail (G_IS_FILE (location));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	task = g_task_new (location, cancellable, callback, user_data);
+	g_task_set_task_data (task, GUINT_TO_POINTER (binary_threshold), NULL);
+	g_task_run_in_thread (task, (GTaskThreadFunc) sniff_thread);
+	g_object_unref (task);
+}
+
+GeditContentSnifferResult *
+gedit_content_sniffer_sniff_finish (GAsyncResult  *result,
+				    GError       **error)
+{
+	g_return_val_if_fail (G_IS_TASK (result), NULL);
+
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+void
+gedit_content_sniffer_result_free (GeditContentSnifferResult *result)
+{
+	if (result != NULL)
+	{
+		g_slice_free (GeditContentSnifferResult, result);
+	}
+}
+
+static const GtkSourceEncoding *
+get_utf16_encoding (const GeditContentSnifferResult *result)
+{
+	const GtkSourceEncoding *encoding;
+
+	if (result->charset == GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_LE)
+	{
+		encoding = gtk_source_encoding_get_from_charset ("UTF-16LE");
+	}
+	else
+	{
+		encoding = gtk_source_encoding_get_from_charset ("UTF-16BE");
+	}
+
+	/* With a BOM, iconv knows the byte order of "UTF-16". Without a BOM it
+	 * is big endian.
+	 */
+	if (encoding == NULL &&
+	    (result->has_bom ||
+	     result->charset == GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_BE))
+	{
+		encoding = gtk_source_encoding_get_from_charset ("UTF-16");
+	}
+
+	return encoding;
+}
+
+static GSList *
+pin (GSList                  *candidates,
+     const GtkSourceEncoding *encoding)
+{
+	g_slist_free (candidates);
+
+	n_pinned++;
+
+	gedit_debug_message (DEBUG_UTILS,
+			     "Encoding pinned to %s (%u pinned, %u fallbacks)",
+			     gtk_source_encoding_get_charset (encoding),
+			     n_pinned,
+			     n_fallbacks);
+
+	return g_slist_prepend (NULL, (gpointer) encoding);
+}
+
+/* Takes the candidate encodings, in the order in which the loader would try
+ * them, and returns the list to give to the loader. The list is reduced to one
+ * encoding when the loader would find the same one, without the failed
+ * conversions; otherwise the encodings known to fail are tried last.
+ */
+GSList *
+gedit_content_sniffer_pin_encoding (const GeditContentSnifferResult *result,
+				    GSList                          *candidates)
+{
+	const GtkSourceEncoding *utf8;
+
+	g_return_val_if_fail (result != NULL, candidates);
+
+	utf8 = gtk_source_encoding_get_utf8 ();
+
+	switch (result->charset)
+	{
+		case GEDIT_CONTENT_SNIFFER_CHARSET_ASCII:
+		case GEDIT_CONTENT_SNIFFER_CHARSET_UTF8:
+			/* Another encoding before UTF-8 would be accepted by
+			 * the loader as well, keep the user's order.
+			 */
+			if (candidates != NULL && candidates->data == utf8)
+			{
+				return pin (candidates, utf8);
+			}
+			break;
+
+		case GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_LE:
+		case GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_BE:
+		{
+			const GtkSourceEncoding *utf16;
+
+			utf16 = get_utf16_encoding (result);
+
+			if (utf16 != NULL)
+			{
+				return pin (candidates, utf16);
+			}
+			break;
+		}
+
+		case GEDIT_CONTENT_SNIFFER_CHARSET_OTHER:
+			/* Not valid UTF-8, but the file may have changed
+			 * since it was sniffed: UTF-8 stays a candidate.
+			 */
+			if (g_slist_find (candidates, utf8) != NULL)
+			{
+				candidates = g_slist_remove_all (candidates, utf8);
+				candidates = g_slist_append (candidates, (gpointer) utf8);
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	n_fallbacks++;
+
+	gedit_debug_message (DEBUG_UTILS,
+			     "Encoding not pinned, %u candidates (%u pinned, %u fallbacks)",
+			     g_slist_length (candidates),
+			     n_pinned,
+			     n_fallbacks);
+
+	return candidates;
+}
+
+/* ex:set ts=8 noet: */
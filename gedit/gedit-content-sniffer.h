@@ -0,0 +1,71 @@
+/*
+ * gedit-content-sniffer.h
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEDIT_CONTENT_SNIFFER_H__
+#define __GEDIT_CONTENT_SNIFFER_H__
+
+#include <gtksourceview/gtksource.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+	GEDIT_CONTENT_SNIFFER_CHARSET_UNKNOWN,	/* the file could not be read, or is too big */
+	GEDIT_CONTENT_SNIFFER_CHARSET_ASCII,
+	GEDIT_CONTENT_SNIFFER_CHARSET_UTF8,
+	GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_LE,
+	GEDIT_CONTENT_SNIFFER_CHARSET_UTF16_BE,
+	GEDIT_CONTENT_SNIFFER_CHARSET_OTHER	/* not valid UTF-8 */
+} GeditContentSnifferCharset;
+
+typedef struct _GeditContentSnifferResult GeditContentSnifferResult;
+
+struct _GeditContentSnifferResult
+{
+	GeditContentSnifferCharset charset;
+
+	/* Whether the charset is given by a byte order mark. */
+	guint has_bom : 1;
+
+	/* Whether the first or the last block of the file looks like binary
+	 * data. The charset is then UNKNOWN.
+	 */
+	guint binary : 1;
+};
+
+void				 gedit_content_sniffer_sniff_async	(GFile                      *location,
+									 guint                       binary_threshold,
+									 GCancellable               *cancellable,
+									 GAsyncReadyCallback         callback,
+									 gpointer                    user_data);
+
+GeditContentSnifferResult	*gedit_content_sniffer_sniff_finish	(GAsyncResult               *result,
+									 GError                    **error);
+
+void				 gedit_content_sniffer_result_free	(GeditContentSnifferResult  *result);
+
+GSList				*gedit_content_sniffer_pin_encoding	(const GeditContentSnifferResult *result,
+									 GSList                     *candidates);
+
+G_END_DECLS
+
+#endif /* __GEDIT_CONTENT_SNIFFER_H__ */
+
+/* ex:set ts=8 noet: */
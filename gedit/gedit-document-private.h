@@ -49,6 +49,48 @@ void		 _gedit_document_set_create				(GeditDocument       *doc,
 
 gboolean	 _gedit_document_get_create				(GeditDocument       *doc);
 
+void		 _gedit_document_hibernate				(GeditDocument       *doc);
+
+gboolean	 _gedit_document_get_hibernated				(GeditDocument       *doc);
+
+gboolean	 _gedit_document_get_long_lines				(GeditDocument       *doc);
+
+gboolean	 _gedit_document_is_long_line				(GeditDocument       *doc,
+									 const GtkTextIter   *iter);
+
+gboolean	 _gedit_document_get_large_mode_set_by_user		(GeditDocument       *doc);
+
+void		 _gedit_document_flush_all_metadata			(void);
+
+void		 _gedit_document_set_file_properties			(GeditDocument           *doc,
+									 const GtkSourceEncoding *encoding,
+									 GtkSourceNewlineType     newline_type,
+									 const GTimeVal          *mtime);
+
+void		 _gedit_document_clear_file_properties			(GeditDocument       *doc);
+
+gboolean	 _gedit_document_has_file_properties			(GeditDocument       *doc);
+
+const GtkSourceEncoding *
+		 _gedit_document_get_file_encoding			(GeditDocument       *doc);
+
+GtkSourceNewlineType
+		 _gedit_document_get_file_newline_type			(GeditDocument       *doc);
+
+void		 _gedit_document_check_file_on_disk			(GeditDocument       *doc,
+									 gboolean            *externally_modified,
+									 gboolean            *deleted);
+
+void		 _gedit_document_check_file_on_disk_async		(GeditDocument       *doc,
+									 GCancellable        *cancellable,
+									 GAsyncReadyCallback  callback,
+									 gpointer             user_data);
+
+gboolean	 _gedit_document_check_file_on_disk_finish		(GeditDocument       *doc,
+									 GAsyncResult        *result,
+									 gboolean            *externally_modified,
+									 gboolean            *deleted);
+
 G_END_DECLS
 
 #endif /* __GEDIT_DOCUMENT_PRIVATE_H__ */
@@ -34,10 +34,15 @@
 #include "gedit-settings.h"
 #include "gedit-debug.h"
 #include "gedit-utils.h"
+#include "gedit-compression.h"
+#include "gedit-language-cache.h"
 #include "gedit-metadata-manager.h"
 
 #define METADATA_QUERY "metadata::*"
 
+/* Delay, in seconds, between a change of the GVfs metadata and its write. */
+#define METADATA_FLUSH_DELAY 2
+
 #define NO_LANGUAGE_NAME "_NORMAL_"
 
 static void	gedit_document_loaded_real	(GeditDocument *doc);
@@ -58,6 +63,13 @@ typedef struct
 
 	GFileInfo   *metadata_info;
 
+	/* The GVfs metadata changed since the last write, for
+	 * pending_metadata_location. See flush_metadata().
+	 */
+	GFileInfo   *pending_metadata;
+	GFile       *pending_metadata_location;
+	guint        metadata_flush_id;
+
 	gchar	    *content_type;
 
 	GTimeVal     time_of_last_save_or_load;
@@ -69,6 +81,31 @@ typedef struct
 
 	guint user_action;
 
+	/* In bytes, 0 to disable the long-line mode. */
+	guint long_line_threshold;
+
+	/* Timeout to check whether the long lines have been edited. */
+	guint long_lines_check_id;
+
+	/* Set of GtkTextMarks, one at the start of each long line. The
+	 * edited lines are checked when they are edited, so only these lines
+	 * need to be checked again to leave the long-line mode.
+	 */
+	GHashTable *long_line_marks;
+
+	/* The properties of the file when gedit has read or written it
+	 * itself, see _gedit_document_set_file_properties().
+	 */
+	const GtkSourceEncoding *file_encoding;
+	GtkSourceNewlineType file_newline_type;
+	GTimeVal file_mtime;
+
+	/* The modification time of the file queried after the last loading
+	 * or saving, see _gedit_document_check_file_on_disk_async().
+	 */
+	GTimeVal disk_mtime;
+	guint n_disk_mtime_queries;
+
 	guint language_set_by_user : 1;
 	guint use_gvfs_metadata : 1;
 
@@ -82,6 +119,35 @@ typedef struct
 	 * when opened from the command line).
 	 */
 	guint create : 1;
+
+	/* The contents have been dropped to save memory, see
+	 * _gedit_document_hibernate().
+	 */
+	guint hibernated : 1;
+
+	/* A line is longer than long_line_threshold, see
+	 * set_long_lines().
+	 */
+	guint long_lines : 1;
+
+	/* The document is too big for the costly features, see
+	 * set_large_mode().
+	 */
+	guint large_mode : 1;
+	guint large_mode_set_by_user : 1;
+
+	/* The highlighting settings are unbound because of the long lines
+	 * or the large mode.
+	 */
+	guint reduced_highlighting : 1;
+
+	/* The file_* fields above are used instead of the GtkSourceFile. */
+	guint file_properties_set : 1;
+	guint file_mtime_set : 1;
+	guint file_externally_modified : 1;
+	guint file_deleted : 1;
+
+	guint disk_mtime_set : 1;
 } GeditDocumentPrivate;
 
 enum
@@ -93,6 +159,8 @@ enum
 	PROP_READ_ONLY,
 	PROP_EMPTY_SEARCH,
 	PROP_USE_GVFS_METADATA,
+	PROP_LONG_LINES,
+	PROP_LARGE_MODE,
 	LAST_PROP
 };
 
@@ -112,6 +180,13 @@ static guint document_signals[LAST_SIGNAL];
 
 static GHashTable *allocated_untitled_numbers = NULL;
 
+/* The documents with GVfs metadata not written yet, and the number of
+ * metadata changes and writes, for the debug output.
+ */
+static GSList *docs_with_pending_metadata = NULL;
+static guint n_metadata_changes = 0;
+static guint n_metadata_writes = 0;
+
 G_DEFINE_TYPE_WITH_PRIVATE (GeditDocument, gedit_document, GTK_SOURCE_TYPE_BUFFER)
 
 static gint
@@ -192,6 +267,79 @@ save_metadata (GeditDocument *doc)
 	g_free (position);
 }
 
+/* The metadata changes are merged and written together, a few seconds after
+ * the first one, or when the document is disposed or its location changes.
+ */
+static void
+flush_metadata (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+	GError *error = NULL;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	if (priv->metadata_flush_id != 0)
+	{
+		g_source_remove (priv->metadata_flush_id);
+		priv->metadata_flush_id = 0;
+	}
+
+	if (priv->pending_metadata == NULL)
+	{
+		return;
+	}
+
+	/* We save synchronously since metadata is always local so it
+	 * should be fast. Moreover this function can be called on
+	 * application shutdown, when the main loop has already exited,
+	 * so an async operation would not terminate.
+	 * https://bugzilla.gnome.org/show_bug.cgi?id=736591
+	 */
+	g_file_set_attributes_from_info (priv->pending_metadata_location,
+					 priv->pending_metadata,
+					 G_FILE_QUERY_INFO_NONE,
+					 NULL,
+					 &error);
+
+	if (error != NULL)
+	{
+		/* Do not complain about metadata if we are closing a
+		 * document for a non existing file.
+		 */
+		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT) &&
+		    !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+		{
+			g_warning ("Set document metadata failed: %s", error->message);
+		}
+
+		g_error_free (error);
+	}
+
+	n_metadata_writes++;
+
+	gedit_debug_message (DEBUG_DOCUMENT, "Metadata written: %u writes for %u changes",
+			     n_metadata_writes,
+			     n_metadata_changes);
+
+	g_clear_object (&priv->pending_metadata);
+	g_clear_object (&priv->pending_metadata_location);
+
+	docs_with_pending_metadata = g_slist_remove (docs_with_pending_metadata, doc);
+}
+
+static gboolean
+flush_metadata_cb (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	priv->metadata_flush_id = 0;
+	flush_metadata (doc);
+
+	return G_SOURCE_REMOVE;
+}
+
 static void
 gedit_document_dispose (GObject *object)
 {
@@ -206,12 +354,26 @@ gedit_document_dispose (GObject *object)
 	 */
 	if (priv->file != NULL)
 	{
-		save_metadata (GEDIT_DOCUMENT (object));
+		/* When hibernated, the metadata has already been saved and the
+		 * cursor position is lost.
+		 */
+		if (!priv->hibernated)
+		{
+			save_metadata (GEDIT_DOCUMENT (object));
+		}
 
 		g_object_unref (priv->file);
 		priv->file = NULL;
 	}
 
+	flush_metadata (GEDIT_DOCUMENT (object));
+
+	if (priv->long_lines_check_id != 0)
+	{
+		g_source_remove (priv->long_lines_check_id);
+		priv->long_lines_check_id = 0;
+	}
+
 	g_clear_object (&priv->editor_settings);
 	g_clear_object (&priv->metadata_info);
 	g_clear_object (&priv->search_context);
@@ -236,6 +398,9 @@ gedit_document_finalize (GObject *object)
 	g_free (priv->content_type);
 	g_free (priv->short_name);
 
+	/* The marks are freed with the buffer. */
+	g_hash_table_destroy (priv->long_line_marks);
+
 	G_OBJECT_CLASS (gedit_document_parent_class)->finalize (object);
 }
 
@@ -276,6 +441,14 @@ gedit_document_get_property (GObject    *object,
 			g_value_set_boolean (value, priv->use_gvfs_metadata);
 			break;
 
+		case PROP_LONG_LINES:
+			g_value_set_boolean (value, priv->long_lines);
+			break;
+
+		case PROP_LARGE_MODE:
+			g_value_set_boolean (value, priv->large_mode);
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -307,6 +480,10 @@ gedit_document_set_property (GObject      *object,
 			priv->use_gvfs_metadata = g_value_get_boolean (value);
 			break;
 
+		case PROP_LARGE_MODE:
+			gedit_document_set_large_mode (doc, g_value_get_boolean (value));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -364,9 +541,407 @@ gedit_document_mark_set (GtkTextBuffer     *buffer,
 	}
 }
 
+static void
+bind_highlighting_settings (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	g_settings_bind (priv->editor_settings,
+			 GEDIT_SETTINGS_SYNTAX_HIGHLIGHTING,
+			 doc,
+			 "highlight-syntax",
+			 G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
+
+	g_settings_bind (priv->editor_settings,
+	                 GEDIT_SETTINGS_BRACKET_MATCHING,
+	                 doc,
+	                 "highlight-matching-brackets",
+	                 G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
+}
+
+static void
+update_highlighting_settings (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+	gboolean reduced;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	reduced = priv->long_lines || priv->large_mode;
+
+	if (priv->reduced_highlighting == reduced)
+	{
+		return;
+	}
+
+	priv->reduced_highlighting = reduced;
+
+	if (reduced)
+	{
+		g_settings_unbind (doc, "highlight-syntax");
+		g_settings_unbind (doc, "highlight-matching-brackets");
+
+		gtk_source_buffer_set_highlight_syntax (GTK_SOURCE_BUFFER (doc), FALSE);
+		gtk_source_buffer_set_highlight_matching_brackets (GTK_SOURCE_BUFFER (doc), FALSE);
+	}
+	else
+	{
+		bind_highlighting_settings (doc);
+	}
+}
+
+static void
+update_search_highlighting (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	if (priv->search_context == NULL)
+	{
+		return;
+	}
+
+	if (priv->large_mode || priv->long_lines)
+	{
+		g_settings_unbind (priv->search_context, "highlight");
+		gtk_source_search_context_set_highlight (priv->search_context, FALSE);
+	}
+	else
+	{
+		g_settings_bind (priv->editor_settings,
+				 GEDIT_SETTINGS_SEARCH_HIGHLIGHTING,
+				 priv->search_context, "highlight",
+				 G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
+	}
+}
+
+/* Syntax highlighting, bracket matching and the highlighting of the search
+ * occurrences work on whole lines, and add attributes to the layout of the
+ * line, so with a line of several megabytes (minified files) they make the
+ * view unusable. They are switched off while the document has such a line.
+ * The views also adapt to the GeditDocument:long-lines property.
+ */
+static void
+set_long_lines (GeditDocument *doc,
+		gboolean       long_lines)
+{
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	if (priv->long_lines == long_lines)
+	{
+		return;
+	}
+
+	gedit_debug_message (DEBUG_DOCUMENT, "Long lines: %s", long_lines ? "yes" : "no");
+
+	priv->long_lines = long_lines != FALSE;
+
+	update_highlighting_settings (doc);
+	update_search_highlighting (doc);
+
+	g_object_notify_by_pspec (G_OBJECT (doc), properties[PROP_LONG_LINES]);
+}
+
+/* In large mode, the features whose cost grows with the size of the whole
+ * document are switched off: syntax highlighting, bracket matching and the
+ * highlighting of the search occurrences. Plugins follow the
+ * GeditDocument:large-mode property for their own costly work.
+ */
+static void
+set_large_mode (GeditDocument *doc,
+		gboolean       large_mode)
+{
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	if (priv->large_mode == large_mode)
+	{
+		return;
+	}
+
+	gedit_debug_message (DEBUG_DOCUMENT, "Large mode: %s", large_mode ? "yes" : "no");
+
+	priv->large_mode = large_mode != FALSE;
+
+	update_highlighting_settings (doc);
+	update_search_highlighting (doc);
+
+	g_object_notify_by_pspec (G_OBJECT (doc), properties[PROP_LARGE_MODE]);
+}
+
+static gboolean
+is_large_document (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+	guint max_size;
+	guint max_lines;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	max_size = g_settings_get_uint (priv->editor_settings,
+					GEDIT_SETTINGS_LARGE_DOCUMENT_SIZE);
+	max_lines = g_settings_get_uint (priv->editor_settings,
+					 GEDIT_SETTINGS_LARGE_DOCUMENT_LINES);
+
+	/* The character count and the line count are kept by the text
+	 * buffer, no need to walk the document.
+	 */
+	return ((max_size > 0 &&
+		 (guint) gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (doc)) > max_size) ||
+		(max_lines > 0 &&
+		 (guint) gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (doc)) > max_lines));
+}
+
+static gboolean
+is_long_line (GeditDocument     *doc,
+	      const GtkTextIter *iter)
+{
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return (priv->long_line_threshold > 0 &&
+		(guint) gtk_text_iter_get_bytes_in_line (iter) > priv->long_line_threshold);
+}
+
+static void
+add_long_line_mark (GeditDocument     *doc,
+		    const GtkTextIter *line_start)
+{
+	GeditDocumentPrivate *priv;
+	GSList *marks;
+	GSList *l;
+	gboolean found = FALSE;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	marks = gtk_text_iter_get_marks (line_start);
+
+	for (l = marks; l != NULL; l = l->next)
+	{
+		if (g_hash_table_contains (priv->long_line_marks, l->data))
+		{
+			found = TRUE;
+			break;
+		}
+	}
+
+	g_slist_free (marks);
+
+	if (!found)
+	{
+		GtkTextMark *mark;
+
+		mark = gtk_text_buffer_create_mark (GTK_TEXT_BUFFER (doc), NULL, line_start, TRUE);
+		g_hash_table_add (priv->long_line_marks, mark);
+	}
+}
+
+/* Marks the long lines among the lines [first_line, last_line]. Returns
+ * whether there is one.
+ */
+static gboolean
+check_lines (GeditDocument *doc,
+	     gint           first_line,
+	     gint           last_line)
+{
+	GeditDocumentPrivate *priv;
+	GtkTextIter iter;
+	gboolean found = FALSE;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	if (priv->long_line_threshold == 0)
+	{
+		return FALSE;
+	}
+
+	gtk_text_buffer_get_iter_at_line (GTK_TEXT_BUFFER (doc), &iter, first_line);
+
+	do
+	{
+		if (gtk_text_iter_get_line (&iter) > last_line)
+		{
+			break;
+		}
+
+		if (is_long_line (doc, &iter))
+		{
+			add_long_line_mark (doc, &iter);
+			found = TRUE;
+		}
+	}
+	while (gtk_text_iter_forward_line (&iter));
+
+	return found;
+}
+
+static void
+clear_long_line_marks (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+	GHashTableIter iter;
+	gpointer mark;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	g_hash_table_iter_init (&iter, priv->long_line_marks);
+
+	while (g_hash_table_iter_next (&iter, &mark, NULL))
+	{
+		gtk_text_buffer_delete_mark (GTK_TEXT_BUFFER (doc), mark);
+		g_hash_table_iter_remove (&iter);
+	}
+}
+
+/* Only the lines which were long are checked: the others have been checked
+ * when they were edited. A mark is no longer at the start of its line when the
+ * previous line has been joined to it, and two marks are on the same line
+ * when two long lines have been joined.
+ */
+static gboolean
+check_long_lines_cb (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+	GHashTable *lines;
+	GHashTableIter iter;
+	gpointer mark;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	priv->long_lines_check_id = 0;
+
+	lines = g_hash_table_new (NULL, NULL);
+
+	g_hash_table_iter_init (&iter, priv->long_line_marks);
+
+	while (g_hash_table_iter_next (&iter, &mark, NULL))
+	{
+		GtkTextIter line_start;
+		gint line;
+
+		gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (doc), &line_start, mark);
+		gtk_text_iter_set_line_offset (&line_start, 0);
+		line = gtk_text_iter_get_line (&line_start);
+
+		if (!is_long_line (doc, &line_start) ||
+		    g_hash_table_contains (lines, GINT_TO_POINTER (line)))
+		{
+			gtk_text_buffer_delete_mark (GTK_TEXT_BUFFER (doc), mark);
+			g_hash_table_iter_remove (&iter);
+			continue;
+		}
+
+		g_hash_table_add (lines, GINT_TO_POINTER (line));
+		gtk_text_buffer_move_mark (GTK_TEXT_BUFFER (doc), mark, &line_start);
+	}
+
+	g_hash_table_destroy (lines);
+
+	set_long_lines (doc, g_hash_table_size (priv->long_line_marks) > 0);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+long_line_threshold_changed (GSettings     *settings,
+			     const gchar   *key,
+			     GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	priv->long_line_threshold = g_settings_get_uint (settings, key);
+
+	clear_long_line_marks (doc);
+
+	set_long_lines (doc,
+			check_lines (doc,
+				     0,
+				     gtk_text_buffer_get_line_count (GTK_TEXT_BUFFER (doc)) - 1));
+}
+
+static void
+gedit_document_insert_text (GtkTextBuffer *buffer,
+			    GtkTextIter   *pos,
+			    const gchar   *text,
+			    gint           len)
+{
+	GeditDocumentPrivate *priv;
+	GtkTextIter start;
+
+	priv = gedit_document_get_instance_private (GEDIT_DOCUMENT (buffer));
+
+	GTK_TEXT_BUFFER_CLASS (gedit_document_parent_class)->insert_text (buffer, pos, text, len);
+
+	if (priv->long_line_threshold == 0)
+	{
+		return;
+	}
+
+	/* Only the lines of the inserted text are checked. The loader inserts
+	 * the file by chunks, so a long line is detected with its first
+	 * chunks, before the view tries to lay it out.
+	 */
+	start = *pos;
+	gtk_text_iter_backward_chars (&start, g_utf8_strlen (text, len));
+
+	if (check_lines (GEDIT_DOCUMENT (buffer),
+			 gtk_text_iter_get_line (&start),
+			 gtk_text_iter_get_line (pos)))
+	{
+		set_long_lines (GEDIT_DOCUMENT (buffer), TRUE);
+	}
+}
+
+static void
+gedit_document_delete_range (GtkTextBuffer *buffer,
+			     GtkTextIter   *start,
+			     GtkTextIter   *end)
+{
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (GEDIT_DOCUMENT (buffer));
+
+	GTK_TEXT_BUFFER_CLASS (gedit_document_parent_class)->delete_range (buffer, start, end);
+
+	if (priv->long_line_threshold == 0)
+	{
+		return;
+	}
+
+	/* Two lines may have been joined. */
+	if (check_lines (GEDIT_DOCUMENT (buffer),
+			 gtk_text_iter_get_line (start),
+			 gtk_text_iter_get_line (start)))
+	{
+		set_long_lines (GEDIT_DOCUMENT (buffer), TRUE);
+	}
+}
+
 static void
 gedit_document_changed (GtkTextBuffer *buffer)
 {
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (GEDIT_DOCUMENT (buffer));
+
+	/* Leave the long-line mode once the long lines have been edited below
+	 * the threshold.
+	 */
+	if (priv->long_lines && priv->long_lines_check_id == 0)
+	{
+		priv->long_lines_check_id =
+			g_timeout_add_seconds (1, (GSourceFunc) check_long_lines_cb, buffer);
+	}
+
 	g_signal_emit (GEDIT_DOCUMENT (buffer), document_signals[CURSOR_MOVED], 0);
 
 	GTK_TEXT_BUFFER_CLASS (gedit_document_parent_class)->changed (buffer);
@@ -406,6 +981,8 @@ gedit_document_class_init (GeditDocumentClass *klass)
 	buf_class->end_user_action = gedit_document_end_user_action;
 	buf_class->mark_set = gedit_document_mark_set;
 	buf_class->changed = gedit_document_changed;
+	buf_class->insert_text = gedit_document_insert_text;
+	buf_class->delete_range = gedit_document_delete_range;
 
 	klass->loaded = gedit_document_loaded_real;
 	klass->saved = gedit_document_saved_real;
@@ -494,6 +1071,43 @@ gedit_document_class_init (GeditDocumentClass *klass)
 		                      TRUE,
 		                      G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
 
+	/**
+	 * GeditDocument:long-lines:
+	 *
+	 * Whether the document has a line longer than the
+	 * #GSettings:long-line-threshold. Syntax highlighting and bracket
+	 * matching are disabled while it is %TRUE.
+	 *
+	 * <warning>
+	 * The property is used internally by gedit. It must not be used in a
+	 * gedit plugin. The property can be modified or removed at any time.
+	 * </warning>
+	 */
+	properties[PROP_LONG_LINES] =
+		g_param_spec_boolean ("long-lines",
+		                      "Long lines",
+		                      "Whether a line is too long for the expensive features",
+		                      FALSE,
+		                      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+	/**
+	 * GeditDocument:large-mode:
+	 *
+	 * Whether the document is too big for the features whose cost grows
+	 * with its size. It is computed when the document is loaded, from the
+	 * #GSettings:large-document-size and #GSettings:large-document-lines
+	 * thresholds, unless it has been set explicitly. Plugins should switch
+	 * off or defer their costly work while it is %TRUE.
+	 *
+	 * Since: 3.20
+	 */
+	properties[PROP_LARGE_MODE] =
+		g_param_spec_boolean ("large-mode",
+		                      "Large Mode",
+		                      "Whether the document is too big for the costly features",
+		                      FALSE,
+		                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties (object_class, LAST_PROP, properties);
 
 	/* This signal is used to update the cursor position in the statusbar,
@@ -637,7 +1251,7 @@ save_encoding_metadata (GeditDocument *doc)
 
 	priv = gedit_document_get_instance_private (doc);
 
-	encoding = gtk_source_file_get_encoding (priv->file);
+	encoding = _gedit_document_get_file_encoding (doc);
 
 	if (encoding == NULL)
 	{
@@ -719,9 +1333,8 @@ guess_language (GeditDocument *doc)
 			basename = g_strdup (priv->short_name);
 		}
 
-		language = gtk_source_language_manager_guess_language (manager,
-								       basename,
-								       priv->content_type);
+		language = gedit_language_cache_guess_language (basename,
+								priv->content_type);
 
 		g_free (basename);
 	}
@@ -780,6 +1393,9 @@ on_location_changed (GtkSourceFile *file,
 		g_object_notify_by_pspec (G_OBJECT (doc), properties[PROP_SHORTNAME]);
 	}
 
+	/* The pending metadata is for the previous location. */
+	flush_metadata (doc);
+
 	/* Load metadata for this location: we load sync since metadata is
 	 * always local so it should be fast and we need the information
 	 * right after the location was set.
@@ -869,17 +1485,17 @@ gedit_document_init (GeditDocument *doc)
 	                 "max-undo-levels",
 	                 G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
 
-	g_settings_bind (priv->editor_settings,
-			 GEDIT_SETTINGS_SYNTAX_HIGHLIGHTING,
-			 doc,
-			 "highlight-syntax",
-			 G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
+	bind_highlighting_settings (doc);
 
-	g_settings_bind (priv->editor_settings,
-	                 GEDIT_SETTINGS_BRACKET_MATCHING,
-	                 doc,
-	                 "highlight-matching-brackets",
-	                 G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
+	priv->long_line_threshold = g_settings_get_uint (priv->editor_settings,
+							 GEDIT_SETTINGS_LONG_LINE_THRESHOLD);
+	priv->long_line_marks = g_hash_table_new (NULL, NULL);
+
+	g_signal_connect_object (priv->editor_settings,
+				 "changed::" GEDIT_SETTINGS_LONG_LINE_THRESHOLD,
+				 G_CALLBACK (long_line_threshold_changed),
+				 doc,
+				 0);
 
 	style_scheme = get_default_style_scheme (priv->editor_settings);
 	if (style_scheme != NULL)
@@ -958,7 +1574,9 @@ set_content_type_no_guess (GeditDocument *doc,
 
 	/* For compression types, we try to just guess from the content */
 	if (gedit_utils_get_compression_type_from_content_type (content_type) !=
-	    GTK_SOURCE_COMPRESSION_TYPE_NONE)
+	    GTK_SOURCE_COMPRESSION_TYPE_NONE ||
+	    gedit_compression_format_from_content_type (content_type) !=
+	    GEDIT_COMPRESSION_FORMAT_NONE)
 	{
 		dupped_content_type = get_content_type_from_content (doc);
 	}
@@ -1222,6 +1840,35 @@ gedit_document_get_readonly (GeditDocument *doc)
 	return gtk_source_file_is_readonly (priv->file);
 }
 
+/* Only the last query gives the modification time, after a loading or a
+ * saving.
+ */
+static void
+update_disk_mtime (GeditDocument *doc,
+		   GFileInfo     *info)
+{
+	GeditDocumentPrivate *priv;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	g_return_if_fail (priv->n_disk_mtime_queries > 0);
+
+	priv->n_disk_mtime_queries--;
+
+	if (priv->n_disk_mtime_queries > 0)
+	{
+		return;
+	}
+
+	priv->disk_mtime_set = (info != NULL &&
+				g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED));
+
+	if (priv->disk_mtime_set)
+	{
+		g_file_info_get_modification_time (info, &priv->disk_mtime);
+	}
+}
+
 static void
 loaded_query_info_cb (GFile         *location,
 		      GAsyncResult  *result,
@@ -1257,6 +1904,8 @@ loaded_query_info_cb (GFile         *location,
 		set_content_type (doc, content_type);
 	}
 
+	update_disk_mtime (doc, info);
+
 	g_clear_object (&info);
 
 	/* Async operation finished. */
@@ -1271,6 +1920,13 @@ gedit_document_loaded_real (GeditDocument *doc)
 
 	priv = gedit_document_get_instance_private (doc);
 
+	priv->hibernated = FALSE;
+
+	if (!priv->large_mode_set_by_user)
+	{
+		set_large_mode (doc, is_large_document (doc));
+	}
+
 	if (!priv->language_set_by_user)
 	{
 		GtkSourceLanguage *language = guess_language (doc);
@@ -1287,14 +1943,20 @@ gedit_document_loaded_real (GeditDocument *doc)
 
 	location = gtk_source_file_get_location (priv->file);
 
+	priv->disk_mtime_set = FALSE;
+
 	if (location != NULL)
 	{
 		/* Keep the doc alive during the async operation. */
 		g_object_ref (doc);
 
+		priv->n_disk_mtime_queries++;
+
 		g_file_query_info_async (location,
 					 G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
-					 G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
+					 G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE ","
+					 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+					 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
 					 G_FILE_QUERY_INFO_NONE,
 					 G_PRIORITY_DEFAULT,
 					 NULL,
@@ -1332,6 +1994,8 @@ saved_query_info_cb (GFile         *location,
 
 	set_content_type (doc, content_type);
 
+	update_disk_mtime (doc, info);
+
 	if (info != NULL)
 	{
 		/* content_type (owned by info) is no longer needed. */
@@ -1342,129 +2006,478 @@ saved_query_info_cb (GFile         *location,
 
 	priv->create = FALSE;
 
-	gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (doc), FALSE);
+	/* The modified flag is not cleared here: the file saver and
+	 * saving_done() in gedit-tab.c know whether the document has been
+	 * edited during the saving.
+	 */
+	save_encoding_metadata (doc);
+
+	/* Async operation finished. */
+	g_object_unref (doc);
+}
+
+static void
+gedit_document_saved_real (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+	GFile *location;
+
+	priv = gedit_document_get_instance_private (doc);
+
+	location = gtk_source_file_get_location (priv->file);
+
+	/* Keep the doc alive during the async operation. */
+	g_object_ref (doc);
+
+	priv->disk_mtime_set = FALSE;
+	priv->n_disk_mtime_queries++;
+
+	g_file_query_info_async (location,
+				 G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+				 G_FILE_QUERY_INFO_NONE,
+				 G_PRIORITY_DEFAULT,
+				 NULL,
+				 (GAsyncReadyCallback) saved_query_info_cb,
+				 doc);
+}
+
+gboolean
+gedit_document_is_untouched (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+	GFile *location;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), TRUE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	location = gtk_source_file_get_location (priv->file);
+
+	return location == NULL && !gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (doc));
+}
+
+gboolean
+gedit_document_is_untitled (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), TRUE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return gtk_source_file_get_location (priv->file) == NULL;
+}
+
+/**
+ * gedit_document_is_local:
+ * @doc: a #GeditDocument.
+ *
+ * Returns: whether the document is local.
+ * Deprecated: 3.18: Use gtk_source_file_is_local() instead.
+ */
+gboolean
+gedit_document_is_local (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return gtk_source_file_is_local (priv->file);
+}
+
+/**
+ * gedit_document_get_deleted:
+ * @doc: a #GeditDocument.
+ *
+ * Returns: whether the file has been deleted.
+ *
+ * Deprecated: 3.18: Unused function.
+ */
+gboolean
+gedit_document_get_deleted (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return gtk_source_file_is_deleted (priv->file);
+}
+
+/*
+ * Deletion and external modification is only checked for local files.
+ */
+gboolean
+_gedit_document_needs_saving (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+	gboolean externally_modified = FALSE;
+	gboolean deleted = FALSE;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	/* The buffer of a hibernated document is empty, its contents are in
+	 * the file, even if the file has changed since.
+	 */
+	if (priv->hibernated)
+	{
+		return FALSE;
+	}
+
+	if (gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (doc)))
+	{
+		return TRUE;
+	}
+
+	if (gtk_source_file_is_local (priv->file))
+	{
+		_gedit_document_check_file_on_disk (doc, &externally_modified, &deleted);
+	}
+
+	return (externally_modified || deleted) && !priv->create;
+}
+
+/* The GtkSourceFile is updated by the GtkSourceView file loader and saver
+ * only. When gedit reads or writes the file itself (see
+ * gedit-compression.c), the GtkSourceFile has no setters, so its encoding,
+ * newline type and modification time are kept in the document instead,
+ * until the next loading or saving done by GtkSourceView. @mtime can be
+ * %NULL if the modification time is unknown.
+ */
+void
+_gedit_document_set_file_properties (GeditDocument           *doc,
+				     const GtkSourceEncoding *encoding,
+				     GtkSourceNewlineType     newline_type,
+				     const GTimeVal          *mtime)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_if_fail (GEDIT_IS_DOCUMENT (doc));
+
+	priv = gedit_document_get_instance_private (doc);
+
+	priv->file_encoding = encoding;
+	priv->file_newline_type = newline_type;
+	priv->file_properties_set = TRUE;
+	priv->file_externally_modified = FALSE;
+	priv->file_deleted = FALSE;
+
+	priv->file_mtime_set = mtime != NULL;
+	if (mtime != NULL)
+	{
+		priv->file_mtime = *mtime;
+	}
+
+	/* Updates the read-only state of the GtkSourceFile. */
+	gtk_source_file_check_file_on_disk (priv->file);
+}
+
+/* The GtkSourceFile is up to date again, after a loading or a saving done by
+ * GtkSourceView.
+ */
+void
+_gedit_document_clear_file_properties (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_if_fail (GEDIT_IS_DOCUMENT (doc));
+
+	priv = gedit_document_get_instance_private (doc);
+
+	priv->file_encoding = NULL;
+	priv->file_properties_set = FALSE;
+	priv->file_mtime_set = FALSE;
+	priv->file_externally_modified = FALSE;
+	priv->file_deleted = FALSE;
+}
+
+gboolean
+_gedit_document_has_file_properties (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return priv->file_properties_set;
+}
+
+const GtkSourceEncoding *
+_gedit_document_get_file_encoding (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), NULL);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	if (priv->file_properties_set)
+	{
+		return priv->file_encoding;
+	}
+
+	return gtk_source_file_get_encoding (priv->file);
+}
+
+GtkSourceNewlineType
+_gedit_document_get_file_newline_type (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), GTK_SOURCE_NEWLINE_TYPE_DEFAULT);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	if (priv->file_properties_set)
+	{
+		return priv->file_newline_type;
+	}
+
+	return gtk_source_file_get_newline_type (priv->file);
+}
+
+/* Like gtk_source_file_check_file_on_disk(), but also for a file written by
+ * gedit itself. The file is queried synchronously. @externally_modified and
+ * @deleted can be %NULL.
+ */
+void
+_gedit_document_check_file_on_disk (GeditDocument *doc,
+				    gboolean      *externally_modified,
+				    gboolean      *deleted)
+{
+	GeditDocumentPrivate *priv;
+	GFile *location;
+
+	g_return_if_fail (GEDIT_IS_DOCUMENT (doc));
+
+	priv = gedit_document_get_instance_private (doc);
+
+	/* Also for the read-only state. */
+	gtk_source_file_check_file_on_disk (priv->file);
+
+	location = gtk_source_file_get_location (priv->file);
+
+	/* The GtkSourceFile compares with the modification time of its own
+	 * last loading or saving, which is out of date.
+	 */
+	if (priv->file_properties_set && location != NULL)
+	{
+		GFileInfo *info;
+
+		info = g_file_query_info (location,
+					  G_FILE_ATTRIBUTE_TIME_MODIFIED,
+					  G_FILE_QUERY_INFO_NONE,
+					  NULL,
+					  NULL);
+
+		if (info == NULL)
+		{
+			priv->file_deleted = TRUE;
+		}
+		else if (priv->file_mtime_set &&
+			 g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+		{
+			GTimeVal mtime;
+
+			g_file_info_get_modification_time (info, &mtime);
+
+			if (mtime.tv_sec != priv->file_mtime.tv_sec ||
+			    mtime.tv_usec != priv->file_mtime.tv_usec)
+			{
+				priv->file_externally_modified = TRUE;
+			}
+		}
+
+		g_clear_object (&info);
+	}
 
-	save_encoding_metadata (doc);
+	if (externally_modified != NULL)
+	{
+		*externally_modified = priv->file_properties_set ?
+				       priv->file_externally_modified :
+				       gtk_source_file_is_externally_modified (priv->file);
+	}
 
-	/* Async operation finished. */
-	g_object_unref (doc);
+	if (deleted != NULL)
+	{
+		*deleted = priv->file_properties_set ?
+			   priv->file_deleted :
+			   gtk_source_file_is_deleted (priv->file);
+	}
 }
 
-static void
-gedit_document_saved_real (GeditDocument *doc)
+enum
+{
+	CHECK_EXTERNALLY_MODIFIED = 1 << 0,
+	CHECK_DELETED = 1 << 1
+};
+
+/* The modification time to compare with, FALSE if it is not known. */
+static gboolean
+get_known_mtime (GeditDocument *doc,
+		 GTimeVal      *mtime)
 {
 	GeditDocumentPrivate *priv;
-	GFile *location;
 
 	priv = gedit_document_get_instance_private (doc);
 
-	location = gtk_source_file_get_location (priv->file);
+	if (priv->file_properties_set)
+	{
+		*mtime = priv->file_mtime;
+		return priv->file_mtime_set;
+	}
 
-	/* Keep the doc alive during the async operation. */
-	g_object_ref (doc);
+	if (priv->disk_mtime_set && priv->n_disk_mtime_queries == 0)
+	{
+		*mtime = priv->disk_mtime;
+		return TRUE;
+	}
 
-	g_file_query_info_async (location,
-				 G_FILE_ATTRIBUTE_STANDARD_CONTENT_TYPE,
-				 G_FILE_QUERY_INFO_NONE,
-				 G_PRIORITY_DEFAULT,
-				 NULL,
-				 (GAsyncReadyCallback) saved_query_info_cb,
-				 doc);
+	return FALSE;
 }
 
-gboolean
-gedit_document_is_untouched (GeditDocument *doc)
+static void
+check_file_query_info_cb (GFile        *location,
+			  GAsyncResult *result,
+			  GTask        *task)
 {
+	GeditDocument *doc = g_task_get_source_object (task);
 	GeditDocumentPrivate *priv;
-	GFile *location;
-
-	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), TRUE);
+	GFileInfo *info;
+	GTimeVal known_mtime;
+	gboolean externally_modified = FALSE;
+	gboolean deleted = FALSE;
+	GError *error = NULL;
 
 	priv = gedit_document_get_instance_private (doc);
 
-	location = gtk_source_file_get_location (priv->file);
-
-	return location == NULL && !gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (doc));
-}
+	info = g_file_query_info_finish (location, result, &error);
 
-gboolean
-gedit_document_is_untitled (GeditDocument *doc)
-{
-	GeditDocumentPrivate *priv;
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
 
-	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), TRUE);
+	g_clear_error (&error);
 
-	priv = gedit_document_get_instance_private (doc);
+	if (!get_known_mtime (doc, &known_mtime))
+	{
+		/* Rare: the query after the loading or the saving is not
+		 * finished, or has failed.
+		 */
+		_gedit_document_check_file_on_disk (doc, &externally_modified, &deleted);
+	}
+	else if (info == NULL)
+	{
+		deleted = TRUE;
+	}
+	else if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+	{
+		GTimeVal mtime;
 
-	return gtk_source_file_get_location (priv->file) == NULL;
-}
+		g_file_info_get_modification_time (info, &mtime);
 
-/**
- * gedit_document_is_local:
- * @doc: a #GeditDocument.
- *
- * Returns: whether the document is local.
- * Deprecated: 3.18: Use gtk_source_file_is_local() instead.
- */
-gboolean
-gedit_document_is_local (GeditDocument *doc)
-{
-	GeditDocumentPrivate *priv;
+		externally_modified = (mtime.tv_sec != known_mtime.tv_sec ||
+				       mtime.tv_usec != known_mtime.tv_usec);
+	}
 
-	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+	if (priv->file_properties_set)
+	{
+		priv->file_externally_modified |= externally_modified;
+		priv->file_deleted |= deleted;
+	}
 
-	priv = gedit_document_get_instance_private (doc);
+	g_clear_object (&info);
 
-	return gtk_source_file_is_local (priv->file);
+	g_task_return_int (task,
+			   (externally_modified ? CHECK_EXTERNALLY_MODIFIED : 0) |
+			   (deleted ? CHECK_DELETED : 0));
+	g_object_unref (task);
 }
 
-/**
- * gedit_document_get_deleted:
- * @doc: a #GeditDocument.
- *
- * Returns: whether the file has been deleted.
- *
- * Deprecated: 3.18: Unused function.
+/* Like _gedit_document_check_file_on_disk(), but the file is queried
+ * asynchronously. The GtkSourceFile keeps its modification time private, so
+ * the file is compared with the modification time queried after the last
+ * loading or saving. The read-only state of the GtkSourceFile is not
+ * updated.
  */
-gboolean
-gedit_document_get_deleted (GeditDocument *doc)
+void
+_gedit_document_check_file_on_disk_async (GeditDocument       *doc,
+					  GCancellable        *cancellable,
+					  GAsyncReadyCallback  callback,
+					  gpointer             user_data)
 {
 	GeditDocumentPrivate *priv;
+	GFile *location;
+	GTask *task;
 
-	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+	g_return_if_fail (GEDIT_IS_DOCUMENT (doc));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 
 	priv = gedit_document_get_instance_private (doc);
 
-	return gtk_source_file_is_deleted (priv->file);
+	task = g_task_new (doc, cancellable, callback, user_data);
+
+	location = gtk_source_file_get_location (priv->file);
+
+	if (location == NULL)
+	{
+		g_task_return_int (task, 0);
+		g_object_unref (task);
+		return;
+	}
+
+	g_file_query_info_async (location,
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+				 G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+				 G_FILE_QUERY_INFO_NONE,
+				 G_PRIORITY_DEFAULT,
+				 cancellable,
+				 (GAsyncReadyCallback) check_file_query_info_cb,
+				 task);
 }
 
-/*
- * Deletion and external modification is only checked for local files.
+/* Returns FALSE if the check has been cancelled. @externally_modified and
+ * @deleted can be %NULL.
  */
 gboolean
-_gedit_document_needs_saving (GeditDocument *doc)
+_gedit_document_check_file_on_disk_finish (GeditDocument *doc,
+					   GAsyncResult  *result,
+					   gboolean      *externally_modified,
+					   gboolean      *deleted)
 {
-	GeditDocumentPrivate *priv;
-	gboolean externally_modified = FALSE;
-	gboolean deleted = FALSE;
+	gssize flags;
 
-	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+	g_return_val_if_fail (g_task_is_valid (result, doc), FALSE);
 
-	priv = gedit_document_get_instance_private (doc);
+	flags = g_task_propagate_int (G_TASK (result), NULL);
 
-	if (gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (doc)))
+	if (flags < 0)
 	{
-		return TRUE;
+		return FALSE;
 	}
 
-	if (gtk_source_file_is_local (priv->file))
+	if (externally_modified != NULL)
 	{
-		gtk_source_file_check_file_on_disk (priv->file);
-		externally_modified = gtk_source_file_is_externally_modified (priv->file);
-		deleted = gtk_source_file_is_deleted (priv->file);
+		*externally_modified = (flags & CHECK_EXTERNALLY_MODIFIED) != 0;
 	}
 
-	return (externally_modified || deleted) && !priv->create;
+	if (deleted != NULL)
+	{
+		*deleted = (flags & CHECK_DELETED) != 0;
+	}
+
+	return TRUE;
 }
 
 /* If @line is bigger than the lines of the document, the cursor is moved
@@ -1578,13 +2591,9 @@ gedit_document_get_language (GeditDocument *doc)
 const GtkSourceEncoding *
 gedit_document_get_encoding (GeditDocument *doc)
 {
-	GeditDocumentPrivate *priv;
-
 	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), NULL);
 
-	priv = gedit_document_get_instance_private (doc);
-
-	return gtk_source_file_get_encoding (priv->file);
+	return _gedit_document_get_file_encoding (doc);
 }
 
 glong
@@ -1613,13 +2622,9 @@ _gedit_document_get_seconds_since_last_save_or_load (GeditDocument *doc)
 GtkSourceNewlineType
 gedit_document_get_newline_type (GeditDocument *doc)
 {
-	GeditDocumentPrivate *priv;
-
 	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), 0);
 
-	priv = gedit_document_get_instance_private (doc);
-
-	return gtk_source_file_get_newline_type (priv->file);
+	return _gedit_document_get_file_newline_type (doc);
 }
 
 /**
@@ -1745,7 +2750,7 @@ gedit_document_set_metadata (GeditDocument *doc,
 	GFile *location;
 	const gchar *key;
 	va_list var_args;
-	GFileInfo *info = NULL;
+	gboolean write_gvfs_metadata;
 
 	g_return_if_fail (GEDIT_IS_DOCUMENT (doc));
 	g_return_if_fail (first_key != NULL);
@@ -1764,9 +2769,23 @@ gedit_document_set_metadata (GeditDocument *doc,
 		return;
 	}
 
-	if (priv->use_gvfs_metadata)
+	write_gvfs_metadata = priv->use_gvfs_metadata && location != NULL;
+
+	if (write_gvfs_metadata)
 	{
-		info = g_file_info_new ();
+		if (priv->pending_metadata_location != NULL &&
+		    !g_file_equal (priv->pending_metadata_location, location))
+		{
+			flush_metadata (doc);
+		}
+
+		if (priv->pending_metadata == NULL)
+		{
+			priv->pending_metadata = g_file_info_new ();
+			priv->pending_metadata_location = g_object_ref (location);
+
+			docs_with_pending_metadata = g_slist_prepend (docs_with_pending_metadata, doc);
+		}
 	}
 
 	va_start (var_args, first_key);
@@ -1777,8 +2796,12 @@ gedit_document_set_metadata (GeditDocument *doc,
 
 		if (priv->use_gvfs_metadata)
 		{
-			set_gvfs_metadata (info, key, value);
 			set_gvfs_metadata (priv->metadata_info, key, value);
+
+			if (write_gvfs_metadata)
+			{
+				set_gvfs_metadata (priv->pending_metadata, key, value);
+			}
 		}
 		else
 		{
@@ -1788,38 +2811,36 @@ gedit_document_set_metadata (GeditDocument *doc,
 
 	va_end (var_args);
 
-	if (priv->use_gvfs_metadata && location != NULL)
+	if (write_gvfs_metadata)
 	{
-		GError *error = NULL;
-
-		/* We save synchronously since metadata is always local so it
-		 * should be fast. Moreover this function can be called on
-		 * application shutdown, when the main loop has already exited,
-		 * so an async operation would not terminate.
-		 * https://bugzilla.gnome.org/show_bug.cgi?id=736591
-		 */
-		g_file_set_attributes_from_info (location,
-						 info,
-						 G_FILE_QUERY_INFO_NONE,
-						 NULL,
-						 &error);
+		n_metadata_changes++;
 
-		if (error != NULL)
+		if (priv->metadata_flush_id == 0)
 		{
-			/* Do not complain about metadata if we are closing a
-			 * document for a non existing file.
-			 */
-			if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT) &&
-			    !g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
-			{
-				g_warning ("Set document metadata failed: %s", error->message);
-			}
-
-			g_error_free (error);
+			priv->metadata_flush_id =
+				g_timeout_add_seconds (METADATA_FLUSH_DELAY,
+						       (GSourceFunc) flush_metadata_cb,
+						       doc);
 		}
 	}
+}
 
-	g_clear_object (&info);
+/**
+ * _gedit_document_flush_all_metadata:
+ *
+ * Writes the GVfs metadata of all the documents, for the application
+ * shutdown.
+ */
+void
+_gedit_document_flush_all_metadata (void)
+{
+	while (docs_with_pending_metadata != NULL)
+	{
+		flush_metadata (docs_with_pending_metadata->data);
+	}
+
+	gedit_debug_message (DEBUG_DOCUMENT, "%u metadata writes saved",
+			     n_metadata_changes - n_metadata_writes);
 }
 
 static void
@@ -1912,10 +2933,7 @@ gedit_document_set_search_context (GeditDocument          *doc,
 	{
 		g_object_ref (search_context);
 
-		g_settings_bind (priv->editor_settings,
-				 GEDIT_SETTINGS_SEARCH_HIGHLIGHTING,
-				 search_context, "highlight",
-				 G_SETTINGS_BIND_GET | G_SETTINGS_BIND_NO_SENSITIVITY);
+		update_search_highlighting (doc);
 
 		g_signal_connect_object (search_context,
 					 "notify::settings",
@@ -1929,6 +2947,52 @@ gedit_document_set_search_context (GeditDocument          *doc,
 	update_empty_search (doc);
 }
 
+/**
+ * gedit_document_get_large_mode:
+ * @doc: a #GeditDocument
+ *
+ * Returns: whether the document is in large mode. See
+ * #GeditDocument:large-mode.
+ *
+ * Since: 3.20
+ */
+gboolean
+gedit_document_get_large_mode (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return priv->large_mode;
+}
+
+/**
+ * gedit_document_set_large_mode:
+ * @doc: a #GeditDocument
+ * @large_mode: whether the document is in large mode
+ *
+ * Overrides the large mode computed from the size of the document, for
+ * example when the user wants the costly features anyway. The choice is kept
+ * when the document is reloaded.
+ *
+ * Since: 3.20
+ */
+void
+gedit_document_set_large_mode (GeditDocument *doc,
+			       gboolean       large_mode)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_if_fail (GEDIT_IS_DOCUMENT (doc));
+
+	priv = gedit_document_get_instance_private (doc);
+
+	priv->large_mode_set_by_user = TRUE;
+	set_large_mode (doc, large_mode);
+}
+
 /**
  * gedit_document_get_search_context:
  * @doc: a #GeditDocument
@@ -2019,4 +3083,85 @@ _gedit_document_get_create (GeditDocument *doc)
 	return priv->create;
 }
 
+/* Drops the contents and the undo history of an unmodified document, which
+ * is reloaded from its file when needed again.
+ */
+void
+_gedit_document_hibernate (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_if_fail (GEDIT_IS_DOCUMENT (doc));
+	g_return_if_fail (!gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (doc)));
+
+	priv = gedit_document_get_instance_private (doc);
+
+	if (priv->hibernated)
+	{
+		return;
+	}
+
+	save_metadata (doc);
+
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (doc));
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (doc), "", 0);
+	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (doc));
+
+	gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (doc), FALSE);
+
+	priv->hibernated = TRUE;
+}
+
+gboolean
+_gedit_document_get_hibernated (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return priv->hibernated;
+}
+
+gboolean
+_gedit_document_get_long_lines (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return priv->long_lines;
+}
+
+gboolean
+_gedit_document_get_large_mode_set_by_user (GeditDocument *doc)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return priv->large_mode_set_by_user;
+}
+
+/* Whether the line of @iter is one of the long lines. */
+gboolean
+_gedit_document_is_long_line (GeditDocument     *doc,
+			      const GtkTextIter *iter)
+{
+	GeditDocumentPrivate *priv;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), FALSE);
+	g_return_val_if_fail (iter != NULL, FALSE);
+
+	priv = gedit_document_get_instance_private (doc);
+
+	return (priv->long_lines &&
+		(guint) gtk_text_iter_get_bytes_in_line (iter) > priv->long_line_threshold);
+}
+
 /* ex:set ts=8 noet: */
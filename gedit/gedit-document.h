@@ -125,6 +125,11 @@ void		 gedit_document_set_search_context		(GeditDocument          *doc,
 GtkSourceSearchContext *
 		 gedit_document_get_search_context		(GeditDocument       *doc);
 
+gboolean	 gedit_document_get_large_mode			(GeditDocument       *doc);
+
+void		 gedit_document_set_large_mode			(GeditDocument       *doc,
+								 gboolean             large_mode);
+
 G_END_DECLS
 
 #endif /* __GEDIT_DOCUMENT_H__ */
@@ -0,0 +1,494 @@
+/*
+ * gedit-file-watcher.c
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Watches the local files of the tabs of a window, to notice when they are
+ * modified by another program. There is one GFileMonitor per directory, shared
+ * by the tabs of the files in that directory. The events are gathered in
+ * batches, so that a burst of events (a "git checkout" for example) is handled
+ * once. The checks of the tabs of a batch are started a few at a time in an
+ * idle, and each tab queries its file asynchronously.
+ */
+
+#include "gedit-file-watcher.h"
+
+#include "gedit-debug.h"
+#include "gedit-tab-private.h"
+
+/* A batch is handled when no event has arrived during this delay, in
+ * milliseconds...
+ */
+#define BATCH_DELAY 200
+
+/* ...or when it is this old, in milliseconds, during a continuous burst. */
+#define BATCH_MAX_DELAY 1000
+
+/* Number of checks started per main loop iteration. */
+#define N_TABS_CHECKED_PER_ITERATION 20
+
+typedef struct _WatchedTab WatchedTab;
+typedef struct _DirectoryMonitor DirectoryMonitor;
+
+struct _GeditFileWatcher
+{
+	/* GeditTab -> WatchedTab */
+	GHashTable *tabs;
+
+	/* GFile of a directory -> DirectoryMonitor */
+	GHashTable *directories;
+
+	/* The watched files which changed since the last batch. */
+	GHashTable *changed_files;
+	gint64 batch_start_time;
+	guint batch_timeout_id;
+
+	/* The WatchedTabs to check. */
+	GQueue tabs_to_check;
+	guint check_idle_id;
+};
+
+struct _WatchedTab
+{
+	GeditFileWatcher *watcher;
+	GeditTab *tab;
+
+	/* The watched location, NULL if the file is not watched. */
+	GFile *location;
+
+	gulong location_notify_id;
+
+	/* Whether the tab is in the tabs_to_check queue. */
+	guint queued : 1;
+};
+
+struct _DirectoryMonitor
+{
+	GeditFileWatcher *watcher;
+	GFileMonitor *monitor;
+
+	/* GFile -> GList of WatchedTabs */
+	GHashTable *files;
+};
+
+static void
+directory_monitor_free (DirectoryMonitor *dir_monitor)
+{
+	if (dir_monitor != NULL)
+	{
+		g_file_monitor_cancel (dir_monitor->monitor);
+		g_signal_handlers_disconnect_by_data (dir_monitor->monitor, dir_monitor);
+		g_object_unref (dir_monitor->monitor);
+
+		g_hash_table_unref (dir_monitor->files);
+
+		g_slice_free (DirectoryMonitor, dir_monitor);
+	}
+}
+
+static gboolean
+check_tabs_idle (GeditFileWatcher *watcher)
+{
+	gint i;
+
+	for (i = 0; i < N_TABS_CHECKED_PER_ITERATION; i++)
+	{
+		WatchedTab *watched_tab = g_queue_pop_head (&watcher->tabs_to_check);
+
+		if (watched_tab == NULL)
+		{
+			break;
+		}
+
+		watched_tab->queued = FALSE;
+		_gedit_tab_check_file_on_disk (watched_tab->tab);
+	}
+
+	if (g_queue_is_empty (&watcher->tabs_to_check))
+	{
+		watcher->check_idle_id = 0;
+		return G_SOURCE_REMOVE;
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+queue_tabs_of_file (GeditFileWatcher *watcher,
+		    GFile            *location)
+{
+	GFile *parent;
+	DirectoryMonitor *dir_monitor;
+	GList *l;
+
+	parent = g_file_get_parent (location);
+	dir_monitor = g_hash_table_lookup (watcher->directories, parent);
+	g_object_unref (parent);
+
+	/* The tab has been closed in the meantime. */
+	if (dir_monitor == NULL)
+	{
+		return;
+	}
+
+	for (l = g_hash_table_lookup (dir_monitor->files, location); l != NULL; l = l->next)
+	{
+		WatchedTab *watched_tab = l->data;
+
+		if (!watched_tab->queued)
+		{
+			watched_tab->queued = TRUE;
+			g_queue_push_tail (&watcher->tabs_to_check, watched_tab);
+		}
+	}
+}
+
+static gboolean
+batch_timeout_cb (GeditFileWatcher *watcher)
+{
+	GHashTableIter iter;
+	gpointer location;
+
+	watcher->batch_timeout_id = 0;
+
+	gedit_debug_message (DEBUG_WINDOW,
+			     "%u watched files changed",
+			     g_hash_table_size (watcher->changed_files));
+
+	g_hash_table_iter_init (&iter, watcher->changed_files);
+	while (g_hash_table_iter_next (&iter, &location, NULL))
+	{
+		queue_tabs_of_file (watcher, location);
+	}
+
+	g_hash_table_remove_all (watcher->changed_files);
+
+	if (!g_queue_is_empty (&watcher->tabs_to_check) &&
+	    watcher->check_idle_id == 0)
+	{
+		watcher->check_idle_id = g_idle_add ((GSourceFunc) check_tabs_idle, watcher);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+directory_changed_cb (GFileMonitor      *monitor,
+		      GFile             *file,
+		      GFile             *other_file,
+		      GFileMonitorEvent  event_type,
+		      DirectoryMonitor  *dir_monitor)
+{
+	GeditFileWatcher *watcher = dir_monitor->watcher;
+	gint64 now;
+
+	switch (event_type)
+	{
+		case G_FILE_MONITOR_EVENT_CHANGED:
+		case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+		case G_FILE_MONITOR_EVENT_DELETED:
+		case G_FILE_MONITOR_EVENT_CREATED:
+			break;
+
+		default:
+			return;
+	}
+
+	if (!g_hash_table_contains (dir_monitor->files, file))
+	{
+		return;
+	}
+
+	g_hash_table_add (watcher->changed_files, g_object_ref (file));
+
+	now = g_get_monotonic_time ();
+
+	if (watcher->batch_timeout_id == 0)
+	{
+		watcher->batch_start_time = now;
+	}
+	else if (now - watcher->batch_start_time < BATCH_MAX_DELAY * 1000)
+	{
+		/* Wait for the end of the burst. */
+		g_source_remove (watcher->batch_timeout_id);
+		watcher->batch_timeout_id = 0;
+	}
+
+	if (watcher->batch_timeout_id == 0)
+	{
+		watcher->batch_timeout_id = g_timeout_add (BATCH_DELAY,
+							   (GSourceFunc) batch_timeout_cb,
+							   watcher);
+	}
+}
+
+static DirectoryMonitor *
+get_directory_monitor (GeditFileWatcher *watcher,
+		       GFile            *directory)
+{
+	DirectoryMonitor *dir_monitor;
+	GFileMonitor *monitor;
+	GError *error = NULL;
+
+	dir_monitor = g_hash_table_lookup (watcher->directories, directory);
+
+	if (dir_monitor != NULL)
+	{
+		return dir_monitor;
+	}
+
+	monitor = g_file_monitor_directory (directory, G_FILE_MONITOR_NONE, NULL, &error);
+
+	if (error != NULL)
+	{
+		/* The file is still checked when its tab gets the focus. */
+		gedit_debug_message (DEBUG_WINDOW, "Cannot monitor directory: %s", error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	dir_monitor = g_slice_new (DirectoryMonitor);
+	dir_monitor->watcher = watcher;
+	dir_monitor->monitor = monitor;
+	dir_monitor->files = g_hash_table_new_full (g_file_hash,
+						    (GEqualFunc) g_file_equal,
+						    g_object_unref,
+						    NULL);
+
+	g_signal_connect (monitor,
+			  "changed",
+			  G_CALLBACK (directory_changed_cb),
+			  dir_monitor);
+
+	g_hash_table_insert (watcher->directories, g_object_ref (directory), dir_monitor);
+
+	return dir_monitor;
+}
+
+static void
+watch_location (WatchedTab *watched_tab)
+{
+	GeditDocument *doc;
+	GtkSourceFile *file;
+	GFile *location;
+	GFile *parent;
+	DirectoryMonitor *dir_monitor;
+	GList *tabs;
+
+	g_assert (watched_tab->location == NULL);
+
+	doc = gedit_tab_get_document (watched_tab->tab);
+	file = gedit_document_get_file (doc);
+	location = gtk_source_file_get_location (file);
+
+	if (location == NULL || !g_file_is_native (location))
+	{
+		return;
+	}
+
+	parent = g_file_get_parent (location);
+
+	if (parent == NULL)
+	{
+		return;
+	}
+
+	dir_monitor = get_directory_monitor (watched_tab->watcher, parent);
+	g_object_unref (parent);
+
+	if (dir_monitor == NULL)
+	{
+		return;
+	}
+
+	tabs = g_hash_table_lookup (dir_monitor->files, location);
+	tabs = g_list_prepend (tabs, watched_tab);
+	g_hash_table_replace (dir_monitor->files, g_object_ref (location), tabs);
+
+	watched_tab->location = g_object_ref (location);
+	_gedit_tab_set_file_monitored (watched_tab->tab, TRUE);
+}
+
+static void
+unwatch_location (WatchedTab *watched_tab)
+{
+	GeditFileWatcher *watcher = watched_tab->watcher;
+	GFile *parent;
+	DirectoryMonitor *dir_monitor;
+	GList *tabs;
+
+	if (watched_tab->location == NULL)
+	{
+		return;
+	}
+
+	parent = g_file_get_parent (watched_tab->location);
+	dir_monitor = g_hash_table_lookup (watcher->directories, parent);
+	g_return_if_fail (dir_monitor != NULL);
+
+	tabs = g_hash_table_lookup (dir_monitor->files, watched_tab->location);
+	tabs = g_list_remove (tabs, watched_tab);
+
+	if (tabs != NULL)
+	{
+		g_hash_table_replace (dir_monitor->files,
+				      g_object_ref (watched_tab->location),
+				      tabs);
+	}
+	else
+	{
+		g_hash_table_remove (dir_monitor->files, watched_tab->location);
+
+		if (g_hash_table_size (dir_monitor->files) == 0)
+		{
+			g_hash_table_remove (watcher->directories, parent);
+		}
+	}
+
+	g_object_unref (parent);
+	g_clear_object (&watched_tab->location);
+
+	_gedit_tab_set_file_monitored (watched_tab->tab, FALSE);
+}
+
+static void
+location_notify_cb (GtkSourceFile *file,
+		    GParamSpec    *pspec,
+		    WatchedTab    *watched_tab)
+{
+	unwatch_location (watched_tab);
+	watch_location (watched_tab);
+}
+
+static void
+watched_tab_free (WatchedTab *watched_tab)
+{
+	GeditFileWatcher *watcher = watched_tab->watcher;
+	GeditDocument *doc;
+
+	unwatch_location (watched_tab);
+
+	if (watched_tab->queued)
+	{
+		g_queue_remove (&watcher->tabs_to_check, watched_tab);
+	}
+
+	doc = gedit_tab_get_document (watched_tab->tab);
+	g_signal_handler_disconnect (gedit_document_get_file (doc),
+				     watched_tab->location_notify_id);
+
+	g_slice_free (WatchedTab, watched_tab);
+}
+
+GeditFileWatcher *
+gedit_file_watcher_new (void)
+{
+	GeditFileWatcher *watcher;
+
+	watcher = g_slice_new0 (GeditFileWatcher);
+
+	watcher->tabs = g_hash_table_new_full (NULL,
+					       NULL,
+					       NULL,
+					       (GDestroyNotify) watched_tab_free);
+
+	watcher->directories = g_hash_table_new_full (g_file_hash,
+						      (GEqualFunc) g_file_equal,
+						      g_object_unref,
+						      (GDestroyNotify) directory_monitor_free);
+
+	watcher->changed_files = g_hash_table_new_full (g_file_hash,
+							(GEqualFunc) g_file_equal,
+							g_object_unref,
+							NULL);
+
+	g_queue_init (&watcher->tabs_to_check);
+
+	return watcher;
+}
+
+void
+gedit_file_watcher_free (GeditFileWatcher *watcher)
+{
+	if (watcher == NULL)
+	{
+		return;
+	}
+
+	if (watcher->batch_timeout_id != 0)
+	{
+		g_source_remove (watcher->batch_timeout_id);
+	}
+
+	if (watcher->check_idle_id != 0)
+	{
+		g_source_remove (watcher->check_idle_id);
+	}
+
+	/* The tabs first, they unwatch their directories. */
+	g_hash_table_unref (watcher->tabs);
+	g_hash_table_unref (watcher->directories);
+	g_hash_table_unref (watcher->changed_files);
+
+	g_queue_clear (&watcher->tabs_to_check);
+
+	g_slice_free (GeditFileWatcher, watcher);
+}
+
+void
+gedit_file_watcher_add_tab (GeditFileWatcher *watcher,
+			    GeditTab         *tab)
+{
+	WatchedTab *watched_tab;
+	GeditDocument *doc;
+
+	g_return_if_fail (watcher != NULL);
+	g_return_if_fail (GEDIT_IS_TAB (tab));
+
+	if (g_hash_table_contains (watcher->tabs, tab))
+	{
+		return;
+	}
+
+	watched_tab = g_slice_new0 (WatchedTab);
+	watched_tab->watcher = watcher;
+	watched_tab->tab = tab;
+
+	doc = gedit_tab_get_document (tab);
+	watched_tab->location_notify_id =
+		g_signal_connect (gedit_document_get_file (doc),
+				  "notify::location",
+				  G_CALLBACK (location_notify_cb),
+				  watched_tab);
+
+	g_hash_table_insert (watcher->tabs, tab, watched_tab);
+
+	watch_location (watched_tab);
+}
+
+void
+gedit_file_watcher_remove_tab (GeditFileWatcher *watcher,
+			       GeditTab         *tab)
+{
+	g_return_if_fail (watcher != NULL);
+	g_return_if_fail (GEDIT_IS_TAB (tab));
+
+	g_hash_table_remove (watcher->tabs, tab);
+}
+
+/* ex:set ts=8 noet: */
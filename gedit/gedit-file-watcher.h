@@ -0,0 +1,44 @@
+/*
+ * gedit-file-watcher.h
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEDIT_FILE_WATCHER_H__
+#define __GEDIT_FILE_WATCHER_H__
+
+#include "gedit-tab.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GeditFileWatcher GeditFileWatcher;
+
+GeditFileWatcher	*gedit_file_watcher_new		(void);
+
+void			 gedit_file_watcher_free	(GeditFileWatcher *watcher);
+
+void			 gedit_file_watcher_add_tab	(GeditFileWatcher *watcher,
+							 GeditTab         *tab);
+
+void			 gedit_file_watcher_remove_tab	(GeditFileWatcher *watcher,
+							 GeditTab         *tab);
+
+G_END_DECLS
+
+#endif /* __GEDIT_FILE_WATCHER_H__ */
+
+/* ex:set ts=8 noet: */
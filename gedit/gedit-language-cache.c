@@ -0,0 +1,350 @@
+/*
+ * gedit-language-cache.c
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Persistent cache of the language guessed for a document.
+ * gtk_source_language_manager_guess_language() matches the file name against
+ * the globs of all the languages, for every loaded document, and again each
+ * time the content type changes.
+ *
+ * The guess depends only on the file name and on the content type, and the
+ * content type already reflects the first line of a script (the shebang).
+ * Most globs have the form "*.ext": a file name that matches none of the other
+ * globs is keyed by its extension, so all the files with the same extension
+ * and content type share one entry.
+ *
+ * The cache file starts with a fingerprint of the globs and MIME types of all
+ * the languages. When a language is installed or changed, the fingerprint
+ * differs and the cache is discarded.
+ */
+
+#include "gedit-language-cache.h"
+
+#include <string.h>
+
+#include "gedit-debug.h"
+#include "gedit-dirs.h"
+
+#define CACHE_FILENAME "language-cache"
+
+/* When reached, the cache is emptied. */
+#define MAX_ENTRIES 4096
+
+/* "name\tcontent-type" -> language id, or "" for no language. */
+static GHashTable *entries = NULL;
+
+/* The globs not of the form "*.ext". */
+static GPtrArray *special_globs = NULL;
+
+static gchar *fingerprint = NULL;
+static gboolean modified = FALSE;
+
+static gboolean
+is_extension_glob (const gchar *glob)
+{
+	return (g_str_has_prefix (glob, "*.") &&
+		glob[2] != '\0' &&
+		strpbrk (glob + 2, "*?[.") == NULL);
+}
+
+static void
+checksum_update_strv (GChecksum  *checksum,
+		      gchar     **strv)
+{
+	gint i;
+
+	for (i = 0; strv != NULL && strv[i] != NULL; i++)
+	{
+		g_checksum_update (checksum, (const guchar *) strv[i], -1);
+		g_checksum_update (checksum, (const guchar *) ";", 1);
+	}
+
+	g_checksum_update (checksum, (const guchar *) "\n", 1);
+}
+
+static void
+init_languages (void)
+{
+	GtkSourceLanguageManager *manager;
+	const gchar * const *ids;
+	GChecksum *checksum;
+	gint i;
+
+	manager = gtk_source_language_manager_get_default ();
+	ids = gtk_source_language_manager_get_language_ids (manager);
+
+	special_globs = g_ptr_array_new_with_free_func (g_free);
+	checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+	for (i = 0; ids != NULL && ids[i] != NULL; i++)
+	{
+		GtkSourceLanguage *language;
+		gchar **globs;
+		gchar **mime_types;
+		gint j;
+
+		language = gtk_source_language_manager_get_language (manager, ids[i]);
+		globs = gtk_source_language_get_globs (language);
+		mime_types = gtk_source_language_get_mime_types (language);
+
+		g_checksum_update (checksum, (const guchar *) ids[i], -1);
+		g_checksum_update (checksum, (const guchar *) "\n", 1);
+		checksum_update_strv (checksum, globs);
+		checksum_update_strv (checksum, mime_types);
+
+		for (j = 0; globs != NULL && globs[j] != NULL; j++)
+		{
+			if (!is_extension_glob (globs[j]))
+			{
+				g_ptr_array_add (special_globs, g_strdup (globs[j]));
+			}
+		}
+
+		g_strfreev (globs);
+		g_strfreev (mime_types);
+	}
+
+	fingerprint = g_strdup (g_checksum_get_string (checksum));
+	g_checksum_free (checksum);
+}
+
+static gchar *
+get_cache_filename (void)
+{
+	return g_build_filename (gedit_dirs_get_user_cache_dir (), CACHE_FILENAME, NULL);
+}
+
+static void
+load_cache (void)
+{
+	gchar *filename;
+	gchar *contents = NULL;
+	gchar **lines;
+	gint i;
+
+	entries = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+
+	init_languages ();
+
+	filename = get_cache_filename ();
+
+	if (!g_file_get_contents (filename, &contents, NULL, NULL))
+	{
+		g_free (filename);
+		return;
+	}
+
+	g_free (filename);
+
+	lines = g_strsplit (contents, "\n", -1);
+	g_free (contents);
+
+	if (lines[0] == NULL || !g_str_equal (lines[0], fingerprint))
+	{
+		gedit_debug_message (DEBUG_DOCUMENT, "Language cache outdated");
+
+		/* Rewrite it with the new fingerprint. */
+		modified = TRUE;
+		g_strfreev (lines);
+		return;
+	}
+
+	/* Each line: name, content type and language id, separated by tabs. */
+	for (i = 1; lines[i] != NULL; i++)
+	{
+		gchar *id;
+
+		id = strrchr (lines[i], '\t');
+
+		if (id == NULL || strchr (lines[i], '\t') == id)
+		{
+			continue;
+		}
+
+		*id = '\0';
+		g_hash_table_replace (entries, g_strdup (lines[i]), g_strdup (id + 1));
+	}
+
+	gedit_debug_message (DEBUG_DOCUMENT, "Language cache loaded: %u entries",
+			     g_hash_table_size (entries));
+
+	g_strfreev (lines);
+}
+
+/* Returns NULL if the guess cannot be cached. */
+static gchar *
+get_key (const gchar *filename,
+	 const gchar *content_type)
+{
+	const gchar *prefix = "";
+	const gchar *name = "";
+
+	if (content_type == NULL)
+	{
+		content_type = "";
+	}
+
+	if (filename != NULL)
+	{
+		guint i;
+
+		for (i = 0; i < special_globs->len; i++)
+		{
+			if (g_pattern_match_simple (g_ptr_array_index (special_globs, i), filename))
+			{
+				prefix = "=";
+				name = filename;
+				break;
+			}
+		}
+
+		if (name[0] == '\0' && strrchr (filename, '.') != NULL)
+		{
+			prefix = "*";
+			name = strrchr (filename, '.');
+		}
+	}
+
+	if (strpbrk (name, "\t\n") != NULL ||
+	    strpbrk (content_type, "\t\n") != NULL)
+	{
+		return NULL;
+	}
+
+	return g_strconcat (prefix, name, "\t", content_type, NULL);
+}
+
+/* Like gtk_source_language_manager_guess_language() with the default language
+ * manager.
+ */
+GtkSourceLanguage *
+gedit_language_cache_guess_language (const gchar *filename,
+				     const gchar *content_type)
+{
+	GtkSourceLanguageManager *manager;
+	GtkSourceLanguage *language;
+	gchar *key;
+
+	manager = gtk_source_language_manager_get_default ();
+
+	if (entries == NULL)
+	{
+		load_cache ();
+	}
+
+	key = get_key (filename, content_type);
+
+	if (key != NULL)
+	{
+		const gchar *id = g_hash_table_lookup (entries, key);
+
+		if (id != NULL && id[0] == '\0')
+		{
+			g_free (key);
+			return NULL;
+		}
+
+		language = id != NULL ? gtk_source_language_manager_get_language (manager, id) : NULL;
+
+		if (language != NULL)
+		{
+			g_free (key);
+			return language;
+		}
+	}
+
+	language = gtk_source_language_manager_guess_language (manager, filename, content_type);
+
+	if (key != NULL)
+	{
+		if (g_hash_table_size (entries) >= MAX_ENTRIES)
+		{
+			g_hash_table_remove_all (entries);
+		}
+
+		g_hash_table_replace (entries,
+				      key,
+				      g_strdup (language != NULL ? gtk_source_language_get_id (language) : ""));
+		modified = TRUE;
+	}
+
+	return language;
+}
+
+static void
+save_cache (void)
+{
+	GString *str;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer id;
+	gchar *filename;
+	GError *error = NULL;
+
+	str = g_string_new (fingerprint);
+	g_string_append_c (str, '\n');
+
+	g_hash_table_iter_init (&iter, entries);
+
+	while (g_hash_table_iter_next (&iter, &key, &id))
+	{
+		g_string_append_printf (str, "%s\t%s\n", (const gchar *) key, (const gchar *) id);
+	}
+
+	g_mkdir_with_parents (gedit_dirs_get_user_cache_dir (), 0755);
+
+	filename = get_cache_filename ();
+	g_file_set_contents (filename, str->str, str->len, &error);
+
+	if (error != NULL)
+	{
+		gedit_debug_message (DEBUG_DOCUMENT, "Cannot save the language cache: %s", error->message);
+		g_error_free (error);
+	}
+
+	g_free (filename);
+	g_string_free (str, TRUE);
+}
+
+void
+gedit_language_cache_shutdown (void)
+{
+	if (entries == NULL)
+	{
+		return;
+	}
+
+	if (modified)
+	{
+		save_cache ();
+	}
+
+	g_hash_table_unref (entries);
+	entries = NULL;
+
+	g_ptr_array_unref (special_globs);
+	special_globs = NULL;
+
+	g_free (fingerprint);
+	fingerprint = NULL;
+
+	modified = FALSE;
+}
+
+/* ex:set ts=8 noet: */
@@ -0,0 +1,37 @@
+/*
+ * gedit-language-cache.h
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEDIT_LANGUAGE_CACHE_H__
+#define __GEDIT_LANGUAGE_CACHE_H__
+
+#include <gtksourceview/gtksource.h>
+
+G_BEGIN_DECLS
+
+GtkSourceLanguage	*gedit_language_cache_guess_language	(const gchar *filename,
+								 const gchar *content_type);
+
+void			 gedit_language_cache_shutdown		(void);
+
+G_END_DECLS
+
+#endif /* __GEDIT_LANGUAGE_CACHE_H__ */
+
+/* ex:set ts=8 noet: */
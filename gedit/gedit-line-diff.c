@@ -0,0 +1,445 @@
+/*
+ * gedit-line-diff.c
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Line-level diff between two texts, computed in a worker thread. The common
+ * first and last lines are skipped, then the shortest edit script of the
+ * remaining lines is found with the O(ND) algorithm of Eugene W. Myers. The
+ * number of edits is bounded: beyond it, the texts are considered too
+ * different and no hunks are returned.
+ */
+
+#include "gedit-line-diff.h"
+
+#include <string.h>
+
+#include "gedit-debug.h"
+
+typedef struct _Line Line;
+typedef struct _DiffData DiffData;
+
+struct _Line
+{
+	const gchar *start;
+
+	/* In bytes, with the line terminator. */
+	gsize length;
+
+	guint hash;
+};
+
+struct _DiffData
+{
+	gchar *old_text;
+	gchar *new_text;
+	guint max_edits;
+};
+
+static void
+diff_data_free (DiffData *data)
+{
+	if (data != NULL)
+	{
+		g_free (data->old_text);
+		g_free (data->new_text);
+		g_slice_free (DiffData, data);
+	}
+}
+
+static void
+hunk_free (GeditLineDiffHunk *hunk)
+{
+	if (hunk != NULL)
+	{
+		g_free (hunk->new_text);
+		g_slice_free (GeditLineDiffHunk, hunk);
+	}
+}
+
+static GArray *
+split_lines (const gchar *text)
+{
+	GArray *lines;
+	const gchar *p = text;
+
+	lines = g_array_new (FALSE, FALSE, sizeof (Line));
+
+	while (*p != '\0')
+	{
+		Line line;
+		guint hash = 5381;
+
+		line.start = p;
+
+		while (*p != '\0' && *p != '\n')
+		{
+			hash = (hash << 5) + hash + (guchar) *p;
+			p++;
+		}
+
+		if (*p == '\n')
+		{
+			p++;
+		}
+
+		line.length = p - line.start;
+		line.hash = hash;
+
+		g_array_append_val (lines, line);
+	}
+
+	return lines;
+}
+
+static inline gboolean
+lines_equal (const Line *a,
+	     const Line *b)
+{
+	return (a->hash == b->hash &&
+		a->length == b->length &&
+		memcmp (a->start, b->start, a->length) == 0);
+}
+
+/* Marks the lines of @a to delete and the lines of @b to insert to turn @a
+ * into @b. Returns FALSE if it takes more than @max_edits edits.
+ */
+static gboolean
+shortest_edit_script (const Line   *a,
+		      gint          n,
+		      const Line   *b,
+		      gint          m,
+		      gint          max_edits,
+		      GCancellable *cancellable,
+		      gboolean     *deleted,
+		      gboolean     *inserted)
+{
+	gint max_d;
+	gint *v;
+	GArray *trace;
+	gint d;
+	gint k;
+	gint x;
+	gint y;
+	gboolean found = FALSE;
+
+	max_d = MIN (n + m, max_edits);
+
+	/* v[k] is the furthest x reached on the diagonal k, for k in
+	 * [-max_d - 1, max_d + 1]. After each step d, v[-d..d] is appended to
+	 * the trace, to find the path back.
+	 */
+	v = g_new0 (gint, 2 * max_d + 3);
+	v += max_d + 1;
+
+	trace = g_array_new (FALSE, FALSE, sizeof (gint));
+
+	for (d = 0; d <= max_d && !found; d++)
+	{
+		if (g_cancellable_is_cancelled (cancellable))
+		{
+			break;
+		}
+
+		for (k = -d; k <= d; k += 2)
+		{
+			if (k == -d || (k != d && v[k - 1] < v[k + 1]))
+			{
+				x = v[k + 1];
+			}
+			else
+			{
+				x = v[k - 1] + 1;
+			}
+
+			y = x - k;
+
+			while (x < n && y < m && lines_equal (&a[x], &b[y]))
+			{
+				x++;
+				y++;
+			}
+
+			v[k] = x;
+
+			if (x >= n && y >= m)
+			{
+				found = TRUE;
+				break;
+			}
+		}
+
+		g_array_append_vals (trace, &v[-d], 2 * d + 1);
+	}
+
+	g_free (v - max_d - 1);
+
+	if (!found)
+	{
+		g_array_free (trace, TRUE);
+		return FALSE;
+	}
+
+	x = n;
+	y = m;
+
+	for (d = d - 1; d > 0; d--)
+	{
+		const gint *prev;
+		gint prev_k;
+		gint prev_x;
+		gint prev_y;
+
+		/* prev[k] is v[k] after the step d - 1. */
+		prev = &g_array_index (trace, gint, (d - 1) * (d - 1) + (d - 1));
+
+		k = x - y;
+
+		if (k == -d || (k != d && prev[k - 1] < prev[k + 1]))
+		{
+			prev_k = k + 1;
+		}
+		else
+		{
+			prev_k = k - 1;
+		}
+
+		prev_x = prev[prev_k];
+		prev_y = prev_x - prev_k;
+
+		if (prev_k == k + 1)
+		{
+			inserted[prev_y] = TRUE;
+		}
+		else
+		{
+			deleted[prev_x] = TRUE;
+		}
+
+		x = prev_x;
+		y = prev_y;
+	}
+
+	g_array_free (trace, TRUE);
+	return TRUE;
+}
+
+static const gchar *
+get_line_start (GArray      *lines,
+		guint        line_num,
+		const gchar *text_end)
+{
+	if (line_num < lines->len)
+	{
+		return g_array_index (lines, Line, line_num).start;
+	}
+
+	return text_end;
+}
+
+static GPtrArray *
+compute_hunks (const gchar  *old_text,
+	       const gchar  *new_text,
+	       guint         max_edits,
+	       GCancellable *cancellable)
+{
+	GArray *old_lines;
+	GArray *new_lines;
+	const gchar *old_end;
+	const gchar *new_end;
+	const gchar *counted;
+	guint prefix = 0;
+	guint suffix = 0;
+	gint n;
+	gint m;
+	gboolean *deleted;
+	gboolean *inserted;
+	GPtrArray *hunks = NULL;
+	gint offset = 0;
+	gint i = 0;
+	gint j = 0;
+
+	old_lines = split_lines (old_text);
+	new_lines = split_lines (new_text);
+
+	while (prefix < old_lines->len &&
+	       prefix < new_lines->len &&
+	       lines_equal (&g_array_index (old_lines, Line, prefix),
+			    &g_array_index (new_lines, Line, prefix)))
+	{
+		prefix++;
+	}
+
+	while (suffix < old_lines->len - prefix &&
+	       suffix < new_lines->len - prefix &&
+	       lines_equal (&g_array_index (old_lines, Line, old_lines->len - 1 - suffix),
+			    &g_array_index (new_lines, Line, new_lines->len - 1 - suffix)))
+	{
+		suffix++;
+	}
+
+	n = old_lines->len - prefix - suffix;
+	m = new_lines->len - prefix - suffix;
+
+	deleted = g_new0 (gboolean, n + 1);
+	inserted = g_new0 (gboolean, m + 1);
+
+	if (!shortest_edit_script (&g_array_index (old_lines, Line, prefix), n,
+				   &g_array_index (new_lines, Line, prefix), m,
+				   max_edits,
+				   cancellable,
+				   deleted,
+				   inserted))
+	{
+		gedit_debug_message (DEBUG_UTILS,
+				     "More than %u edits between the %d and %d different lines",
+				     max_edits, n, m);
+		goto out;
+	}
+
+	hunks = g_ptr_array_new_with_free_func ((GDestroyNotify) hunk_free);
+
+	old_end = old_text + strlen (old_text);
+	new_end = new_text + strlen (new_text);
+	counted = old_text;
+
+	while (i < n || j < m)
+	{
+		GeditLineDiffHunk *hunk;
+		const gchar *old_start;
+		const gchar *old_stop;
+		const gchar *new_start;
+		const gchar *new_stop;
+		gint first_i = i;
+		gint first_j = j;
+
+		if (i < n && j < m && !deleted[i] && !inserted[j])
+		{
+			i++;
+			j++;
+			continue;
+		}
+
+		while ((i < n && deleted[i]) || (j < m && inserted[j]))
+		{
+			if (i < n && deleted[i])
+			{
+				i++;
+			}
+
+			if (j < m && inserted[j])
+			{
+				j++;
+			}
+		}
+
+		old_start = get_line_start (old_lines, prefix + first_i, old_end);
+		old_stop = get_line_start (old_lines, prefix + i, old_end);
+		new_start = get_line_start (new_lines, prefix + first_j, new_end);
+		new_stop = get_line_start (new_lines, prefix + j, new_end);
+
+		offset += g_utf8_strlen (counted, old_start - counted);
+		counted = old_start;
+
+		hunk = g_slice_new (GeditLineDiffHunk);
+		hunk->old_offset = offset;
+		hunk->old_length = g_utf8_strlen (old_start, old_stop - old_start);
+		hunk->new_text = g_strndup (new_start, new_stop - new_start);
+
+		g_ptr_array_add (hunks, hunk);
+	}
+
+	gedit_debug_message (DEBUG_UTILS,
+			     "%u hunks, %u common first lines, %u common last lines",
+			     hunks->len, prefix, suffix);
+
+out:
+	g_free (deleted);
+	g_free (inserted);
+	g_array_free (old_lines, TRUE);
+	g_array_free (new_lines, TRUE);
+
+	return hunks;
+}
+
+static void
+diff_thread (GTask        *task,
+	     gpointer      source_object,
+	     DiffData     *data,
+	     GCancellable *cancellable)
+{
+	GPtrArray *hunks;
+
+	hunks = compute_hunks (data->old_text,
+			       data->new_text,
+			       data->max_edits,
+			       cancellable);
+
+	if (g_task_return_error_if_cancelled (task))
+	{
+		if (hunks != NULL)
+		{
+			g_ptr_array_unref (hunks);
+		}
+
+		return;
+	}
+
+	g_task_return_pointer (task, hunks, (GDestroyNotify) g_ptr_array_unref);
+}
+
+/* Takes ownership of @old_text and @new_text, which must be valid UTF-8. */
+void
+gedit_line_diff_compute_async (gchar               *old_text,
+			       gchar               *new_text,
+			       guint                max_edits,
+			       GCancellable        *cancellable,
+			       GAsyncReadyCallback  callback,
+			       gpointer             user_data)
+{
+	GTask *task;
+	DiffData *data;
+
+	g_return_if_fail (old_text != NULL);
+	g_return_if_fail (new_text != NULL);
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+	data = g_slice_new (DiffData);
+	data->old_text = old_text;
+	data->new_text = new_text;
+	data->max_edits = max_edits;
+
+	task = g_task_new (NULL, cancellable, callback, user_data);
+	g_task_set_task_data (task, data, (GDestroyNotify) diff_data_free);
+	g_task_run_in_thread (task, (GTaskThreadFunc) diff_thread);
+	g_object_unref (task);
+}
+
+/* Returns the hunks in the order of the old text, or NULL without error when
+ * the texts have too many differences.
+ */
+GPtrArray *
+gedit_line_diff_compute_finish (GAsyncResult  *result,
+				GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, NULL), NULL);
+
+	return g_task_propagate_pointer (G_TASK (result), error);
+}
+
+/* ex:set ts=8 noet: */
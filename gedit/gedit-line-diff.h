@@ -0,0 +1,55 @@
+/*
+ * gedit-line-diff.h
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEDIT_LINE_DIFF_H__
+#define __GEDIT_LINE_DIFF_H__
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _GeditLineDiffHunk GeditLineDiffHunk;
+
+/* Replacement of whole lines of the old text. The offsets are in characters,
+ * in the old text.
+ */
+struct _GeditLineDiffHunk
+{
+	gint old_offset;
+	gint old_length;
+
+	gchar *new_text;
+};
+
+void		 gedit_line_diff_compute_async	(gchar               *old_text,
+						 gchar               *new_text,
+						 guint                max_edits,
+						 GCancellable        *cancellable,
+						 GAsyncReadyCallback  callback,
+						 gpointer             user_data);
+
+GPtrArray	*gedit_line_diff_compute_finish	(GAsyncResult        *result,
+						 GError             **error);
+
+G_END_DECLS
+
+#endif /* __GEDIT_LINE_DIFF_H__ */
+
+/* ex:set ts=8 noet: */
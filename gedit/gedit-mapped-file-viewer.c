@@ -0,0 +1,1158 @@
+/*
+ * gedit-mapped-file-viewer.c
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Read-only viewer for huge files. The file is mapped in memory and only a
+ * window of WINDOW_N_LINES lines around the visible area is inserted in the
+ * buffer, so the memory used by the GtkTextBuffer doesn't depend on the file
+ * size. The window is moved when the user scrolls near its borders, when
+ * going to a line, or when a search match is found outside of it.
+ *
+ * In hex mode, used to preview a binary file, each line shows HEX_LINE_SIZE
+ * bytes of the file. The lines have a fixed size, so no index is needed. The
+ * search is then done in the buffer only.
+ */
+
+#include "gedit-mapped-file-viewer.h"
+
+#include <string.h>
+
+#include "gedit-debug.h"
+
+/* The byte offset of one line every INDEX_STRIDE lines is stored in the
+ * index. The other lines are found with memchr() from the closest entry.
+ */
+#define INDEX_STRIDE 1024
+
+#define WINDOW_N_LINES 4000
+
+/* A window never contains much more than that number of bytes, and a single
+ * line longer than that is truncated.
+ */
+#define WINDOW_MAX_BYTES (4 * 1024 * 1024)
+
+#define HEX_LINE_SIZE 16
+
+/* The search thread checks if it is cancelled between two chunks. */
+#define SEARCH_CHUNK_SIZE (16 * 1024 * 1024)
+
+struct _GeditMappedFileViewer
+{
+	GeditView *view;
+	GtkAdjustment *vadjustment;
+	GtkTextMark *scroll_mark;
+
+	GMappedFile *mapped_file;
+	const gchar *contents;
+	gsize length;
+
+	/* The offsets of the lines 0, INDEX_STRIDE, 2 * INDEX_STRIDE, ...
+	 * NULL while the index is built by the worker thread.
+	 */
+	GArray *index;
+	gint64 n_lines;
+	GTimer *index_timer;
+
+	/* The lines [first_line, first_line + n_window_lines) are in the
+	 * buffer.
+	 */
+	gint64 first_line;
+	gint64 n_window_lines;
+
+	GCancellable *cancellable;
+	GCancellable *search_cancellable;
+
+	gulong value_changed_id;
+	guint idle_shift_done;
+
+	guint shifting : 1;
+	guint hex : 1;
+};
+
+typedef struct
+{
+	GArray *index;
+	gint64 n_lines;
+} IndexResult;
+
+typedef struct
+{
+	GMappedFile *mapped_file;
+	gchar *text;
+	gsize text_len;
+	gsize from;
+	guint case_sensitive : 1;
+	guint backward : 1;
+} SearchData;
+
+static void
+index_result_free (IndexResult *result)
+{
+	if (result != NULL)
+	{
+		if (result->index != NULL)
+		{
+			g_array_unref (result->index);
+		}
+
+		g_slice_free (IndexResult, result);
+	}
+}
+
+static void
+search_data_free (SearchData *data)
+{
+	if (data != NULL)
+	{
+		g_mapped_file_unref (data->mapped_file);
+		g_free (data->text);
+		g_slice_free (SearchData, data);
+	}
+}
+
+static void
+build_index_thread (GTask        *task,
+		    gpointer      source_object,
+		    GMappedFile  *mapped_file,
+		    GCancellable *cancellable)
+{
+	const gchar *contents = g_mapped_file_get_contents (mapped_file);
+	gsize length = g_mapped_file_get_length (mapped_file);
+	gsize pos = 0;
+	guint64 offset = 0;
+	gint64 line = 0;
+	IndexResult *result;
+
+	result = g_slice_new0 (IndexResult);
+	result->index = g_array_new (FALSE, FALSE, sizeof (guint64));
+	g_array_append_val (result->index, offset);
+
+	while (pos < length)
+	{
+		const gchar *newline;
+
+		newline = memchr (contents + pos, '\n', length - pos);
+
+		if (newline == NULL)
+		{
+			break;
+		}
+
+		pos = newline - contents + 1;
+		line++;
+
+		if (line % INDEX_STRIDE == 0)
+		{
+			offset = pos;
+			g_array_append_val (result->index, offset);
+
+			if (g_task_return_error_if_cancelled (task))
+			{
+				index_result_free (result);
+				return;
+			}
+		}
+	}
+
+	/* Like in a GtkTextBuffer, the text after the last newline is a
+	 * line, even if it is empty.
+	 */
+	result->n_lines = line + 1;
+
+	g_task_return_pointer (task, result, (GDestroyNotify) index_result_free);
+}
+
+static void
+build_index_cb (GObject               *source_object,
+		GAsyncResult          *result,
+		GeditMappedFileViewer *viewer)
+{
+	IndexResult *index_result;
+
+	index_result = g_task_propagate_pointer (G_TASK (result), NULL);
+
+	/* Cancelled: the viewer has been freed. */
+	if (index_result == NULL)
+	{
+		return;
+	}
+
+	viewer->index = index_result->index;
+	viewer->n_lines = index_result->n_lines;
+	index_result->index = NULL;
+	index_result_free (index_result);
+
+	gedit_debug_message (DEBUG_TAB,
+			     "Line index built in %.3f s: %" G_GINT64_FORMAT " lines",
+			     g_timer_elapsed (viewer->index_timer, NULL),
+			     viewer->n_lines);
+
+	g_timer_destroy (viewer->index_timer);
+	viewer->index_timer = NULL;
+}
+
+/* Returns the byte offset of the start of @line. Without the index, the lines
+ * are counted from the start of the file.
+ */
+static gsize
+get_line_offset (GeditMappedFileViewer *viewer,
+		 gint64                 line)
+{
+	gsize offset = 0;
+	gint64 cur_line = 0;
+
+	if (viewer->hex)
+	{
+		return MIN ((gsize) line * HEX_LINE_SIZE, viewer->length);
+	}
+
+	if (viewer->index != NULL)
+	{
+		guint i = MIN (line / INDEX_STRIDE, viewer->index->len - 1);
+
+		offset = g_array_index (viewer->index, guint64, i);
+		cur_line = (gint64) i * INDEX_STRIDE;
+	}
+
+	while (cur_line < line && offset < viewer->length)
+	{
+		const gchar *newline;
+
+		newline = memchr (viewer->contents + offset, '\n', viewer->length - offset);
+
+		if (newline == NULL)
+		{
+			break;
+		}
+
+		offset = newline - viewer->contents + 1;
+		cur_line++;
+	}
+
+	return offset;
+}
+
+/* Must be called only when the index is built. */
+static gint64
+get_line_at_offset (GeditMappedFileViewer *viewer,
+		    gsize                  offset)
+{
+	guint low = 0;
+	guint high = viewer->index->len;
+	gsize pos;
+	gint64 line;
+
+	/* Find the last entry of the index that is before @offset. */
+	while (high - low > 1)
+	{
+		guint middle = (low + high) / 2;
+
+		if (g_array_index (viewer->index, guint64, middle) <= offset)
+		{
+			low = middle;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	line = (gint64) low * INDEX_STRIDE;
+	pos = g_array_index (viewer->index, guint64, low);
+
+	while (pos < offset)
+	{
+		const gchar *newline;
+
+		newline = memchr (viewer->contents + pos, '\n', offset - pos);
+
+		if (newline == NULL)
+		{
+			break;
+		}
+
+		pos = newline - viewer->contents + 1;
+		line++;
+	}
+
+	return line;
+}
+
+/* The file is shown as UTF-8, the invalid bytes (including the nul
+ * characters) are replaced by U+FFFD.
+ */
+static gchar *
+make_valid_text (const gchar *text,
+		 gsize        length,
+		 gsize       *valid_length)
+{
+	GString *string;
+	const gchar *end = text + length;
+
+	string = g_string_sized_new (length);
+
+	while (text < end)
+	{
+		const gchar *invalid;
+
+		if (g_utf8_validate (text, end - text, &invalid))
+		{
+			g_string_append_len (string, text, end - text);
+			break;
+		}
+
+		g_string_append_len (string, text, invalid - text);
+
+		/* U+FFFD REPLACEMENT CHARACTER */
+		g_string_append (string, "\357\277\275");
+
+		text = invalid + 1;
+	}
+
+	*valid_length = string->len;
+	return g_string_free (string, FALSE);
+}
+
+/* Each line: the offset, the bytes in hexadecimal, and the printable ASCII
+ * characters.
+ */
+static gchar *
+make_hex_text (const guchar *data,
+	       gsize         length,
+	       gsize         offset,
+	       gsize        *text_length)
+{
+	GString *string;
+	gsize line_start;
+
+	string = g_string_sized_new ((length / HEX_LINE_SIZE + 1) * 80);
+
+	for (line_start = 0; line_start < length; line_start += HEX_LINE_SIZE)
+	{
+		gsize line_len = MIN (HEX_LINE_SIZE, length - line_start);
+		gsize i;
+
+		g_string_append_printf (string, "%08" G_GSIZE_MODIFIER "x ", offset + line_start);
+
+		for (i = 0; i < HEX_LINE_SIZE; i++)
+		{
+			if (i == HEX_LINE_SIZE / 2)
+			{
+				g_string_append_c (string, ' ');
+			}
+
+			if (i < line_len)
+			{
+				g_string_append_printf (string, " %02x", data[line_start + i]);
+			}
+			else
+			{
+				g_string_append (string, "   ");
+			}
+		}
+
+		g_string_append (string, "  |");
+
+		for (i = 0; i < line_len; i++)
+		{
+			guchar c = data[line_start + i];
+
+			g_string_append_c (string, g_ascii_isprint (c) ? c : '.');
+		}
+
+		g_string_append (string, "|\n");
+	}
+
+	*text_length = string->len;
+	return g_string_free (string, FALSE);
+}
+
+static void
+load_window (GeditMappedFileViewer *viewer,
+	     gint64                 first_line)
+{
+	GtkTextBuffer *buffer;
+	gsize start;
+	gsize end;
+	gint64 n_lines = 0;
+	gchar *text;
+	gsize text_len;
+
+	start = get_line_offset (viewer, first_line);
+	end = start;
+
+	if (viewer->hex)
+	{
+		end = MIN (start + (gsize) WINDOW_N_LINES * HEX_LINE_SIZE, viewer->length);
+		n_lines = (end - start + HEX_LINE_SIZE - 1) / HEX_LINE_SIZE;
+	}
+
+	while (!viewer->hex &&
+	       n_lines < WINDOW_N_LINES &&
+	       end < viewer->length &&
+	       end - start < WINDOW_MAX_BYTES)
+	{
+		const gchar *newline;
+
+		newline = memchr (viewer->contents + end, '\n', viewer->length - end);
+		end = newline != NULL ? (gsize) (newline - viewer->contents + 1) : viewer->length;
+		n_lines++;
+	}
+
+	if (n_lines == 1 && end - start > WINDOW_MAX_BYTES)
+	{
+		end = start + WINDOW_MAX_BYTES;
+	}
+
+	gedit_debug_message (DEBUG_TAB,
+			     "Window at line %" G_GINT64_FORMAT ": %" G_GINT64_FORMAT " lines",
+			     first_line,
+			     n_lines);
+
+	if (viewer->hex)
+	{
+		text = make_hex_text ((const guchar *) viewer->contents + start,
+				      end - start,
+				      start,
+				      &text_len);
+	}
+	else
+	{
+		text = make_valid_text (viewer->contents + start, end - start, &text_len);
+	}
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (viewer->view));
+
+	g_signal_handler_block (viewer->vadjustment, viewer->value_changed_id);
+
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_text (buffer, text, text_len);
+	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (buffer));
+	gtk_text_buffer_set_modified (buffer, FALSE);
+
+	g_signal_handler_unblock (viewer->vadjustment, viewer->value_changed_id);
+
+	viewer->first_line = first_line;
+	viewer->n_window_lines = n_lines;
+
+	g_free (text);
+}
+
+static gboolean
+shift_done_cb (GeditMappedFileViewer *viewer)
+{
+	viewer->shifting = FALSE;
+	viewer->idle_shift_done = 0;
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The view is scrolled after the layout is validated, ignore the adjustment
+ * changes until then.
+ */
+static void
+block_shifts_until_idle (GeditMappedFileViewer *viewer)
+{
+	viewer->shifting = TRUE;
+
+	if (viewer->idle_shift_done == 0)
+	{
+		viewer->idle_shift_done = g_idle_add_full (G_PRIORITY_LOW,
+							   (GSourceFunc) shift_done_cb,
+							   viewer,
+							   NULL);
+	}
+}
+
+/* Loads the window so that @line is in its middle. */
+static void
+center_window_on_line (GeditMappedFileViewer *viewer,
+		       gint64                 line)
+{
+	gint64 first_line;
+
+	first_line = line - WINDOW_N_LINES / 2;
+	first_line = MIN (first_line, viewer->n_lines - WINDOW_N_LINES);
+	first_line = MAX (first_line, 0);
+
+	if (first_line != viewer->first_line)
+	{
+		load_window (viewer, first_line);
+	}
+}
+
+static void
+get_iter_at_line (GeditMappedFileViewer *viewer,
+		  GtkTextIter           *iter,
+		  gint64                 line)
+{
+	GtkTextBuffer *buffer;
+	gint64 window_line;
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (viewer->view));
+	window_line = CLAMP (line - viewer->first_line, 0, viewer->n_window_lines);
+
+	gtk_text_buffer_get_iter_at_line (buffer, iter, (gint) window_line);
+}
+
+static void
+vadjustment_value_changed_cb (GtkAdjustment         *adjustment,
+			      GeditMappedFileViewer *viewer)
+{
+	GtkTextBuffer *buffer;
+	gdouble value;
+	gdouble page_size;
+	gdouble upper;
+	GtkTextIter iter;
+	gint64 top_line;
+	gint64 old_first_line;
+
+	if ((viewer->index == NULL && !viewer->hex) || viewer->shifting)
+	{
+		return;
+	}
+
+	value = gtk_adjustment_get_value (adjustment);
+	page_size = gtk_adjustment_get_page_size (adjustment);
+	upper = gtk_adjustment_get_upper (adjustment);
+
+	if (!(value < page_size && viewer->first_line > 0) &&
+	    !(value + 2 * page_size > upper &&
+	      viewer->first_line + viewer->n_window_lines < viewer->n_lines))
+	{
+		return;
+	}
+
+	gtk_text_view_get_line_at_y (GTK_TEXT_VIEW (viewer->view), &iter, (gint) value, NULL);
+	top_line = viewer->first_line + gtk_text_iter_get_line (&iter);
+
+	old_first_line = viewer->first_line;
+	center_window_on_line (viewer, top_line);
+
+	if (viewer->first_line == old_first_line)
+	{
+		return;
+	}
+
+	/* Keep the same line at the top of the view. */
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (viewer->view));
+	get_iter_at_line (viewer, &iter, top_line);
+
+	gtk_text_buffer_place_cursor (buffer, &iter);
+	gtk_text_buffer_move_mark (buffer, viewer->scroll_mark, &iter);
+	gtk_text_view_scroll_to_mark (GTK_TEXT_VIEW (viewer->view),
+				      viewer->scroll_mark,
+				      0.0,
+				      TRUE,
+				      0.0,
+				      0.0);
+
+	block_shifts_until_idle (viewer);
+}
+
+static GeditMappedFileViewer *
+viewer_new (GeditView  *view,
+	    GFile      *location,
+	    gboolean    hex,
+	    GError    **error)
+{
+	GeditMappedFileViewer *viewer;
+	GMappedFile *mapped_file;
+	GtkTextBuffer *buffer;
+	GtkTextIter start;
+	gchar *path;
+	GTask *task;
+
+	g_return_val_if_fail (GEDIT_IS_VIEW (view), NULL);
+	g_return_val_if_fail (G_IS_FILE (location), NULL);
+	g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+	path = g_file_get_path (location);
+
+	if (path == NULL)
+	{
+		g_set_error_literal (error,
+				     G_IO_ERROR,
+				     G_IO_ERROR_NOT_SUPPORTED,
+				     "Only local files can be mapped in memory");
+		return NULL;
+	}
+
+	mapped_file = g_mapped_file_new (path, FALSE, error);
+	g_free (path);
+
+	if (mapped_file == NULL)
+	{
+		return NULL;
+	}
+
+	viewer = g_slice_new0 (GeditMappedFileViewer);
+	viewer->view = view;
+	viewer->mapped_file = mapped_file;
+	viewer->contents = g_mapped_file_get_contents (mapped_file);
+	viewer->length = g_mapped_file_get_length (mapped_file);
+	viewer->cancellable = g_cancellable_new ();
+	viewer->hex = hex != FALSE;
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (view));
+	gtk_text_buffer_get_start_iter (buffer, &start);
+	viewer->scroll_mark = gtk_text_buffer_create_mark (buffer, NULL, &start, TRUE);
+
+	viewer->vadjustment = g_object_ref (gtk_scrollable_get_vadjustment (GTK_SCROLLABLE (view)));
+	viewer->value_changed_id = g_signal_connect (viewer->vadjustment,
+						     "value-changed",
+						     G_CALLBACK (vadjustment_value_changed_cb),
+						     viewer);
+
+	/* The first window can be shown without the index. */
+	load_window (viewer, 0);
+
+	gtk_text_buffer_get_start_iter (buffer, &start);
+	gtk_text_buffer_place_cursor (buffer, &start);
+
+	if (hex)
+	{
+		viewer->n_lines = MAX ((viewer->length + HEX_LINE_SIZE - 1) / HEX_LINE_SIZE, 1);
+		return viewer;
+	}
+
+	viewer->index_timer = g_timer_new ();
+
+	task = g_task_new (NULL,
+			   viewer->cancellable,
+			   (GAsyncReadyCallback) build_index_cb,
+			   viewer);
+
+	g_task_set_task_data (task,
+			      g_mapped_file_ref (mapped_file),
+			      (GDestroyNotify) g_mapped_file_unref);
+
+	g_task_run_in_thread (task, (GTaskThreadFunc) build_index_thread);
+	g_object_unref (task);
+
+	return viewer;
+}
+
+GeditMappedFileViewer *
+gedit_mapped_file_viewer_new (GeditView  *view,
+			      GFile      *location,
+			      GError    **error)
+{
+	return viewer_new (view, location, FALSE, error);
+}
+
+/* A read-only hexadecimal dump of the file, for a binary file. */
+GeditMappedFileViewer *
+gedit_mapped_file_viewer_new_hex (GeditView  *view,
+				  GFile      *location,
+				  GError    **error)
+{
+	return viewer_new (view, location, TRUE, error);
+}
+
+void
+gedit_mapped_file_viewer_free (GeditMappedFileViewer *viewer)
+{
+	GtkTextBuffer *buffer;
+
+	if (viewer == NULL)
+	{
+		return;
+	}
+
+	g_cancellable_cancel (viewer->cancellable);
+	g_object_unref (viewer->cancellable);
+
+	if (viewer->search_cancellable != NULL)
+	{
+		g_cancellable_cancel (viewer->search_cancellable);
+		g_object_unref (viewer->search_cancellable);
+	}
+
+	if (viewer->idle_shift_done != 0)
+	{
+		g_source_remove (viewer->idle_shift_done);
+	}
+
+	g_signal_handler_disconnect (viewer->vadjustment, viewer->value_changed_id);
+	g_object_unref (viewer->vadjustment);
+
+	buffer = gtk_text_mark_get_buffer (viewer->scroll_mark);
+
+	if (buffer != NULL)
+	{
+		gtk_text_buffer_delete_mark (buffer, viewer->scroll_mark);
+	}
+
+	if (viewer->index != NULL)
+	{
+		g_array_unref (viewer->index);
+	}
+
+	if (viewer->index_timer != NULL)
+	{
+		g_timer_destroy (viewer->index_timer);
+	}
+
+	/* The worker threads keep their own reference. */
+	g_mapped_file_unref (viewer->mapped_file);
+
+	g_slice_free (GeditMappedFileViewer, viewer);
+}
+
+/* Going to a line outside of the window and searching need the line index.
+ * Until it is built, only the first window is available. In hex mode the
+ * search is done in the buffer, so the viewer is never ready for it.
+ */
+gboolean
+gedit_mapped_file_viewer_is_ready (GeditMappedFileViewer *viewer)
+{
+	g_return_val_if_fail (viewer != NULL, FALSE);
+
+	return viewer->index != NULL;
+}
+
+/* Returns the line in the file of @iter, which is in the buffer. */
+gint64
+gedit_mapped_file_viewer_get_line (GeditMappedFileViewer *viewer,
+				   const GtkTextIter     *iter)
+{
+	g_return_val_if_fail (viewer != NULL, 0);
+	g_return_val_if_fail (iter != NULL, 0);
+
+	return viewer->first_line + gtk_text_iter_get_line (iter);
+}
+
+gboolean
+gedit_mapped_file_viewer_goto_line_offset (GeditMappedFileViewer *viewer,
+					   gint64                 line,
+					   gint                   line_offset)
+{
+	GtkTextBuffer *buffer;
+	GtkTextIter iter;
+	gboolean ret = TRUE;
+
+	g_return_val_if_fail (viewer != NULL, FALSE);
+	g_return_val_if_fail (line >= 0, FALSE);
+
+	if (line < viewer->first_line ||
+	    line >= viewer->first_line + viewer->n_window_lines)
+	{
+		if (viewer->index == NULL && !viewer->hex)
+		{
+			return FALSE;
+		}
+
+		if (line >= viewer->n_lines)
+		{
+			line = viewer->n_lines - 1;
+			ret = FALSE;
+		}
+
+		center_window_on_line (viewer, line);
+	}
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (viewer->view));
+	get_iter_at_line (viewer, &iter, line);
+
+	if (line_offset > 0)
+	{
+		GtkTextIter line_end = iter;
+
+		if (!gtk_text_iter_ends_line (&line_end))
+		{
+			gtk_text_iter_forward_to_line_end (&line_end);
+		}
+
+		if (line_offset <= gtk_text_iter_get_line_offset (&line_end))
+		{
+			gtk_text_iter_set_line_offset (&iter, line_offset);
+		}
+		else
+		{
+			iter = line_end;
+			ret = FALSE;
+		}
+	}
+
+	gtk_text_buffer_place_cursor (buffer, &iter);
+	block_shifts_until_idle (viewer);
+
+	return ret;
+}
+
+static gboolean
+matches_at (const gchar *str,
+	    const gchar *text,
+	    gsize        text_len,
+	    gboolean     case_sensitive)
+{
+	if (case_sensitive)
+	{
+		return memcmp (str, text, text_len) == 0;
+	}
+
+	/* Only the ASCII characters are case folded. */
+	return g_ascii_strncasecmp (str, text, text_len) == 0;
+}
+
+/* Returns the offset of the first match (or the last one if @backward) that
+ * is entirely in [start, end), or -1.
+ */
+static gssize
+find_in_range (const gchar *contents,
+	       gsize        start,
+	       gsize        end,
+	       const gchar *text,
+	       gsize        text_len,
+	       gboolean     case_sensitive,
+	       gboolean     backward)
+{
+	gsize pos;
+
+	if (end < start + text_len)
+	{
+		return -1;
+	}
+
+	if (!backward)
+	{
+		for (pos = start; pos + text_len <= end; pos++)
+		{
+			if (case_sensitive)
+			{
+				const gchar *found;
+
+				found = memchr (contents + pos, text[0], end - text_len + 1 - pos);
+
+				if (found == NULL)
+				{
+					return -1;
+				}
+
+				pos = found - contents;
+			}
+
+			if (matches_at (contents + pos, text, text_len, case_sensitive))
+			{
+				return pos;
+			}
+		}
+
+		return -1;
+	}
+
+	pos = end - text_len + 1;
+
+	while (pos > start)
+	{
+		pos--;
+
+		if (matches_at (contents + pos, text, text_len, case_sensitive))
+		{
+			return pos;
+		}
+	}
+
+	return -1;
+}
+
+static gssize
+search_forward (GTask      *task,
+		SearchData *data,
+		gsize       from,
+		gsize       to)
+{
+	const gchar *contents = g_mapped_file_get_contents (data->mapped_file);
+	gsize chunk_start = from;
+
+	while (chunk_start < to)
+	{
+		gsize chunk_end;
+		gssize match;
+
+		chunk_end = MIN (to, chunk_start + SEARCH_CHUNK_SIZE + data->text_len - 1);
+
+		match = find_in_range (contents,
+				       chunk_start,
+				       chunk_end,
+				       data->text,
+				       data->text_len,
+				       data->case_sensitive,
+				       FALSE);
+
+		if (match >= 0 || g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+		{
+			return match;
+		}
+
+		chunk_start += SEARCH_CHUNK_SIZE;
+	}
+
+	return -1;
+}
+
+static gssize
+search_backward (GTask      *task,
+		 SearchData *data,
+		 gsize       from,
+		 gsize       to)
+{
+	const gchar *contents = g_mapped_file_get_contents (data->mapped_file);
+	gsize chunk_end = to;
+
+	while (chunk_end > from)
+	{
+		gsize chunk_start;
+		gssize match;
+
+		chunk_start = chunk_end - from > SEARCH_CHUNK_SIZE ? chunk_end - SEARCH_CHUNK_SIZE : from;
+
+		match = find_in_range (contents,
+				       chunk_start,
+				       MIN (to, chunk_end + data->text_len - 1),
+				       data->text,
+				       data->text_len,
+				       data->case_sensitive,
+				       TRUE);
+
+		if (match >= 0 || g_cancellable_is_cancelled (g_task_get_cancellable (task)))
+		{
+			return match;
+		}
+
+		chunk_end = chunk_start;
+	}
+
+	return -1;
+}
+
+static void
+search_thread (GTask        *task,
+	       gpointer      source_object,
+	       SearchData   *data,
+	       GCancellable *cancellable)
+{
+	gsize length = g_mapped_file_get_length (data->mapped_file);
+	gsize from = MIN (data->from, length);
+	gssize match = -1;
+
+	if (length > 0)
+	{
+		/* Wrap around like GtkSourceSearchContext. */
+		if (!data->backward)
+		{
+			match = search_forward (task, data, from, length);
+
+			if (match < 0)
+			{
+				match = search_forward (task, data, 0, MIN (length, from + data->text_len - 1));
+			}
+		}
+		else
+		{
+			match = search_backward (task, data, 0, from);
+
+			if (match < 0)
+			{
+				match = search_backward (task, data, from, length);
+			}
+		}
+	}
+
+	if (!g_task_return_error_if_cancelled (task))
+	{
+		g_task_return_int (task, match);
+	}
+}
+
+static gsize
+get_offset_at_iter (GeditMappedFileViewer *viewer,
+		    const GtkTextIter     *iter)
+{
+	gsize line_start;
+	gsize offset;
+
+	line_start = get_line_offset (viewer, gedit_mapped_file_viewer_get_line (viewer, iter));
+	offset = line_start + gtk_text_iter_get_line_index (iter);
+
+	return MIN (offset, viewer->length);
+}
+
+/* The byte offsets in the file and in the buffer differ when there are
+ * invalid characters, so convert the match to characters.
+ */
+static void
+select_match (GeditMappedFileViewer *viewer,
+	      gsize                  match,
+	      gsize                  match_len)
+{
+	GtkTextBuffer *buffer;
+	GtkTextIter match_start;
+	GtkTextIter match_end;
+	gint64 line;
+	gsize line_start;
+	gchar *prefix;
+	gsize prefix_len;
+	gchar *matched;
+	gsize matched_len;
+	glong offset;
+	glong n_chars;
+
+	line = get_line_at_offset (viewer, match);
+
+	if (line < viewer->first_line ||
+	    line >= viewer->first_line + viewer->n_window_lines)
+	{
+		center_window_on_line (viewer, line);
+	}
+
+	line_start = get_line_offset (viewer, line);
+
+	prefix = make_valid_text (viewer->contents + line_start, match - line_start, &prefix_len);
+	matched = make_valid_text (viewer->contents + match, match_len, &matched_len);
+	offset = g_utf8_strlen (prefix, prefix_len);
+	n_chars = g_utf8_strlen (matched, matched_len);
+	g_free (prefix);
+	g_free (matched);
+
+	buffer = gtk_text_view_get_buffer (GTK_TEXT_VIEW (viewer->view));
+	get_iter_at_line (viewer, &match_start, line);
+
+	if (!gtk_text_iter_ends_line (&match_start))
+	{
+		GtkTextIter line_end = match_start;
+
+		gtk_text_iter_forward_to_line_end (&line_end);
+		offset = MIN (offset, gtk_text_iter_get_line_offset (&line_end));
+		gtk_text_iter_set_line_offset (&match_start, offset);
+	}
+
+	match_end = match_start;
+	gtk_text_iter_forward_chars (&match_end, n_chars);
+
+	gtk_text_buffer_select_range (buffer, &match_start, &match_end);
+	block_shifts_until_idle (viewer);
+}
+
+static void
+search_thread_cb (GObject      *source_object,
+		  GAsyncResult *result,
+		  GTask        *task)
+{
+	GeditMappedFileViewer *viewer;
+	SearchData *data;
+	GError *error = NULL;
+	gssize match;
+
+	match = g_task_propagate_int (G_TASK (result), &error);
+
+	/* If cancelled, the viewer may have been freed. */
+	if (error != NULL)
+	{
+		g_task_return_error (task, error);
+		g_object_unref (task);
+		return;
+	}
+
+	if (match < 0)
+	{
+		g_task_return_boolean (task, FALSE);
+		g_object_unref (task);
+		return;
+	}
+
+	viewer = g_task_get_task_data (task);
+	data = g_task_get_task_data (G_TASK (result));
+
+	select_match (viewer, match, data->text_len);
+
+	g_task_return_boolean (task, TRUE);
+	g_object_unref (task);
+}
+
+/* Searches @search_text in the whole file, from @from, and selects the match
+ * if any. A new search cancels the previous one. Regular expressions are not
+ * supported.
+ */
+void
+gedit_mapped_file_viewer_search_async (GeditMappedFileViewer *viewer,
+				       const gchar           *search_text,
+				       gboolean               case_sensitive,
+				       gboolean               backward,
+				       const GtkTextIter     *from,
+				       GAsyncReadyCallback    callback,
+				       gpointer               user_data)
+{
+	GTask *task;
+	GTask *search_task;
+	SearchData *data;
+
+	g_return_if_fail (viewer != NULL);
+	g_return_if_fail (viewer->index != NULL);
+	g_return_if_fail (search_text != NULL);
+	g_return_if_fail (from != NULL);
+
+	if (viewer->search_cancellable != NULL)
+	{
+		g_cancellable_cancel (viewer->search_cancellable);
+		g_object_unref (viewer->search_cancellable);
+	}
+
+	viewer->search_cancellable = g_cancellable_new ();
+
+	task = g_task_new (NULL, viewer->search_cancellable, callback, user_data);
+	g_task_set_task_data (task, viewer, NULL);
+
+	if (search_text[0] == '\0')
+	{
+		g_task_return_boolean (task, FALSE);
+		g_object_unref (task);
+		return;
+	}
+
+	data = g_slice_new0 (SearchData);
+	data->mapped_file = g_mapped_file_ref (viewer->mapped_file);
+	data->text = g_strdup (search_text);
+	data->text_len = strlen (search_text);
+	data->from = get_offset_at_iter (viewer, from);
+	data->case_sensitive = case_sensitive != FALSE;
+	data->backward = backward != FALSE;
+
+	search_task = g_task_new (NULL,
+				  viewer->search_cancellable,
+				  (GAsyncReadyCallback) search_thread_cb,
+				  task);
+
+	g_task_set_task_data (search_task, data, (GDestroyNotify) search_data_free);
+	g_task_run_in_thread (search_task, (GTaskThreadFunc) search_thread);
+	g_object_unref (search_task);
+}
+
+/* Returns whether a match has been found and selected. */
+gboolean
+gedit_mapped_file_viewer_search_finish (GAsyncResult  *result,
+					GError       **error)
+{
+	g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+	return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+/* ex:set ts=8 noet: */
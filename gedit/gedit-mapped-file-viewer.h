@@ -0,0 +1,65 @@
+/*
+ * gedit-mapped-file-viewer.h
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEDIT_MAPPED_FILE_VIEWER_H__
+#define __GEDIT_MAPPED_FILE_VIEWER_H__
+
+#include <gtk/gtk.h>
+#include "gedit-view.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GeditMappedFileViewer GeditMappedFileViewer;
+
+GeditMappedFileViewer	*gedit_mapped_file_viewer_new			(GeditView              *view,
+									 GFile                  *location,
+									 GError                **error);
+
+GeditMappedFileViewer	*gedit_mapped_file_viewer_new_hex		(GeditView              *view,
+									 GFile                  *location,
+									 GError                **error);
+
+void			 gedit_mapped_file_viewer_free			(GeditMappedFileViewer  *viewer);
+
+gboolean		 gedit_mapped_file_viewer_is_ready		(GeditMappedFileViewer  *viewer);
+
+gint64			 gedit_mapped_file_viewer_get_line		(GeditMappedFileViewer  *viewer,
+									 const GtkTextIter      *iter);
+
+gboolean		 gedit_mapped_file_viewer_goto_line_offset	(GeditMappedFileViewer  *viewer,
+									 gint64                  line,
+									 gint                    line_offset);
+
+void			 gedit_mapped_file_viewer_search_async		(GeditMappedFileViewer  *viewer,
+									 const gchar            *search_text,
+									 gboolean                case_sensitive,
+									 gboolean                backward,
+									 const GtkTextIter      *from,
+									 GAsyncReadyCallback     callback,
+									 gpointer                user_data);
+
+gboolean		 gedit_mapped_file_viewer_search_finish		(GAsyncResult           *result,
+									 GError                **error);
+
+G_END_DECLS
+
+#endif /* __GEDIT_MAPPED_FILE_VIEWER_H__ */
+
+/* ex:set ts=8 noet: */
@@ -19,15 +19,54 @@
  * along with this program; if not, see <http://www.gnu.org/licenses/>.
  */
 
+/* The metadata is kept in a log: each change appends a record to the file
+ * instead of rewriting all the items. When the log has many more records than
+ * live values, it is compacted, i.e. rewritten with only the live values. The
+ * writes are done in a thread, one after the other.
+ *
+ * Format, the fields are separated by tabs and escaped like C strings:
+ *   gedit-metadata 1\n
+ *   s <atime> <uri> <key> <value>\n	sets a value
+ *   u <atime> <uri> <key>\n		unsets a value
+ *   t <atime> <uri>\n			updates the access time of an item
+ *   d <atime> <uri>\n			deletes an item
+ *
+ * A record is only taken into account when it ends with a newline, so a log
+ * truncated by a crash can still be replayed; it is then compacted. The old
+ * XML file is imported when there is no log yet.
+ *
+ * Several gedit processes can share the log. Each write is done with an
+ * advisory lock held on "<log>.lock", and the records written by the other
+ * processes since the last write are read at the same time, kept in the log
+ * and merged in memory. A record older than the access time of its item is
+ * ignored, so when two processes change the same file, the last one wins.
+ */
+
 #include "gedit-metadata-manager.h"
+#include <string.h>
 #include <libxml/xmlreader.h>
 #include "gedit-debug.h"
 
+#ifdef G_OS_UNIX
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib/gstdio.h>
+#endif
+
 /*
 #define GEDIT_METADATA_VERBOSE_DEBUG	1
 */
 
-#define MAX_ITEMS 50
+#define LOG_HEADER "gedit-metadata 1\n"
+#define LOG_HEADER_LENGTH (sizeof (LOG_HEADER) - 1)
+#define LEGACY_METADATA_FILENAME "gedit-metadata.xml"
+
+/* The log is compacted when it has more than COMPACTION_RATIO times as many
+ * records as live values, and more than COMPACTION_MIN_RECORDS records.
+ */
+#define COMPACTION_RATIO 4
+#define COMPACTION_MIN_RECORDS 256
 
 typedef struct _GeditMetadataManager GeditMetadataManager;
 
@@ -35,10 +74,16 @@ typedef struct _Item Item;
 
 struct _Item
 {
+	/* Also the key in the items hash table. */
+	gchar		*uri;
+
 	/* Time of last access in seconds since January 1, 1970 UTC. */
 	gint64	 	 atime;
 
 	GHashTable	*values;
+
+	/* Link in the LRU queue, its data is the item. */
+	GList		 lru_link;
 };
 
 struct _GeditMetadataManager
@@ -46,59 +91,938 @@ struct _GeditMetadataManager
 	/* It is true if the file has been read. */
 	gboolean	 values_loaded;
 
-	guint 		 timeout_id;
+	/* The thread reading the file, see gedit_metadata_manager_preload().
+	 * The other fields must not be used before it is joined.
+	 */
+	GThread		*load_thread;
+
+	guint 		 timeout_id;
+
+	GHashTable	*items;
+
+	/* The items, the most recently used first. */
+	GQueue		 lru;
+
+	/* The least recently used items are removed above that. */
+	guint		 max_items;
+
+	gchar		*metadata_filename;
+	GFile		*log_file;
+
+	/* Records not written yet. */
+	GString		*pending_records;
+	guint		 n_pending_records;
+
+	/* URIs of the items accessed by gedit_metadata_manager_get() since
+	 * the last write. Their access time is written with the next records.
+	 */
+	GHashTable	*accessed_items;
+
+	/* Number of records in the log file, once the pending operations are
+	 * done.
+	 */
+	guint		 n_log_records;
+
+	/* When the log doesn't exist or is damaged. */
+	guint		 needs_compaction : 1;
+};
+
+typedef enum
+{
+	OPERATION_REPLACE,
+	OPERATION_APPEND
+} OperationType;
+
+typedef struct
+{
+	OperationType type;
+	GFile *file;
+	GBytes *data;
+} Operation;
+
+static gboolean gedit_metadata_manager_save (gpointer data);
+static void ensure_values_loaded (void);
+
+static GeditMetadataManager *gedit_metadata_manager = NULL;
+
+/* The writes to the log are done in a thread, one after the other, so that
+ * the order of the records is kept. operation_running is unset by the thread,
+ * under the lock, so that the shutdown can wait for it.
+ */
+static GQueue operations = G_QUEUE_INIT;
+static gboolean operation_running = FALSE;
+static GMutex operation_lock;
+static GCond operation_cond;
+
+/* The identifier of the log file and the end of the last record known by
+ * this process. Only used by the load and by the operations, which run
+ * after it.
+ */
+static gchar *log_id = NULL;
+static gsize log_offset = 0;
+
+static void
+item_free (gpointer data)
+{
+	Item *item;
+
+	g_return_if_fail (data != NULL);
+
+#ifdef GEDIT_METADATA_VERBOSE_DEBUG
+	gedit_debug (DEBUG_METADATA);
+#endif
+
+	item = (Item *)data;
+
+	g_queue_unlink (&gedit_metadata_manager->lru, &item->lru_link);
+
+	if (item->values != NULL)
+		g_hash_table_destroy (item->values);
+
+	g_free (item->uri);
+	g_free (item);
+}
+
+/* Sets the access time of @item and makes it the most recently used. */
+static void
+item_touch (Item   *item,
+	    gint64  atime)
+{
+	item->atime = atime;
+
+	g_queue_unlink (&gedit_metadata_manager->lru, &item->lru_link);
+	g_queue_push_head_link (&gedit_metadata_manager->lru, &item->lru_link);
+}
+
+static Item *
+get_or_create_item (const gchar *uri)
+{
+	Item *item;
+
+	item = (Item *)g_hash_table_lookup (gedit_metadata_manager->items,
+					    uri);
+
+	if (item == NULL)
+	{
+		item = g_new0 (Item, 1);
+		item->uri = g_strdup (uri);
+		item->lru_link.data = item;
+
+		g_queue_push_head_link (&gedit_metadata_manager->lru, &item->lru_link);
+
+		g_hash_table_insert (gedit_metadata_manager->items,
+				     item->uri,
+				     item);
+	}
+
+	if (item->values == NULL)
+	{
+		 item->values = g_hash_table_new_full (g_str_hash,
+				 		       g_str_equal,
+						       g_free,
+						       g_free);
+	}
+
+	return item;
+}
+
+static void
+item_set_value (Item        *item,
+		const gchar *key,
+		const gchar *value)
+{
+	if (value != NULL)
+	{
+		g_hash_table_insert (item->values,
+				     g_strdup (key),
+				     g_strdup (value));
+	}
+	else
+	{
+		g_hash_table_remove (item->values,
+				     key);
+	}
+}
+
+static void
+gedit_metadata_manager_arm_timeout (void)
+{
+	if (gedit_metadata_manager->timeout_id == 0)
+	{
+		gedit_metadata_manager->timeout_id =
+			g_timeout_add_seconds_full (G_PRIORITY_DEFAULT_IDLE,
+						    2,
+						    (GSourceFunc)gedit_metadata_manager_save,
+						    NULL,
+						    NULL);
+	}
+}
+
+static void
+operation_free (Operation *op)
+{
+	g_object_unref (op->file);
+	g_bytes_unref (op->data);
+	g_slice_free (Operation, op);
+}
+
+/* Returns the file descriptor holding the lock, or -1. The lock is released
+ * by unlock_log().
+ */
+static gint
+lock_log (GFile *file)
+{
+#ifdef G_OS_UNIX
+	gchar *path;
+	gchar *lock_filename;
+	struct flock lock;
+	gint fd;
+
+	path = g_file_get_path (file);
+	lock_filename = g_strconcat (path, ".lock", NULL);
+	fd = g_open (lock_filename, O_RDWR | O_CREAT, 0600);
+	g_free (lock_filename);
+	g_free (path);
+
+	if (fd == -1)
+	{
+		return -1;
+	}
+
+	memset (&lock, 0, sizeof (lock));
+	lock.l_type = F_WRLCK;
+	lock.l_whence = SEEK_SET;
+
+	while (fcntl (fd, F_SETLKW, &lock) == -1)
+	{
+		if (errno != EINTR)
+		{
+			close (fd);
+			return -1;
+		}
+	}
+
+	return fd;
+#else
+	return -1;
+#endif
+}
+
+static void
+unlock_log (gint fd)
+{
+#ifdef G_OS_UNIX
+	/* Closing the file releases the lock. */
+	if (fd != -1)
+	{
+		close (fd);
+	}
+#endif
+}
+
+static gchar *
+query_log_id (GFile *file)
+{
+	GFileInfo *info;
+	gchar *id;
+
+	info = g_file_query_info (file,
+				  G_FILE_ATTRIBUTE_ID_FILE,
+				  G_FILE_QUERY_INFO_NONE,
+				  NULL,
+				  NULL);
+
+	if (info == NULL)
+	{
+		return NULL;
+	}
+
+	id = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE));
+	g_object_unref (info);
+
+	return id;
+}
+
+static gboolean
+is_log (const gchar *contents,
+	gsize        length)
+{
+	return (length >= LOG_HEADER_LENGTH &&
+		strncmp (contents, LOG_HEADER, LOG_HEADER_LENGTH) == 0);
+}
+
+/* Returns the offset of the end of the last complete record. */
+static gsize
+get_records_end (const gchar *contents,
+		 gsize        length)
+{
+	gsize end = length;
+
+	while (end > LOG_HEADER_LENGTH && contents[end - 1] != '\n')
+	{
+		end--;
+	}
+
+	return end;
+}
+
+/* Called with the lock held. Returns the records written by the other
+ * processes since @log_offset, or NULL. Only the end of the log is read, from
+ * @log_offset, unless the log has been replaced by another process: all its
+ * records are new then.
+ *
+ * @log_length is set to the size of the log, 0 if it doesn't exist or is not
+ * a log, and @records_end to the end of its last complete record.
+ */
+static GBytes *
+read_foreign_records (GFile *file,
+		      gsize *log_length,
+		      gsize *records_end)
+{
+	GFileInputStream *stream;
+	GFileInfo *info;
+	goffset size = 0;
+	gchar *id = NULL;
+	gsize start;
+	gsize records_start;
+	gsize n_read = 0;
+	gchar *buffer;
+	gsize end;
+	GBytes *foreign_records = NULL;
+
+	*log_length = 0;
+	*records_end = 0;
+
+	stream = g_file_read (file, NULL, NULL);
+
+	if (stream == NULL)
+	{
+		return NULL;
+	}
+
+	/* Done on the open file, like fstat(). */
+	info = g_file_input_stream_query_info (stream,
+					       G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+					       G_FILE_ATTRIBUTE_ID_FILE,
+					       NULL,
+					       NULL);
+
+	if (info != NULL)
+	{
+		size = g_file_info_get_size (info);
+		id = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE));
+		g_object_unref (info);
+	}
+
+	if (g_strcmp0 (id, log_id) == 0 &&
+	    log_offset >= LOG_HEADER_LENGTH &&
+	    (goffset) log_offset <= size)
+	{
+		start = log_offset;
+	}
+	else
+	{
+		start = 0;
+	}
+
+	g_free (id);
+
+	if (start > 0)
+	{
+		buffer = g_malloc (size - start);
+
+		if (!g_seekable_seek (G_SEEKABLE (stream), start, G_SEEK_SET, NULL, NULL) ||
+		    !g_input_stream_read_all (G_INPUT_STREAM (stream),
+					      buffer,
+					      size - start,
+					      &n_read,
+					      NULL,
+					      NULL))
+		{
+			n_read = 0;
+		}
+
+		g_object_unref (stream);
+	}
+	else
+	{
+		g_object_unref (stream);
+
+		if (!g_file_load_contents (file, NULL, &buffer, &n_read, NULL, NULL))
+		{
+			buffer = NULL;
+			n_read = 0;
+		}
+	}
+
+	if (start == 0)
+	{
+		if (!is_log (buffer, n_read))
+		{
+			g_free (buffer);
+			return NULL;
+		}
+
+		records_start = LOG_HEADER_LENGTH;
+	}
+	else
+	{
+		records_start = 0;
+	}
+
+	end = n_read;
+
+	while (end > records_start && buffer[end - 1] != '\n')
+	{
+		end--;
+	}
+
+	*log_length = start + n_read;
+	*records_end = start + end;
+
+	if (end > records_start)
+	{
+		foreign_records = g_bytes_new (buffer + records_start, end - records_start);
+	}
+
+	g_free (buffer);
+
+	return foreign_records;
+}
+
+/* Returns the records written by the other processes since the last
+ * operation, or NULL.
+ */
+static GBytes *
+run_operation (Operation *op)
+{
+	GFile *cache_dir;
+	gint lock_fd;
+	gsize length;
+	gsize records_end;
+	gsize new_length;
+	GBytes *foreign_records;
+	GError *error = NULL;
+
+	/* make sure the cache dir exists */
+	cache_dir = g_file_get_parent (op->file);
+	g_file_make_directory_with_parents (cache_dir, NULL, NULL);
+	g_object_unref (cache_dir);
+
+	/* The lock is only held while the log is read and written. */
+	lock_fd = lock_log (op->file);
+
+	foreign_records = read_foreign_records (op->file, &length, &records_end);
+
+	if (op->type == OPERATION_APPEND &&
+	    length > 0 &&
+	    records_end == length)
+	{
+		GFileOutputStream *stream;
+
+		stream = g_file_append_to (op->file,
+					   G_FILE_CREATE_NONE,
+					   NULL,
+					   &error);
+
+		if (stream != NULL)
+		{
+			g_output_stream_write_all (G_OUTPUT_STREAM (stream),
+						   g_bytes_get_data (op->data, NULL),
+						   g_bytes_get_size (op->data),
+						   NULL,
+						   NULL,
+						   &error);
+
+			g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, NULL);
+			g_object_unref (stream);
+		}
+
+		new_length = length + g_bytes_get_size (op->data);
+	}
+	else
+	{
+		GString *new_contents;
+
+		switch (op->type)
+		{
+			case OPERATION_REPLACE:
+				/* The records of the other processes are
+				 * not in the compacted log, keep them.
+				 */
+				new_contents = g_string_new_len (g_bytes_get_data (op->data, NULL),
+								 g_bytes_get_size (op->data));
+
+				if (foreign_records != NULL)
+				{
+					g_string_append_len (new_contents,
+							     g_bytes_get_data (foreign_records, NULL),
+							     g_bytes_get_size (foreign_records));
+				}
+				break;
+
+			case OPERATION_APPEND:
+			{
+				gchar *contents;
+
+				/* Without the truncated record at the end, left
+				 * by a crash, or a new log. The only case where
+				 * the whole log is read.
+				 */
+				if (length > 0 &&
+				    g_file_load_contents (op->file, NULL, &contents, &length, NULL, NULL))
+				{
+					new_contents = g_string_new_len (contents,
+									 MIN (records_end, length));
+					g_free (contents);
+				}
+				else
+				{
+					new_contents = g_string_new (LOG_HEADER);
+				}
+
+				g_string_append_len (new_contents,
+						     g_bytes_get_data (op->data, NULL),
+						     g_bytes_get_size (op->data));
+				break;
+			}
+
+			default:
+				g_assert_not_reached ();
+		}
+
+		g_file_replace_contents (op->file,
+					 new_contents->str,
+					 new_contents->len,
+					 NULL,
+					 FALSE,
+					 G_FILE_CREATE_NONE,
+					 NULL,
+					 NULL,
+					 &error);
+
+		new_length = new_contents->len;
+		g_string_free (new_contents, TRUE);
+	}
+
+	g_free (log_id);
+	log_id = query_log_id (op->file);
+	log_offset = new_length;
+
+	unlock_log (lock_fd);
+
+	if (error != NULL)
+	{
+		g_warning ("Cannot write the metadata file: %s", error->message);
+		g_error_free (error);
+	}
+
+	return foreign_records;
+}
+
+static void
+operation_thread (GTask        *task,
+		  gpointer      source_object,
+		  Operation    *op,
+		  GCancellable *cancellable)
+{
+	GBytes *foreign_records;
+
+	foreign_records = run_operation (op);
+
+	g_mutex_lock (&operation_lock);
+	operation_running = FALSE;
+	g_cond_signal (&operation_cond);
+	g_mutex_unlock (&operation_lock);
+
+	g_task_return_pointer (task,
+			       foreign_records,
+			       (GDestroyNotify) g_bytes_unref);
+}
+
+static void merge_foreign_records (GBytes *records);
+
+static void process_next_operation (void);
+
+static void
+operation_done_cb (GObject      *source_object,
+		   GAsyncResult *result,
+		   gpointer      user_data)
+{
+	GBytes *foreign_records;
+
+	foreign_records = g_task_propagate_pointer (G_TASK (result), NULL);
+
+	if (foreign_records != NULL)
+	{
+		if (gedit_metadata_manager != NULL)
+		{
+			merge_foreign_records (foreign_records);
+		}
+
+		g_bytes_unref (foreign_records);
+	}
+
+	process_next_operation ();
+}
+
+static void
+process_next_operation (void)
+{
+	Operation *op;
+	GTask *task;
+
+	g_mutex_lock (&operation_lock);
+
+	if (operation_running || g_queue_is_empty (&operations))
+	{
+		g_mutex_unlock (&operation_lock);
+		return;
+	}
+
+	operation_running = TRUE;
+	g_mutex_unlock (&operation_lock);
+
+	op = g_queue_pop_head (&operations);
+
+	task = g_task_new (NULL, NULL, operation_done_cb, NULL);
+	g_task_set_task_data (task, op, (GDestroyNotify) operation_free);
+	g_task_run_in_thread (task, (GTaskThreadFunc) operation_thread);
+	g_object_unref (task);
+}
+
+/* Takes the ownership of @data. */
+static void
+push_operation (OperationType  type,
+		GBytes        *data)
+{
+	Operation *op;
+
+	op = g_slice_new0 (Operation);
+	op->type = type;
+	op->file = g_object_ref (gedit_metadata_manager->log_file);
+	op->data = data;
+
+	g_queue_push_tail (&operations, op);
+	process_next_operation ();
+}
+
+static void
+append_field (GString     *record,
+	      const gchar *field)
+{
+	const gchar *p;
+
+	g_string_append_c (record, '\t');
+
+	for (p = field; *p != '\0'; p++)
+	{
+		switch (*p)
+		{
+			case '\\':
+				g_string_append (record, "\\\\");
+				break;
+			case '\t':
+				g_string_append (record, "\\t");
+				break;
+			case '\n':
+				g_string_append (record, "\\n");
+				break;
+			case '\r':
+				g_string_append (record, "\\r");
+				break;
+			default:
+				g_string_append_c (record, *p);
+				break;
+		}
+	}
+}
+
+static void
+append_record (GString     *log,
+	       gchar        type,
+	       gint64       atime,
+	       const gchar *uri,
+	       const gchar *key,
+	       const gchar *value)
+{
+	g_string_append_c (log, type);
+	g_string_append_printf (log, "\t%" G_GINT64_FORMAT, atime);
+
+	append_field (log, uri);
+
+	if (key != NULL)
+	{
+		append_field (log, key);
+	}
+
+	if (value != NULL)
+	{
+		append_field (log, value);
+	}
+
+	g_string_append_c (log, '\n');
+}
+
+static void
+add_pending_record (gchar        type,
+		    gint64       atime,
+		    const gchar *uri,
+		    const gchar *key,
+		    const gchar *value)
+{
+	append_record (gedit_metadata_manager->pending_records,
+		       type,
+		       atime,
+		       uri,
+		       key,
+		       value);
+
+	gedit_metadata_manager->n_pending_records++;
+}
+
+static gboolean
+replay_record (gchar **fields)
+{
+	guint n_fields = g_strv_length (fields);
+	guint expected_n_fields;
+	gint64 atime;
+	gchar *end;
+	Item *item;
+	guint i;
+
+	if (n_fields == 0 || strlen (fields[0]) != 1)
+	{
+		return FALSE;
+	}
+
+	switch (fields[0][0])
+	{
+		case 's':
+			expected_n_fields = 5;
+			break;
+		case 'u':
+			expected_n_fields = 4;
+			break;
+		case 't':
+		case 'd':
+			expected_n_fields = 3;
+			break;
+		default:
+			return FALSE;
+	}
+
+	if (n_fields != expected_n_fields)
+	{
+		return FALSE;
+	}
+
+	for (i = 1; i < n_fields; i++)
+	{
+		gchar *tmp = fields[i];
+
+		fields[i] = g_strcompress (tmp);
+		g_free (tmp);
+	}
+
+	atime = g_ascii_strtoll (fields[1], &end, 10);
+
+	if (end == fields[1] || *end != '\0')
+	{
+		return FALSE;
+	}
+
+	item = g_hash_table_lookup (gedit_metadata_manager->items, fields[2]);
+
+	/* Older than the last change, by this process or another one. */
+	if (item != NULL && atime < item->atime)
+	{
+		return TRUE;
+	}
+
+	switch (fields[0][0])
+	{
+		case 's':
+			item = get_or_create_item (fields[2]);
+			item_set_value (item, fields[3], fields[4]);
+			item_touch (item, atime);
+			break;
+
+		case 'u':
+			item = get_or_create_item (fields[2]);
+			item_set_value (item, fields[3], NULL);
+			item_touch (item, atime);
+			break;
+
+		case 't':
+			if (item != NULL)
+				item_touch (item, atime);
+			break;
+
+		case 'd':
+			if (item != NULL)
+				g_hash_table_remove (gedit_metadata_manager->items, fields[2]);
+			break;
+
+		default:
+			g_assert_not_reached ();
+	}
+
+	return TRUE;
+}
+
+/* Replays complete records. Returns FALSE if some are invalid. */
+static gboolean
+replay_records (const gchar *records,
+		gsize        length,
+		guint       *n_records)
+{
+	const gchar *line = records;
+	const gchar *records_end = records + length;
+	gboolean valid = TRUE;
+
+	while (line < records_end)
+	{
+		const gchar *line_end;
+		gchar *record;
+		gchar **fields;
+
+		line_end = memchr (line, '\n', records_end - line);
+
+		if (line_end == NULL)
+		{
+			return FALSE;
+		}
+
+		record = g_strndup (line, line_end - line);
+		fields = g_strsplit (record, "\t", 0);
+
+		if (replay_record (fields))
+		{
+			(*n_records)++;
+		}
+		else
+		{
+			valid = FALSE;
+		}
+
+		g_strfreev (fields);
+		g_free (record);
 
-	GHashTable	*items;
+		line = line_end + 1;
+	}
 
-	gchar		*metadata_filename;
-};
+	return valid;
+}
 
-static gboolean gedit_metadata_manager_save (gpointer data);
+static gint
+compare_items_atime (const Item *item1,
+		     const Item *item2,
+		     gpointer    user_data)
+{
+	if (item1->atime > item2->atime)
+		return -1;
 
-static GeditMetadataManager *gedit_metadata_manager = NULL;
+	return item1->atime < item2->atime ? 1 : 0;
+}
 
 static void
-item_free (gpointer data)
+sort_items (void)
 {
-	Item *item;
+	/* The records are not exactly in the order of the access times. */
+	g_queue_sort (&gedit_metadata_manager->lru,
+		      (GCompareDataFunc) compare_items_atime,
+		      NULL);
+}
 
-	g_return_if_fail (data != NULL);
+static void
+merge_foreign_records (GBytes *records)
+{
+	guint n_records = 0;
 
-#ifdef GEDIT_METADATA_VERBOSE_DEBUG
-	gedit_debug (DEBUG_METADATA);
-#endif
+	replay_records (g_bytes_get_data (records, NULL),
+			g_bytes_get_size (records),
+			&n_records);
 
-	item = (Item *)data;
+	sort_items ();
 
-	if (item->values != NULL)
-		g_hash_table_destroy (item->values);
+	gedit_metadata_manager->n_log_records += n_records;
 
-	g_free (item);
+	gedit_debug_message (DEBUG_METADATA, "%u records merged from other processes",
+			     n_records);
 }
 
-static void
-gedit_metadata_manager_arm_timeout (void)
+/* Can be called in the load thread. */
+static gboolean
+load_log (void)
 {
-	if (gedit_metadata_manager->timeout_id == 0)
+	gint lock_fd;
+	gchar *contents;
+	gsize length;
+	gsize records_end;
+	GError *error = NULL;
+
+	lock_fd = lock_log (gedit_metadata_manager->log_file);
+
+	if (!g_file_get_contents (gedit_metadata_manager->metadata_filename,
+				  &contents,
+				  &length,
+				  &error))
 	{
-		gedit_metadata_manager->timeout_id =
-			g_timeout_add_seconds_full (G_PRIORITY_DEFAULT_IDLE,
-						    2,
-						    (GSourceFunc)gedit_metadata_manager_save,
-						    NULL,
-						    NULL);
+		unlock_log (lock_fd);
+
+		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+		{
+			g_message ("Cannot read the metadata file: %s", error->message);
+		}
+
+		g_error_free (error);
+		return FALSE;
+	}
+
+	log_id = query_log_id (gedit_metadata_manager->log_file);
+
+	unlock_log (lock_fd);
+
+	if (!is_log (contents, length))
+	{
+		g_message ("File '%s' is of the wrong type",
+			   gedit_metadata_manager->metadata_filename);
+		g_free (contents);
+
+		return FALSE;
+	}
+
+	records_end = get_records_end (contents, length);
+	log_offset = records_end;
+
+	if (!replay_records (contents + LOG_HEADER_LENGTH,
+			     records_end - LOG_HEADER_LENGTH,
+			     &gedit_metadata_manager->n_log_records) ||
+	    records_end != length)
+	{
+		gedit_metadata_manager->needs_compaction = TRUE;
 	}
+
+	gedit_debug_message (DEBUG_METADATA, "%u records replayed",
+			     gedit_metadata_manager->n_log_records);
+
+	g_free (contents);
+
+	return TRUE;
 }
 
 /**
  * gedit_metadata_manager_init:
  * @metadata_filename: the filename where the metadata is stored.
+ * @max_items: the maximum number of files for which the metadata is kept.
  *
  * This function initializes the metadata manager.
  * See also gedit_metadata_manager_shutdown().
  */
 void
-gedit_metadata_manager_init (const gchar *metadata_filename)
+gedit_metadata_manager_init (const gchar *metadata_filename,
+			     guint        max_items)
 {
 	gedit_debug (DEBUG_METADATA);
 
@@ -111,13 +1035,26 @@ gedit_metadata_manager_init (const gchar *metadata_filename)
 
 	gedit_metadata_manager->values_loaded = FALSE;
 
+	/* The keys are owned by the items. */
 	gedit_metadata_manager->items =
 		g_hash_table_new_full (g_str_hash,
 				       g_str_equal,
-				       g_free,
+				       NULL,
 				       item_free);
 
+	g_queue_init (&gedit_metadata_manager->lru);
+	gedit_metadata_manager->max_items = MAX (max_items, 1);
+
+	gedit_metadata_manager->accessed_items =
+		g_hash_table_new_full (g_str_hash,
+				       g_str_equal,
+				       g_free,
+				       NULL);
+
+	gedit_metadata_manager->pending_records = g_string_new (NULL);
+
 	gedit_metadata_manager->metadata_filename = g_strdup (metadata_filename);
+	gedit_metadata_manager->log_file = g_file_new_for_path (metadata_filename);
 }
 
 /**
@@ -129,21 +1066,65 @@ gedit_metadata_manager_init (const gchar *metadata_filename)
 void
 gedit_metadata_manager_shutdown (void)
 {
+	Operation *op;
+
 	gedit_debug (DEBUG_METADATA);
 
 	if (gedit_metadata_manager == NULL)
 		return;
 
+	if (gedit_metadata_manager->load_thread != NULL)
+	{
+		ensure_values_loaded ();
+	}
+
 	if (gedit_metadata_manager->timeout_id)
 	{
 		g_source_remove (gedit_metadata_manager->timeout_id);
 		gedit_metadata_manager->timeout_id = 0;
+	}
+
+	if (gedit_metadata_manager->values_loaded)
+	{
 		gedit_metadata_manager_save (NULL);
 	}
 
+	/* The records of the other processes are not needed anymore. The
+	 * operations left are run here, after the one running in the thread.
+	 */
+	g_mutex_lock (&operation_lock);
+
+	while (operation_running)
+	{
+		g_cond_wait (&operation_cond, &operation_lock);
+	}
+
+	g_mutex_unlock (&operation_lock);
+
+	while ((op = g_queue_pop_head (&operations)) != NULL)
+	{
+		GBytes *foreign_records;
+
+		foreign_records = run_operation (op);
+
+		if (foreign_records != NULL)
+		{
+			g_bytes_unref (foreign_records);
+		}
+
+		operation_free (op);
+	}
+
+	g_free (log_id);
+	log_id = NULL;
+	log_offset = 0;
+
 	if (gedit_metadata_manager->items != NULL)
 		g_hash_table_destroy (gedit_metadata_manager->items);
 
+	g_hash_table_destroy (gedit_metadata_manager->accessed_items);
+	g_string_free (gedit_metadata_manager->pending_records, TRUE);
+	g_object_unref (gedit_metadata_manager->log_file);
 	g_free (gedit_metadata_manager->metadata_filename);
 
 	g_free (gedit_metadata_manager);
@@ -176,15 +1157,10 @@ parseItem (xmlDocPtr doc, xmlNodePtr cur)
 		return;
 	}
 
-	item = g_new0 (Item, 1);
+	item = get_or_create_item ((gchar *)uri);
 
 	item->atime = g_ascii_strtoll ((char *)atime, NULL, 0);
 
-	item->values = g_hash_table_new_full (g_str_hash,
-					      g_str_equal,
-					      g_free,
-					      g_free);
-
 	cur = cur->xmlChildrenNode;
 
 	while (cur != NULL)
@@ -213,58 +1189,55 @@ parseItem (xmlDocPtr doc, xmlNodePtr cur)
 		cur = cur->next;
 	}
 
-	g_hash_table_insert (gedit_metadata_manager->items,
-			     g_strdup ((gchar *)uri),
-			     item);
-
 	xmlFree (uri);
 	xmlFree (atime);
 }
 
 static gboolean
-load_values (void)
+import_legacy_metadata (void)
 {
 	xmlDocPtr doc;
 	xmlNodePtr cur;
+	gchar *cache_dir;
+	gchar *filename;
 
 	gedit_debug (DEBUG_METADATA);
 
-	g_return_val_if_fail (gedit_metadata_manager != NULL, FALSE);
-	g_return_val_if_fail (gedit_metadata_manager->values_loaded == FALSE, FALSE);
-
-	gedit_metadata_manager->values_loaded = TRUE;
-
 	xmlKeepBlanksDefault (0);
 
-	/* FIXME: file locking - Paolo */
-	if ((gedit_metadata_manager->metadata_filename == NULL) ||
-	    (!g_file_test (gedit_metadata_manager->metadata_filename, G_FILE_TEST_EXISTS)))
+	cache_dir = g_path_get_dirname (gedit_metadata_manager->metadata_filename);
+	filename = g_build_filename (cache_dir, LEGACY_METADATA_FILENAME, NULL);
+	g_free (cache_dir);
+
+	if (!g_file_test (filename, G_FILE_TEST_EXISTS))
 	{
+		g_free (filename);
 		return FALSE;
 	}
 
-	doc = xmlParseFile (gedit_metadata_manager->metadata_filename);
+	doc = xmlParseFile (filename);
 
 	if (doc == NULL)
 	{
+		g_free (filename);
 		return FALSE;
 	}
 
 	cur = xmlDocGetRootElement (doc);
 	if (cur == NULL)
 	{
-		g_message ("The metadata file '%s' is empty",
-		           g_path_get_basename (gedit_metadata_manager->metadata_filename));
+		g_message ("The metadata file '%s' is empty", filename);
 		xmlFreeDoc (doc);
+		g_free (filename);
 
 		return FALSE;
 	}
 
 	if (xmlStrcmp (cur->name, (const xmlChar *) "metadata"))
 	{
-		g_message ("File '%s' is of the wrong type",
-		           g_path_get_basename (gedit_metadata_manager->metadata_filename));
+		g_message ("File '%s' is of the wrong type", filename);
 		xmlFreeDoc (doc);
+		g_free (filename);
 
 		return FALSE;
 	}
@@ -281,9 +1254,114 @@ load_values (void)
 
 	xmlFreeDoc (doc);
 
+	gedit_debug_message (DEBUG_METADATA, "Imported '%s'", filename);
+	g_free (filename);
+
 	return TRUE;
 }
 
+/* Can be called in the load thread. */
+static void
+load_values (void)
+{
+	gint64 start_time;
+
+	gedit_debug (DEBUG_METADATA);
+
+	g_return_if_fail (gedit_metadata_manager != NULL);
+	g_return_if_fail (gedit_metadata_manager->values_loaded == FALSE);
+
+	if (gedit_metadata_manager->metadata_filename == NULL)
+	{
+		return;
+	}
+
+	start_time = g_get_monotonic_time ();
+
+	if (!load_log ())
+	{
+		/* The log is written from scratch, with the values of the old
+		 * XML file if any.
+		 */
+		import_legacy_metadata ();
+		gedit_metadata_manager->needs_compaction = TRUE;
+	}
+
+	sort_items ();
+
+	gedit_debug_message (DEBUG_METADATA, "Metadata loaded in %.1f ms: %u items",
+			     (g_get_monotonic_time () - start_time) / 1000.0,
+			     g_hash_table_size (gedit_metadata_manager->items));
+}
+
+static gpointer
+load_thread_func (gpointer data)
+{
+	load_values ();
+
+	return NULL;
+}
+
+/* Waits for the load thread if it is running, or loads the values. */
+static void
+ensure_values_loaded (void)
+{
+	if (gedit_metadata_manager->values_loaded)
+	{
+		return;
+	}
+
+	if (gedit_metadata_manager->load_thread != NULL)
+	{
+		gint64 start_time = g_get_monotonic_time ();
+
+		g_thread_join (gedit_metadata_manager->load_thread);
+		gedit_metadata_manager->load_thread = NULL;
+
+		gedit_debug_message (DEBUG_METADATA, "Waited %.1f ms for the load thread",
+				     (g_get_monotonic_time () - start_time) / 1000.0);
+	}
+	else
+	{
+		load_values ();
+	}
+
+	gedit_metadata_manager->values_loaded = TRUE;
+
+	if (gedit_metadata_manager->needs_compaction)
+	{
+		gedit_metadata_manager_arm_timeout ();
+	}
+}
+
+/**
+ * gedit_metadata_manager_preload:
+ *
+ * Starts loading the metadata in a thread, so that it is ready when a
+ * document is opened. The first call to gedit_metadata_manager_get() or
+ * gedit_metadata_manager_set() waits for the end of the load if needed.
+ */
+void
+gedit_metadata_manager_preload (void)
+{
+	gedit_debug (DEBUG_METADATA);
+
+	g_return_if_fail (gedit_metadata_manager != NULL);
+
+	if (gedit_metadata_manager->values_loaded ||
+	    gedit_metadata_manager->load_thread != NULL)
+	{
+		return;
+	}
+
+	/* libxml2 must be initialized in the main thread. */
+	xmlInitParser ();
+
+	gedit_metadata_manager->load_thread = g_thread_new ("gedit-metadata",
+							    load_thread_func,
+							    NULL);
+}
+
 /**
  * gedit_metadata_manager_get:
  * @location: a #GFile.
@@ -306,28 +1384,23 @@ gedit_metadata_manager_get (GFile       *location,
 
 	gedit_debug_message (DEBUG_METADATA, "URI: %s --- key: %s", uri, key );
 
-	if (!gedit_metadata_manager->values_loaded)
-	{
-		gboolean res;
-
-		res = load_values ();
-
-		if (!res)
-		{
-			g_free (uri);
-			return NULL;
-		}
-	}
+	ensure_values_loaded ();
 
 	item = (Item *)g_hash_table_lookup (gedit_metadata_manager->items,
 					    uri);
 
-	g_free (uri);
-
 	if (item == NULL)
+	{
+		g_free (uri);
 		return NULL;
+	}
 
-	item->atime = g_get_real_time () / 1000;
+	item_touch (item, g_get_real_time () / 1000);
+
+	/* The access time is written with the next records, there is no
+	 * need to write to the log for a read.
+	 */
+	g_hash_table_add (gedit_metadata_manager->accessed_items, uri);
 
 	if (item->values == NULL)
 		return NULL;
@@ -363,49 +1436,19 @@ gedit_metadata_manager_set (GFile       *location,
 
 	gedit_debug_message (DEBUG_METADATA, "URI: %s --- key: %s --- value: %s", uri, key, value);
 
-	if (!gedit_metadata_manager->values_loaded)
-	{
-		gboolean res;
-
-		res = load_values ();
-
-		if (!res)
-			return;
-	}
-
-	item = (Item *)g_hash_table_lookup (gedit_metadata_manager->items,
-					    uri);
-
-	if (item == NULL)
-	{
-		item = g_new0 (Item, 1);
-
-		g_hash_table_insert (gedit_metadata_manager->items,
-				     g_strdup (uri),
-				     item);
-	}
+	ensure_values_loaded ();
 
-	if (item->values == NULL)
-	{
-		 item->values = g_hash_table_new_full (g_str_hash,
-				 		       g_str_equal,
-						       g_free,
-						       g_free);
-	}
+	item = get_or_create_item (uri);
+	item_set_value (item, key, value);
+	item_touch (item, g_get_real_time () / 1000);
 
-	if (value != NULL)
-	{
-		g_hash_table_insert (item->values,
-				     g_strdup (key),
-				     g_strdup (value));
-	}
-	else
-	{
-		g_hash_table_remove (item->values,
-				     key);
-	}
+	add_pending_record (value != NULL ? 's' : 'u',
+			    item->atime,
+			    uri,
+			    key,
+			    value);
 
-	item->atime = g_get_real_time () / 1000;
+	g_hash_table_remove (gedit_metadata_manager->accessed_items, uri);
 
 	g_free (uri);
 
@@ -413,164 +1456,171 @@ gedit_metadata_manager_set (GFile       *location,
 }
 
 static void
-save_values (const gchar *key, const gchar *value, xmlNodePtr parent)
+resize_items (void)
 {
-	xmlNodePtr xml_node;
-
-#ifdef GEDIT_METADATA_VERBOSE_DEBUG
-	gedit_debug (DEBUG_METADATA);
-#endif
-
-	g_return_if_fail (key != NULL);
+	while (g_hash_table_size (gedit_metadata_manager->items) > gedit_metadata_manager->max_items)
+	{
+		Item *oldest;
 
-	if (value == NULL)
-		return;
+		oldest = g_queue_peek_tail (&gedit_metadata_manager->lru);
 
-	xml_node = xmlNewChild (parent,
-				NULL,
-				(const xmlChar *)"entry",
-				NULL);
+		g_return_if_fail (oldest != NULL);
 
-	xmlSetProp (xml_node,
-		    (const xmlChar *)"key",
-		    (const xmlChar *)key);
-	xmlSetProp (xml_node,
-		    (const xmlChar *)"value",
-		    (const xmlChar *)value);
+		add_pending_record ('d', oldest->atime, oldest->uri, NULL, NULL);
+		g_hash_table_remove (gedit_metadata_manager->accessed_items,
+				     oldest->uri);
 
-#ifdef GEDIT_METADATA_VERBOSE_DEBUG
-	gedit_debug_message (DEBUG_METADATA, "entry: %s = %s", key, value);
-#endif
+		g_hash_table_remove (gedit_metadata_manager->items,
+				     oldest->uri);
+	}
 }
 
 static void
-save_item (const gchar *key, const gpointer *data, xmlNodePtr parent)
+add_access_time_records (void)
 {
-	xmlNodePtr xml_node;
-	const Item *item = (const Item *)data;
-	gchar *atime;
+	GHashTableIter iter;
+	gpointer uri;
 
-#ifdef GEDIT_METADATA_VERBOSE_DEBUG
-	gedit_debug (DEBUG_METADATA);
-#endif
+	g_hash_table_iter_init (&iter, gedit_metadata_manager->accessed_items);
 
-	g_return_if_fail (key != NULL);
+	while (g_hash_table_iter_next (&iter, &uri, NULL))
+	{
+		Item *item;
 
-	if (item == NULL)
-		return;
+		item = g_hash_table_lookup (gedit_metadata_manager->items, uri);
 
-	xml_node = xmlNewChild (parent, NULL, (const xmlChar *)"document", NULL);
+		if (item != NULL)
+		{
+			add_pending_record ('t', item->atime, uri, NULL, NULL);
+		}
+	}
 
-	xmlSetProp (xml_node, (const xmlChar *)"uri", (const xmlChar *)key);
+	g_hash_table_remove_all (gedit_metadata_manager->accessed_items);
+}
 
-#ifdef GEDIT_METADATA_VERBOSE_DEBUG
-	gedit_debug_message (DEBUG_METADATA, "uri: %s", key);
-#endif
+static guint
+count_live_values (void)
+{
+	GHashTableIter iter;
+	gpointer value;
+	guint n_values = 0;
 
-	atime = g_strdup_printf ("%" G_GINT64_FORMAT, item->atime);
-	xmlSetProp (xml_node, (const xmlChar *)"atime", (const xmlChar *)atime);
+	g_hash_table_iter_init (&iter, gedit_metadata_manager->items);
 
-#ifdef GEDIT_METADATA_VERBOSE_DEBUG
-	gedit_debug_message (DEBUG_METADATA, "atime: %s", atime);
-#endif
+	while (g_hash_table_iter_next (&iter, NULL, &value))
+	{
+		Item *item = value;
 
-	g_free (atime);
+		if (item->values != NULL)
+		{
+			n_values += g_hash_table_size (item->values);
+		}
+	}
 
-    	g_hash_table_foreach (item->values,
-			      (GHFunc)save_values,
-			      xml_node);
+	return n_values;
 }
 
-static void
-get_oldest (const gchar *key, const gpointer value, const gchar ** key_to_remove)
+static gboolean
+should_compact (void)
 {
-	const Item *item = (const Item *)value;
+	guint n_records;
 
-	if (*key_to_remove == NULL)
+	if (gedit_metadata_manager->needs_compaction)
 	{
-		*key_to_remove = key;
+		return TRUE;
 	}
-	else
-	{
-		const Item *item_to_remove =
-			g_hash_table_lookup (gedit_metadata_manager->items,
-					     *key_to_remove);
 
-		g_return_if_fail (item_to_remove != NULL);
+	n_records = gedit_metadata_manager->n_log_records +
+		    gedit_metadata_manager->n_pending_records;
 
-		if (item->atime < item_to_remove->atime)
-		{
-			*key_to_remove = key;
-		}
-	}
+	return (n_records > COMPACTION_MIN_RECORDS &&
+		n_records > COMPACTION_RATIO * count_live_values ());
 }
 
-static void
-resize_items (void)
+/* Serializes the live values, to replace the log. */
+static GBytes *
+serialize_items (guint *n_records)
 {
-	while (g_hash_table_size (gedit_metadata_manager->items) > MAX_ITEMS)
+	GString *log;
+	GHashTableIter iter;
+	gpointer key;
+	gpointer value;
+
+	log = g_string_new (LOG_HEADER);
+	*n_records = 0;
+
+	g_hash_table_iter_init (&iter, gedit_metadata_manager->items);
+
+	while (g_hash_table_iter_next (&iter, &key, &value))
 	{
-		gpointer key_to_remove = NULL;
+		const gchar *uri = key;
+		Item *item = value;
+		GHashTableIter values_iter;
+		gpointer values_key;
+		gpointer values_value;
 
-		g_hash_table_foreach (gedit_metadata_manager->items,
-				      (GHFunc)get_oldest,
-				      &key_to_remove);
+		if (item->values == NULL)
+			continue;
 
-		g_return_if_fail (key_to_remove != NULL);
+		g_hash_table_iter_init (&values_iter, item->values);
 
-		g_hash_table_remove (gedit_metadata_manager->items,
-				     key_to_remove);
+		while (g_hash_table_iter_next (&values_iter, &values_key, &values_value))
+		{
+			append_record (log, 's', item->atime, uri, values_key, values_value);
+			(*n_records)++;
+		}
 	}
+
+	return g_string_free_to_bytes (log);
 }
 
 static gboolean
 gedit_metadata_manager_save (gpointer data)
 {
-	xmlDocPtr  doc;
-	xmlNodePtr root;
-
 	gedit_debug (DEBUG_METADATA);
 
 	gedit_metadata_manager->timeout_id = 0;
 
 	resize_items ();
 
-	xmlIndentTreeOutput = TRUE;
+	if (should_compact ())
+	{
+		guint n_records;
 
-	doc = xmlNewDoc ((const xmlChar *)"1.0");
-	if (doc == NULL)
-		return TRUE;
+		push_operation (OPERATION_REPLACE, serialize_items (&n_records));
 
-	/* Create metadata root */
-	root = xmlNewDocNode (doc, NULL, (const xmlChar *)"metadata", NULL);
-	xmlDocSetRootElement (doc, root);
+		gedit_debug_message (DEBUG_METADATA, "Log compacted: %u records instead of %u",
+				     n_records,
+				     gedit_metadata_manager->n_log_records +
+				     gedit_metadata_manager->n_pending_records);
 
-    	g_hash_table_foreach (gedit_metadata_manager->items,
-			      (GHFunc)save_item,
-			      root);
+		gedit_metadata_manager->n_log_records = n_records;
+		gedit_metadata_manager->needs_compaction = FALSE;
 
-	/* FIXME: lock file - Paolo */
-	if (gedit_metadata_manager->metadata_filename != NULL)
+		/* The access times are in the new log. */
+		g_hash_table_remove_all (gedit_metadata_manager->accessed_items);
+	}
+	else
 	{
-		gchar *cache_dir;
-		int res;
+		add_access_time_records ();
 
-		/* make sure the cache dir exists */
-		cache_dir = g_path_get_dirname (gedit_metadata_manager->metadata_filename);
-		res = g_mkdir_with_parents (cache_dir, 0755);
-		if (res != -1)
+		if (gedit_metadata_manager->n_pending_records == 0)
 		{
-			xmlSaveFormatFile (gedit_metadata_manager->metadata_filename,
-			                   doc,
-			                   1);
+			return FALSE;
 		}
 
-		g_free (cache_dir);
-	}
+		gedit_debug_message (DEBUG_METADATA, "%u records appended",
+				     gedit_metadata_manager->n_pending_records);
 
-	xmlFreeDoc (doc);
+		push_operation (OPERATION_APPEND,
+				g_bytes_new (gedit_metadata_manager->pending_records->str,
+					     gedit_metadata_manager->pending_records->len));
+
+		gedit_metadata_manager->n_log_records += gedit_metadata_manager->n_pending_records;
+	}
 
-	gedit_debug_message (DEBUG_METADATA, "DONE");
+	g_string_truncate (gedit_metadata_manager->pending_records, 0);
+	gedit_metadata_manager->n_pending_records = 0;
 
 	return FALSE;
 }
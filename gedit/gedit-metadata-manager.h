@@ -26,10 +26,13 @@
 
 G_BEGIN_DECLS
 
-void		 gedit_metadata_manager_init		(const gchar *metadata_filename);
+void		 gedit_metadata_manager_init		(const gchar *metadata_filename,
+							 guint        max_items);
 
 void		 gedit_metadata_manager_shutdown 	(void);
 
+void		 gedit_metadata_manager_preload		(void);
+
 
 gchar		*gedit_metadata_manager_get 		(GFile       *location,
 					     		 const gchar *key);
@@ -97,7 +97,8 @@ get_current_docs_list (GeditOpenDocumentSelectorStore *selector_store G_GNUC_UNU
 
 	window = gedit_open_document_selector_get_window (selector);
 
-	docs = gedit_window_get_documents (window);
+	/* Runs in a thread, and only the locations are needed. */
+	docs = _gedit_window_peek_documents (window);
 	for (l = docs; l != NULL; l = l->next)
 	{
 		file = gtk_source_file_get_location (gedit_document_get_file (l->data));
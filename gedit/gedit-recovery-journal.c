@@ -0,0 +1,1156 @@
+/*
+ * gedit-recovery-journal.c
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Journal of the modifications of a document, to recover it after a crash.
+ *
+ * While a document is modified, a journal file exists for it in the
+ * "recovery" directory of the user cache dir. The journal starts with a
+ * snapshot of the contents, followed by the insertions and deletions done
+ * since then. Consecutive insertions or deletions (when typing or erasing
+ * characters) are merged in one record, and the records are appended to the
+ * file a few seconds after an edit. When the records become bigger than the
+ * snapshot, the journal is rewritten with a new snapshot. The journal is
+ * deleted when the document is unmodified (after a save for example) or
+ * closed.
+ *
+ * The snapshot is copied from the buffer by chunks, in idle callbacks. The
+ * edits done meanwhile before the copied part are recorded after the
+ * snapshot, the ones after it are in the next chunks.
+ *
+ * The journal files are named "<pid>-<serial>.journal". At startup, the
+ * journals of the processes which no longer exist are replayed. Such a
+ * journal is deleted once its document is recovered.
+ *
+ * Format, the numbers are in ASCII and the offsets are in characters:
+ *   GEDIT-RECOVERY 1\n
+ *   L <uri>\n				the location, if any
+ *   S <n_bytes>\n<text>\n		the snapshot
+ *   I <offset> <n_bytes>\n<text>\n	an insertion
+ *   D <offset> <n_chars>\n		a deletion
+ */
+
+#include "gedit-recovery-journal.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#ifdef G_OS_UNIX
+#include <signal.h>
+#include <sys/types.h>
+#include <unistd.h>
+#else
+#include <process.h>
+#define getpid _getpid
+#endif
+
+#include "gedit-debug.h"
+#include "gedit-dirs.h"
+
+#define JOURNAL_HEADER "GEDIT-RECOVERY 1\n"
+#define JOURNAL_SUFFIX ".journal"
+
+/* Delay, in seconds, between an edit and the write of the records. */
+#define FLUSH_DELAY 2
+
+/* A new snapshot is written when the records appended since the last one are
+ * bigger than the snapshot, and than that.
+ */
+#define COMPACTION_MIN_SIZE (1024 * 1024)
+
+/* Number of characters of the snapshot copied in one idle callback. */
+#define SNAPSHOT_CHUNK_CHARS (256 * 1024)
+
+typedef enum
+{
+	RECORD_NONE,
+	RECORD_INSERT,
+	RECORD_DELETE
+} RecordType;
+
+struct _GeditRecoveryJournal
+{
+	GeditDocument *doc;
+
+	GFile *file;
+
+	/* Records not written yet. */
+	GString *pending;
+
+	/* The last record, not in "pending" yet because it can be merged with
+	 * the next edit.
+	 */
+	RecordType last_type;
+	gint last_offset;
+	gint last_n_chars;
+	GString *last_text;
+
+	gsize snapshot_size;
+	gsize n_appended_bytes;
+
+	guint flush_timeout_id;
+
+	/* While a snapshot is copied: the text copied so far, and its end in
+	 * the buffer.
+	 */
+	GString *snapshot_text;
+	gint snapshot_offset;
+	guint snapshot_idle_id;
+
+	/* Whether the journal file contains a snapshot. Before that, the
+	 * edits don't need to be recorded.
+	 */
+	guint has_snapshot : 1;
+
+	/* While the document is loaded. */
+	guint suspended : 1;
+};
+
+typedef enum
+{
+	OPERATION_REPLACE,
+	OPERATION_APPEND,
+	OPERATION_DELETE
+} OperationType;
+
+typedef struct
+{
+	OperationType type;
+	GFile *file;
+
+	/* For OPERATION_REPLACE, the data is written after the prefix. */
+	GBytes *prefix;
+	GBytes *data;
+} Operation;
+
+/* The operations on the journal files are done in a thread, one after the
+ * other, so that the order of the writes is kept. operation_running is
+ * unset by the thread, under the lock, so that the shutdown can wait for
+ * it.
+ */
+static GQueue operations = G_QUEUE_INIT;
+static gboolean operation_running = FALSE;
+static GMutex operation_lock;
+static GCond operation_cond;
+
+static GList *journals = NULL;
+static guint journal_serial = 0;
+
+static gchar *
+get_journals_dir (void)
+{
+	return g_build_filename (gedit_dirs_get_user_cache_dir (), "recovery", NULL);
+}
+
+static void
+operation_free (Operation *op)
+{
+	g_object_unref (op->file);
+
+	if (op->prefix != NULL)
+	{
+		g_bytes_unref (op->prefix);
+	}
+
+	if (op->data != NULL)
+	{
+		g_bytes_unref (op->data);
+	}
+
+	g_slice_free (Operation, op);
+}
+
+static gboolean
+write_bytes (GOutputStream  *stream,
+	     GBytes         *bytes,
+	     GError        **error)
+{
+	return g_output_stream_write_all (stream,
+					  g_bytes_get_data (bytes, NULL),
+					  g_bytes_get_size (bytes),
+					  NULL,
+					  NULL,
+					  error);
+}
+
+static void
+run_operation (Operation *op)
+{
+	GError *error = NULL;
+
+	switch (op->type)
+	{
+		case OPERATION_REPLACE:
+		{
+			gchar *dir = get_journals_dir ();
+			GFileOutputStream *stream;
+
+			g_mkdir_with_parents (dir, 0700);
+			g_free (dir);
+
+			stream = g_file_replace (op->file,
+						 NULL,
+						 FALSE,
+						 G_FILE_CREATE_PRIVATE,
+						 NULL,
+						 &error);
+
+			if (stream != NULL)
+			{
+				if ((op->prefix == NULL || write_bytes (G_OUTPUT_STREAM (stream), op->prefix, &error)) &&
+				    write_bytes (G_OUTPUT_STREAM (stream), op->data, &error))
+				{
+					g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, &error);
+				}
+
+				g_object_unref (stream);
+			}
+			break;
+		}
+
+		case OPERATION_APPEND:
+		{
+			GFileOutputStream *stream;
+
+			stream = g_file_append_to (op->file,
+						   G_FILE_CREATE_PRIVATE,
+						   NULL,
+						   &error);
+
+			if (stream != NULL)
+			{
+				write_bytes (G_OUTPUT_STREAM (stream), op->data, &error);
+
+				g_output_stream_close (G_OUTPUT_STREAM (stream), NULL, NULL);
+				g_object_unref (stream);
+			}
+			break;
+		}
+
+		case OPERATION_DELETE:
+			g_file_delete (op->file, NULL, &error);
+
+			if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+			{
+				g_clear_error (&error);
+			}
+			break;
+
+		default:
+			g_assert_not_reached ();
+	}
+
+	if (error != NULL)
+	{
+		gedit_debug_message (DEBUG_DOCUMENT, "Recovery journal error: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+static void
+operation_thread (GTask        *task,
+		  gpointer      source_object,
+		  Operation    *op,
+		  GCancellable *cancellable)
+{
+	run_operation (op);
+
+	g_mutex_lock (&operation_lock);
+	operation_running = FALSE;
+	g_cond_signal (&operation_cond);
+	g_mutex_unlock (&operation_lock);
+
+	g_task_return_boolean (task, TRUE);
+}
+
+static void process_next_operation (void);
+
+static void
+operation_done_cb (GObject      *source_object,
+		   GAsyncResult *result,
+		   gpointer      user_data)
+{
+	process_next_operation ();
+}
+
+static void
+process_next_operation (void)
+{
+	Operation *op;
+	GTask *task;
+
+	g_mutex_lock (&operation_lock);
+
+	if (operation_running || g_queue_is_empty (&operations))
+	{
+		g_mutex_unlock (&operation_lock);
+		return;
+	}
+
+	operation_running = TRUE;
+	g_mutex_unlock (&operation_lock);
+
+	op = g_queue_pop_head (&operations);
+
+	task = g_task_new (NULL, NULL, operation_done_cb, NULL);
+	g_task_set_task_data (task, op, (GDestroyNotify) operation_free);
+	g_task_run_in_thread (task, (GTaskThreadFunc) operation_thread);
+	g_object_unref (task);
+}
+
+/* Takes the ownership of @prefix and @data. */
+static void
+push_operation (OperationType  type,
+		GFile         *file,
+		GBytes        *prefix,
+		GBytes        *data)
+{
+	Operation *op;
+
+	op = g_slice_new0 (Operation);
+	op->type = type;
+	op->file = g_object_ref (file);
+	op->prefix = prefix;
+	op->data = data;
+
+	g_queue_push_tail (&operations, op);
+	process_next_operation ();
+}
+
+static void
+commit_last_record (GeditRecoveryJournal *journal)
+{
+	switch (journal->last_type)
+	{
+		case RECORD_INSERT:
+			g_string_append_printf (journal->pending,
+						"I %d %" G_GSIZE_FORMAT "\n",
+						journal->last_offset,
+						journal->last_text->len);
+			g_string_append_len (journal->pending,
+					     journal->last_text->str,
+					     journal->last_text->len);
+			g_string_append_c (journal->pending, '\n');
+			break;
+
+		case RECORD_DELETE:
+			g_string_append_printf (journal->pending,
+						"D %d %d\n",
+						journal->last_offset,
+						journal->last_n_chars);
+			break;
+
+		default:
+			break;
+	}
+
+	journal->last_type = RECORD_NONE;
+	g_string_truncate (journal->last_text, 0);
+}
+
+static void
+write_snapshot (GeditRecoveryJournal *journal)
+{
+	GtkSourceFile *source_file;
+	GFile *location;
+	GString *header;
+
+	header = g_string_new (JOURNAL_HEADER);
+
+	source_file = gedit_document_get_file (journal->doc);
+	location = gtk_source_file_get_location (source_file);
+
+	if (location != NULL)
+	{
+		gchar *uri = g_file_get_uri (location);
+
+		g_string_append_printf (header, "L %s\n", uri);
+		g_free (uri);
+	}
+
+	g_string_append_printf (header, "S %" G_GSIZE_FORMAT "\n", journal->snapshot_text->len);
+
+	/* The end of the S record. */
+	g_string_append_c (journal->snapshot_text, '\n');
+
+	journal->has_snapshot = TRUE;
+	journal->snapshot_size = header->len + journal->snapshot_text->len;
+	journal->n_appended_bytes = 0;
+
+	push_operation (OPERATION_REPLACE,
+			journal->file,
+			g_string_free_to_bytes (header),
+			g_string_free_to_bytes (journal->snapshot_text));
+
+	journal->snapshot_text = NULL;
+}
+
+static void flush (GeditRecoveryJournal *journal);
+
+static gboolean
+copy_snapshot_chunk_cb (GeditRecoveryJournal *journal)
+{
+	GtkTextBuffer *buffer = GTK_TEXT_BUFFER (journal->doc);
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+
+	gtk_text_buffer_get_iter_at_offset (buffer, &start, journal->snapshot_offset);
+	gtk_text_buffer_get_iter_at_offset (buffer, &end, journal->snapshot_offset + SNAPSHOT_CHUNK_CHARS);
+
+	text = gtk_text_buffer_get_text (buffer, &start, &end, TRUE);
+	g_string_append (journal->snapshot_text, text);
+	g_free (text);
+
+	journal->snapshot_offset = gtk_text_iter_get_offset (&end);
+
+	if (!gtk_text_iter_is_end (&end))
+	{
+		return G_SOURCE_CONTINUE;
+	}
+
+	journal->snapshot_idle_id = 0;
+
+	write_snapshot (journal);
+
+	/* The edits done while copying. */
+	flush (journal);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+start_snapshot (GeditRecoveryJournal *journal)
+{
+	/* The snapshot contains the pending edits. */
+	journal->last_type = RECORD_NONE;
+	g_string_truncate (journal->last_text, 0);
+	g_string_truncate (journal->pending, 0);
+
+	journal->snapshot_text = g_string_new (NULL);
+	journal->snapshot_offset = 0;
+	journal->snapshot_idle_id = g_idle_add_full (G_PRIORITY_LOW,
+						     (GSourceFunc) copy_snapshot_chunk_cb,
+						     journal,
+						     NULL);
+}
+
+static void
+cancel_snapshot (GeditRecoveryJournal *journal)
+{
+	if (journal->snapshot_idle_id != 0)
+	{
+		g_source_remove (journal->snapshot_idle_id);
+		journal->snapshot_idle_id = 0;
+	}
+
+	if (journal->snapshot_text != NULL)
+	{
+		g_string_free (journal->snapshot_text, TRUE);
+		journal->snapshot_text = NULL;
+	}
+
+	journal->snapshot_offset = 0;
+}
+
+/* Whether the edits are recorded: after a snapshot, or before the part of the
+ * snapshot already copied.
+ */
+static gboolean
+is_recording (GeditRecoveryJournal *journal)
+{
+	return journal->has_snapshot || journal->snapshot_text != NULL;
+}
+
+static void
+flush (GeditRecoveryJournal *journal)
+{
+	if (journal->flush_timeout_id != 0)
+	{
+		g_source_remove (journal->flush_timeout_id);
+		journal->flush_timeout_id = 0;
+	}
+
+	/* The edits are flushed once the snapshot is copied. */
+	if (journal->suspended ||
+	    journal->snapshot_text != NULL ||
+	    !gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (journal->doc)))
+	{
+		return;
+	}
+
+	commit_last_record (journal);
+
+	if (!journal->has_snapshot ||
+	    journal->n_appended_bytes > MAX (COMPACTION_MIN_SIZE, journal->snapshot_size))
+	{
+		start_snapshot (journal);
+	}
+	else if (journal->pending->len > 0)
+	{
+		push_operation (OPERATION_APPEND,
+				journal->file,
+				NULL,
+				g_bytes_new (journal->pending->str, journal->pending->len));
+
+		journal->n_appended_bytes += journal->pending->len;
+		g_string_truncate (journal->pending, 0);
+	}
+}
+
+static gboolean
+flush_timeout_cb (GeditRecoveryJournal *journal)
+{
+	journal->flush_timeout_id = 0;
+	flush (journal);
+
+	return G_SOURCE_REMOVE;
+}
+
+static void
+schedule_flush (GeditRecoveryJournal *journal)
+{
+	if (journal->flush_timeout_id == 0)
+	{
+		journal->flush_timeout_id = g_timeout_add_seconds (FLUSH_DELAY,
+								   (GSourceFunc) flush_timeout_cb,
+								   journal);
+	}
+}
+
+/* The document is the same as its file, or empty: the journal is not needed. */
+static void
+reset (GeditRecoveryJournal *journal)
+{
+	if (journal->flush_timeout_id != 0)
+	{
+		g_source_remove (journal->flush_timeout_id);
+		journal->flush_timeout_id = 0;
+	}
+
+	cancel_snapshot (journal);
+
+	journal->last_type = RECORD_NONE;
+	g_string_truncate (journal->last_text, 0);
+	g_string_truncate (journal->pending, 0);
+
+	if (journal->has_snapshot)
+	{
+		push_operation (OPERATION_DELETE, journal->file, NULL, NULL);
+		journal->has_snapshot = FALSE;
+	}
+
+	journal->snapshot_size = 0;
+	journal->n_appended_bytes = 0;
+}
+
+static void
+insert_text_cb (GtkTextBuffer        *buffer,
+		GtkTextIter          *location,
+		const gchar          *text,
+		gint                  length,
+		GeditRecoveryJournal *journal)
+{
+	gint offset;
+	gint n_chars;
+
+	if (journal->suspended)
+	{
+		return;
+	}
+
+	schedule_flush (journal);
+
+	/* The next snapshot will contain it. */
+	if (!is_recording (journal))
+	{
+		return;
+	}
+
+	if (length < 0)
+	{
+		length = strlen (text);
+	}
+
+	offset = gtk_text_iter_get_offset (location);
+	n_chars = g_utf8_strlen (text, length);
+
+	if (journal->snapshot_text != NULL)
+	{
+		/* In a part of the snapshot not copied yet. */
+		if (offset >= journal->snapshot_offset)
+		{
+			return;
+		}
+
+		journal->snapshot_offset += n_chars;
+	}
+
+	if (journal->last_type != RECORD_INSERT ||
+	    offset != journal->last_offset + journal->last_n_chars)
+	{
+		commit_last_record (journal);
+
+		journal->last_type = RECORD_INSERT;
+		journal->last_offset = offset;
+		journal->last_n_chars = 0;
+	}
+
+	g_string_append_len (journal->last_text, text, length);
+	journal->last_n_chars += n_chars;
+}
+
+static void
+delete_range_cb (GtkTextBuffer        *buffer,
+		 GtkTextIter          *start,
+		 GtkTextIter          *end,
+		 GeditRecoveryJournal *journal)
+{
+	gint offset;
+	gint n_chars;
+
+	if (journal->suspended)
+	{
+		return;
+	}
+
+	schedule_flush (journal);
+
+	if (!is_recording (journal))
+	{
+		return;
+	}
+
+	offset = gtk_text_iter_get_offset (start);
+	n_chars = gtk_text_iter_get_offset (end) - offset;
+
+	if (journal->snapshot_text != NULL)
+	{
+		if (offset >= journal->snapshot_offset)
+		{
+			return;
+		}
+
+		/* Only the copied part is recorded, the rest is no longer in
+		 * the buffer to be copied.
+		 */
+		n_chars = MIN (n_chars, journal->snapshot_offset - offset);
+		journal->snapshot_offset -= n_chars;
+	}
+
+	if (journal->last_type == RECORD_INSERT &&
+	    offset >= journal->last_offset &&
+	    offset + n_chars <= journal->last_offset + journal->last_n_chars)
+	{
+		/* Correction of text just typed. */
+		const gchar *str = journal->last_text->str;
+		const gchar *del_start;
+		const gchar *del_end;
+
+		del_start = g_utf8_offset_to_pointer (str, offset - journal->last_offset);
+		del_end = g_utf8_offset_to_pointer (del_start, n_chars);
+
+		g_string_erase (journal->last_text,
+				del_start - str,
+				del_end - del_start);
+		journal->last_n_chars -= n_chars;
+		return;
+	}
+
+	if (journal->last_type == RECORD_DELETE &&
+	    offset + n_chars == journal->last_offset)
+	{
+		/* Backspace */
+		journal->last_offset = offset;
+		journal->last_n_chars += n_chars;
+		return;
+	}
+
+	if (journal->last_type == RECORD_DELETE &&
+	    offset == journal->last_offset)
+	{
+		/* Delete */
+		journal->last_n_chars += n_chars;
+		return;
+	}
+
+	commit_last_record (journal);
+
+	journal->last_type = RECORD_DELETE;
+	journal->last_offset = offset;
+	journal->last_n_chars = n_chars;
+}
+
+static void
+modified_changed_cb (GtkTextBuffer        *buffer,
+		     GeditRecoveryJournal *journal)
+{
+	if (gtk_text_buffer_get_modified (buffer))
+	{
+		schedule_flush (journal);
+	}
+	else
+	{
+		reset (journal);
+	}
+}
+
+static void
+load_cb (GeditDocument        *doc,
+	 GeditRecoveryJournal *journal)
+{
+	journal->suspended = TRUE;
+	reset (journal);
+}
+
+static void
+resume (GeditRecoveryJournal *journal)
+{
+	journal->suspended = FALSE;
+	reset (journal);
+
+	/* For example when loaded from stdin. */
+	if (gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (journal->doc)))
+	{
+		schedule_flush (journal);
+	}
+}
+
+static void
+loaded_cb (GeditDocument        *doc,
+	   GeditRecoveryJournal *journal)
+{
+	resume (journal);
+}
+
+GeditRecoveryJournal *
+gedit_recovery_journal_new (GeditDocument *doc)
+{
+	GeditRecoveryJournal *journal;
+	gchar *dir;
+	gchar *name;
+	gchar *path;
+
+	g_return_val_if_fail (GEDIT_IS_DOCUMENT (doc), NULL);
+
+	journal = g_slice_new0 (GeditRecoveryJournal);
+	journal->doc = doc;
+	journal->pending = g_string_new (NULL);
+	journal->last_text = g_string_new (NULL);
+
+	dir = get_journals_dir ();
+	name = g_strdup_printf ("%lu-%u" JOURNAL_SUFFIX,
+				(gulong) getpid (),
+				++journal_serial);
+	path = g_build_filename (dir, name, NULL);
+
+	journal->file = g_file_new_for_path (path);
+
+	g_free (dir);
+	g_free (name);
+	g_free (path);
+
+	g_signal_connect (doc,
+			  "insert-text",
+			  G_CALLBACK (insert_text_cb),
+			  journal);
+
+	g_signal_connect (doc,
+			  "delete-range",
+			  G_CALLBACK (delete_range_cb),
+			  journal);
+
+	g_signal_connect (doc,
+			  "modified-changed",
+			  G_CALLBACK (modified_changed_cb),
+			  journal);
+
+	g_signal_connect (doc,
+			  "load",
+			  G_CALLBACK (load_cb),
+			  journal);
+
+	g_signal_connect (doc,
+			  "loaded",
+			  G_CALLBACK (loaded_cb),
+			  journal);
+
+	journals = g_list_prepend (journals, journal);
+
+	return journal;
+}
+
+/* The load started by the "load" signal of the document failed, so no
+ * "loaded" signal follows: the edits are recorded again.
+ */
+void
+gedit_recovery_journal_load_failed (GeditRecoveryJournal *journal)
+{
+	if (journal != NULL && journal->suspended)
+	{
+		resume (journal);
+	}
+}
+
+/* The document is closed, the journal file is deleted. */
+void
+gedit_recovery_journal_free (GeditRecoveryJournal *journal)
+{
+	if (journal == NULL)
+	{
+		return;
+	}
+
+	g_signal_handlers_disconnect_by_data (journal->doc, journal);
+
+	reset (journal);
+
+	journals = g_list_remove (journals, journal);
+
+	g_object_unref (journal->file);
+	g_string_free (journal->pending, TRUE);
+	g_string_free (journal->last_text, TRUE);
+
+	g_slice_free (GeditRecoveryJournal, journal);
+}
+
+/* Called when gedit quits: the documents are closed, even if GTK+ still holds
+ * references on some of them, and the journal files must be deleted before
+ * the process exits. The remaining operations are run here, after the one
+ * running in the thread.
+ */
+void
+gedit_recovery_journal_shutdown (void)
+{
+	Operation *op;
+
+	while (journals != NULL)
+	{
+		GeditRecoveryJournal *journal = journals->data;
+
+		g_signal_handlers_disconnect_by_data (journal->doc, journal);
+		reset (journal);
+
+		journals = g_list_delete_link (journals, journals);
+	}
+
+	g_mutex_lock (&operation_lock);
+
+	while (operation_running)
+	{
+		g_cond_wait (&operation_cond, &operation_lock);
+	}
+
+	g_mutex_unlock (&operation_lock);
+
+	while ((op = g_queue_pop_head (&operations)) != NULL)
+	{
+		run_operation (op);
+		operation_free (op);
+	}
+}
+
+static gboolean
+is_process_alive (gulong pid)
+{
+#ifdef G_OS_UNIX
+	return (pid == (gulong) getpid () ||
+		kill ((pid_t) pid, 0) == 0 ||
+		errno == EPERM);
+#else
+	/* No way to know, the journals are never replayed. */
+	return TRUE;
+#endif
+}
+
+/* Reads the number at *p, followed by the char 'next'. */
+static gboolean
+parse_number (const gchar **p,
+	      gchar         next,
+	      guint64      *number)
+{
+	gchar *end;
+
+	*number = g_ascii_strtoull (*p, &end, 10);
+
+	if (end == *p || *end != next)
+	{
+		return FALSE;
+	}
+
+	*p = end + 1;
+	return TRUE;
+}
+
+/* Reads the text of a S or I record. */
+static gboolean
+parse_text (const gchar **p,
+	    const gchar  *end,
+	    guint64       n_bytes,
+	    const gchar **text)
+{
+	if ((guint64) (end - *p) < n_bytes + 1 ||
+	    (*p)[n_bytes] != '\n' ||
+	    !g_utf8_validate (*p, n_bytes, NULL))
+	{
+		return FALSE;
+	}
+
+	*text = *p;
+	*p += n_bytes + 1;
+
+	return TRUE;
+}
+
+/* Returns FALSE when the record is invalid, for example when it has been
+ * truncated by the crash.
+ */
+static gboolean
+replay_record (const gchar **p,
+	       const gchar  *end,
+	       GString     **text,
+	       glong        *n_chars,
+	       gchar       **uri)
+{
+	const gchar *line = *p;
+	const gchar *eol;
+	const gchar *record_text;
+	guint64 offset;
+	guint64 n;
+
+	eol = memchr (line, '\n', end - line);
+
+	if (eol == NULL || eol - line < 2 || line[1] != ' ')
+	{
+		return FALSE;
+	}
+
+	*p = line + 2;
+
+	switch (line[0])
+	{
+		case 'L':
+			g_free (*uri);
+			*uri = g_strndup (*p, eol - *p);
+			*p = eol + 1;
+			return TRUE;
+
+		case 'S':
+			if (!parse_number (p, '\n', &n) ||
+			    !parse_text (p, end, n, &record_text))
+			{
+				return FALSE;
+			}
+
+			if (*text != NULL)
+			{
+				g_string_free (*text, TRUE);
+			}
+
+			*text = g_string_new_len (record_text, n);
+			*n_chars = g_utf8_strlen (record_text, n);
+			return TRUE;
+
+		case 'I':
+		{
+			const gchar *pos;
+
+			if (*text == NULL ||
+			    !parse_number (p, ' ', &offset) ||
+			    !parse_number (p, '\n', &n) ||
+			    offset > (guint64) *n_chars ||
+			    !parse_text (p, end, n, &record_text))
+			{
+				return FALSE;
+			}
+
+			pos = g_utf8_offset_to_pointer ((*text)->str, offset);
+			g_string_insert_len (*text, pos - (*text)->str, record_text, n);
+			*n_chars += g_utf8_strlen (record_text, n);
+			return TRUE;
+		}
+
+		case 'D':
+		{
+			const gchar *start;
+			const gchar *stop;
+
+			if (*text == NULL ||
+			    !parse_number (p, ' ', &offset) ||
+			    !parse_number (p, '\n', &n) ||
+			    offset + n > (guint64) *n_chars)
+			{
+				return FALSE;
+			}
+
+			start = g_utf8_offset_to_pointer ((*text)->str, offset);
+			stop = g_utf8_offset_to_pointer (start, n);
+			g_string_erase (*text, start - (*text)->str, stop - start);
+			*n_chars -= n;
+			return TRUE;
+		}
+
+		default:
+			return FALSE;
+	}
+}
+
+static GeditRecoveredDocument *
+replay (const gchar *contents,
+	gsize        length)
+{
+	const gchar *p = contents;
+	const gchar *end = contents + length;
+	GString *text = NULL;
+	glong n_chars = 0;
+	gchar *uri = NULL;
+	GeditRecoveredDocument *recovered;
+
+	if (length < strlen (JOURNAL_HEADER) ||
+	    strncmp (contents, JOURNAL_HEADER, strlen (JOURNAL_HEADER)) != 0)
+	{
+		return NULL;
+	}
+
+	p += strlen (JOURNAL_HEADER);
+
+	while (p < end &&
+	       replay_record (&p, end, &text, &n_chars, &uri))
+	{
+	}
+
+	if (text == NULL)
+	{
+		g_free (uri);
+		return NULL;
+	}
+
+	recovered = g_slice_new0 (GeditRecoveredDocument);
+	recovered->text = g_string_free (text, FALSE);
+
+	if (uri != NULL)
+	{
+		recovered->location = g_file_new_for_uri (uri);
+		g_free (uri);
+	}
+
+	return recovered;
+}
+
+/* Returns the documents recovered from the journals left by the gedit
+ * processes which crashed. Their journals are kept until
+ * gedit_recovered_document_delete_journal() is called, the invalid ones are
+ * deleted.
+ */
+GSList *
+gedit_recovery_journal_recover_all (void)
+{
+	gchar *dir_path;
+	GDir *dir;
+	const gchar *name;
+	GSList *recovered_docs = NULL;
+
+	dir_path = get_journals_dir ();
+	dir = g_dir_open (dir_path, 0, NULL);
+
+	if (dir == NULL)
+	{
+		g_free (dir_path);
+		return NULL;
+	}
+
+	while ((name = g_dir_read_name (dir)) != NULL)
+	{
+		gchar *end;
+		gulong pid;
+		gchar *path;
+		gchar *contents;
+		gsize length;
+
+		if (!g_str_has_suffix (name, JOURNAL_SUFFIX))
+		{
+			continue;
+		}
+
+		pid = strtoul (name, &end, 10);
+
+		if (end == name || *end != '-' || is_process_alive (pid))
+		{
+			continue;
+		}
+
+		path = g_build_filename (dir_path, name, NULL);
+
+		if (g_file_get_contents (path, &contents, &length, NULL))
+		{
+			GeditRecoveredDocument *recovered;
+
+			recovered = replay (contents, length);
+			g_free (contents);
+
+			if (recovered != NULL)
+			{
+				gedit_debug_message (DEBUG_DOCUMENT, "Recovered: %s", name);
+
+				recovered->journal = g_file_new_for_path (path);
+				recovered_docs = g_slist_prepend (recovered_docs, recovered);
+
+				g_free (path);
+				continue;
+			}
+		}
+
+		g_unlink (path);
+		g_free (path);
+	}
+
+	g_dir_close (dir);
+	g_free (dir_path);
+
+	return g_slist_reverse (recovered_docs);
+}
+
+/* Once the recovered contents are in a document, which has its own journal. */
+void
+gedit_recovered_document_delete_journal (GeditRecoveredDocument *recovered)
+{
+	g_return_if_fail (recovered != NULL);
+
+	if (recovered->journal != NULL)
+	{
+		push_operation (OPERATION_DELETE, recovered->journal, NULL, NULL);
+		g_clear_object (&recovered->journal);
+	}
+}
+
+void
+gedit_recovered_document_free (GeditRecoveredDocument *recovered)
+{
+	if (recovered != NULL)
+	{
+		g_clear_object (&recovered->location);
+		g_clear_object (&recovered->journal);
+		g_free (recovered->text);
+		g_slice_free (GeditRecoveredDocument, recovered);
+	}
+}
+
+/* ex:set ts=8 noet: */
@@ -0,0 +1,63 @@
+/*
+ * gedit-recovery-journal.h
+ * This file is part of gedit
+ *
+ * Copyright (C) 2016 - The gedit Team
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEDIT_RECOVERY_JOURNAL_H__
+#define __GEDIT_RECOVERY_JOURNAL_H__
+
+#include "gedit-document.h"
+
+G_BEGIN_DECLS
+
+typedef struct _GeditRecoveryJournal GeditRecoveryJournal;
+
+typedef struct _GeditRecoveredDocument GeditRecoveredDocument;
+
+struct _GeditRecoveredDocument
+{
+	/* NULL for an untitled document. */
+	GFile *location;
+
+	gchar *text;
+
+	/* The journal file, deleted by
+	 * gedit_recovered_document_delete_journal().
+	 */
+	GFile *journal;
+};
+
+GeditRecoveryJournal	*gedit_recovery_journal_new		(GeditDocument          *doc);
+
+void			 gedit_recovery_journal_load_failed	(GeditRecoveryJournal   *journal);
+
+void			 gedit_recovery_journal_free		(GeditRecoveryJournal   *journal);
+
+void			 gedit_recovery_journal_shutdown	(void);
+
+GSList			*gedit_recovery_journal_recover_all	(void);
+
+void			 gedit_recovered_document_delete_journal (GeditRecoveredDocument *recovered);
+
+void			 gedit_recovered_document_free		(GeditRecoveredDocument *recovered);
+
+G_END_DECLS
+
+#endif /* __GEDIT_RECOVERY_JOURNAL_H__ */
+
+/* ex:set ts=8 noet: */
@@ -241,7 +241,7 @@ on_scheme_changed (GSettings     *settings,
 		}
 	}
 
-	docs = gedit_app_get_documents (GEDIT_APP (g_application_get_default ()));
+	docs = _gedit_app_peek_documents (GEDIT_APP (g_application_get_default ()));
 
 	for (l = docs; l != NULL; l = g_list_next (l))
 	{
@@ -264,7 +264,7 @@ on_auto_save_changed (GSettings     *settings,
 
 	auto_save = g_settings_get_boolean (settings, key);
 
-	docs = gedit_app_get_documents (GEDIT_APP (g_application_get_default ()));
+	docs = _gedit_app_peek_documents (GEDIT_APP (g_application_get_default ()));
 
 	for (l = docs; l != NULL; l = g_list_next (l))
 	{
@@ -286,7 +286,7 @@ on_auto_save_interval_changed (GSettings     *settings,
 
 	g_settings_get (settings, key, "u", &auto_save_interval);
 
-	docs = gedit_app_get_documents (GEDIT_APP (g_application_get_default ()));
+	docs = _gedit_app_peek_documents (GEDIT_APP (g_application_get_default ()));
 
 	for (l = docs; l != NULL; l = g_list_next (l))
 	{
@@ -308,7 +308,7 @@ on_syntax_highlighting_changed (GSettings     *settings,
 
 	enable = g_settings_get_boolean (settings, key);
 
-	docs = gedit_app_get_documents (GEDIT_APP (g_application_get_default ()));
+	docs = _gedit_app_peek_documents (GEDIT_APP (g_application_get_default ()));
 
 	for (l = docs; l != NULL; l = g_list_next (l))
 	{
@@ -94,6 +94,19 @@ void			 gedit_settings_set_list			(GSettings     *settings,
 #define GEDIT_SETTINGS_CANDIDATE_ENCODINGS		"candidate-encodings"
 #define GEDIT_SETTINGS_ACTIVE_PLUGINS			"active-plugins"
 #define GEDIT_SETTINGS_ENSURE_TRAILING_NEWLINE		"ensure-trailing-newline"
+#define GEDIT_SETTINGS_VIEWER_MODE_THRESHOLD		"viewer-mode-threshold"
+#define GEDIT_SETTINGS_MAX_CONCURRENT_LOADS		"max-concurrent-loads"
+#define GEDIT_SETTINGS_HIBERNATION_DELAY		"hibernation-delay"
+#define GEDIT_SETTINGS_CRASH_RECOVERY			"crash-recovery"
+#define GEDIT_SETTINGS_MINIMAL_DIFF_REVERT		"minimal-diff-revert"
+#define GEDIT_SETTINGS_AUTO_RELOAD			"auto-reload"
+#define GEDIT_SETTINGS_FOLLOW_MAX_LINES			"follow-max-lines"
+#define GEDIT_SETTINGS_FOLLOW_AUTO_SCROLL		"follow-auto-scroll"
+#define GEDIT_SETTINGS_BINARY_DETECTION_THRESHOLD	"binary-detection-threshold"
+#define GEDIT_SETTINGS_LONG_LINE_THRESHOLD		"long-line-threshold"
+#define GEDIT_SETTINGS_LARGE_DOCUMENT_SIZE		"large-document-size"
+#define GEDIT_SETTINGS_LARGE_DOCUMENT_LINES		"large-document-lines"
+#define GEDIT_SETTINGS_MAX_METADATA_ITEMS		"max-metadata-items"
 
 /* window state keys */
 #define GEDIT_SETTINGS_WINDOW_STATE			"state"
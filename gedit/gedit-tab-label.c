@@ -157,7 +157,8 @@ sync_state (GeditTab      *tab,
 
 	state = gedit_tab_get_state (tab);
 
-	if ((state == GEDIT_TAB_STATE_LOADING) ||
+	/* A placeholder tab is not loading anything yet. */
+	if ((state == GEDIT_TAB_STATE_LOADING && !_gedit_tab_is_placeholder (tab)) ||
 	    (state == GEDIT_TAB_STATE_SAVING) ||
 	    (state == GEDIT_TAB_STATE_REVERTING))
 	{
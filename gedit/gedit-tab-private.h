@@ -41,14 +41,38 @@ void		 _gedit_tab_load			(GeditTab                *tab,
 							 gint                     column_pos,
 							 gboolean                 create);
 
+void		 _gedit_tab_load_placeholder		(GeditTab                *tab,
+							 GFile                   *location,
+							 const GtkSourceEncoding *encoding,
+							 gint                     line_pos,
+							 gint                     column_pos,
+							 gboolean                 create);
+
+gboolean	 _gedit_tab_is_placeholder		(GeditTab                *tab);
+
+void		 _gedit_tab_materialize			(GeditTab                *tab);
+
 void		 _gedit_tab_load_stream			(GeditTab                *tab,
 							 GInputStream            *location,
 							 const GtkSourceEncoding *encoding,
 							 gint                     line_pos,
 							 gint                     column_pos);
 
+void		 _gedit_tab_load_snapshot		(GeditTab                *tab,
+							 GFile                   *location,
+							 GInputStream            *stream,
+							 const GtkSourceEncoding *encoding,
+							 const GTimeVal          *mtime,
+							 gint                     line_pos,
+							 gint                     column_pos);
+
 void		 _gedit_tab_revert			(GeditTab                *tab);
 
+void		 _gedit_tab_check_file_on_disk		(GeditTab                *tab);
+
+void		 _gedit_tab_set_file_monitored		(GeditTab                *tab,
+							 gboolean                 monitored);
+
 void		 _gedit_tab_save_async			(GeditTab                *tab,
 							 GCancellable            *cancellable,
 							 GAsyncReadyCallback      callback,
@@ -74,6 +98,13 @@ gboolean	 _gedit_tab_get_can_close		(GeditTab                 *tab);
 
 GeditViewFrame	*_gedit_tab_get_view_frame		(GeditTab                 *tab);
 
+gboolean	 _gedit_tab_get_viewer_mode		(GeditTab                 *tab);
+
+void		 _gedit_tab_set_follow			(GeditTab                 *tab,
+							 gboolean                  follow);
+
+gboolean	 _gedit_tab_get_follow			(GeditTab                 *tab);
+
 void		 _gedit_tab_set_network_available	(GeditTab	     *tab,
 							 gboolean	     enable);
 
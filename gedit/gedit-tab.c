@@ -23,13 +23,17 @@
 #include "gedit-tab-private.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <glib/gi18n.h>
 
 #include "gedit-app.h"
 #include "gedit-app-private.h"
+#include "gedit-compression.h"
+#include "gedit-content-sniffer.h"
 #include "gedit-recent.h"
 #include "gedit-utils.h"
 #include "gedit-io-error-info-bar.h"
+#include "gedit-line-diff.h"
 #include "gedit-print-job.h"
 #include "gedit-print-preview.h"
 #include "gedit-progress-info-bar.h"
@@ -39,9 +43,42 @@
 #include "gedit-enum-types.h"
 #include "gedit-settings.h"
 #include "gedit-view-frame.h"
+#include "gedit-mapped-file-viewer.h"
+#include "gedit-recovery-journal.h"
 
 #define GEDIT_TAB_KEY "GEDIT_TAB_KEY"
 
+/* When more than this number of bytes have been read, the part of the file
+ * that is already loaded is displayed and can be scrolled, while the rest of
+ * the file is still being loaded.
+ */
+#define PROGRESSIVE_DISPLAY_MIN_SIZE (256 * 1024)
+
+/* The file loader inserts the contents in the buffer from its I/O callbacks.
+ * With G_PRIORITY_DEFAULT they starve the redraws and the first validation of
+ * the text view, so the window stays frozen until the end of the loading.
+ */
+#define LOADER_IO_PRIORITY GTK_TEXT_VIEW_PRIORITY_VALIDATE
+
+/* While some tabs wait for their hibernation, the available memory is
+ * checked at this interval, in seconds.
+ */
+#define MEMORY_PRESSURE_CHECK_INTERVAL 30
+
+/* When reverting, if more lines than this have changed, the whole file is
+ * reloaded instead of applying the differences.
+ */
+#define MAX_REVERT_DIFF_EDITS 1000
+
+/* Maximum number of bytes read at once in follow mode. */
+#define FOLLOW_READ_SIZE (256 * 1024)
+
+/* The documents with at least this number of characters are saved from a
+ * copy of their text, so that they stay editable during the saving. See
+ * use_copy_saver().
+ */
+#define COPY_SAVE_MIN_SIZE (256 * 1024)
+
 struct _GeditTab
 {
 	GtkBox parent_instance;
@@ -60,6 +97,29 @@ struct _GeditTab
 
 	GtkSourceFileSaverFlags save_flags;
 
+	/* The location under which the tab is in the app's location index. */
+	GFile *indexed_location;
+
+	/* Set in viewer mode, for huge files, and for the hex preview of a
+	 * binary file.
+	 */
+	GeditMappedFileViewer *viewer;
+
+	/* To recover the document after a crash. */
+	GeditRecoveryJournal *journal;
+
+	/* For a placeholder tab, the load started when the tab is shown for
+	 * the first time.
+	 */
+	GTask *placeholder_task;
+
+	/* Hibernation of a tab not shown for a long time: the contents of the
+	 * document are dropped and reloaded when the tab is shown again.
+	 */
+	guint hibernation_timeout_id;
+	gint hibernated_line;
+	gint hibernated_line_offset;
+
 	guint idle_scroll;
 
 	gint auto_save_interval;
@@ -69,17 +129,114 @@ struct _GeditTab
 	guint auto_save : 1;
 
 	guint ask_if_externally_modified : 1;
+
+	/* Whether the file is watched by the file watcher of the window, in
+	 * which case it is not checked each time the view gets the focus.
+	 */
+	guint file_monitored : 1;
+	guint check_file_on_focus : 1;
+
+	/* The file is checked asynchronously, one check at a time, see
+	 * _gedit_tab_check_file_on_disk().
+	 */
+	guint checking_file : 1;
+	guint check_file_pending : 1;
+
+	/* Whether the viewer shows a hex dump. */
+	guint hex_preview : 1;
+
+	/* The file is still being loaded but what is already loaded is
+	 * displayed.
+	 */
+	guint progressive_display : 1;
+
+	guint hibernated : 1;
+
+	/* The view stays editable while the document is saved from a copy
+	 * of its text.
+	 */
+	guint saving_copy : 1;
+
+	/* The document has been loaded with invalid characters, see
+	 * use_copy_saver().
+	 */
+	guint invalid_chars : 1;
+
+	/* Follow mode: what is appended to the file is appended to the
+	 * buffer. follow_offset is the number of bytes of the file already
+	 * read.
+	 */
+	GFileMonitor *follow_monitor;
+	GCancellable *follow_cancellable;
+	GCharsetConverter *follow_converter;
+	GByteArray *follow_undecoded;
+	gchar *follow_held_newline;
+	goffset follow_offset;
+	guint follow : 1;
+	guint follow_reading : 1;
+	guint follow_pending : 1;
+	guint follow_trimmed : 1;
 };
 
+typedef struct _OperationStats OperationStats;
 typedef struct _SaverData SaverData;
 typedef struct _LoaderData LoaderData;
 
+/* Measures of a file loading, reverting or saving, to know where the time
+ * goes. They are logged with GEDIT_DEBUG_TAB. The times are in microseconds.
+ */
+struct _OperationStats
+{
+	/* Number of bytes read or written. */
+	goffset bytes;
+
+	/* From the request to the end of the operation. */
+	gint64 wall_time;
+
+	/* Waiting in the loads queue. */
+	gint64 queue_time;
+
+	/* Scanning the content of the file to choose its encoding. */
+	gint64 sniff_time;
+
+	/* Spent in the GtkSourceFileLoader or GtkSourceFileSaver, where the
+	 * I/O and the charset conversion are interleaved.
+	 */
+	gint64 transfer_time;
+
+	/* From the start of the loader or saver to its first progress. */
+	gint64 time_to_first_byte;
+
+	/* For a revert applying only the differences: computing them. */
+	gint64 diff_time;
+
+	/* Number of candidate encodings tried by the loader, the last one
+	 * being the chosen one.
+	 */
+	guint encoding_attempts;
+
+	guint success : 1;
+};
+
 struct _SaverData
 {
 	GtkSourceFileSaver *saver;
 
 	GTimer *timer;
 
+	OperationStats stats;
+	gint64 start_time;
+
+	/* For a document saved from a copy of its text: whether it has been
+	 * edited since the copy, and the copy with its saver when the copy
+	 * is written by GtkSourceView.
+	 */
+	GtkTextBuffer *document;
+	gulong document_changed_id;
+	GtkSourceBuffer *copy;
+	GtkSourceFileSaver *copy_saver;
+	guint document_changed : 1;
+
 	/* Notes about the create_backup saver flag:
 	 * - At the beginning of a new file saving, force_no_backup is FALSE.
 	 *   The create_backup flag is set to the saver if it is enabled in
@@ -107,7 +264,54 @@ struct _LoaderData
 	GTimer *timer;
 	gint line_pos;
 	gint column_pos;
+
+	/* The encoding passed to load_async(), for a load that is waiting in
+	 * the queue.
+	 */
+	const GtkSourceEncoding *requested_encoding;
+
 	guint user_requested_encoding : 1;
+	guint progressive_display : 1;
+
+	/* Whether the load takes a slot in the loads queue. */
+	guint uses_load_slot : 1;
+
+	/* The user has chosen to load a file that looks binary, see
+	 * ask_binary_file(). The candidate encodings are already known.
+	 */
+	guint binary_accepted : 1;
+
+	/* For the statistics of the load. */
+	OperationStats stats;
+	gint64 request_time;
+	gint64 launch_time;
+	gint64 transfer_start_time;
+	gint64 diff_start_time;
+	GSList *candidate_encodings;
+
+	/* For a revert applying only the differences: the new contents of the
+	 * file, and whether the document has changed in the meantime.
+	 */
+	GtkSourceBuffer *new_contents;
+	guint document_changed : 1;
+
+	/* For a file compressed in a format unknown to GtkSourceView: its
+	 * location. The file is decompressed by a stream given to the loader,
+	 * so the loader doesn't know the location.
+	 */
+	GFile *compressed_location;
+
+	/* For a loader reading a stream: the modification time of the file,
+	 * if known. See _gedit_document_set_file_properties().
+	 */
+	GTimeVal mtime;
+	guint mtime_set : 1;
+
+	/* The contents come from the snapshot of a closed tab, see
+	 * gedit-closed-tab.c, and compressed_location is the location of the
+	 * file.
+	 */
+	guint from_snapshot : 1;
 };
 
 G_DEFINE_TYPE (GeditTab, gedit_tab, GTK_TYPE_BOX)
@@ -120,6 +324,7 @@ enum
 	PROP_AUTO_SAVE,
 	PROP_AUTO_SAVE_INTERVAL,
 	PROP_CAN_CLOSE,
+	PROP_FOLLOW,
 	LAST_PROP
 };
 
@@ -133,13 +338,48 @@ enum
 
 static guint signals[LAST_SIGNAL];
 
+/* Queue of the file loads. When many files are opened at once, only a few of
+ * them are loaded at the same time, the loads of the visible tabs first, so
+ * that the main loop is not flooded by all the loaders.
+ */
+static GQueue pending_loads = G_QUEUE_INIT;
+static guint n_running_loads = 0;
+static guint start_pending_loads_id = 0;
+
+/* The tabs waiting for their hibernation. */
+static GList *hibernation_candidates = NULL;
+static guint memory_pressure_check_id = 0;
+static guint64 hibernation_bytes_reclaimed = 0;
+
 static gboolean gedit_tab_auto_save (GeditTab *tab);
 
 static void launch_loader (GTask                   *loading_task,
 			   const GtkSourceEncoding *encoding);
 
+static void start_load (GTask *loading_task);
+
 static void launch_saver (GTask *saving_task);
 
+static void cancel_pending_load (GeditTab *tab);
+
+static void update_location_index (GeditTab *tab,
+				   GFile    *location);
+
+static void tab_mapped (GeditTab *tab);
+
+static void tab_unmapped (GeditTab *tab);
+
+static void stop_hibernation_timer (GeditTab *tab);
+
+static void wake_up (GeditTab            *tab,
+		     GAsyncReadyCallback  callback,
+		     gpointer             user_data);
+
+static gboolean load_finish (GeditTab     *tab,
+			     GAsyncResult *result);
+
+static void stop_following (GeditTab *tab);
+
 static SaverData *
 saver_data_new (void)
 {
@@ -161,6 +401,14 @@ saver_data_free (SaverData *data)
 			g_timer_destroy (data->timer);
 		}
 
+		if (data->document_changed_id != 0)
+		{
+			g_signal_handler_disconnect (data->document, data->document_changed_id);
+		}
+
+		g_clear_object (&data->copy_saver);
+		g_clear_object (&data->copy);
+
 		g_slice_free (SaverData, data);
 	}
 }
@@ -186,10 +434,25 @@ loader_data_free (LoaderData *data)
 			g_timer_destroy (data->timer);
 		}
 
+		g_clear_object (&data->new_contents);
+		g_clear_object (&data->compressed_location);
+		g_slist_free (data->candidate_encodings);
+
 		g_slice_free (LoaderData, data);
 	}
 }
 
+static GFile *
+get_loader_location (LoaderData *data)
+{
+	if (data->compressed_location != NULL)
+	{
+		return data->compressed_location;
+	}
+
+	return gtk_source_file_loader_get_location (data->loader);
+}
+
 static void
 set_editable (GeditTab *tab,
 	      gboolean  editable)
@@ -202,7 +465,8 @@ set_editable (GeditTab *tab,
 	view = gedit_tab_get_view (tab);
 
 	val = (tab->state == GEDIT_TAB_STATE_NORMAL &&
-	       tab->editable);
+	       tab->editable &&
+	       tab->viewer == NULL);
 
 	gtk_text_view_set_editable (GTK_TEXT_VIEW (view), val);
 }
@@ -244,6 +508,7 @@ update_auto_save_timeout (GeditTab *tab)
 	file = gedit_document_get_file (doc);
 
 	if (tab->state == GEDIT_TAB_STATE_NORMAL &&
+	    tab->viewer == NULL &&
 	    tab->auto_save &&
 	    !gedit_document_is_untitled (doc) &&
 	    !gtk_source_file_is_readonly (file))
@@ -256,6 +521,17 @@ update_auto_save_timeout (GeditTab *tab)
 	}
 }
 
+static void
+close_viewer (GeditTab *tab)
+{
+	if (tab->viewer != NULL)
+	{
+		gedit_view_frame_set_mapped_file_viewer (tab->frame, NULL);
+		gedit_mapped_file_viewer_free (tab->viewer);
+		tab->viewer = NULL;
+	}
+}
+
 static void
 gedit_tab_get_property (GObject    *object,
 		        guint       prop_id,
@@ -286,6 +562,10 @@ gedit_tab_get_property (GObject    *object,
 			g_value_set_boolean (value, _gedit_tab_get_can_close (tab));
 			break;
 
+		case PROP_FOLLOW:
+			g_value_set_boolean (value, _gedit_tab_get_follow (tab));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -310,6 +590,10 @@ gedit_tab_set_property (GObject      *object,
 			gedit_tab_set_auto_save_interval (tab, g_value_get_int (value));
 			break;
 
+		case PROP_FOLLOW:
+			_gedit_tab_set_follow (tab, g_value_get_boolean (value));
+			break;
+
 		default:
 			G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
 			break;
@@ -321,12 +605,35 @@ gedit_tab_dispose (GObject *object)
 {
 	GeditTab *tab = GEDIT_TAB (object);
 
+	stop_following (tab);
+
 	g_clear_object (&tab->editor_settings);
 	g_clear_object (&tab->print_job);
 	g_clear_object (&tab->print_preview);
 
 	remove_auto_save_timeout (tab);
 
+	close_viewer (tab);
+	cancel_pending_load (tab);
+	update_location_index (tab, NULL);
+	stop_hibernation_timer (tab);
+
+	gedit_recovery_journal_free (tab->journal);
+	tab->journal = NULL;
+
+	if (tab->placeholder_task != NULL)
+	{
+		GTask *loading_task = tab->placeholder_task;
+
+		tab->placeholder_task = NULL;
+
+		g_task_return_new_error (loading_task,
+					 G_IO_ERROR,
+					 G_IO_ERROR_CANCELLED,
+					 "The load has been cancelled");
+		g_object_unref (loading_task);
+	}
+
 	if (tab->idle_scroll != 0)
 	{
 		g_source_remove (tab->idle_scroll);
@@ -411,6 +718,13 @@ gedit_tab_class_init (GeditTabClass *klass)
 		                      TRUE,
 		                      G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
 
+	properties[PROP_FOLLOW] =
+		g_param_spec_boolean ("follow",
+		                      "Follow",
+		                      "Whether the text appended to the file is appended to the document",
+		                      FALSE,
+		                      G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
 	g_object_class_install_properties (object_class, LAST_PROP, properties);
 
 	signals[DROP_URIS] =
@@ -441,21 +755,23 @@ gedit_tab_get_state (GeditTab *tab)
 }
 
 static void
-set_cursor_according_to_state (GtkTextView   *view,
+set_cursor_according_to_state (GeditTab      *tab,
 			       GeditTabState  state)
 {
+	GtkTextView *view;
 	GdkDisplay *display;
 	GdkCursor *cursor;
 	GdkWindow *text_window;
 	GdkWindow *left_window;
 
+	view = GTK_TEXT_VIEW (gedit_tab_get_view (tab));
 	display = gtk_widget_get_display (GTK_WIDGET (view));
 
 	text_window = gtk_text_view_get_window (view, GTK_TEXT_WINDOW_TEXT);
 	left_window = gtk_text_view_get_window (view, GTK_TEXT_WINDOW_LEFT);
 
-	if ((state == GEDIT_TAB_STATE_LOADING)          ||
-	    (state == GEDIT_TAB_STATE_REVERTING)        ||
+	if ((state == GEDIT_TAB_STATE_LOADING && !tab->progressive_display)   ||
+	    (state == GEDIT_TAB_STATE_REVERTING && !tab->progressive_display) ||
 	    (state == GEDIT_TAB_STATE_SAVING)           ||
 	    (state == GEDIT_TAB_STATE_PRINTING)         ||
 	    (state == GEDIT_TAB_STATE_CLOSING))
@@ -486,7 +802,7 @@ static void
 view_realized (GtkTextView *view,
 	       GeditTab    *tab)
 {
-	set_cursor_according_to_state (view, tab->state);
+	set_cursor_according_to_state (tab, tab->state);
 }
 
 static void
@@ -502,15 +818,18 @@ set_view_properties_according_to_state (GeditTab      *tab,
 
 	view = gedit_tab_get_view (tab);
 
-	val = ((state == GEDIT_TAB_STATE_NORMAL) &&
-	       tab->editable);
+	val = ((state == GEDIT_TAB_STATE_NORMAL ||
+		(state == GEDIT_TAB_STATE_SAVING && tab->saving_copy)) &&
+	       tab->editable &&
+	       tab->viewer == NULL &&
+	       !tab->follow);
 	gtk_text_view_set_editable (GTK_TEXT_VIEW (view), val);
 
-	val = ((state != GEDIT_TAB_STATE_LOADING) &&
+	val = ((state != GEDIT_TAB_STATE_LOADING || tab->progressive_display) &&
 	       (state != GEDIT_TAB_STATE_CLOSING));
 	gtk_text_view_set_cursor_visible (GTK_TEXT_VIEW (view), val);
 
-	val = ((state != GEDIT_TAB_STATE_LOADING) &&
+	val = ((state != GEDIT_TAB_STATE_LOADING || tab->progressive_display) &&
 	       (state != GEDIT_TAB_STATE_CLOSING) &&
 	       (hl_current_line));
 	gtk_source_view_set_highlight_current_line (GTK_SOURCE_VIEW (view), val);
@@ -544,8 +863,7 @@ gedit_tab_set_state (GeditTab      *tab,
 		gtk_widget_show (GTK_WIDGET (tab->frame));
 	}
 
-	set_cursor_according_to_state (GTK_TEXT_VIEW (gedit_tab_get_view (tab)),
-				       state);
+	set_cursor_according_to_state (tab, state);
 
 	update_auto_save_timeout (tab);
 
@@ -553,6 +871,38 @@ gedit_tab_set_state (GeditTab      *tab,
 	g_object_notify_by_pspec (G_OBJECT (tab), properties[PROP_CAN_CLOSE]);
 }
 
+static void
+update_location_index (GeditTab *tab,
+		       GFile    *location)
+{
+	GApplication *app = g_application_get_default ();
+
+	if (tab->indexed_location == location)
+	{
+		return;
+	}
+
+	if (tab->indexed_location != NULL)
+	{
+		if (app != NULL)
+		{
+			_gedit_app_remove_tab_location (GEDIT_APP (app),
+							tab,
+							tab->indexed_location);
+		}
+
+		g_clear_object (&tab->indexed_location);
+	}
+
+	if (location != NULL && app != NULL)
+	{
+		tab->indexed_location = g_object_ref (location);
+		_gedit_app_add_tab_location (GEDIT_APP (app),
+					     tab,
+					     tab->indexed_location);
+	}
+}
+
 static void
 document_location_notify_handler (GtkSourceFile *file,
 				  GParamSpec    *pspec,
@@ -560,6 +910,8 @@ document_location_notify_handler (GtkSourceFile *file,
 {
 	gedit_debug (DEBUG_TAB);
 
+	update_location_index (tab, gtk_source_file_get_location (file));
+
 	/* Notify the change in the location */
 	g_object_notify_by_pspec (G_OBJECT (tab), properties[PROP_NAME]);
 }
@@ -657,7 +1009,7 @@ io_loading_error_info_bar_response (GtkWidget *info_bar,
 	GFile *location;
 	const GtkSourceEncoding *encoding;
 
-	location = gtk_source_file_loader_get_location (data->loader);
+	location = get_loader_location (data);
 
 	switch (response_id)
 	{
@@ -1242,43 +1594,142 @@ display_externally_modified_notification (GeditTab *tab)
 }
 
 static gboolean
-view_focused_in (GtkWidget     *widget,
-                 GdkEventFocus *event,
-                 GeditTab      *tab)
+should_check_file_on_disk (GeditTab *tab)
 {
 	GeditDocument *doc;
-	GtkSourceFile *file;
 
-	g_return_val_if_fail (GEDIT_IS_TAB (tab), GDK_EVENT_PROPAGATE);
+	/* we already asked, don't bug the user again */
+	if (!tab->ask_if_externally_modified)
+	{
+		return FALSE;
+	}
 
-	/* we try to detect file changes only in the normal state */
-	if (tab->state != GEDIT_TAB_STATE_NORMAL)
+	/* The changes are appended to the document. */
+	if (tab->follow)
 	{
-		return GDK_EVENT_PROPAGATE;
+		return FALSE;
 	}
 
-	/* we already asked, don't bug the user again */
-	if (!tab->ask_if_externally_modified)
+	/* The file is loaded anyway when the tab is shown. A hibernated
+	 * document never needs saving, see _gedit_document_needs_saving().
+	 */
+	if (tab->hibernated || tab->placeholder_task != NULL)
 	{
-		return GDK_EVENT_PROPAGATE;
+		return FALSE;
 	}
 
 	doc = gedit_tab_get_document (tab);
-	file = gedit_document_get_file (doc);
 
 	/* If file was never saved or is remote we do not check */
-	if (gtk_source_file_is_local (file))
-	{
-		gtk_source_file_check_file_on_disk (file);
+	return gtk_source_file_is_local (gedit_document_get_file (doc));
+}
+
+static void
+check_file_on_disk_cb (GeditDocument *doc,
+		       GAsyncResult  *result,
+		       GeditTab      *tab)
+{
+	gboolean externally_modified = FALSE;
+
+	_gedit_document_check_file_on_disk_finish (doc, result, &externally_modified, NULL);
 
-		if (gtk_source_file_is_externally_modified (file))
+	tab->checking_file = FALSE;
+
+	if (tab->check_file_pending)
+	{
+		/* The file has changed again, or the tab came back to the
+		 * normal state, in the meantime.
+		 */
+		tab->check_file_pending = FALSE;
+		_gedit_tab_check_file_on_disk (tab);
+	}
+	else if (externally_modified)
+	{
+		/* The state may have changed in the meantime. */
+		if (tab->state != GEDIT_TAB_STATE_NORMAL)
+		{
+			tab->check_file_on_focus = TRUE;
+		}
+		else if (should_check_file_on_disk (tab))
 		{
-			gedit_tab_set_state (tab, GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION);
+			if (!gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (doc)) &&
+			    g_settings_get_boolean (tab->editor_settings, GEDIT_SETTINGS_AUTO_RELOAD))
+			{
+				gedit_debug_message (DEBUG_TAB, "Reload the externally modified file");
+
+				_gedit_tab_revert (tab);
+			}
+			else
+			{
+				gedit_tab_set_state (tab, GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION);
 
-			display_externally_modified_notification (tab);
+				display_externally_modified_notification (tab);
+			}
 		}
 	}
 
+	g_object_unref (tab);
+}
+
+/* The file is queried asynchronously, so that a burst of changes, seen by the
+ * file watcher, doesn't block the main loop.
+ */
+void
+_gedit_tab_check_file_on_disk (GeditTab *tab)
+{
+	g_return_if_fail (GEDIT_IS_TAB (tab));
+
+	/* we try to detect file changes only in the normal state */
+	if (tab->state != GEDIT_TAB_STATE_NORMAL)
+	{
+		/* Check again when the user comes back to the tab. */
+		tab->check_file_on_focus = TRUE;
+		return;
+	}
+
+	tab->check_file_on_focus = FALSE;
+
+	if (!should_check_file_on_disk (tab))
+	{
+		return;
+	}
+
+	if (tab->checking_file)
+	{
+		tab->check_file_pending = TRUE;
+		return;
+	}
+
+	tab->checking_file = TRUE;
+
+	_gedit_document_check_file_on_disk_async (gedit_tab_get_document (tab),
+						  NULL,
+						  (GAsyncReadyCallback) check_file_on_disk_cb,
+						  g_object_ref (tab));
+}
+
+void
+_gedit_tab_set_file_monitored (GeditTab *tab,
+			       gboolean  monitored)
+{
+	g_return_if_fail (GEDIT_IS_TAB (tab));
+
+	tab->file_monitored = monitored != FALSE;
+}
+
+static gboolean
+view_focused_in (GtkWidget     *widget,
+                 GdkEventFocus *event,
+                 GeditTab      *tab)
+{
+	g_return_val_if_fail (GEDIT_IS_TAB (tab), GDK_EVENT_PROPAGATE);
+
+	/* The changes of a watched file are already known. */
+	if (!tab->file_monitored || tab->check_file_on_focus)
+	{
+		_gedit_tab_check_file_on_disk (tab);
+	}
+
 	return GDK_EVENT_PROPAGATE;
 }
 
@@ -1400,6 +1851,12 @@ gedit_tab_init (GeditTab *tab)
 			  G_CALLBACK (document_modified_changed),
 			  tab);
 
+	if (g_settings_get_boolean (tab->editor_settings, GEDIT_SETTINGS_CRASH_RECOVERY) &&
+	    !(lockdown & GEDIT_LOCKDOWN_SAVE_TO_DISK))
+	{
+		tab->journal = gedit_recovery_journal_new (doc);
+	}
+
 	view = gedit_tab_get_view (tab);
 
 	g_signal_connect_after (view,
@@ -1416,6 +1873,16 @@ gedit_tab_init (GeditTab *tab)
 			  "drop-uris",
 			  G_CALLBACK (on_drop_uris),
 			  tab);
+
+	g_signal_connect (tab,
+			  "map",
+			  G_CALLBACK (tab_mapped),
+			  NULL);
+
+	g_signal_connect (tab,
+			  "unmap",
+			  G_CALLBACK (tab_unmapped),
+			  NULL);
 }
 
 GeditTab *
@@ -1522,7 +1989,6 @@ _gedit_tab_get_tooltip (GeditTab *tab)
 		gchar *content_description;
 		gchar *content_full_description;
 		gchar *encoding;
-		GtkSourceFile *file;
 		const GtkSourceEncoding *enc;
 
 		case GEDIT_TAB_STATE_LOADING_ERROR:
@@ -1554,8 +2020,7 @@ _gedit_tab_get_tooltip (GeditTab *tab)
 			g_free (mime_type);
 			g_free (content_description);
 
-			file = gedit_document_get_file (doc);
-			enc = gtk_source_file_get_encoding (file);
+			enc = _gedit_document_get_file_encoding (doc);
 
 			if (enc == NULL)
 			{
@@ -1649,6 +2114,43 @@ gedit_tab_get_from_document (GeditDocument *doc)
 	return g_object_get_data (G_OBJECT (doc), GEDIT_TAB_KEY);
 }
 
+static void
+start_progressive_display (GTask *loading_task)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GtkTextIter start;
+
+	gedit_debug (DEBUG_TAB);
+
+	data->progressive_display = TRUE;
+	tab->progressive_display = TRUE;
+
+	/* The loader inserts the next chunks at the end of the buffer, so with
+	 * the cursor at the start the view stays at the top of the file while
+	 * the user can already scroll and read it.
+	 */
+	gtk_text_buffer_get_start_iter (GTK_TEXT_BUFFER (doc), &start);
+	gtk_text_buffer_place_cursor (GTK_TEXT_BUFFER (doc), &start);
+
+	/* The view is still not editable until the end of the loading. */
+	set_view_properties_according_to_state (tab, tab->state);
+	set_cursor_according_to_state (tab, tab->state);
+}
+
+static void
+stop_progressive_display (GeditTab *tab)
+{
+	if (tab->progressive_display)
+	{
+		tab->progressive_display = FALSE;
+
+		set_view_properties_according_to_state (tab, tab->state);
+		set_cursor_according_to_state (tab, tab->state);
+	}
+}
+
 static void
 loader_progress_cb (goffset  size,
 		    goffset  total_size,
@@ -1660,6 +2162,19 @@ loader_progress_cb (goffset  size,
 	g_return_if_fail (tab->state == GEDIT_TAB_STATE_LOADING ||
 			  tab->state == GEDIT_TAB_STATE_REVERTING);
 
+	if (data->stats.time_to_first_byte == 0 && size > 0)
+	{
+		data->stats.time_to_first_byte = g_get_monotonic_time () - data->transfer_start_time;
+	}
+
+	data->stats.bytes = size;
+
+	if (!data->progressive_display &&
+	    size >= PROGRESSIVE_DISPLAY_MIN_SIZE)
+	{
+		start_progressive_display (loading_task);
+	}
+
 	if (should_show_progress_info (&data->timer, size, total_size))
 	{
 		show_loading_info_bar (loading_task);
@@ -1675,6 +2190,22 @@ goto_line (GTask *loading_task)
 	GeditDocument *doc = gedit_tab_get_document (tab);
 	GtkTextIter iter;
 
+	/* If the user has already moved the cursor while the file was being
+	 * loaded, keep it where it is.
+	 */
+	if (data->progressive_display)
+	{
+		GtkTextMark *insert;
+
+		insert = gtk_text_buffer_get_insert (GTK_TEXT_BUFFER (doc));
+		gtk_text_buffer_get_iter_at_mark (GTK_TEXT_BUFFER (doc), &iter, insert);
+
+		if (!gtk_text_iter_is_start (&iter))
+		{
+			return;
+		}
+	}
+
 	/* Move the cursor at the requested line if any. */
 	if (data->line_pos > 0)
 	{
@@ -1721,42 +2252,26 @@ static gboolean
 file_already_opened (GeditDocument *doc,
 		     GFile         *location)
 {
-	GList *all_documents;
+	GList *tabs;
 	GList *l;
-	gboolean already_opened = FALSE;
 
 	if (location == NULL)
 	{
 		return FALSE;
 	}
 
-	all_documents = gedit_app_get_documents (GEDIT_APP (g_application_get_default ()));
+	tabs = _gedit_app_get_tabs_from_location (GEDIT_APP (g_application_get_default ()),
+						  location);
 
-	for (l = all_documents; l != NULL; l = l->next)
+	for (l = tabs; l != NULL; l = l->next)
 	{
-		GeditDocument *cur_doc = l->data;
-		GtkSourceFile *cur_file;
-		GFile *cur_location;
-
-		if (cur_doc == doc)
-		{
-			continue;
-		}
-
-		cur_file = gedit_document_get_file (cur_doc);
-		cur_location = gtk_source_file_get_location (cur_file);
-
-		if (cur_location != NULL &&
-		    g_file_equal (location, cur_location))
+		if (gedit_tab_get_document (l->data) != doc)
 		{
-			already_opened = TRUE;
-			break;
+			return TRUE;
 		}
 	}
 
-	g_list_free (all_documents);
-
-	return already_opened;
+	return FALSE;
 }
 
 static void
@@ -1768,9 +2283,26 @@ successful_load (GTask *loading_task)
 	GtkSourceFile *file = gedit_document_get_file (doc);
 	GFile *location;
 
-	if (data->user_requested_encoding)
+	/* The GtkSourceFile has been updated by the loader, except for the
+	 * stream of a compressed file: the location and the modification time
+	 * of the file are unknown to the loader.
+	 */
+	if (data->compressed_location != NULL &&
+	    gtk_source_file_loader_get_input_stream (data->loader) != NULL)
 	{
-		const GtkSourceEncoding *encoding = gtk_source_file_loader_get_encoding (data->loader);
+		_gedit_document_set_file_properties (doc,
+						     gtk_source_file_get_encoding (file),
+						     gtk_source_file_get_newline_type (file),
+						     data->mtime_set ? &data->mtime : NULL);
+	}
+	else
+	{
+		_gedit_document_clear_file_properties (doc);
+	}
+
+	if (data->user_requested_encoding)
+	{
+		const GtkSourceEncoding *encoding = gtk_source_file_loader_get_encoding (data->loader);
 		const gchar *charset = gtk_source_encoding_get_charset (encoding);
 
 		gedit_document_set_metadata (doc,
@@ -1789,7 +2321,7 @@ successful_load (GTask *loading_task)
 		tab->idle_scroll = g_idle_add ((GSourceFunc)scroll_to_cursor, tab);
 	}
 
-	location = gtk_source_file_loader_get_location (data->loader);
+	location = get_loader_location (data);
 
 	/* If the document is readonly we don't care how many times the file
 	 * is opened.
@@ -1824,6 +2356,237 @@ successful_load (GTask *loading_task)
 	g_signal_emit_by_name (doc, "loaded");
 }
 
+/* Returns the next load to start: the first one of a visible tab, otherwise
+ * the oldest one.
+ */
+static GTask *
+pop_next_pending_load (void)
+{
+	GList *l;
+
+	for (l = pending_loads.head; l != NULL; l = l->next)
+	{
+		GTask *loading_task = l->data;
+		GeditTab *tab = g_task_get_source_object (loading_task);
+
+		if (gtk_widget_get_mapped (GTK_WIDGET (tab)))
+		{
+			g_queue_delete_link (&pending_loads, l);
+			return loading_task;
+		}
+	}
+
+	return g_queue_pop_head (&pending_loads);
+}
+
+static gboolean
+start_pending_loads (gpointer user_data)
+{
+	start_pending_loads_id = 0;
+
+	while (!g_queue_is_empty (&pending_loads))
+	{
+		GTask *loading_task;
+		GeditTab *tab;
+		LoaderData *data;
+		guint max_running_loads;
+
+		loading_task = pop_next_pending_load ();
+		tab = g_task_get_source_object (loading_task);
+		data = g_task_get_task_data (loading_task);
+
+		max_running_loads = g_settings_get_uint (tab->editor_settings,
+							 GEDIT_SETTINGS_MAX_CONCURRENT_LOADS);
+
+		if (max_running_loads > 0 &&
+		    n_running_loads >= max_running_loads)
+		{
+			g_queue_push_head (&pending_loads, loading_task);
+			break;
+		}
+
+		gedit_debug_message (DEBUG_TAB,
+				     "Start load, %u running, %u pending",
+				     n_running_loads,
+				     g_queue_get_length (&pending_loads));
+
+		data->uses_load_slot = TRUE;
+		n_running_loads++;
+
+		launch_loader (loading_task, data->requested_encoding);
+	}
+
+	return G_SOURCE_REMOVE;
+}
+
+/* The loads are started in an idle, after the new tabs are added to the
+ * notebooks, so that it is known which ones are visible.
+ */
+static void
+queue_start_pending_loads (void)
+{
+	if (start_pending_loads_id == 0 &&
+	    !g_queue_is_empty (&pending_loads))
+	{
+		start_pending_loads_id = g_idle_add (start_pending_loads, NULL);
+	}
+}
+
+static void
+queue_load (GTask                   *loading_task,
+	    const GtkSourceEncoding *encoding)
+{
+	LoaderData *data = g_task_get_task_data (loading_task);
+
+	data->requested_encoding = encoding;
+	data->request_time = g_get_monotonic_time ();
+
+	g_queue_push_tail (&pending_loads, loading_task);
+	queue_start_pending_loads ();
+}
+
+static void
+release_load_slot (GTask *loading_task)
+{
+	LoaderData *data = g_task_get_task_data (loading_task);
+
+	if (data->uses_load_slot)
+	{
+		data->uses_load_slot = FALSE;
+
+		g_return_if_fail (n_running_loads > 0);
+		n_running_loads--;
+
+		queue_start_pending_loads ();
+	}
+}
+
+/* For a tab destroyed while its load is waiting in the queue. */
+static void
+cancel_pending_load (GeditTab *tab)
+{
+	GList *l;
+
+	for (l = pending_loads.head; l != NULL; l = l->next)
+	{
+		GTask *loading_task = l->data;
+
+		if (g_task_get_source_object (loading_task) == tab)
+		{
+			g_queue_delete_link (&pending_loads, l);
+
+			g_task_return_new_error (loading_task,
+						 G_IO_ERROR,
+						 G_IO_ERROR_CANCELLED,
+						 "The load has been cancelled");
+			g_object_unref (loading_task);
+			return;
+		}
+	}
+}
+
+static void
+tab_mapped (GeditTab *tab)
+{
+	stop_hibernation_timer (tab);
+
+	if (tab->hibernated)
+	{
+		wake_up (tab, (GAsyncReadyCallback) load_finish, NULL);
+		return;
+	}
+
+	if (tab->placeholder_task != NULL)
+	{
+		_gedit_tab_materialize (tab);
+		return;
+	}
+
+	/* The tab has now the priority, if its load is waiting. */
+	queue_start_pending_loads ();
+}
+
+static void
+dump_stats (const gchar                  *operation,
+	    const OperationStats *stats)
+{
+	gdouble throughput = 0.0;
+
+	if (stats->transfer_time > 0)
+	{
+		/* Bytes per microsecond are MB/s. */
+		throughput = (gdouble) stats->bytes / stats->transfer_time;
+	}
+
+	gedit_debug_message (DEBUG_TAB,
+			     "%s %s: %" G_GOFFSET_FORMAT " bytes, %.1f MB/s, "
+			     "wall %.3f ms, queue %.3f ms, sniff %.3f ms, "
+			     "transfer %.3f ms, first byte %.3f ms, diff %.3f ms, "
+			     "%u encoding attempts",
+			     operation,
+			     stats->success ? "done" : "failed",
+			     stats->bytes,
+			     throughput,
+			     stats->wall_time / 1000.0,
+			     stats->queue_time / 1000.0,
+			     stats->sniff_time / 1000.0,
+			     stats->transfer_time / 1000.0,
+			     stats->time_to_first_byte / 1000.0,
+			     stats->diff_time / 1000.0,
+			     stats->encoding_attempts);
+}
+
+/* The loader tries the candidate encodings in order, without the duplicates,
+ * and keeps the first one which works.
+ */
+static guint
+count_encoding_attempts (GSList                  *candidates,
+			 const GtkSourceEncoding *encoding)
+{
+	GSList *tried = NULL;
+	GSList *l;
+	guint n_attempts = 0;
+
+	for (l = candidates; l != NULL; l = l->next)
+	{
+		if (g_slist_find (tried, l->data) != NULL)
+		{
+			continue;
+		}
+
+		tried = g_slist_prepend (tried, l->data);
+		n_attempts++;
+
+		if (l->data == encoding)
+		{
+			break;
+		}
+	}
+
+	g_slist_free (tried);
+	return n_attempts;
+}
+
+static void
+record_load_stats (GTask    *loading_task,
+		   gboolean  success)
+{
+	LoaderData *data = g_task_get_task_data (loading_task);
+	gint64 now = g_get_monotonic_time ();
+
+	data->stats.wall_time = now - data->request_time;
+	data->stats.transfer_time = now - data->transfer_start_time;
+	data->stats.encoding_attempts =
+		count_encoding_attempts (data->candidate_encodings,
+					 gtk_source_file_loader_get_encoding (data->loader));
+	data->stats.success = success != FALSE;
+
+	/* A new attempt, with another encoding, is timed from its start. */
+	data->request_time = 0;
+
+	dump_stats ("Load", &data->stats);
+}
+
 static void
 load_cb (GtkSourceFileLoader *loader,
 	 GAsyncResult        *result,
@@ -1832,7 +2595,7 @@ load_cb (GtkSourceFileLoader *loader,
 	GeditTab *tab = g_task_get_source_object (loading_task);
 	LoaderData *data = g_task_get_task_data (loading_task);
 	GeditDocument *doc = gedit_tab_get_document (tab);
-	GFile *location = gtk_source_file_loader_get_location (loader);
+	GFile *location = get_loader_location (data);
 	gboolean create_named_new_doc;
 	GError *error = NULL;
 
@@ -1840,18 +2603,24 @@ load_cb (GtkSourceFileLoader *loader,
 	                  tab->state == GEDIT_TAB_STATE_REVERTING);
 
 	gtk_source_file_loader_load_finish (loader, result, &error);
+	restore_compressed_location (loading_task);
 
 	if (error != NULL)
 	{
 		gedit_debug_message (DEBUG_TAB, "File loading error: %s", error->message);
 	}
 
+	release_load_slot (loading_task);
+	record_load_stats (loading_task, error == NULL);
+
 	if (data->timer != NULL)
 	{
 		g_timer_destroy (data->timer);
 		data->timer = NULL;
 	}
 
+	stop_progressive_display (tab);
+
 	set_info_bar (tab, NULL, GTK_RESPONSE_NONE);
 
 	/* Special case creating a named new doc. */
@@ -1887,6 +2656,7 @@ load_cb (GtkSourceFileLoader *loader,
 		 * decide to make it editable again.
 		 */
 		set_editable (tab, FALSE);
+		tab->invalid_chars = TRUE;
 
 		encoding = gtk_source_file_loader_get_encoding (loader);
 
@@ -1921,6 +2691,9 @@ load_cb (GtkSourceFileLoader *loader,
 	{
 		GtkWidget *info_bar;
 
+		/* No "loaded" signal. */
+		gedit_recovery_journal_load_failed (tab->journal);
+
 		if (tab->state == GEDIT_TAB_STATE_LOADING)
 		{
 			gtk_widget_hide (GTK_WIDGET (tab->frame));
@@ -1969,6 +2742,8 @@ load_cb (GtkSourceFileLoader *loader,
 
 	g_assert (error == NULL);
 
+	tab->invalid_chars = FALSE;
+
 	gedit_tab_set_state (tab, GEDIT_TAB_STATE_NORMAL);
 	successful_load (loading_task);
 
@@ -1990,7 +2765,6 @@ get_candidate_encodings (GeditTab *tab)
 {
 	GSList *candidates = NULL;
 	GeditDocument *doc;
-	GtkSourceFile *file;
 	gchar *metadata_charset;
 	const GtkSourceEncoding *file_encoding;
 
@@ -2015,8 +2789,7 @@ get_candidate_encodings (GeditTab *tab)
 	/* Finally prepend the GtkSourceFile's encoding, if previously set by a
 	 * file loader or file saver.
 	 */
-	file = gedit_document_get_file (doc);
-	file_encoding = gtk_source_file_get_encoding (file);
+	file_encoding = _gedit_document_get_file_encoding (doc);
 
 	if (file_encoding != NULL)
 	{
@@ -2027,133 +2800,522 @@ get_candidate_encodings (GeditTab *tab)
 	return candidates;
 }
 
+static void run_loader (GTask  *loading_task,
+			GSList *candidate_encodings);
+
+static gboolean open_viewer (GeditTab *tab,
+			     GFile    *location,
+			     gboolean  hex);
+
+/* The loader of a stream unsets the location of the file. */
 static void
-launch_loader (GTask                   *loading_task,
-	       const GtkSourceEncoding *encoding)
+restore_compressed_location (GTask *loading_task)
 {
 	GeditTab *tab = g_task_get_source_object (loading_task);
 	LoaderData *data = g_task_get_task_data (loading_task);
-	GSList *candidate_encodings = NULL;
-	GeditDocument *doc;
+	GtkSourceFile *file;
 
-	if (encoding != NULL)
-	{
-		data->user_requested_encoding = TRUE;
-		candidate_encodings = g_slist_append (NULL, (gpointer) encoding);
-	}
-	else
+	if (data->compressed_location != NULL)
 	{
-		data->user_requested_encoding = FALSE;
-		candidate_encodings = get_candidate_encodings (tab);
+		file = gedit_document_get_file (gedit_tab_get_document (tab));
+		gtk_source_file_set_location (file, data->compressed_location);
 	}
+}
 
-	gtk_source_file_loader_set_candidate_encodings (data->loader, candidate_encodings);
-	g_slist_free (candidate_encodings);
+static void
+run_compressed_loader (GTask *loading_task)
+{
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GSList *candidate_encodings;
 
-	doc = gedit_tab_get_document (tab);
-	g_signal_emit_by_name (doc, "load");
+	candidate_encodings = data->candidate_encodings;
+	data->candidate_encodings = NULL;
 
-	if (data->timer != NULL)
+	run_loader (loading_task, candidate_encodings);
+}
+
+static void
+compressed_file_info_cb (GFileInputStream *file_stream,
+			 GAsyncResult     *result,
+			 GTask            *loading_task)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GFileInfo *info;
+	GConverter *decompressor;
+	GInputStream *stream;
+
+	info = g_file_input_stream_query_info_finish (file_stream, result, NULL);
+
+	if (info != NULL)
 	{
-		g_timer_destroy (data->timer);
+		if (g_file_info_has_attribute (info, G_FILE_ATTRIBUTE_TIME_MODIFIED))
+		{
+			g_file_info_get_modification_time (info, &data->mtime);
+			data->mtime_set = TRUE;
+		}
+
+		g_object_unref (info);
 	}
 
-	data->timer = g_timer_new ();
+	/* The converter stream is not pollable, so its asynchronous reads,
+	 * and thus the decompression, are done in a thread.
+	 */
+	decompressor = gedit_compression_decompressor_new (gedit_compression_format_from_location (data->compressed_location));
+	stream = g_converter_input_stream_new (G_INPUT_STREAM (file_stream), decompressor);
 
-	gtk_source_file_loader_load_async (data->loader,
-					   G_PRIORITY_DEFAULT,
-					   g_task_get_cancellable (loading_task),
-					   (GFileProgressCallback) loader_progress_cb,
-					   loading_task,
-					   NULL,
-					   (GAsyncReadyCallback) load_cb,
-					   loading_task);
+	data->loader = gtk_source_file_loader_new_from_stream (GTK_SOURCE_BUFFER (doc),
+							       gedit_document_get_file (doc),
+							       stream);
+
+	g_object_unref (stream);
+	g_object_unref (decompressor);
+	g_object_unref (file_stream);
+
+	run_compressed_loader (loading_task);
 }
 
 static void
-load_async (GeditTab                *tab,
-	    GFile                   *location,
-	    const GtkSourceEncoding *encoding,
-	    gint                     line_pos,
-	    gint                     column_pos,
-	    gboolean                 create,
-	    GCancellable            *cancellable,
-	    GAsyncReadyCallback      callback,
-	    gpointer                 user_data)
+compressed_file_read_cb (GFile        *location,
+			 GAsyncResult *result,
+			 GTask        *loading_task)
 {
-	GeditDocument *doc;
-	GtkSourceFile *file;
-	GTask *loading_task;
-	LoaderData *data;
-
-	g_return_if_fail (GEDIT_IS_TAB (tab));
-	g_return_if_fail (G_IS_FILE (location));
-	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
-	g_return_if_fail (tab->state == GEDIT_TAB_STATE_NORMAL);
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GtkSourceFile *file = gedit_document_get_file (doc);
+	GFileInputStream *file_stream;
+	GError *error = NULL;
 
-	gedit_tab_set_state (tab, GEDIT_TAB_STATE_LOADING);
+	file_stream = g_file_read_finish (location, result, &error);
 
-	doc = gedit_tab_get_document (tab);
-	file = gedit_document_get_file (doc);
-	gtk_source_file_set_location (file, location);
+	g_clear_object (&data->loader);
 
-	loading_task = g_task_new (tab, cancellable, callback, user_data);
+	if (file_stream != NULL)
+	{
+		/* Like the GtkSourceView loader, for the external
+		 * modification checks. The stream is unreferenced in the
+		 * callback.
+		 */
+		data->mtime_set = FALSE;
+
+		g_file_input_stream_query_info_async (file_stream,
+						      G_FILE_ATTRIBUTE_TIME_MODIFIED,
+						      LOADER_IO_PRIORITY,
+						      g_task_get_cancellable (loading_task),
+						      (GAsyncReadyCallback) compressed_file_info_cb,
+						      loading_task);
+		return;
+	}
 
-	data = loader_data_new ();
-	g_task_set_task_data (loading_task, data, (GDestroyNotify) loader_data_free);
+	/* A normal loader reports the error. */
+	gedit_debug_message (DEBUG_TAB, "Cannot open the compressed file: %s", error->message);
+	g_error_free (error);
 
+	gtk_source_file_set_location (file, location);
 	data->loader = gtk_source_file_loader_new (GTK_SOURCE_BUFFER (doc), file);
-	data->line_pos = line_pos;
-	data->column_pos = column_pos;
-
-	_gedit_document_set_create (doc, create);
 
-	launch_loader (loading_task, encoding);
+	run_compressed_loader (loading_task);
 }
 
-static gboolean
-load_finish (GeditTab     *tab,
-	     GAsyncResult *result)
+static void
+launch_compressed_loader (GTask  *loading_task,
+			  GSList *candidate_encodings)
 {
-	g_return_val_if_fail (g_task_is_valid (result, tab), FALSE);
+	LoaderData *data = g_task_get_task_data (loading_task);
 
-	return g_task_propagate_boolean (G_TASK (result), NULL);
+	if (data->compressed_location == NULL)
+	{
+		data->compressed_location = g_object_ref (get_loader_location (data));
+	}
+
+	g_slist_free (data->candidate_encodings);
+	data->candidate_encodings = candidate_encodings;
+
+	g_file_read_async (data->compressed_location,
+			   LOADER_IO_PRIORITY,
+			   g_task_get_cancellable (loading_task),
+			   (GAsyncReadyCallback) compressed_file_read_cb,
+			   loading_task);
 }
 
-void
-_gedit_tab_load (GeditTab                *tab,
-		 GFile                   *location,
-		 const GtkSourceEncoding *encoding,
-		 gint                     line_pos,
-		 gint                     column_pos,
-		 gboolean                 create)
+static void
+binary_file_info_bar_response (GtkWidget *info_bar,
+			       gint       response_id,
+			       GTask     *loading_task)
 {
-	GCancellable *cancellable;
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
 
-	cancellable = g_cancellable_new ();
+	set_info_bar (tab, NULL, GTK_RESPONSE_NONE);
 
-	load_async (tab,
-		    location,
-		    encoding,
-		    line_pos,
-		    column_pos,
-		    create,
-		    cancellable,
-		    (GAsyncReadyCallback) load_finish,
-		    NULL);
+	switch (response_id)
+	{
+		case GTK_RESPONSE_ACCEPT:
+			if (open_viewer (tab, get_loader_location (data), TRUE))
+			{
+				gedit_tab_set_state (tab, GEDIT_TAB_STATE_NORMAL);
+				gedit_recent_add_document (gedit_tab_get_document (tab));
 
-	g_object_unref (cancellable);
-}
+				g_task_return_boolean (loading_task, TRUE);
+				g_object_unref (loading_task);
+				break;
+			}
 
-static void
-load_stream_async (GeditTab                *tab,
-		   GInputStream            *stream,
-		   const GtkSourceEncoding *encoding,
-		   gint                     line_pos,
-		   gint                     column_pos,
-		   GCancellable            *cancellable,
-		   GAsyncReadyCallback      callback,
-		   gpointer                 user_data)
+			/* The file cannot be mapped, load it as text. */
+			/* fall through */
+
+		case GTK_RESPONSE_YES:
+			/* The load slot has been released, wait for one
+			 * again.
+			 */
+			data->binary_accepted = TRUE;
+			queue_load (loading_task, data->requested_encoding);
+			break;
+
+		default:
+			g_task_return_boolean (loading_task, FALSE);
+			g_object_unref (loading_task);
+
+			remove_tab (tab);
+			break;
+	}
+}
+
+/* Asks the user before loading a file that looks binary: the conversion of
+ * the whole file would be slow, and would mostly give invalid characters.
+ */
+static void
+ask_binary_file (GTask  *loading_task,
+		 GSList *candidate_encodings)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GtkWidget *info_bar;
+
+	g_slist_free (data->candidate_encodings);
+	data->candidate_encodings = candidate_encodings;
+
+	/* The other loads don't wait for the user. */
+	release_load_slot (loading_task);
+
+	info_bar = gedit_binary_file_info_bar_new (get_loader_location (data));
+
+	g_signal_connect (info_bar,
+			  "response",
+			  G_CALLBACK (binary_file_info_bar_response),
+			  loading_task);
+
+	set_info_bar (tab, info_bar, GTK_RESPONSE_CANCEL);
+}
+
+static void
+sniff_cb (GObject      *source_object,
+	  GAsyncResult *result,
+	  GTask        *loading_task)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GeditContentSnifferResult *sniff_result;
+	GSList *candidate_encodings;
+	gboolean binary = FALSE;
+	GError *error = NULL;
+
+	data->stats.sniff_time = g_get_monotonic_time () - data->launch_time;
+
+	candidate_encodings = get_candidate_encodings (tab);
+
+	sniff_result = gedit_content_sniffer_sniff_finish (result, &error);
+
+	/* The loader reports the error, if the file cannot be read. */
+	if (error != NULL)
+	{
+		gedit_debug_message (DEBUG_TAB, "Content sniffing error: %s", error->message);
+		g_error_free (error);
+	}
+	else
+	{
+		binary = sniff_result->binary;
+		candidate_encodings = gedit_content_sniffer_pin_encoding (sniff_result,
+									  candidate_encodings);
+		gedit_content_sniffer_result_free (sniff_result);
+	}
+
+	if (binary)
+	{
+		ask_binary_file (loading_task, candidate_encodings);
+		return;
+	}
+
+	run_loader (loading_task, candidate_encodings);
+}
+
+static void
+launch_loader (GTask                   *loading_task,
+	       const GtkSourceEncoding *encoding)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GSList *candidate_encodings = NULL;
+	GFile *location;
+	GeditCompressionFormat compression_format;
+
+	memset (&data->stats, 0, sizeof (OperationStats));
+	data->launch_time = g_get_monotonic_time ();
+
+	if (data->request_time == 0)
+	{
+		data->request_time = data->launch_time;
+	}
+
+	data->stats.queue_time = data->launch_time - data->request_time;
+
+	if (data->binary_accepted)
+	{
+		candidate_encodings = data->candidate_encodings;
+		data->candidate_encodings = NULL;
+
+		run_loader (loading_task, candidate_encodings);
+		return;
+	}
+
+	location = get_loader_location (data);
+	compression_format = data->from_snapshot ?
+			     GEDIT_COMPRESSION_FORMAT_NONE :
+			     gedit_compression_format_from_location (location);
+
+	if (encoding != NULL)
+	{
+		data->user_requested_encoding = TRUE;
+		candidate_encodings = g_slist_append (NULL, (gpointer) encoding);
+	}
+	else
+	{
+		data->user_requested_encoding = FALSE;
+
+		/* For a local file, scan its content first: it avoids the
+		 * failed conversions with the candidate encodings. The content
+		 * of a compressed file is not the text.
+		 */
+		if (location != NULL &&
+		    g_file_is_native (location) &&
+		    compression_format == GEDIT_COMPRESSION_FORMAT_NONE)
+		{
+			guint binary_threshold = 0;
+
+			/* When reverting, the user has already chosen to load
+			 * the file.
+			 */
+			if (tab->state == GEDIT_TAB_STATE_LOADING)
+			{
+				binary_threshold = g_settings_get_uint (tab->editor_settings,
+									GEDIT_SETTINGS_BINARY_DETECTION_THRESHOLD);
+			}
+
+			gedit_content_sniffer_sniff_async (location,
+							   binary_threshold,
+							   g_task_get_cancellable (loading_task),
+							   (GAsyncReadyCallback) sniff_cb,
+							   loading_task);
+			return;
+		}
+
+		candidate_encodings = get_candidate_encodings (tab);
+	}
+
+	if (compression_format != GEDIT_COMPRESSION_FORMAT_NONE)
+	{
+		launch_compressed_loader (loading_task, candidate_encodings);
+		return;
+	}
+
+	run_loader (loading_task, candidate_encodings);
+}
+
+static void
+run_loader (GTask  *loading_task,
+	    GSList *candidate_encodings)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GeditDocument *doc;
+
+	gtk_source_file_loader_set_candidate_encodings (data->loader, candidate_encodings);
+
+	g_slist_free (data->candidate_encodings);
+	data->candidate_encodings = candidate_encodings;
+
+	doc = gedit_tab_get_document (tab);
+	g_signal_emit_by_name (doc, "load");
+
+	if (data->timer != NULL)
+	{
+		g_timer_destroy (data->timer);
+	}
+
+	data->timer = g_timer_new ();
+	data->transfer_start_time = g_get_monotonic_time ();
+
+	data->progressive_display = FALSE;
+
+	gtk_source_file_loader_load_async (data->loader,
+					   LOADER_IO_PRIORITY,
+					   g_task_get_cancellable (loading_task),
+					   (GFileProgressCallback) loader_progress_cb,
+					   loading_task,
+					   NULL,
+					   (GAsyncReadyCallback) load_cb,
+					   loading_task);
+
+	restore_compressed_location (loading_task);
+}
+
+/* Whether the size of the file must be queried, to know if it is opened in
+ * viewer mode. See start_load().
+ */
+static gboolean
+can_use_viewer_mode (GeditTab *tab,
+		     GFile    *location)
+{
+	guint threshold;
+
+	threshold = g_settings_get_uint (tab->editor_settings,
+					 GEDIT_SETTINGS_VIEWER_MODE_THRESHOLD);
+
+	/* The mapped file viewer shows the raw bytes of the file. */
+	return (threshold != 0 &&
+		g_file_is_native (location) &&
+		gedit_compression_format_from_location (location) == GEDIT_COMPRESSION_FORMAT_NONE);
+}
+
+static gboolean
+should_use_viewer_mode (GeditTab  *tab,
+			GFileInfo *info)
+{
+	guint threshold;
+
+	threshold = g_settings_get_uint (tab->editor_settings,
+					 GEDIT_SETTINGS_VIEWER_MODE_THRESHOLD);
+
+	return (g_file_info_get_file_type (info) == G_FILE_TYPE_REGULAR &&
+		g_file_info_get_size (info) >= (goffset) threshold * 1024 * 1024);
+}
+
+/* Returns FALSE if the file cannot be mapped in memory, it should then be
+ * loaded normally.
+ */
+static gboolean
+open_viewer (GeditTab *tab,
+	     GFile    *location,
+	     gboolean  hex)
+{
+	GError *error = NULL;
+
+	close_viewer (tab);
+
+	if (hex)
+	{
+		tab->viewer = gedit_mapped_file_viewer_new_hex (gedit_tab_get_view (tab),
+								location,
+								&error);
+	}
+	else
+	{
+		tab->viewer = gedit_mapped_file_viewer_new (gedit_tab_get_view (tab),
+							    location,
+							    &error);
+	}
+
+	if (error != NULL)
+	{
+		gedit_debug_message (DEBUG_TAB, "Cannot map the file: %s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	gedit_view_frame_set_mapped_file_viewer (tab->frame, tab->viewer);
+	tab->hex_preview = hex != FALSE;
+
+	/* The buffer is only a view of the file. */
+	gedit_recovery_journal_free (tab->journal);
+	tab->journal = NULL;
+
+	/* The buffer contains only a part of the file, there is nothing to
+	 * save or to reload when the file changes.
+	 */
+	tab->ask_if_externally_modified = FALSE;
+
+	return TRUE;
+}
+
+static void
+start_load_query_info_cb (GFile        *location,
+			  GAsyncResult *result,
+			  GTask        *loading_task)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GFileInfo *info;
+
+	/* On error, the loader reports it. */
+	info = g_file_query_info_finish (location, result, NULL);
+
+	if (info != NULL &&
+	    should_use_viewer_mode (tab, info) &&
+	    open_viewer (tab, location, FALSE))
+	{
+		g_object_unref (info);
+
+		gedit_tab_set_state (tab, GEDIT_TAB_STATE_NORMAL);
+		gedit_recent_add_document (gedit_tab_get_document (tab));
+
+		g_task_return_boolean (loading_task, TRUE);
+		g_object_unref (loading_task);
+		return;
+	}
+
+	g_clear_object (&info);
+
+	queue_load (loading_task, data->requested_encoding);
+}
+
+static void
+start_load (GTask *loading_task)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GFile *location;
+
+	location = gtk_source_file_loader_get_location (data->loader);
+
+	if (can_use_viewer_mode (tab, location))
+	{
+		g_file_query_info_async (location,
+					 G_FILE_ATTRIBUTE_STANDARD_TYPE ","
+					 G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					 G_FILE_QUERY_INFO_NONE,
+					 G_PRIORITY_DEFAULT,
+					 g_task_get_cancellable (loading_task),
+					 (GAsyncReadyCallback) start_load_query_info_cb,
+					 loading_task);
+		return;
+	}
+
+	queue_load (loading_task, data->requested_encoding);
+}
+
+static void
+load_async (GeditTab                *tab,
+	    GFile                   *location,
+	    const GtkSourceEncoding *encoding,
+	    gint                     line_pos,
+	    gint                     column_pos,
+	    gboolean                 create,
+	    gboolean                 placeholder,
+	    GCancellable            *cancellable,
+	    GAsyncReadyCallback      callback,
+	    gpointer                 user_data)
 {
 	GeditDocument *doc;
 	GtkSourceFile *file;
@@ -2161,110 +3323,1469 @@ load_stream_async (GeditTab                *tab,
 	LoaderData *data;
 
 	g_return_if_fail (GEDIT_IS_TAB (tab));
-	g_return_if_fail (G_IS_INPUT_STREAM (stream));
+	g_return_if_fail (G_IS_FILE (location));
 	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
 	g_return_if_fail (tab->state == GEDIT_TAB_STATE_NORMAL);
 
+	/* Set before the state, so that the tab label sees a placeholder. */
+	loading_task = g_task_new (tab, cancellable, callback, user_data);
+
+	if (placeholder)
+	{
+		tab->placeholder_task = loading_task;
+	}
+
 	gedit_tab_set_state (tab, GEDIT_TAB_STATE_LOADING);
 
 	doc = gedit_tab_get_document (tab);
 	file = gedit_document_get_file (doc);
-
-	gtk_source_file_set_location (file, NULL);
-
-	loading_task = g_task_new (tab, cancellable, callback, user_data);
+	gtk_source_file_set_location (file, location);
 
 	data = loader_data_new ();
 	g_task_set_task_data (loading_task, data, (GDestroyNotify) loader_data_free);
 
-	data->loader = gtk_source_file_loader_new_from_stream (GTK_SOURCE_BUFFER (doc),
-							       file,
-							       stream);
+	data->loader = gtk_source_file_loader_new (GTK_SOURCE_BUFFER (doc), file);
 	data->line_pos = line_pos;
 	data->column_pos = column_pos;
+	data->requested_encoding = encoding;
 
-	_gedit_document_set_create (doc, FALSE);
+	_gedit_document_set_create (doc, create);
 
-	launch_loader (loading_task, encoding);
+	if (!placeholder)
+	{
+		start_load (loading_task);
+	}
 }
 
-void
-_gedit_tab_load_stream (GeditTab                *tab,
-			GInputStream            *stream,
-			const GtkSourceEncoding *encoding,
-			gint                     line_pos,
-			gint                     column_pos)
+static gboolean
+load_finish (GeditTab     *tab,
+	     GAsyncResult *result)
 {
-	GCancellable *cancellable;
+	g_return_val_if_fail (g_task_is_valid (result, tab), FALSE);
 
-	cancellable = g_cancellable_new ();
+	return g_task_propagate_boolean (G_TASK (result), NULL);
+}
 
-	load_stream_async (tab,
-			   stream,
-			   encoding,
-			   line_pos,
-			   column_pos,
-			   cancellable,
-			   (GAsyncReadyCallback) load_finish,
-			   NULL);
+void
+_gedit_tab_load (GeditTab                *tab,
+		 GFile                   *location,
+		 const GtkSourceEncoding *encoding,
+		 gint                     line_pos,
+		 gint                     column_pos,
+		 gboolean                 create)
+{
+	GCancellable *cancellable;
+
+	cancellable = g_cancellable_new ();
+
+	load_async (tab,
+		    location,
+		    encoding,
+		    line_pos,
+		    column_pos,
+		    create,
+		    FALSE,
+		    cancellable,
+		    (GAsyncReadyCallback) load_finish,
+		    NULL);
+
+	g_object_unref (cancellable);
+}
+
+/* Like _gedit_tab_load(), but for a tab opened in the background among many
+ * others: the file is not read before the tab is shown for the first time.
+ * Until then the tab keeps only the location of the file, and its state is
+ * LOADING.
+ */
+void
+_gedit_tab_load_placeholder (GeditTab                *tab,
+			     GFile                   *location,
+			     const GtkSourceEncoding *encoding,
+			     gint                     line_pos,
+			     gint                     column_pos,
+			     gboolean                 create)
+{
+	GCancellable *cancellable;
+
+	cancellable = g_cancellable_new ();
+
+	load_async (tab,
+		    location,
+		    encoding,
+		    line_pos,
+		    column_pos,
+		    create,
+		    TRUE,
+		    cancellable,
+		    (GAsyncReadyCallback) load_finish,
+		    NULL);
 
 	g_object_unref (cancellable);
 }
 
+gboolean
+_gedit_tab_is_placeholder (GeditTab *tab)
+{
+	g_return_val_if_fail (GEDIT_IS_TAB (tab), FALSE);
+
+	return tab->placeholder_task != NULL;
+}
+
+/* Starts the load of a placeholder tab, without waiting for the tab to be
+ * shown. Does nothing if @tab is not a placeholder.
+ */
+void
+_gedit_tab_materialize (GeditTab *tab)
+{
+	GTask *loading_task;
+
+	g_return_if_fail (GEDIT_IS_TAB (tab));
+
+	if (tab->placeholder_task == NULL)
+	{
+		return;
+	}
+
+	gedit_debug_message (DEBUG_TAB, "Materialize placeholder tab");
+
+	loading_task = tab->placeholder_task;
+	tab->placeholder_task = NULL;
+
+	/* The state is still LOADING, but the tab is no longer a
+	 * placeholder, the tab label and the window need to know it.
+	 */
+	g_object_notify_by_pspec (G_OBJECT (tab), properties[PROP_STATE]);
+
+	start_load (loading_task);
+}
+
+/* @location is the file of a snapshot, or NULL, and @mtime its modification
+ * time, if known.
+ */
 static void
-revert_async (GeditTab            *tab,
-	      GCancellable        *cancellable,
-	      GAsyncReadyCallback  callback,
-	      gpointer             user_data)
+load_stream_async (GeditTab                *tab,
+		   GFile                   *location,
+		   GInputStream            *stream,
+		   const GtkSourceEncoding *encoding,
+		   const GTimeVal          *mtime,
+		   gint                     line_pos,
+		   gint                     column_pos,
+		   GCancellable            *cancellable,
+		   GAsyncReadyCallback      callback,
+		   gpointer                 user_data)
 {
 	GeditDocument *doc;
 	GtkSourceFile *file;
-	GFile *location;
 	GTask *loading_task;
 	LoaderData *data;
 
-	g_return_if_fail (GEDIT_IS_TAB (tab));
-	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
-	g_return_if_fail (tab->state == GEDIT_TAB_STATE_NORMAL ||
-	                  tab->state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION);
+	g_return_if_fail (GEDIT_IS_TAB (tab));
+	g_return_if_fail (G_IS_INPUT_STREAM (stream));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+	g_return_if_fail (tab->state == GEDIT_TAB_STATE_NORMAL);
+
+	gedit_tab_set_state (tab, GEDIT_TAB_STATE_LOADING);
+
+	doc = gedit_tab_get_document (tab);
+	file = gedit_document_get_file (doc);
+
+	gtk_source_file_set_location (file, NULL);
+
+	loading_task = g_task_new (tab, cancellable, callback, user_data);
+
+	data = loader_data_new ();
+	g_task_set_task_data (loading_task, data, (GDestroyNotify) loader_data_free);
+
+	data->loader = gtk_source_file_loader_new_from_stream (GTK_SOURCE_BUFFER (doc),
+							       file,
+							       stream);
+	data->line_pos = line_pos;
+	data->column_pos = column_pos;
+
+	if (location != NULL)
+	{
+		data->compressed_location = g_object_ref (location);
+		data->from_snapshot = TRUE;
+	}
+
+	/* Set on the document when loaded, with the read-only state of the
+	 * file.
+	 */
+	if (mtime != NULL)
+	{
+		data->mtime = *mtime;
+		data->mtime_set = TRUE;
+	}
+
+	_gedit_document_set_create (doc, FALSE);
+
+	launch_loader (loading_task, encoding);
+}
+
+void
+_gedit_tab_load_stream (GeditTab                *tab,
+			GInputStream            *stream,
+			const GtkSourceEncoding *encoding,
+			gint                     line_pos,
+			gint                     column_pos)
+{
+	GCancellable *cancellable;
+
+	cancellable = g_cancellable_new ();
+
+	load_stream_async (tab,
+			   NULL,
+			   stream,
+			   encoding,
+			   NULL,
+			   line_pos,
+			   column_pos,
+			   cancellable,
+			   (GAsyncReadyCallback) load_finish,
+			   NULL);
+
+	g_object_unref (cancellable);
+}
+
+/* Loads the snapshot of a closed tab: @stream has the contents of @location,
+ * in @encoding, as it was at @mtime.
+ */
+void
+_gedit_tab_load_snapshot (GeditTab                *tab,
+			  GFile                   *location,
+			  GInputStream            *stream,
+			  const GtkSourceEncoding *encoding,
+			  const GTimeVal          *mtime,
+			  gint                     line_pos,
+			  gint                     column_pos)
+{
+	GCancellable *cancellable;
+
+	g_return_if_fail (G_IS_FILE (location));
+
+	cancellable = g_cancellable_new ();
+
+	load_stream_async (tab,
+			   location,
+			   stream,
+			   encoding,
+			   mtime,
+			   line_pos,
+			   column_pos,
+			   cancellable,
+			   (GAsyncReadyCallback) load_finish,
+			   NULL);
+
+	g_object_unref (cancellable);
+}
+
+static void
+launch_reload (GTask *loading_task,
+	       gint   line_pos,
+	       gint   column_pos)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GtkSourceFile *file = gedit_document_get_file (doc);
+	LoaderData *data;
+
+	gedit_tab_set_state (tab, GEDIT_TAB_STATE_REVERTING);
+
+	data = loader_data_new ();
+	g_task_set_task_data (loading_task, data, (GDestroyNotify) loader_data_free);
+
+	data->loader = gtk_source_file_loader_new (GTK_SOURCE_BUFFER (doc), file);
+	data->line_pos = line_pos;
+	data->column_pos = column_pos;
+
+	launch_loader (loading_task, NULL);
+}
+
+static void
+diff_revert_document_changed (GtkTextBuffer *buffer,
+			      GTask         *loading_task)
+{
+	LoaderData *data = g_task_get_task_data (loading_task);
+
+	data->document_changed = TRUE;
+}
+
+static void
+diff_revert_progress_cb (goffset  size,
+			 goffset  total_size,
+			 GTask   *loading_task)
+{
+	LoaderData *data = g_task_get_task_data (loading_task);
+
+	if (data->stats.time_to_first_byte == 0 && size > 0)
+	{
+		data->stats.time_to_first_byte = g_get_monotonic_time () - data->transfer_start_time;
+	}
+
+	data->stats.bytes = size;
+}
+
+static void
+record_diff_revert_stats (GTask    *loading_task,
+			  gboolean  success)
+{
+	LoaderData *data = g_task_get_task_data (loading_task);
+
+	data->stats.wall_time = g_get_monotonic_time () - data->request_time;
+	data->stats.success = success != FALSE;
+
+	/* The reload of the whole file is timed from its start. */
+	data->request_time = 0;
+
+	dump_stats ("Revert", &data->stats);
+}
+
+/* Reloads the whole file, when the differences cannot be applied. */
+static void
+diff_revert_fallback (GTask *loading_task)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	GeditDocument *doc = gedit_tab_get_document (tab);
+
+	g_signal_handlers_disconnect_by_func (doc,
+					      diff_revert_document_changed,
+					      loading_task);
+
+	record_diff_revert_stats (loading_task, FALSE);
+
+	launch_reload (loading_task, 0, 0);
+}
+
+static void
+apply_diff_hunks (GeditTab  *tab,
+		  GPtrArray *hunks)
+{
+	GtkTextBuffer *buffer = GTK_TEXT_BUFFER (gedit_tab_get_document (tab));
+	gint i;
+
+	gtk_text_buffer_begin_user_action (buffer);
+
+	/* From the end, so that the offsets of the previous hunks stay valid. */
+	for (i = hunks->len - 1; i >= 0; i--)
+	{
+		GeditLineDiffHunk *hunk = g_ptr_array_index (hunks, i);
+		GtkTextIter start;
+		GtkTextIter end;
+
+		gtk_text_buffer_get_iter_at_offset (buffer, &start, hunk->old_offset);
+		gtk_text_buffer_get_iter_at_offset (buffer, &end, hunk->old_offset + hunk->old_length);
+
+		gtk_text_buffer_delete (buffer, &start, &end);
+		gtk_text_buffer_insert (buffer, &start, hunk->new_text, -1);
+	}
+
+	gtk_text_buffer_end_user_action (buffer);
+
+	gtk_text_buffer_set_modified (buffer, FALSE);
+}
+
+static void
+diff_revert_diff_cb (GObject      *source_object,
+		     GAsyncResult *result,
+		     GTask        *loading_task)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GPtrArray *hunks;
+	GError *error = NULL;
+
+	hunks = gedit_line_diff_compute_finish (result, &error);
+
+	data->stats.diff_time = g_get_monotonic_time () - data->diff_start_time;
+
+	if (error != NULL)
+	{
+		gedit_debug_message (DEBUG_TAB, "Diff error: %s", error->message);
+		g_error_free (error);
+	}
+
+	if (hunks == NULL || data->document_changed)
+	{
+		gedit_debug_message (DEBUG_TAB, "Revert: reload the whole file");
+
+		if (hunks != NULL)
+		{
+			g_ptr_array_unref (hunks);
+		}
+
+		diff_revert_fallback (loading_task);
+		return;
+	}
+
+	g_signal_handlers_disconnect_by_func (doc,
+					      diff_revert_document_changed,
+					      loading_task);
+
+	gedit_debug_message (DEBUG_TAB, "Revert: apply %u hunks", hunks->len);
+
+	g_signal_emit_by_name (doc, "load");
+	apply_diff_hunks (tab, hunks);
+	g_signal_emit_by_name (doc, "loaded");
+
+	g_ptr_array_unref (hunks);
+
+	record_diff_revert_stats (loading_task, TRUE);
+
+	tab->ask_if_externally_modified = TRUE;
+	gedit_tab_set_state (tab, GEDIT_TAB_STATE_NORMAL);
+
+	g_task_return_boolean (loading_task, TRUE);
+	g_object_unref (loading_task);
+}
+
+static void
+diff_revert_load_cb (GtkSourceFileLoader *loader,
+		     GAsyncResult        *result,
+		     GTask               *loading_task)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	LoaderData *data = g_task_get_task_data (loading_task);
+	GtkTextBuffer *buffer;
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *old_text;
+	gchar *new_text;
+	GError *error = NULL;
+
+	/* On error, the whole file is reloaded, which reports the error. */
+	if (!gtk_source_file_loader_load_finish (loader, result, &error))
+	{
+		gedit_debug_message (DEBUG_TAB, "Revert: loading error: %s", error->message);
+		g_error_free (error);
+
+		diff_revert_fallback (loading_task);
+		return;
+	}
+
+	data->stats.transfer_time = g_get_monotonic_time () - data->transfer_start_time;
+	data->stats.encoding_attempts =
+		count_encoding_attempts (data->candidate_encodings,
+					 gtk_source_file_loader_get_encoding (loader));
+
+	buffer = GTK_TEXT_BUFFER (gedit_tab_get_document (tab));
+	gtk_text_buffer_get_bounds (buffer, &start, &end);
+	old_text = gtk_text_buffer_get_text (buffer, &start, &end, TRUE);
+
+	buffer = GTK_TEXT_BUFFER (data->new_contents);
+	gtk_text_buffer_get_bounds (buffer, &start, &end);
+	new_text = gtk_text_buffer_get_text (buffer, &start, &end, TRUE);
+
+	g_clear_object (&data->new_contents);
+	g_clear_object (&data->loader);
+
+	data->diff_start_time = g_get_monotonic_time ();
+
+	gedit_line_diff_compute_async (old_text,
+				       new_text,
+				       MAX_REVERT_DIFF_EDITS,
+				       g_task_get_cancellable (loading_task),
+				       (GAsyncReadyCallback) diff_revert_diff_cb,
+				       loading_task);
+}
+
+/* Reverts by applying only the changed lines, as one user action: the marks,
+ * the undo history and the scroll position are kept. The file is loaded in a
+ * separate buffer, with the GtkSourceFile of the document so that its
+ * properties are updated like for a normal reload.
+ */
+static void
+launch_diff_revert (GTask *loading_task)
+{
+	GeditTab *tab = g_task_get_source_object (loading_task);
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GtkSourceFile *file = gedit_document_get_file (doc);
+	LoaderData *data;
+
+	gedit_tab_set_state (tab, GEDIT_TAB_STATE_REVERTING);
+
+	data = loader_data_new ();
+	g_task_set_task_data (loading_task, data, (GDestroyNotify) loader_data_free);
+
+	data->request_time = g_get_monotonic_time ();
+	data->transfer_start_time = data->request_time;
+
+	data->new_contents = gtk_source_buffer_new (NULL);
+	gtk_source_buffer_set_implicit_trailing_newline (data->new_contents,
+							 gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (doc)));
+
+	data->loader = gtk_source_file_loader_new (data->new_contents, file);
+
+	data->candidate_encodings = get_candidate_encodings (tab);
+	gtk_source_file_loader_set_candidate_encodings (data->loader, data->candidate_encodings);
+
+	g_signal_connect (doc,
+			  "changed",
+			  G_CALLBACK (diff_revert_document_changed),
+			  loading_task);
+
+	gtk_source_file_loader_load_async (data->loader,
+					   LOADER_IO_PRIORITY,
+					   g_task_get_cancellable (loading_task),
+					   (GFileProgressCallback) diff_revert_progress_cb,
+					   loading_task,
+					   NULL,
+					   (GAsyncReadyCallback) diff_revert_load_cb,
+					   loading_task);
+}
+
+static void
+revert_async (GeditTab            *tab,
+	      GCancellable        *cancellable,
+	      GAsyncReadyCallback  callback,
+	      gpointer             user_data)
+{
+	GeditDocument *doc;
+	GtkSourceFile *file;
+	GFile *location;
+	GTask *loading_task;
+
+	g_return_if_fail (GEDIT_IS_TAB (tab));
+	g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+	g_return_if_fail (tab->state == GEDIT_TAB_STATE_NORMAL ||
+	                  tab->state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION);
+
+	if (tab->state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)
+	{
+		set_info_bar (tab, NULL, GTK_RESPONSE_NONE);
+	}
+
+	doc = gedit_tab_get_document (tab);
+	file = gedit_document_get_file (doc);
+	location = gtk_source_file_get_location (file);
+	g_return_if_fail (location != NULL);
+
+	/* The whole file is loaded again. */
+	if (tab->follow)
+	{
+		stop_following (tab);
+		set_view_properties_according_to_state (tab, tab->state);
+		g_object_notify_by_pspec (G_OBJECT (tab), properties[PROP_FOLLOW]);
+	}
+
+	loading_task = g_task_new (tab, cancellable, callback, user_data);
+
+	/* In viewer mode, map the file again, it may have grown. */
+	if (tab->viewer != NULL &&
+	    open_viewer (tab, location, tab->hex_preview))
+	{
+		g_task_return_boolean (loading_task, TRUE);
+		g_object_unref (loading_task);
+		return;
+	}
+
+	/* The loader of the new contents would not decompress the file. */
+	if (g_settings_get_boolean (tab->editor_settings, GEDIT_SETTINGS_MINIMAL_DIFF_REVERT) &&
+	    gedit_compression_format_from_location (location) == GEDIT_COMPRESSION_FORMAT_NONE)
+	{
+		launch_diff_revert (loading_task);
+	}
+	else
+	{
+		launch_reload (loading_task, 0, 0);
+	}
+}
+
+void
+_gedit_tab_revert (GeditTab *tab)
+{
+	GCancellable *cancellable;
+
+	cancellable = g_cancellable_new ();
+
+	revert_async (tab,
+		      cancellable,
+		      (GAsyncReadyCallback) load_finish,
+		      NULL);
+
+	g_object_unref (cancellable);
+}
+
+/* Returns TRUE if less than a tenth of the memory is available. The
+ * information comes from /proc/meminfo, so it is only known on Linux.
+ */
+static gboolean
+is_memory_low (void)
+{
+	gchar *contents;
+	gchar **lines;
+	gchar **l;
+	guint64 total = 0;
+	guint64 available = 0;
+
+	if (!g_file_get_contents ("/proc/meminfo", &contents, NULL, NULL))
+	{
+		return FALSE;
+	}
+
+	lines = g_strsplit (contents, "\n", -1);
+
+	for (l = lines; *l != NULL; l++)
+	{
+		if (g_str_has_prefix (*l, "MemTotal:"))
+		{
+			total = g_ascii_strtoull (*l + strlen ("MemTotal:"), NULL, 10);
+		}
+		else if (g_str_has_prefix (*l, "MemAvailable:"))
+		{
+			available = g_ascii_strtoull (*l + strlen ("MemAvailable:"), NULL, 10);
+		}
+	}
+
+	g_strfreev (lines);
+	g_free (contents);
+
+	return total > 0 && available > 0 && available < total / 10;
+}
+
+static gboolean
+can_hibernate (GeditTab *tab)
+{
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GtkSourceFile *file = gedit_document_get_file (doc);
+	GFile *location = gtk_source_file_get_location (file);
+
+	/* Only the local files, which are quickly loaded again. */
+	return (!tab->hibernated &&
+		tab->state == GEDIT_TAB_STATE_NORMAL &&
+		tab->info_bar == NULL &&
+		tab->viewer == NULL &&
+		!tab->follow &&
+		!gtk_widget_get_mapped (GTK_WIDGET (tab)) &&
+		location != NULL &&
+		g_file_is_native (location) &&
+		!gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (doc)));
+}
+
+static void
+hibernate (GeditTab *tab)
+{
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GtkTextBuffer *buffer = GTK_TEXT_BUFFER (doc);
+	GtkTextIter iter;
+	guint64 n_bytes = 0;
+
+	stop_hibernation_timer (tab);
+
+	gtk_text_buffer_get_iter_at_mark (buffer,
+					  &iter,
+					  gtk_text_buffer_get_insert (buffer));
+
+	tab->hibernated_line = gtk_text_iter_get_line (&iter);
+	tab->hibernated_line_offset = gtk_text_iter_get_line_offset (&iter);
+
+	gtk_text_buffer_get_start_iter (buffer, &iter);
+
+	do
+	{
+		n_bytes += gtk_text_iter_get_bytes_in_line (&iter);
+	}
+	while (gtk_text_iter_forward_line (&iter));
+
+	_gedit_document_hibernate (doc);
+	tab->hibernated = TRUE;
+
+	hibernation_bytes_reclaimed += n_bytes;
+
+	gedit_debug_message (DEBUG_TAB,
+			     "Tab hibernated: %" G_GUINT64_FORMAT " bytes, "
+			     "%" G_GUINT64_FORMAT " bytes reclaimed in total",
+			     n_bytes,
+			     hibernation_bytes_reclaimed);
+}
+
+static void
+wake_up (GeditTab            *tab,
+	 GAsyncReadyCallback  callback,
+	 gpointer             user_data)
+{
+	GCancellable *cancellable;
+	GTask *loading_task;
+
+	g_return_if_fail (tab->hibernated);
+	g_return_if_fail (tab->state == GEDIT_TAB_STATE_NORMAL);
+
+	gedit_debug (DEBUG_TAB);
+
+	tab->hibernated = FALSE;
+
+	cancellable = g_cancellable_new ();
+	loading_task = g_task_new (tab, cancellable, callback, user_data);
+	g_object_unref (cancellable);
+
+	launch_reload (loading_task,
+		       tab->hibernated_line + 1,
+		       tab->hibernated_line_offset + 1);
+}
+
+static gboolean
+hibernation_timeout_cb (GeditTab *tab)
+{
+	if (!can_hibernate (tab))
+	{
+		/* Maybe later, when the load or save is finished. */
+		return G_SOURCE_CONTINUE;
+	}
+
+	tab->hibernation_timeout_id = 0;
+	hibernate (tab);
+
+	return G_SOURCE_REMOVE;
+}
+
+static gboolean
+check_memory_pressure (gpointer user_data)
+{
+	GList *l;
+
+	if (!is_memory_low ())
+	{
+		return G_SOURCE_CONTINUE;
+	}
+
+	gedit_debug_message (DEBUG_TAB, "Low memory, hibernate the hidden tabs");
+
+	l = hibernation_candidates;
+
+	while (l != NULL)
+	{
+		GeditTab *tab = l->data;
+
+		/* hibernate() removes the tab from the list. */
+		l = l->next;
+
+		if (can_hibernate (tab))
+		{
+			hibernate (tab);
+		}
+	}
+
+	return G_SOURCE_CONTINUE;
+}
+
+static void
+stop_hibernation_timer (GeditTab *tab)
+{
+	if (tab->hibernation_timeout_id != 0)
+	{
+		g_source_remove (tab->hibernation_timeout_id);
+		tab->hibernation_timeout_id = 0;
+	}
+
+	hibernation_candidates = g_list_remove (hibernation_candidates, tab);
+
+	if (hibernation_candidates == NULL &&
+	    memory_pressure_check_id != 0)
+	{
+		g_source_remove (memory_pressure_check_id);
+		memory_pressure_check_id = 0;
+	}
+}
+
+static void
+tab_unmapped (GeditTab *tab)
+{
+	guint delay;
+
+	/* The tab is being disposed. */
+	if (tab->editor_settings == NULL)
+	{
+		return;
+	}
+
+	delay = g_settings_get_uint (tab->editor_settings,
+				     GEDIT_SETTINGS_HIBERNATION_DELAY);
+
+	if (delay == 0 ||
+	    tab->hibernated ||
+	    tab->hibernation_timeout_id != 0)
+	{
+		return;
+	}
+
+	tab->hibernation_timeout_id = g_timeout_add_seconds (delay * 60,
+							     (GSourceFunc) hibernation_timeout_cb,
+							     tab);
+
+	hibernation_candidates = g_list_prepend (hibernation_candidates, tab);
+
+	if (memory_pressure_check_id == 0)
+	{
+		memory_pressure_check_id = g_timeout_add_seconds (MEMORY_PRESSURE_CHECK_INTERVAL,
+								  check_memory_pressure,
+								  NULL);
+	}
+}
+
+/* Follow mode, for the files which keep growing, like logs: the bytes
+ * appended to the file are read from the last known offset and appended to
+ * the buffer, without undo entries. While following, the document is not
+ * editable and cannot be saved, since the first lines may be dropped to keep
+ * at most follow-max-lines lines.
+ */
+
+static const gchar *
+get_newline_string (GtkSourceNewlineType newline_type)
+{
+	switch (newline_type)
+	{
+		case GTK_SOURCE_NEWLINE_TYPE_CR:
+			return "\r";
+
+		case GTK_SOURCE_NEWLINE_TYPE_CR_LF:
+			return "\r\n";
+
+		case GTK_SOURCE_NEWLINE_TYPE_LF:
+		default:
+			return "\n";
+	}
+}
+
+/* Decodes the read bytes, with the bytes of an incomplete character of the
+ * previous read. The bytes of an incomplete character at the end are kept for
+ * the next read.
+ */
+static gchar *
+follow_decode (GeditTab     *tab,
+	       const guchar *data,
+	       gsize         size)
+{
+	GByteArray *input = tab->follow_undecoded;
+	GString *output;
+	gsize pos = 0;
+
+	g_byte_array_append (input, data, size);
+	output = g_string_sized_new (input->len);
+
+	while (pos < input->len)
+	{
+		gchar outbuf[4096];
+		gsize bytes_read;
+		gsize bytes_written;
+		GConverterResult result;
+		GError *error = NULL;
+
+		result = g_converter_convert (G_CONVERTER (tab->follow_converter),
+					      input->data + pos,
+					      input->len - pos,
+					      outbuf,
+					      sizeof (outbuf),
+					      G_CONVERTER_NO_FLAGS,
+					      &bytes_read,
+					      &bytes_written,
+					      &error);
+
+		if (result == G_CONVERTER_ERROR)
+		{
+			if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PARTIAL_INPUT))
+			{
+				g_error_free (error);
+				break;
+			}
+
+			gedit_debug_message (DEBUG_TAB, "Follow: conversion error: %s", error->message);
+			g_error_free (error);
+
+			/* Skip the invalid byte. */
+			pos++;
+			continue;
+		}
+
+		pos += bytes_read;
+		g_string_append_len (output, outbuf, bytes_written);
+	}
+
+	g_byte_array_remove_range (input, 0, pos);
+
+	return g_string_free (output, FALSE);
+}
+
+static void
+follow_append (GeditTab    *tab,
+	       const gchar *text)
+{
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	GtkTextBuffer *buffer = GTK_TEXT_BUFFER (doc);
+	GtkTextIter iter;
+	gsize length;
+	gsize newline_length = 0;
+	guint max_lines;
+	gint n_lines;
+
+	length = strlen (text);
+
+	if (length == 0)
+	{
+		return;
+	}
+
+	/* With an implicit trailing newline, the last newline of the file is
+	 * not in the buffer. It is inserted with the next text.
+	 */
+	if (gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (doc)))
+	{
+		if (text[length - 1] == '\n' || text[length - 1] == '\r')
+		{
+			newline_length = 1;
+
+			if (length >= 2 &&
+			    text[length - 1] == '\n' &&
+			    text[length - 2] == '\r')
+			{
+				newline_length = 2;
+			}
+		}
+	}
+
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (doc));
+
+	gtk_text_buffer_get_end_iter (buffer, &iter);
+
+	if (tab->follow_held_newline != NULL)
+	{
+		gtk_text_buffer_insert (buffer, &iter, tab->follow_held_newline, -1);
+		g_free (tab->follow_held_newline);
+		tab->follow_held_newline = NULL;
+	}
+
+	gtk_text_buffer_insert (buffer, &iter, text, length - newline_length);
+
+	if (newline_length > 0)
+	{
+		tab->follow_held_newline = g_strndup (text + length - newline_length, newline_length);
+	}
+
+	max_lines = g_settings_get_uint (tab->editor_settings, GEDIT_SETTINGS_FOLLOW_MAX_LINES);
+	n_lines = gtk_text_buffer_get_line_count (buffer);
+
+	if (max_lines > 0 && n_lines > (gint) max_lines)
+	{
+		GtkTextIter start;
+
+		gtk_text_buffer_get_start_iter (buffer, &start);
+		gtk_text_buffer_get_iter_at_line (buffer, &iter, n_lines - max_lines);
+		gtk_text_buffer_delete (buffer, &start, &iter);
+
+		tab->follow_trimmed = TRUE;
+	}
+
+	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (doc));
+
+	gtk_text_buffer_set_modified (buffer, FALSE);
+
+	if (g_settings_get_boolean (tab->editor_settings, GEDIT_SETTINGS_FOLLOW_AUTO_SCROLL))
+	{
+		GeditView *view = gedit_tab_get_view (tab);
+
+		gtk_text_buffer_get_end_iter (buffer, &iter);
+		gtk_text_buffer_place_cursor (buffer, &iter);
+		gtk_text_view_scroll_mark_onscreen (GTK_TEXT_VIEW (view),
+						    gtk_text_buffer_get_insert (buffer));
+	}
+}
+
+/* The file has been truncated or replaced, for example by a log rotation:
+ * it is followed from its beginning.
+ */
+static void
+follow_restart (GeditTab *tab)
+{
+	GeditDocument *doc = gedit_tab_get_document (tab);
+
+	gedit_debug_message (DEBUG_TAB, "Follow: the file has been truncated");
+
+	tab->follow_offset = 0;
+	tab->follow_trimmed = TRUE;
+
+	g_clear_pointer (&tab->follow_held_newline, g_free);
+	g_byte_array_set_size (tab->follow_undecoded, 0);
+	g_converter_reset (G_CONVERTER (tab->follow_converter));
+
+	gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (doc));
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (doc), "", -1);
+	gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (doc));
+
+	gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (doc), FALSE);
+}
+
+static void follow_read (GeditTab *tab);
+
+static void
+follow_read_done (GeditTab     *tab,
+		  GInputStream *stream)
+{
+	if (stream != NULL)
+	{
+		g_object_unref (stream);
+	}
+
+	tab->follow_reading = FALSE;
+
+	if (tab->follow && tab->follow_pending)
+	{
+		follow_read (tab);
+	}
+
+	g_object_unref (tab);
+}
+
+static void
+follow_read_cb (GInputStream *stream,
+		GAsyncResult *result,
+		GeditTab     *tab)
+{
+	GBytes *bytes;
+	gchar *text;
+	GError *error = NULL;
+
+	bytes = g_input_stream_read_bytes_finish (stream, result, &error);
+
+	/* Follow mode stopped in the meantime. */
+	if (!tab->follow)
+	{
+		g_clear_error (&error);
+
+		if (bytes != NULL)
+		{
+			g_bytes_unref (bytes);
+		}
+
+		follow_read_done (tab, stream);
+		return;
+	}
+
+	if (error != NULL)
+	{
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			gedit_debug_message (DEBUG_TAB, "Follow: read error: %s", error->message);
+		}
+
+		g_error_free (error);
+		follow_read_done (tab, stream);
+		return;
+	}
+
+	if (g_bytes_get_size (bytes) == 0)
+	{
+		g_bytes_unref (bytes);
+		follow_read_done (tab, stream);
+		return;
+	}
+
+	tab->follow_offset += g_bytes_get_size (bytes);
+
+	text = follow_decode (tab,
+			      g_bytes_get_data (bytes, NULL),
+			      g_bytes_get_size (bytes));
+	follow_append (tab, text);
+
+	g_free (text);
+	g_bytes_unref (bytes);
+
+	g_input_stream_read_bytes_async (stream,
+					 FOLLOW_READ_SIZE,
+					 G_PRIORITY_DEFAULT,
+					 tab->follow_cancellable,
+					 (GAsyncReadyCallback) follow_read_cb,
+					 tab);
+}
+
+static void
+follow_skip_cb (GInputStream *stream,
+		GAsyncResult *result,
+		GeditTab     *tab)
+{
+	gssize skipped;
+	GError *error = NULL;
+
+	skipped = g_input_stream_skip_finish (stream, result, &error);
+
+	if (error != NULL)
+	{
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			gedit_debug_message (DEBUG_TAB, "Follow: skip error: %s", error->message);
+		}
+
+		g_error_free (error);
+		follow_read_done (tab, stream);
+		return;
+	}
+
+	/* The file has been truncated in the meantime, the next change reads
+	 * it again.
+	 */
+	if (!tab->follow || skipped != tab->follow_offset)
+	{
+		follow_read_done (tab, stream);
+		return;
+	}
+
+	g_input_stream_read_bytes_async (stream,
+					 FOLLOW_READ_SIZE,
+					 G_PRIORITY_DEFAULT,
+					 tab->follow_cancellable,
+					 (GAsyncReadyCallback) follow_read_cb,
+					 tab);
+}
+
+static void
+follow_query_info_cb (GFileInputStream *stream,
+		      GAsyncResult     *result,
+		      GeditTab         *tab)
+{
+	GFileInfo *info;
+	goffset size;
+	GError *error = NULL;
+
+	info = g_file_input_stream_query_info_finish (stream, result, &error);
+
+	if (error != NULL)
+	{
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			gedit_debug_message (DEBUG_TAB, "Follow: query info error: %s", error->message);
+		}
+
+		g_error_free (error);
+		follow_read_done (tab, G_INPUT_STREAM (stream));
+		return;
+	}
+
+	size = g_file_info_get_size (info);
+	g_object_unref (info);
+
+	if (!tab->follow || size == tab->follow_offset)
+	{
+		follow_read_done (tab, G_INPUT_STREAM (stream));
+		return;
+	}
+
+	if (size < tab->follow_offset)
+	{
+		follow_restart (tab);
+	}
+
+	if (tab->follow_offset == 0)
+	{
+		g_input_stream_read_bytes_async (G_INPUT_STREAM (stream),
+						 FOLLOW_READ_SIZE,
+						 G_PRIORITY_DEFAULT,
+						 tab->follow_cancellable,
+						 (GAsyncReadyCallback) follow_read_cb,
+						 tab);
+		return;
+	}
+
+	g_input_stream_skip_async (G_INPUT_STREAM (stream),
+				   tab->follow_offset,
+				   G_PRIORITY_DEFAULT,
+				   tab->follow_cancellable,
+				   (GAsyncReadyCallback) follow_skip_cb,
+				   tab);
+}
+
+static void
+follow_open_cb (GFile        *location,
+		GAsyncResult *result,
+		GeditTab     *tab)
+{
+	GFileInputStream *stream;
+	GError *error = NULL;
+
+	stream = g_file_read_finish (location, result, &error);
+
+	if (error != NULL)
+	{
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+		{
+			gedit_debug_message (DEBUG_TAB, "Follow: open error: %s", error->message);
+		}
+
+		g_error_free (error);
+		follow_read_done (tab, NULL);
+		return;
+	}
+
+	if (!tab->follow)
+	{
+		follow_read_done (tab, G_INPUT_STREAM (stream));
+		return;
+	}
+
+	g_file_input_stream_query_info_async (stream,
+					      G_FILE_ATTRIBUTE_STANDARD_SIZE,
+					      G_PRIORITY_DEFAULT,
+					      tab->follow_cancellable,
+					      (GAsyncReadyCallback) follow_query_info_cb,
+					      tab);
+}
+
+static void
+follow_read (GeditTab *tab)
+{
+	GeditDocument *doc;
+	GFile *location;
+
+	/* Only one read at a time, the next one starts at its end. */
+	if (tab->follow_reading ||
+	    tab->state != GEDIT_TAB_STATE_NORMAL)
+	{
+		tab->follow_pending = TRUE;
+		return;
+	}
+
+	tab->follow_reading = TRUE;
+	tab->follow_pending = FALSE;
+
+	doc = gedit_tab_get_document (tab);
+	location = gtk_source_file_get_location (gedit_document_get_file (doc));
+
+	g_file_read_async (location,
+			   G_PRIORITY_DEFAULT,
+			   tab->follow_cancellable,
+			   (GAsyncReadyCallback) follow_open_cb,
+			   g_object_ref (tab));
+}
+
+static void
+follow_file_changed_cb (GFileMonitor      *monitor,
+			GFile             *file,
+			GFile             *other_file,
+			GFileMonitorEvent  event_type,
+			GeditTab          *tab)
+{
+	switch (event_type)
+	{
+		case G_FILE_MONITOR_EVENT_CHANGED:
+		case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+		case G_FILE_MONITOR_EVENT_CREATED:
+			follow_read (tab);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* The size of the file is queried before following it: the bytes appended
+ * since the file was loaded are not read. Until then, the reads wait, see
+ * follow_read().
+ */
+static void
+follow_query_size_cb (GFile        *location,
+		      GAsyncResult *result,
+		      GeditTab     *tab)
+{
+	GFileInfo *info;
+	GFileMonitor *monitor;
+	GError *error = NULL;
+
+	info = g_file_query_info_finish (location, result, &error);
+
+	/* Follow mode has been stopped. */
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_error_free (error);
+		follow_read_done (tab, NULL);
+		return;
+	}
+
+	if (error != NULL)
+	{
+		gedit_debug_message (DEBUG_TAB, "Follow: query info error: %s", error->message);
+		g_error_free (error);
+		goto failed;
+	}
+
+	if (!tab->follow)
+	{
+		g_object_unref (info);
+		follow_read_done (tab, NULL);
+		return;
+	}
+
+	tab->follow_offset = g_file_info_get_size (info);
+	g_object_unref (info);
+
+	monitor = g_file_monitor_file (location, G_FILE_MONITOR_NONE, NULL, &error);
+
+	if (error != NULL)
+	{
+		gedit_debug_message (DEBUG_TAB, "Follow: monitor error: %s", error->message);
+		g_error_free (error);
+		goto failed;
+	}
+
+	tab->follow_monitor = monitor;
+
+	g_signal_connect (monitor,
+			  "changed",
+			  G_CALLBACK (follow_file_changed_cb),
+			  tab);
+
+	follow_read_done (tab, NULL);
+	return;
+
+failed:
+	if (tab->follow)
+	{
+		stop_following (tab);
+		set_view_properties_according_to_state (tab, tab->state);
+		g_object_notify_by_pspec (G_OBJECT (tab), properties[PROP_FOLLOW]);
+	}
+
+	follow_read_done (tab, NULL);
+}
+
+static gboolean
+start_following (GeditTab *tab)
+{
+	GeditDocument *doc;
+	GtkSourceFile *file;
+	GFile *location;
+	const GtkSourceEncoding *encoding;
+	GCharsetConverter *converter;
+	GError *error = NULL;
+
+	doc = gedit_tab_get_document (tab);
+	file = gedit_document_get_file (doc);
+	location = gtk_source_file_get_location (file);
+
+	if (location == NULL ||
+	    !g_file_is_native (location) ||
+	    gedit_compression_format_from_location (location) != GEDIT_COMPRESSION_FORMAT_NONE ||
+	    tab->viewer != NULL ||
+	    tab->state != GEDIT_TAB_STATE_NORMAL ||
+	    gtk_text_buffer_get_modified (GTK_TEXT_BUFFER (doc)))
+	{
+		gedit_debug_message (DEBUG_TAB, "Follow: the document cannot follow its file");
+		return FALSE;
+	}
+
+	encoding = _gedit_document_get_file_encoding (doc);
+	if (encoding == NULL)
+	{
+		encoding = gtk_source_encoding_get_utf8 ();
+	}
+
+	converter = g_charset_converter_new ("UTF-8",
+					     gtk_source_encoding_get_charset (encoding),
+					     &error);
+
+	if (error != NULL)
+	{
+		gedit_debug_message (DEBUG_TAB, "Follow: converter error: %s", error->message);
+		g_error_free (error);
+		return FALSE;
+	}
+
+	g_charset_converter_set_use_fallback (converter, TRUE);
+
+	tab->follow_converter = converter;
+	tab->follow_cancellable = g_cancellable_new ();
+	tab->follow_undecoded = g_byte_array_new ();
+	tab->follow_offset = 0;
+	tab->follow_trimmed = FALSE;
+	tab->follow_pending = FALSE;
 
-	if (tab->state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)
+	/* The loader removed the last newline of the file. */
+	if (gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (doc)) &&
+	    gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (doc)) > 0)
 	{
-		set_info_bar (tab, NULL, GTK_RESPONSE_NONE);
+		tab->follow_held_newline = g_strdup (get_newline_string (_gedit_document_get_file_newline_type (doc)));
 	}
 
-	doc = gedit_tab_get_document (tab);
-	file = gedit_document_get_file (doc);
-	location = gtk_source_file_get_location (file);
-	g_return_if_fail (location != NULL);
+	tab->follow_reading = TRUE;
 
-	gedit_tab_set_state (tab, GEDIT_TAB_STATE_REVERTING);
+	g_file_query_info_async (location,
+				 G_FILE_ATTRIBUTE_STANDARD_SIZE,
+				 G_FILE_QUERY_INFO_NONE,
+				 G_PRIORITY_DEFAULT,
+				 tab->follow_cancellable,
+				 (GAsyncReadyCallback) follow_query_size_cb,
+				 g_object_ref (tab));
 
-	loading_task = g_task_new (tab, cancellable, callback, user_data);
+	return TRUE;
+}
 
-	data = loader_data_new ();
-	g_task_set_task_data (loading_task, data, (GDestroyNotify) loader_data_free);
+static void
+stop_following (GeditTab *tab)
+{
+	if (tab->follow_monitor != NULL)
+	{
+		g_signal_handlers_disconnect_by_func (tab->follow_monitor,
+						      follow_file_changed_cb,
+						      tab);
+		g_file_monitor_cancel (tab->follow_monitor);
+		g_clear_object (&tab->follow_monitor);
+	}
 
-	data->loader = gtk_source_file_loader_new (GTK_SOURCE_BUFFER (doc), file);
-	data->line_pos = 0;
-	data->column_pos = 0;
+	if (tab->follow_cancellable != NULL)
+	{
+		g_cancellable_cancel (tab->follow_cancellable);
+		g_clear_object (&tab->follow_cancellable);
+	}
 
-	launch_loader (loading_task, NULL);
+	g_clear_object (&tab->follow_converter);
+	g_clear_pointer (&tab->follow_held_newline, g_free);
+
+	if (tab->follow_undecoded != NULL)
+	{
+		g_byte_array_unref (tab->follow_undecoded);
+		tab->follow_undecoded = NULL;
+	}
+
+	tab->follow = FALSE;
 }
 
 void
-_gedit_tab_revert (GeditTab *tab)
+_gedit_tab_set_follow (GeditTab *tab,
+		       gboolean  follow)
 {
-	GCancellable *cancellable;
+	g_return_if_fail (GEDIT_IS_TAB (tab));
 
-	cancellable = g_cancellable_new ();
+	follow = follow != FALSE;
 
-	revert_async (tab,
-		      cancellable,
-		      (GAsyncReadyCallback) load_finish,
-		      NULL);
+	if (tab->follow == follow)
+	{
+		return;
+	}
 
-	g_object_unref (cancellable);
+	if (follow)
+	{
+		tab->follow = start_following (tab);
+	}
+	else
+	{
+		stop_following (tab);
+
+		/* Load the file again, for the dropped lines and to know the
+		 * new modification time of the file.
+		 */
+		if (tab->state == GEDIT_TAB_STATE_NORMAL)
+		{
+			_gedit_tab_revert (tab);
+		}
+	}
+
+	set_view_properties_according_to_state (tab, tab->state);
+
+	g_object_notify_by_pspec (G_OBJECT (tab), properties[PROP_FOLLOW]);
+}
+
+gboolean
+_gedit_tab_get_follow (GeditTab *tab)
+{
+	g_return_val_if_fail (GEDIT_IS_TAB (tab), FALSE);
+
+	return tab->follow;
 }
 
 static void
@@ -2294,6 +4815,13 @@ saver_progress_cb (goffset  size,
 
 	g_return_if_fail (tab->state == GEDIT_TAB_STATE_SAVING);
 
+	if (data->stats.time_to_first_byte == 0 && size > 0)
+	{
+		data->stats.time_to_first_byte = g_get_monotonic_time () - data->start_time;
+	}
+
+	data->stats.bytes = size;
+
 	if (should_show_progress_info (&data->timer, size, total_size))
 	{
 		show_saving_info_bar (saving_task);
@@ -2302,25 +4830,27 @@ saver_progress_cb (goffset  size,
 }
 
 static void
-save_cb (GtkSourceFileSaver *saver,
-	 GAsyncResult       *result,
-	 GTask              *saving_task)
+saving_done (GTask  *saving_task,
+	     GError *error)
 {
 	GeditTab *tab = g_task_get_source_object (saving_task);
 	SaverData *data = g_task_get_task_data (saving_task);
 	GeditDocument *doc = gedit_tab_get_document (tab);
-	GFile *location = gtk_source_file_saver_get_location (saver);
-	GError *error = NULL;
-
-	g_return_if_fail (tab->state == GEDIT_TAB_STATE_SAVING);
-
-	gtk_source_file_saver_save_finish (saver, result, &error);
+	GFile *location = gtk_source_file_saver_get_location (data->saver);
 
 	if (error != NULL)
 	{
 		gedit_debug_message (DEBUG_TAB, "File saving error: %s", error->message);
 	}
 
+	tab->saving_copy = FALSE;
+
+	data->stats.wall_time = g_get_monotonic_time () - data->start_time;
+	data->stats.transfer_time = data->stats.wall_time;
+	data->stats.success = error == NULL;
+
+	dump_stats ("Save", &data->stats);
+
 	if (data->timer != NULL)
 	{
 		g_timer_destroy (data->timer);
@@ -2397,7 +4927,7 @@ save_cb (GtkSourceFileSaver *saver,
 			g_return_if_fail (error->domain == G_CONVERT_ERROR ||
 			                  error->domain == G_IO_ERROR);
 
-			encoding = gtk_source_file_saver_get_encoding (saver);
+			encoding = gtk_source_file_saver_get_encoding (data->saver);
 
 			info_bar = gedit_conversion_error_while_saving_info_bar_new (location, encoding, error);
 			g_return_if_fail (info_bar != NULL);
@@ -2412,6 +4942,14 @@ save_cb (GtkSourceFileSaver *saver,
 	}
 	else
 	{
+		/* The text has been saved from a copy, the edits done during
+		 * the saving are not saved.
+		 */
+		if (data->document != NULL && !data->document_changed)
+		{
+			gtk_text_buffer_set_modified (GTK_TEXT_BUFFER (doc), FALSE);
+		}
+
 		gedit_recent_add_document (doc);
 
 		gedit_tab_set_state (tab, GEDIT_TAB_STATE_NORMAL);
@@ -2422,6 +4960,31 @@ save_cb (GtkSourceFileSaver *saver,
 		g_task_return_boolean (saving_task, TRUE);
 		g_object_unref (saving_task);
 	}
+}
+
+static void
+save_cb (GtkSourceFileSaver *saver,
+	 GAsyncResult       *result,
+	 GTask              *saving_task)
+{
+	GeditTab *tab = g_task_get_source_object (saving_task);
+	SaverData *data = g_task_get_task_data (saving_task);
+	GError *error = NULL;
+
+	g_return_if_fail (tab->state == GEDIT_TAB_STATE_SAVING);
+
+	gtk_source_file_saver_save_finish (saver, result, &error);
+
+	/* A retry makes a new copy of the text. */
+	g_clear_object (&data->copy_saver);
+	g_clear_object (&data->copy);
+
+	if (error == NULL)
+	{
+		_gedit_document_clear_file_properties (gedit_tab_get_document (tab));
+	}
+
+	saving_done (saving_task, error);
 
 	if (error != NULL)
 	{
@@ -2430,12 +4993,243 @@ save_cb (GtkSourceFileSaver *saver,
 }
 
 static void
-launch_saver (GTask *saving_task)
+thread_save_cb (GObject      *source_object,
+		GAsyncResult *result,
+		GTask        *saving_task)
 {
 	GeditTab *tab = g_task_get_source_object (saving_task);
+	SaverData *data = g_task_get_task_data (saving_task);
+	gssize size;
+	GTimeVal mtime;
+	GError *error = NULL;
+
+	g_return_if_fail (tab->state == GEDIT_TAB_STATE_SAVING);
+
+	size = gedit_compression_save_finish (result, &mtime, &error);
+
+	if (error == NULL)
+	{
+		GeditDocument *doc = gedit_tab_get_document (tab);
+		GtkSourceFile *file = gedit_document_get_file (doc);
+
+		data->stats.bytes = size;
+
+		/* Done by the GtkSourceView saver for the other files: the
+		 * location changes for a "save as", and the file properties
+		 * are the ones of the saving.
+		 */
+		gtk_source_file_set_location (file, gtk_source_file_saver_get_location (data->saver));
+
+		_gedit_document_set_file_properties (doc,
+						     gtk_source_file_saver_get_encoding (data->saver),
+						     gtk_source_file_saver_get_newline_type (data->saver),
+						     mtime.tv_sec != 0 ? &mtime : NULL);
+	}
+
+	saving_done (saving_task, error);
+
+	if (error != NULL)
+	{
+		g_error_free (error);
+	}
+}
+
+static void
+copy_document_changed (GtkTextBuffer *buffer,
+		       SaverData     *data)
+{
+	data->document_changed = TRUE;
+}
+
+/* The GtkSourceFile doesn't know the encoding and the newline type of a file
+ * written by gedit itself, see _gedit_document_set_file_properties().
+ */
+static GtkSourceFileSaver *
+saver_new (GeditDocument *doc)
+{
+	GtkSourceFileSaver *saver;
+
+	saver = gtk_source_file_saver_new (GTK_SOURCE_BUFFER (doc),
+					   gedit_document_get_file (doc));
+
+	gtk_source_file_saver_set_encoding (saver, _gedit_document_get_file_encoding (doc));
+	gtk_source_file_saver_set_newline_type (saver, _gedit_document_get_file_newline_type (doc));
+
+	return saver;
+}
+
+/* The GtkSourceView saver keeps the document read-only while it reads it,
+ * which is long for a big document. Such a document is saved from a copy of
+ * its text instead, still by GtkSourceView, so that the GtkSourceFile is
+ * updated as usual. Only GtkSourceView knows the invalid characters of a
+ * document, which are lost in a copy of its text.
+ */
+static gboolean
+use_copy_saver (GeditTab *tab)
+{
+	GeditDocument *doc = gedit_tab_get_document (tab);
+
+	return (gtk_text_buffer_get_char_count (GTK_TEXT_BUFFER (doc)) >= COPY_SAVE_MIN_SIZE &&
+		!tab->invalid_chars);
+}
+
+/* The check of the GtkSourceView saver before writing the file, for the
+ * thread saver, or when the GtkSourceFile doesn't know the modification time
+ * of the file. Only a local file is checked, since it is queried
+ * synchronously.
+ */
+static gboolean
+is_externally_modified (GeditTab *tab,
+			GFile    *location)
+{
 	GeditDocument *doc = gedit_tab_get_document (tab);
+	GtkSourceFile *file = gedit_document_get_file (doc);
+	GFile *file_location = gtk_source_file_get_location (file);
+	gboolean externally_modified = FALSE;
+
+	if (file_location != NULL &&
+	    g_file_equal (location, file_location) &&
+	    gtk_source_file_is_local (file))
+	{
+		_gedit_document_check_file_on_disk (doc, &externally_modified, NULL);
+	}
+
+	return externally_modified;
+}
+
+/* The document stays editable, the edits done during the saving are not
+ * saved.
+ */
+static void
+watch_document_changes (SaverData     *data,
+			GtkTextBuffer *buffer)
+{
+	data->document_changed = FALSE;
+
+	if (data->document == NULL)
+	{
+		data->document = buffer;
+		data->document_changed_id = g_signal_connect (buffer,
+							      "changed",
+							      G_CALLBACK (copy_document_changed),
+							      data);
+	}
+}
+
+static void
+launch_copy_saver (GTask *saving_task)
+{
+	GeditTab *tab = g_task_get_source_object (saving_task);
+	SaverData *data = g_task_get_task_data (saving_task);
+	GtkTextBuffer *buffer = GTK_TEXT_BUFFER (gedit_tab_get_document (tab));
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+
+	gtk_text_buffer_get_bounds (buffer, &start, &end);
+	text = gtk_text_buffer_get_text (buffer, &start, &end, TRUE);
+
+	g_clear_object (&data->copy_saver);
+	g_clear_object (&data->copy);
+
+	data->copy = gtk_source_buffer_new (NULL);
+	gtk_source_buffer_set_implicit_trailing_newline (data->copy,
+							 gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer)));
+
+	gtk_source_buffer_begin_not_undoable_action (data->copy);
+	gtk_text_buffer_set_text (GTK_TEXT_BUFFER (data->copy), text, -1);
+	gtk_source_buffer_end_not_undoable_action (data->copy);
+
+	g_free (text);
+
+	/* The GtkSourceFile of the document is updated by this saver. */
+	data->copy_saver = gtk_source_file_saver_new_with_target (data->copy,
+								  gtk_source_file_saver_get_file (data->saver),
+								  gtk_source_file_saver_get_location (data->saver));
+
+	gtk_source_file_saver_set_encoding (data->copy_saver,
+					    gtk_source_file_saver_get_encoding (data->saver));
+	gtk_source_file_saver_set_newline_type (data->copy_saver,
+						gtk_source_file_saver_get_newline_type (data->saver));
+	gtk_source_file_saver_set_compression_type (data->copy_saver,
+						    gtk_source_file_saver_get_compression_type (data->saver));
+	gtk_source_file_saver_set_flags (data->copy_saver,
+					 gtk_source_file_saver_get_flags (data->saver));
+
+	watch_document_changes (data, buffer);
+
+	gtk_source_file_saver_save_async (data->copy_saver,
+					  G_PRIORITY_DEFAULT,
+					  g_task_get_cancellable (saving_task),
+					  (GFileProgressCallback) saver_progress_cb,
+					  saving_task,
+					  NULL,
+					  (GAsyncReadyCallback) save_cb,
+					  saving_task);
+}
+
+/* GtkSourceView writes only the gzip compression, the xz and zstd files are
+ * written by gedit, see gedit-compression.c.
+ */
+static void
+launch_thread_saver (GTask                  *saving_task,
+		     GeditCompressionFormat  compression_format)
+{
+	GeditTab *tab = g_task_get_source_object (saving_task);
 	SaverData *data = g_task_get_task_data (saving_task);
+	GtkTextBuffer *buffer = GTK_TEXT_BUFFER (gedit_tab_get_document (tab));
+	GtkSourceFileSaverFlags flags = gtk_source_file_saver_get_flags (data->saver);
+	GtkTextIter start;
+	GtkTextIter end;
+	gchar *text;
+
+	/* The only work done on the main thread: the conversion, the
+	 * compression and the writing are done in the thread.
+	 */
+	gtk_text_buffer_get_bounds (buffer, &start, &end);
+	text = gtk_text_buffer_get_text (buffer, &start, &end, TRUE);
+
+	if (gtk_source_buffer_get_implicit_trailing_newline (GTK_SOURCE_BUFFER (buffer)))
+	{
+		gsize length = strlen (text);
+
+		text = g_realloc (text, length + 2);
+		text[length] = '\n';
+		text[length + 1] = '\0';
+	}
+
+	watch_document_changes (data, buffer);
+
+	gedit_compression_save_async (gtk_source_file_saver_get_location (data->saver),
+				      text,
+				      gtk_source_file_saver_get_encoding (data->saver),
+				      gtk_source_file_saver_get_newline_type (data->saver),
+				      (flags & GTK_SOURCE_FILE_SAVER_FLAGS_CREATE_BACKUP) != 0,
+				      compression_format,
+				      g_task_get_cancellable (saving_task),
+				      (GAsyncReadyCallback) thread_save_cb,
+				      saving_task);
+}
 
+static void
+launch_saver (GTask *saving_task)
+{
+	GeditTab *tab = g_task_get_source_object (saving_task);
+	GeditDocument *doc = gedit_tab_get_document (tab);
+	SaverData *data = g_task_get_task_data (saving_task);
+	GFile *location;
+	GtkSourceFileSaverFlags flags;
+	GeditCompressionFormat compression_format;
+	gboolean use_thread;
+	gboolean use_copy;
+
+	location = gtk_source_file_saver_get_location (data->saver);
+	flags = gtk_source_file_saver_get_flags (data->saver);
+	compression_format = gedit_compression_format_from_location (location);
+	use_thread = compression_format != GEDIT_COMPRESSION_FORMAT_NONE;
+	use_copy = !use_thread && use_copy_saver (tab);
+
+	tab->saving_copy = use_thread || use_copy;
 	gedit_tab_set_state (tab, GEDIT_TAB_STATE_SAVING);
 
 	g_signal_emit_by_name (doc, "save");
@@ -2447,6 +5241,65 @@ launch_saver (GTask *saving_task)
 
 	data->timer = g_timer_new ();
 
+	memset (&data->stats, 0, sizeof (OperationStats));
+	data->start_time = g_get_monotonic_time ();
+
+	/* Only GtkSourceView knows the invalid characters. For a compressed
+	 * file, the document is assumed to still have the ones found when it
+	 * was loaded. See use_copy_saver().
+	 */
+	if (use_thread && tab->invalid_chars &&
+	    (flags & GTK_SOURCE_FILE_SAVER_FLAGS_IGNORE_INVALID_CHARS) == 0)
+	{
+		GError *error;
+
+		error = g_error_new_literal (GTK_SOURCE_FILE_SAVER_ERROR,
+					     GTK_SOURCE_FILE_SAVER_ERROR_INVALID_CHARS,
+					     _("The buffer contains invalid characters."));
+
+		saving_done (saving_task, error);
+		g_error_free (error);
+		return;
+	}
+
+	if ((use_thread || _gedit_document_has_file_properties (doc)) &&
+	    (flags & GTK_SOURCE_FILE_SAVER_FLAGS_IGNORE_MODIFICATION_TIME) == 0)
+	{
+		if (is_externally_modified (tab, location))
+		{
+			GError *error;
+
+			error = g_error_new_literal (GTK_SOURCE_FILE_SAVER_ERROR,
+						     GTK_SOURCE_FILE_SAVER_ERROR_EXTERNALLY_MODIFIED,
+						     _("The file is externally modified."));
+
+			saving_done (saving_task, error);
+			g_error_free (error);
+			return;
+		}
+
+		/* The modification time of the GtkSourceFile is out of
+		 * date, and the file has just been checked.
+		 */
+		if (!use_thread)
+		{
+			gtk_source_file_saver_set_flags (data->saver,
+							 flags | GTK_SOURCE_FILE_SAVER_FLAGS_IGNORE_MODIFICATION_TIME);
+		}
+	}
+
+	if (use_thread)
+	{
+		launch_thread_saver (saving_task, compression_format);
+		return;
+	}
+
+	if (use_copy)
+	{
+		launch_copy_saver (saving_task);
+		return;
+	}
+
 	gtk_source_file_saver_save_async (data->saver,
 					  G_PRIORITY_DEFAULT,
 					  g_task_get_cancellable (saving_task),
@@ -2491,10 +5344,10 @@ _gedit_tab_save_async (GeditTab            *tab,
 	GTask *saving_task;
 	SaverData *data;
 	GeditDocument *doc;
-	GtkSourceFile *file;
 	GtkSourceFileSaverFlags save_flags;
 
 	g_return_if_fail (GEDIT_IS_TAB (tab));
+	g_return_if_fail (tab->viewer == NULL);
 	g_return_if_fail (tab->state == GEDIT_TAB_STATE_NORMAL ||
 	                  tab->state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION ||
 	                  tab->state == GEDIT_TAB_STATE_SHOWING_PRINT_PREVIEW);
@@ -2518,6 +5371,18 @@ _gedit_tab_save_async (GeditTab            *tab,
 
 	saving_task = g_task_new (tab, cancellable, callback, user_data);
 
+	/* The buffer of a hibernated document is empty and must not replace
+	 * the file, which has the contents.
+	 */
+	if (tab->hibernated)
+	{
+		gedit_debug_message (DEBUG_TAB, "Hibernated tab, nothing to save");
+
+		g_task_return_boolean (saving_task, TRUE);
+		g_object_unref (saving_task);
+		return;
+	}
+
 	data = saver_data_new ();
 	g_task_set_task_data (saving_task, data, (GDestroyNotify) saver_data_free);
 
@@ -2532,9 +5397,7 @@ _gedit_tab_save_async (GeditTab            *tab,
 		save_flags |= GTK_SOURCE_FILE_SAVER_FLAGS_IGNORE_MODIFICATION_TIME;
 	}
 
-	file = gedit_document_get_file (doc);
-
-	data->saver = gtk_source_file_saver_new (GTK_SOURCE_BUFFER (doc), file);
+	data->saver = saver_new (doc);
 
 	gtk_source_file_saver_set_flags (data->saver, save_flags);
 
@@ -2605,7 +5468,7 @@ gedit_tab_auto_save (GeditTab *tab)
 	data = saver_data_new ();
 	g_task_set_task_data (saving_task, data, (GDestroyNotify) saver_data_free);
 
-	data->saver = gtk_source_file_saver_new (GTK_SOURCE_BUFFER (doc), file);
+	data->saver = saver_new (doc);
 
 	save_flags = get_initial_save_flags (tab, TRUE);
 	gtk_source_file_saver_set_flags (data->saver, save_flags);
@@ -2615,6 +5478,26 @@ gedit_tab_auto_save (GeditTab *tab)
 	return G_SOURCE_REMOVE;
 }
 
+static void
+save_as_wake_up_cb (GeditTab     *tab,
+		    GAsyncResult *result,
+		    GTask        *saving_task)
+{
+	/* A failed reload shows its own error in the tab. */
+	if (!load_finish (tab, result) ||
+	    tab->state != GEDIT_TAB_STATE_NORMAL)
+	{
+		g_task_return_new_error (saving_task,
+					 G_IO_ERROR,
+					 G_IO_ERROR_FAILED,
+					 "The document could not be reloaded before saving it");
+		g_object_unref (saving_task);
+		return;
+	}
+
+	launch_saver (saving_task);
+}
+
 /* Call _gedit_tab_save_finish() in @callback, there is no
  * _gedit_tab_save_as_finish().
  */
@@ -2635,6 +5518,7 @@ _gedit_tab_save_as_async (GeditTab                 *tab,
 	GtkSourceFileSaverFlags save_flags;
 
 	g_return_if_fail (GEDIT_IS_TAB (tab));
+	g_return_if_fail (tab->viewer == NULL);
 	g_return_if_fail (tab->state == GEDIT_TAB_STATE_NORMAL ||
 	                  tab->state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION ||
 	                  tab->state == GEDIT_TAB_STATE_SHOWING_PRINT_PREVIEW);
@@ -2679,6 +5563,18 @@ _gedit_tab_save_as_async (GeditTab                 *tab,
 	gtk_source_file_saver_set_compression_type (data->saver, compression_type);
 	gtk_source_file_saver_set_flags (data->saver, save_flags);
 
+	/* The buffer of a hibernated document is empty. The saver reads the
+	 * buffer only when it is launched, so it is launched once the reload
+	 * is finished.
+	 */
+	if (tab->hibernated)
+	{
+		gedit_debug_message (DEBUG_TAB, "Hibernated tab, save it once reloaded");
+
+		wake_up (tab, (GAsyncReadyCallback) save_as_wake_up_cb, saving_task);
+		return;
+	}
+
 	launch_saver (saving_task);
 }
 
@@ -3108,4 +6004,15 @@ _gedit_tab_get_view_frame (GeditTab *tab)
 	return tab->frame;
 }
 
+/* In viewer mode, the buffer contains only a part of a huge file, so the
+ * document must not be saved.
+ */
+gboolean
+_gedit_tab_get_viewer_mode (GeditTab *tab)
+{
+	g_return_val_if_fail (GEDIT_IS_TAB (tab), FALSE);
+
+	return tab->viewer != NULL;
+}
+
 /* ex:set ts=8 noet: */
@@ -32,6 +32,7 @@
 #include "gedit-debug.h"
 #include "gedit-utils.h"
 #include "gedit-settings.h"
+#include "gedit-mapped-file-viewer.h"
 #include "libgd/gd.h"
 
 #define FLUSH_TIMEOUT_DURATION 30 /* in seconds */
@@ -94,6 +95,9 @@ struct _GeditViewFrame
 	 */
 	gchar *search_text;
 	gchar *old_search_text;
+
+	/* Owned by the GeditTab, set when the tab is in viewer mode. */
+	GeditMappedFileViewer *mapped_file_viewer;
 };
 
 G_DEFINE_TYPE (GeditViewFrame, gedit_view_frame, GTK_TYPE_OVERLAY)
@@ -294,6 +298,64 @@ finish_search (GeditViewFrame    *frame,
 	}
 }
 
+static void
+mapped_file_viewer_search_finished (GObject        *source_object,
+				    GAsyncResult   *result,
+				    GeditViewFrame *frame)
+{
+	GError *error = NULL;
+	gboolean found;
+
+	found = gedit_mapped_file_viewer_search_finish (result, &error);
+
+	/* Replaced by a new search, or the viewer has been freed. */
+	if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+	{
+		g_error_free (error);
+		return;
+	}
+
+	g_clear_error (&error);
+
+	finish_search (frame, found);
+}
+
+/* In viewer mode, only a part of the file is in the buffer, so the search is
+ * done in the whole file by the GeditMappedFileViewer. Regex searches are
+ * done in the buffer only.
+ */
+static gboolean
+search_in_mapped_file (GeditViewFrame    *frame,
+		       const GtkTextIter *from,
+		       gboolean           backward)
+{
+	const gchar *search_text;
+
+	if (frame->mapped_file_viewer == NULL ||
+	    !gedit_mapped_file_viewer_is_ready (frame->mapped_file_viewer) ||
+	    gtk_source_search_settings_get_regex_enabled (frame->search_settings))
+	{
+		return FALSE;
+	}
+
+	search_text = gtk_source_search_settings_get_search_text (frame->search_settings);
+
+	if (search_text == NULL)
+	{
+		return FALSE;
+	}
+
+	gedit_mapped_file_viewer_search_async (frame->mapped_file_viewer,
+					       search_text,
+					       gtk_source_search_settings_get_case_sensitive (frame->search_settings),
+					       backward,
+					       from,
+					       (GAsyncReadyCallback) mapped_file_viewer_search_finished,
+					       frame);
+
+	return TRUE;
+}
+
 static void
 start_search_finished (GtkSourceSearchContext *search_context,
 		       GAsyncResult           *result,
@@ -356,6 +418,11 @@ start_search (GeditViewFrame *frame)
 					  &start_at,
 					  frame->start_mark);
 
+	if (search_in_mapped_file (frame, &start_at, FALSE))
+	{
+		return;
+	}
+
 	gtk_source_search_context_forward_async (search_context,
 						 &start_at,
 						 NULL,
@@ -412,6 +479,11 @@ forward_search (GeditViewFrame *frame)
 
 	gtk_text_buffer_get_selection_bounds (buffer, NULL, &start_at);
 
+	if (search_in_mapped_file (frame, &start_at, FALSE))
+	{
+		return;
+	}
+
 	gtk_source_search_context_forward_async (search_context,
 						 &start_at,
 						 NULL,
@@ -469,6 +541,11 @@ backward_search (GeditViewFrame *frame)
 
 	gtk_text_buffer_get_selection_bounds (buffer, &start_at, NULL);
 
+	if (search_in_mapped_file (frame, &start_at, TRUE))
+	{
+		return;
+	}
+
 	gtk_source_search_context_backward_async (search_context,
 						  &start_at,
 						  NULL,
@@ -1036,7 +1113,8 @@ update_goto_line (GeditViewFrame *frame)
 	const gchar *entry_text;
 	gboolean moved;
 	gboolean moved_offset;
-	gint line;
+	gint64 line;
+	gint64 cur_line;
 	gint offset_line = 0;
 	gint line_offset = 0;
 	gchar **split_text = NULL;
@@ -1057,6 +1135,15 @@ update_goto_line (GeditViewFrame *frame)
 					  &iter,
 					  frame->start_mark);
 
+	if (frame->mapped_file_viewer != NULL)
+	{
+		cur_line = gedit_mapped_file_viewer_get_line (frame->mapped_file_viewer, &iter);
+	}
+	else
+	{
+		cur_line = gtk_text_iter_get_line (&iter);
+	}
+
 	split_text = g_strsplit (entry_text, ":", -1);
 
 	if (g_strv_length (split_text) > 1)
@@ -1070,8 +1157,6 @@ update_goto_line (GeditViewFrame *frame)
 
 	if (text[0] == '-')
 	{
-		gint cur_line = gtk_text_iter_get_line (&iter);
-
 		if (text[1] != '\0')
 		{
 			offset_line = MAX (atoi (text + 1), 0);
@@ -1081,8 +1166,6 @@ update_goto_line (GeditViewFrame *frame)
 	}
 	else if (entry_text[0] == '+')
 	{
-		gint cur_line = gtk_text_iter_get_line (&iter);
-
 		if (text[1] != '\0')
 		{
 			offset_line = MAX (atoi (text + 1), 0);
@@ -1092,7 +1175,7 @@ update_goto_line (GeditViewFrame *frame)
 	}
 	else
 	{
-		line = MAX (atoi (text) - 1, 0);
+		line = MAX (g_ascii_strtoll (text, NULL, 10) - 1, 0);
 	}
 
 	if (split_text[1] != NULL)
@@ -1102,8 +1185,18 @@ update_goto_line (GeditViewFrame *frame)
 
 	g_strfreev (split_text);
 
-	moved = gedit_document_goto_line (doc, line);
-	moved_offset = gedit_document_goto_line_offset (doc, line, line_offset);
+	if (frame->mapped_file_viewer != NULL)
+	{
+		moved = gedit_mapped_file_viewer_goto_line_offset (frame->mapped_file_viewer,
+								   line,
+								   line_offset);
+		moved_offset = TRUE;
+	}
+	else
+	{
+		moved = gedit_document_goto_line (doc, (gint) line);
+		moved_offset = gedit_document_goto_line_offset (doc, (gint) line, line_offset);
+	}
 
 	gedit_view_scroll_to_cursor (frame->view);
 
@@ -1584,6 +1677,15 @@ gedit_view_frame_popup_goto_line (GeditViewFrame *frame)
 	start_interactive_search_real (frame, GOTO_LINE);
 }
 
+void
+gedit_view_frame_set_mapped_file_viewer (GeditViewFrame        *frame,
+					 GeditMappedFileViewer *viewer)
+{
+	g_return_if_fail (GEDIT_IS_VIEW_FRAME (frame));
+
+	frame->mapped_file_viewer = viewer;
+}
+
 void
 gedit_view_frame_clear_search (GeditViewFrame *frame)
 {
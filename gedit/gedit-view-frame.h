@@ -25,6 +25,7 @@
 #include "gedit-document.h"
 #include "gedit-view.h"
 #include "gedit-view-holder.h"
+#include "gedit-mapped-file-viewer.h"
 
 G_BEGIN_DECLS
 
@@ -43,6 +44,9 @@ void		 gedit_view_frame_popup_goto_line	(GeditViewFrame *frame);
 
 void		 gedit_view_frame_clear_search		(GeditViewFrame *frame);
 
+void		 gedit_view_frame_set_mapped_file_viewer	(GeditViewFrame        *frame,
+								 GeditMappedFileViewer *viewer);
+
 G_END_DECLS
 
 #endif /* __GEDIT_VIEW_FRAME_H__ */
@@ -29,6 +29,7 @@
 #include "gedit-plugins-engine.h"
 #include "gedit-debug.h"
 #include "gedit-utils.h"
+#include "gedit-document-private.h"
 #include "gedit-settings.h"
 #include "gedit-app.h"
 #include "gedit-app-private.h"
@@ -47,6 +48,11 @@ struct _GeditViewPrivate
 	GtkTextBuffer *current_buffer;
 	PeasExtensionSet *extensions;
 	gchar *direct_save_uri;
+
+	/* Whether the settings are overridden for the long lines of
+	 * the buffer.
+	 */
+	guint long_lines : 1;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (GeditView, gedit_view, GTK_SOURCE_TYPE_VIEW)
@@ -70,6 +76,67 @@ file_read_only_notify_handler (GtkSourceFile *file,
 				    !gtk_source_file_is_readonly (file));
 }
 
+static void
+bind_long_line_settings (GeditView *view)
+{
+	g_settings_bind (view->priv->editor_settings,
+	                 GEDIT_SETTINGS_HIGHLIGHT_CURRENT_LINE,
+	                 view,
+	                 "highlight-current-line",
+	                 G_SETTINGS_BIND_GET);
+
+	g_settings_bind (view->priv->editor_settings,
+	                 GEDIT_SETTINGS_WRAP_MODE,
+	                 view,
+	                 "wrap-mode",
+	                 G_SETTINGS_BIND_GET);
+}
+
+/* A line of several megabytes is wrapped by characters: unwrapped, its width
+ * exceeds the range of the Pango coordinates, and the word wrapping looks for
+ * the word boundaries of the whole line. GtkTextView still lays the whole line
+ * out in one PangoLayout, each time it is edited, so the document only avoids
+ * adding attributes to it, see set_long_lines() in gedit-document.c.
+ */
+static void
+update_long_lines (GeditView *view)
+{
+	gboolean long_lines;
+
+	long_lines = (view->priv->current_buffer != NULL &&
+		      _gedit_document_get_long_lines (GEDIT_DOCUMENT (view->priv->current_buffer)));
+
+	if (long_lines == view->priv->long_lines)
+	{
+		return;
+	}
+
+	view->priv->long_lines = long_lines;
+
+	if (long_lines)
+	{
+		g_settings_unbind (view, "highlight-current-line");
+		g_settings_unbind (view, "wrap-mode");
+
+		gtk_source_view_set_highlight_current_line (GTK_SOURCE_VIEW (view), FALSE);
+		gtk_text_view_set_wrap_mode (GTK_TEXT_VIEW (view), GTK_WRAP_CHAR);
+	}
+	else
+	{
+		bind_long_line_settings (view);
+	}
+}
+
+static void
+long_lines_notify_handler (GeditDocument *doc,
+			   GParamSpec    *pspec,
+			   GeditView     *view)
+{
+	gedit_debug (DEBUG_VIEW);
+
+	update_long_lines (view);
+}
+
 static void
 current_buffer_removed (GeditView *view)
 {
@@ -83,6 +150,10 @@ current_buffer_removed (GeditView *view)
 						      file_read_only_notify_handler,
 						      view);
 
+		g_signal_handlers_disconnect_by_func (view->priv->current_buffer,
+						      long_lines_notify_handler,
+						      view);
+
 		g_object_unref (view->priv->current_buffer);
 		view->priv->current_buffer = NULL;
 	}
@@ -101,6 +172,7 @@ on_notify_buffer_cb (GeditView  *view,
 
 	if (!GEDIT_IS_DOCUMENT (buffer))
 	{
+		update_long_lines (view);
 		return;
 	}
 
@@ -115,6 +187,14 @@ on_notify_buffer_cb (GeditView  *view,
 
 	gtk_text_view_set_editable (GTK_TEXT_VIEW (view),
 				    !gtk_source_file_is_readonly (file));
+
+	g_signal_connect_object (buffer,
+				 "notify::long-lines",
+				 G_CALLBACK (long_lines_notify_handler),
+				 view,
+				 0);
+
+	update_long_lines (view);
 }
 
 static void
@@ -246,17 +326,10 @@ gedit_view_constructed (GObject *object)
 	                 "right-margin-position",
 	                 G_SETTINGS_BIND_GET);
 
-	g_settings_bind (priv->editor_settings,
-	                 GEDIT_SETTINGS_HIGHLIGHT_CURRENT_LINE,
-	                 view,
-	                 "highlight-current-line",
-	                 G_SETTINGS_BIND_GET);
-
-	g_settings_bind (priv->editor_settings,
-	                 GEDIT_SETTINGS_WRAP_MODE,
-	                 view,
-	                 "wrap-mode",
-	                 G_SETTINGS_BIND_GET);
+	if (!priv->long_lines)
+	{
+		bind_long_line_settings (view);
+	}
 
 	g_settings_bind (priv->editor_settings,
 	                 GEDIT_SETTINGS_SMART_HOME_END,
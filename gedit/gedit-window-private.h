@@ -26,8 +26,10 @@
 #include "gedit/gedit-window.h"
 #include "gedit-message-bus.h"
 #include "gedit-settings.h"
+#include "gedit-file-watcher.h"
 #include "gedit-multi-notebook.h"
 #include "gedit-open-document-selector.h"
+#include "gedit-closed-tab.h"
 
 G_BEGIN_DECLS
 
@@ -70,13 +72,16 @@ struct _GeditWindowPrivate
 	GtkWidget      *line_col_button;
 	GtkWidget      *tab_width_button;
 	GtkWidget      *language_button;
+	GtkWidget      *large_mode_button;
 	GtkWidget      *language_button_label;
 	GtkWidget      *language_popover;
 	guint           generic_message_cid;
 	guint           tip_message_cid;
 	guint 	        bracket_match_message_cid;
+	guint           loading_message_cid;
 	guint 	        tab_width_id;
 	guint 	        language_changed_id;
+	guint           large_mode_changed_id;
 	guint           wrap_mode_changed_id;
 
 	/* Headerbars */
@@ -93,6 +98,10 @@ struct _GeditWindowPrivate
 
 	gint            num_tabs_with_error;
 
+	/* For the loading progress of several files */
+	gint            num_tabs_loading;
+	gint            num_tabs_to_load;
+
 	gint            width;
 	gint            height;
 	GdkWindowState  window_state;
@@ -112,7 +121,13 @@ struct _GeditWindowPrivate
 
 	gchar          *direct_save_uri;
 
-	GSList         *closed_docs_stack;
+	GSList         *closed_tabs_stack;
+
+	/* While closing several tabs: the number of tabs left to remove. */
+	guint           n_tabs_to_remove;
+
+	/* Notices the files modified by other programs. */
+	GeditFileWatcher *file_watcher;
 
 	guint           removing_tabs : 1;
 	guint           dispose_has_run : 1;
@@ -120,6 +135,8 @@ struct _GeditWindowPrivate
 	guint           in_fullscreen_eventbox : 1;
 };
 
+GeditClosedTab	*_gedit_window_pop_last_closed_tab	(GeditWindow         *window);
+
 G_END_DECLS
 
 #endif  /* __GEDIT_WINDOW_PRIVATE_H__  */
@@ -64,6 +64,10 @@
 #define TAB_WIDTH_DATA "GeditWindowTabWidthData"
 #define FULLSCREEN_ANIMATION_SPEED 500
 
+/* The snapshots of the closed tabs, see gedit-closed-tab.c. */
+#define MAX_CLOSED_TAB_SNAPSHOTS 10
+#define MAX_CLOSED_TAB_SNAPSHOTS_SIZE (16 * 1024 * 1024)
+
 enum
 {
 	PROP_0,
@@ -221,6 +225,9 @@ gedit_window_dispose (GObject *object)
 		window->priv->dispose_has_run = TRUE;
 	}
 
+	gedit_file_watcher_free (window->priv->file_watcher);
+	window->priv->file_watcher = NULL;
+
 	g_clear_object (&window->priv->message_bus);
 	g_clear_object (&window->priv->window_group);
 	g_clear_object (&window->priv->default_location);
@@ -254,7 +261,7 @@ gedit_window_finalize (GObject *object)
 {
 	GeditWindow *window = GEDIT_WINDOW (object);
 
-	g_slist_free_full (window->priv->closed_docs_stack, (GDestroyNotify)g_object_unref);
+	g_slist_free_full (window->priv->closed_tabs_stack, (GDestroyNotify)gedit_closed_tab_free);
 
 	G_OBJECT_CLASS (gedit_window_parent_class)->finalize (object);
 }
@@ -498,6 +505,7 @@ gedit_window_class_init (GeditWindowClass *klass)
 	gtk_widget_class_bind_template_child_private (widget_class, GeditWindow, bottom_panel);
 	gtk_widget_class_bind_template_child_private (widget_class, GeditWindow, statusbar);
 	gtk_widget_class_bind_template_child_private (widget_class, GeditWindow, language_button);
+	gtk_widget_class_bind_template_child_private (widget_class, GeditWindow, large_mode_button);
 	gtk_widget_class_bind_template_child_private (widget_class, GeditWindow, tab_width_button);
 	gtk_widget_class_bind_template_child_private (widget_class, GeditWindow, line_col_button);
 	gtk_widget_class_bind_template_child_private (widget_class, GeditWindow, fullscreen_controls);
@@ -526,9 +534,15 @@ received_clipboard_contents (GtkClipboard     *clipboard,
 	{
 		GeditTabState state;
 		gboolean state_normal;
+		GeditView *view;
 
 		state = gedit_tab_get_state (tab);
-		state_normal = (state == GEDIT_TAB_STATE_NORMAL);
+		view = gedit_tab_get_view (tab);
+
+		/* See update_actions_sensitivity(). */
+		state_normal = (state == GEDIT_TAB_STATE_NORMAL ||
+				(state == GEDIT_TAB_STATE_SAVING &&
+				 gtk_text_view_get_editable (GTK_TEXT_VIEW (view))));
 
 		enabled = state_normal &&
 		          gtk_selection_data_targets_include_text (selection_data);
@@ -601,7 +615,10 @@ update_actions_sensitivity (GeditWindow *window)
 	gint tab_number = -1;
 	GAction *action;
 	gboolean editable = FALSE;
+	gboolean editing = FALSE;
 	gboolean empty_search = FALSE;
+	gboolean viewer_mode = FALSE;
+	gboolean following = FALSE;
 	GtkClipboard *clipboard;
 	GeditLockdownMask lockdown;
 	gboolean enable_syntax_highlighting;
@@ -622,8 +639,16 @@ update_actions_sensitivity (GeditWindow *window)
 		tab_number = gtk_notebook_page_num (GTK_NOTEBOOK (notebook), GTK_WIDGET (tab));
 		editable = gtk_text_view_get_editable (GTK_TEXT_VIEW (view));
 		empty_search = _gedit_document_get_empty_search (doc);
+		viewer_mode = _gedit_tab_get_viewer_mode (tab);
+		following = _gedit_tab_get_follow (tab);
 	}
 
+	/* A big document stays editable while a copy of its text is saved,
+	 * see launch_saver() in gedit-tab.c.
+	 */
+	editing = (state == GEDIT_TAB_STATE_NORMAL ||
+		   (state == GEDIT_TAB_STATE_SAVING && editable));
+
 	lockdown = gedit_app_get_lockdown (GEDIT_APP (g_application_get_default ()));
 
 	clipboard = gtk_widget_get_clipboard (GTK_WIDGET (window), GDK_SELECTION_CLIPBOARD);
@@ -633,6 +658,7 @@ update_actions_sensitivity (GeditWindow *window)
 	                             ((state == GEDIT_TAB_STATE_NORMAL) ||
 	                              (state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)) &&
 	                             (file != NULL) && !gtk_source_file_is_readonly (file) &&
+	                             !viewer_mode && !following &&
 	                             !(lockdown & GEDIT_LOCKDOWN_SAVE_TO_DISK));
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "save-as");
@@ -641,6 +667,7 @@ update_actions_sensitivity (GeditWindow *window)
 	                              (state == GEDIT_TAB_STATE_SAVING_ERROR) ||
 	                              (state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)) &&
 	                             (doc != NULL) &&
+	                             !viewer_mode && !following &&
 	                             !(lockdown & GEDIT_LOCKDOWN_SAVE_TO_DISK));
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "revert");
@@ -650,7 +677,7 @@ update_actions_sensitivity (GeditWindow *window)
 	                             (doc != NULL) && !gedit_document_is_untitled (doc));
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "reopen-closed-tab");
-	g_simple_action_set_enabled (G_SIMPLE_ACTION (action), (window->priv->closed_docs_stack != NULL));
+	g_simple_action_set_enabled (G_SIMPLE_ACTION (action), (window->priv->closed_tabs_stack != NULL));
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "print");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
@@ -669,28 +696,28 @@ update_actions_sensitivity (GeditWindow *window)
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "undo");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             (state == GEDIT_TAB_STATE_NORMAL) &&
+	                             editing &&
 	                             (doc != NULL) && gtk_source_buffer_can_undo (GTK_SOURCE_BUFFER (doc)));
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "redo");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             (state == GEDIT_TAB_STATE_NORMAL) &&
+	                             editing &&
 	                             (doc != NULL) && gtk_source_buffer_can_redo (GTK_SOURCE_BUFFER (doc)));
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "cut");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             (state == GEDIT_TAB_STATE_NORMAL) &&
+	                             editing &&
 	                             editable &&
 	                             (doc != NULL) && gtk_text_buffer_get_has_selection (GTK_TEXT_BUFFER (doc)));
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "copy");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             ((state == GEDIT_TAB_STATE_NORMAL) ||
+	                             (editing ||
 	                              (state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)) &&
 	                             (doc != NULL) && gtk_text_buffer_get_has_selection (GTK_TEXT_BUFFER (doc)));
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "paste");
-	if (num_tabs > 0 && (state == GEDIT_TAB_STATE_NORMAL) && editable)
+	if (num_tabs > 0 && editing && editable)
 	{
 		set_paste_sensitivity_according_to_clipboard (window, clipboard);
 	}
@@ -701,7 +728,7 @@ update_actions_sensitivity (GeditWindow *window)
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "delete");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             (state == GEDIT_TAB_STATE_NORMAL) &&
+	                             editing &&
 	                             editable &&
 	                             (doc != NULL) && gtk_text_buffer_get_has_selection (GTK_TEXT_BUFFER (doc)));
 
@@ -710,36 +737,36 @@ update_actions_sensitivity (GeditWindow *window)
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "find");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             ((state == GEDIT_TAB_STATE_NORMAL) ||
+	                             (editing ||
 	                              (state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)) &&
 	                             (doc != NULL));
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "replace");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             (state == GEDIT_TAB_STATE_NORMAL) &&
+	                             editing &&
 	                             (doc != NULL) && editable);
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "find-next");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             ((state == GEDIT_TAB_STATE_NORMAL) ||
+	                             (editing ||
 	                              (state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)) &&
 	                              (doc != NULL) && !empty_search);
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "find-prev");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             ((state == GEDIT_TAB_STATE_NORMAL) ||
+	                             (editing ||
 	                              (state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)) &&
 	                              (doc != NULL) && !empty_search);
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "clear-highlight");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             ((state == GEDIT_TAB_STATE_NORMAL) ||
+	                             (editing ||
 	                              (state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)) &&
 	                              (doc != NULL) && !empty_search);
 
 	action = g_action_map_lookup_action (G_ACTION_MAP (window), "goto-line");
 	g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-	                             ((state == GEDIT_TAB_STATE_NORMAL) ||
+	                             (editing ||
 	                              (state == GEDIT_TAB_STATE_EXTERNALLY_MODIFIED_NOTIFICATION)) &&
 	                             (doc != NULL));
 
@@ -830,7 +857,7 @@ on_recent_chooser_item_activated (GeditOpenDocumentSelector *open_document_selec
 		GSList *loaded = NULL;
 
 		locations = g_slist_prepend (locations, (gpointer) location);
-		loaded = gedit_commands_load_locations (window, locations, NULL, 0, 0);
+		loaded = _gedit_cmd_load_locations (window, locations, NULL, 0, 0);
 
 		/* if it doesn't contain just 1 element */
 		if (!loaded || loaded->next)
@@ -893,6 +920,8 @@ setup_statusbar (GeditWindow *window)
 		(GTK_STATUSBAR (window->priv->statusbar), "tip_message");
 	window->priv->bracket_match_message_cid = gtk_statusbar_get_context_id
 		(GTK_STATUSBAR (window->priv->statusbar), "bracket_match_message");
+	window->priv->loading_message_cid = gtk_statusbar_get_context_id
+		(GTK_STATUSBAR (window->priv->statusbar), "loading_message");
 
 	g_settings_bind (window->priv->ui_settings,
 	                 "statusbar-visible",
@@ -1040,7 +1069,18 @@ update_cursor_position_statusbar (GtkTextBuffer *buffer,
 					  gtk_text_buffer_get_insert (buffer));
 
 	line = 1 + gtk_text_iter_get_line (&iter);
-	col = 1 + gtk_source_view_get_visual_column (GTK_SOURCE_VIEW (view), &iter);
+
+	/* The visual column walks the line from its start to expand the tabs,
+	 * on each cursor move: too slow on a line of several megabytes.
+	 */
+	if (_gedit_document_is_long_line (GEDIT_DOCUMENT (buffer), &iter))
+	{
+		col = 1 + gtk_text_iter_get_line_offset (&iter);
+	}
+	else
+	{
+		col = 1 + gtk_source_view_get_visual_column (GTK_SOURCE_VIEW (view), &iter);
+	}
 
 	if ((line >= 0) || (col >= 0))
 	{
@@ -1257,6 +1297,21 @@ language_changed (GObject     *object,
 	                            window);
 }
 
+/* The indicator stays visible once the user has overridden the large mode, so
+ * that it can be toggled back.
+ */
+static void
+large_mode_changed (GObject     *object,
+		    GParamSpec  *pspec,
+		    GeditWindow *window)
+{
+	GeditDocument *doc = GEDIT_DOCUMENT (object);
+
+	gtk_widget_set_visible (window->priv->large_mode_button,
+				gedit_document_get_large_mode (doc) ||
+				_gedit_document_get_large_mode_set_by_user (doc));
+}
+
 static void
 update_statusbar_wrap_mode_checkbox_from_view (GeditWindow *window,
                                                GeditView   *view)
@@ -1328,6 +1383,8 @@ remove_actions (GeditWindow *window)
 	g_action_map_remove_action (G_ACTION_MAP (window), "display-right-margin");
 	g_action_map_remove_action (G_ACTION_MAP (window), "highlight-current-line");
 	g_action_map_remove_action (G_ACTION_MAP (window), "wrap-mode");
+	g_action_map_remove_action (G_ACTION_MAP (window), "follow");
+	g_action_map_remove_action (G_ACTION_MAP (window), "large-mode");
 }
 
 static void
@@ -1345,6 +1402,7 @@ sync_current_tab_actions (GeditWindow *window,
 	if (new_view != NULL)
 	{
 		GPropertyAction *action;
+		GeditTab *tab;
 
 		action = g_property_action_new ("auto-indent", new_view, "auto-indent");
 		g_action_map_add_action (G_ACTION_MAP (window), G_ACTION (action));
@@ -1370,6 +1428,15 @@ sync_current_tab_actions (GeditWindow *window,
 		g_action_map_add_action (G_ACTION_MAP (window), G_ACTION (action));
 		g_object_unref (action);
 
+		tab = gedit_tab_get_from_document (GEDIT_DOCUMENT (gtk_text_view_get_buffer (GTK_TEXT_VIEW (new_view))));
+		action = g_property_action_new ("follow", tab, "follow");
+		g_action_map_add_action (G_ACTION_MAP (window), G_ACTION (action));
+		g_object_unref (action);
+
+		action = g_property_action_new ("large-mode", gedit_tab_get_document (tab), "large-mode");
+		g_action_map_add_action (G_ACTION_MAP (window), G_ACTION (action));
+		g_object_unref (action);
+
 		g_action_map_add_action_entries (G_ACTION_MAP (window),
 		                                 text_wrapping_entrie,
 		                                 G_N_ELEMENTS (text_wrapping_entrie),
@@ -1406,6 +1473,14 @@ update_statusbar (GeditWindow *window,
 
 			window->priv->language_changed_id = 0;
 		}
+
+		if (window->priv->large_mode_changed_id)
+		{
+			g_signal_handler_disconnect (gtk_text_view_get_buffer (GTK_TEXT_VIEW (old_view)),
+						     window->priv->large_mode_changed_id);
+
+			window->priv->large_mode_changed_id = 0;
+		}
 	}
 
 	if (new_view)
@@ -1434,9 +1509,15 @@ update_statusbar (GeditWindow *window,
 								      G_CALLBACK (language_changed),
 								      window);
 
+		window->priv->large_mode_changed_id = g_signal_connect (doc,
+									"notify::large-mode",
+									G_CALLBACK (large_mode_changed),
+									window);
+
 		/* call it for the first time */
 		tab_width_changed (G_OBJECT (new_view), NULL, window);
 		language_changed (G_OBJECT (doc), NULL, window);
+		large_mode_changed (G_OBJECT (doc), NULL, window);
 	}
 }
 
@@ -1498,11 +1579,19 @@ analyze_tab_state (GeditTab    *tab,
 {
 	GeditTabState ts;
 
+	/* A placeholder waits for being shown, it does not load anything. */
+	if (_gedit_tab_is_placeholder (tab))
+	{
+		return;
+	}
+
 	ts = gedit_tab_get_state (tab);
 
 	switch (ts)
 	{
 		case GEDIT_TAB_STATE_LOADING:
+			++window->priv->num_tabs_loading;
+			/* fall through */
 		case GEDIT_TAB_STATE_REVERTING:
 			window->priv->state |= GEDIT_WINDOW_STATE_LOADING;
 			break;
@@ -1527,19 +1616,63 @@ analyze_tab_state (GeditTab    *tab,
 	}
 }
 
+/* When several files are loaded, show how many of them are loaded. A single
+ * file has already its progress info bar.
+ */
+static void
+update_loading_progress (GeditWindow *window,
+			 gint         old_num_tabs_loading)
+{
+	GeditWindowPrivate *priv = window->priv;
+	GtkStatusbar *statusbar = GTK_STATUSBAR (priv->statusbar);
+
+	if (priv->num_tabs_loading > old_num_tabs_loading)
+	{
+		priv->num_tabs_to_load += priv->num_tabs_loading - old_num_tabs_loading;
+	}
+	else if (priv->num_tabs_loading == old_num_tabs_loading)
+	{
+		return;
+	}
+
+	gtk_statusbar_remove_all (statusbar, priv->loading_message_cid);
+
+	if (priv->num_tabs_loading == 0)
+	{
+		priv->num_tabs_to_load = 0;
+	}
+	else if (priv->num_tabs_to_load > 1)
+	{
+		gchar *msg;
+
+		msg = g_strdup_printf (ngettext ("Loaded %d of %d file\342\200\246",
+						 "Loaded %d of %d files\342\200\246",
+						 priv->num_tabs_to_load),
+				       priv->num_tabs_to_load - priv->num_tabs_loading,
+				       priv->num_tabs_to_load);
+
+		gtk_statusbar_push (statusbar, priv->loading_message_cid, msg);
+
+		g_free (msg);
+	}
+}
+
 static void
 update_window_state (GeditWindow *window)
 {
 	GeditWindowState old_ws;
 	gint old_num_of_errors;
+	gint old_num_tabs_loading;
 
 	gedit_debug_message (DEBUG_WINDOW, "Old state: %x", window->priv->state);
 
 	old_ws = window->priv->state;
 	old_num_of_errors = window->priv->num_tabs_with_error;
+	old_num_tabs_loading = window->priv->num_tabs_loading;
 
 	window->priv->state = 0;
 	window->priv->num_tabs_with_error = 0;
+	window->priv->num_tabs_loading = 0;
 
 	gedit_multi_notebook_foreach_tab (window->priv->multi_notebook,
 					  (GtkCallback)analyze_tab_state,
@@ -1547,6 +1680,8 @@ update_window_state (GeditWindow *window)
 
 	gedit_debug_message (DEBUG_WINDOW, "New state: %x", window->priv->state);
 
+	update_loading_progress (window, old_num_tabs_loading);
+
 	if (old_ws != window->priv->state)
 	{
 		update_actions_sensitivity (window);
@@ -1670,11 +1805,11 @@ load_uris_from_drop (GeditWindow  *window,
 	}
 
 	locations = g_slist_reverse (locations);
-	loaded = gedit_commands_load_locations (window,
-	                                        locations,
-	                                        NULL,
-	                                        0,
-	                                        0);
+	loaded = _gedit_cmd_load_locations (window,
+	                                    locations,
+	                                    NULL,
+	                                    0,
+	                                    0);
 
 	g_slist_free (loaded);
 	g_slist_free_full (locations, g_object_unref);
@@ -1940,6 +2075,8 @@ editable_changed (GeditView  *view,
                   GParamSpec  *arg1,
                   GeditWindow *window)
 {
+	update_actions_sensitivity (window);
+
 	peas_extension_set_foreach (window->priv->extensions,
 	                            (PeasExtensionSetForeachFunc) extension_update_state,
 	                            window);
@@ -2019,40 +2156,101 @@ on_tab_added (GeditMultiNotebook *multi,
 			  G_CALLBACK (readonly_changed),
 			  window);
 
+	if (window->priv->file_watcher != NULL)
+	{
+		gedit_file_watcher_add_tab (window->priv->file_watcher, tab);
+	}
+
 	update_window_state (window);
 	update_can_close (window);
 
 	g_signal_emit (G_OBJECT (window), signals[TAB_ADDED], 0, tab);
 }
 
+/* Only the most recently closed tabs keep the snapshot of their contents. */
+static void
+trim_closed_tab_snapshots (GeditWindow *window)
+{
+	GSList *l;
+	guint n_snapshots = 0;
+	gsize total_size = 0;
+
+	for (l = window->priv->closed_tabs_stack; l != NULL; l = l->next)
+	{
+		GeditClosedTab *closed_tab = l->data;
+		gsize size = gedit_closed_tab_get_snapshot_size (closed_tab);
+
+		/* The size of a snapshot being compressed is 0, until it is
+		 * taken and the snapshots are trimmed again.
+		 */
+		if (!gedit_closed_tab_has_snapshot (closed_tab))
+		{
+			continue;
+		}
+
+		if (n_snapshots >= MAX_CLOSED_TAB_SNAPSHOTS ||
+		    total_size + size > MAX_CLOSED_TAB_SNAPSHOTS_SIZE)
+		{
+			gedit_closed_tab_drop_snapshot (closed_tab);
+			continue;
+		}
+
+		n_snapshots++;
+		total_size += size;
+	}
+}
+
+static void
+closed_tab_snapshot_taken (GeditClosedTab *closed_tab,
+			   gpointer        user_data)
+{
+	trim_closed_tab_snapshots (GEDIT_WINDOW (user_data));
+}
+
 static void
-push_last_closed_doc (GeditWindow   *window,
-                      GeditDocument *doc)
+push_last_closed_tab (GeditWindow *window,
+                      GeditTab    *tab)
 {
 	GeditWindowPrivate *priv = window->priv;
-	GtkSourceFile *file = gedit_document_get_file (doc);
-	GFile *location = gtk_source_file_get_location (file);
+	GeditClosedTab *closed_tab;
+	gboolean with_snapshot;
 
-	if (location != NULL)
+	if (priv->n_tabs_to_remove > 0)
 	{
-		priv->closed_docs_stack = g_slist_prepend (priv->closed_docs_stack, location);
-		g_object_ref (location);
+		priv->n_tabs_to_remove--;
+	}
+
+	/* No snapshot that would be dropped right away: when gedit quits, or
+	 * when the tabs closed after this one take all the snapshots.
+	 */
+	with_snapshot = (!_gedit_cmd_file_is_quitting (window) &&
+			 priv->n_tabs_to_remove < MAX_CLOSED_TAB_SNAPSHOTS);
+
+	closed_tab = gedit_closed_tab_new (tab,
+					   with_snapshot,
+					   closed_tab_snapshot_taken,
+					   window);
+
+	if (closed_tab != NULL)
+	{
+		priv->closed_tabs_stack = g_slist_prepend (priv->closed_tabs_stack, closed_tab);
+		trim_closed_tab_snapshots (window);
 	}
 }
 
-GFile *
-_gedit_window_pop_last_closed_doc (GeditWindow *window)
+GeditClosedTab *
+_gedit_window_pop_last_closed_tab (GeditWindow *window)
 {
 	GeditWindowPrivate *priv = window->priv;
-	GFile *f = NULL;
+	GeditClosedTab *closed_tab = NULL;
 
-	if (window->priv->closed_docs_stack != NULL)
+	if (window->priv->closed_tabs_stack != NULL)
 	{
-		f = priv->closed_docs_stack->data;
-		priv->closed_docs_stack = g_slist_remove (priv->closed_docs_stack, f);
+		closed_tab = priv->closed_tabs_stack->data;
+		priv->closed_tabs_stack = g_slist_remove (priv->closed_tabs_stack, closed_tab);
 	}
 
-	return f;
+	return closed_tab;
 }
 
 static void
@@ -2112,6 +2310,11 @@ on_tab_removed (GeditMultiNotebook *multi,
 					      G_CALLBACK (editable_changed),
 					      window);
 
+	if (window->priv->file_watcher != NULL)
+	{
+		gedit_file_watcher_remove_tab (window->priv->file_watcher, tab);
+	}
+
 	if (tab == gedit_multi_notebook_get_active_tab (multi))
 	{
 		if (window->priv->tab_width_id)
@@ -2126,6 +2329,12 @@ on_tab_removed (GeditMultiNotebook *multi,
 			window->priv->language_changed_id = 0;
 		}
 
+		if (window->priv->large_mode_changed_id)
+		{
+			g_signal_handler_disconnect (doc, window->priv->large_mode_changed_id);
+			window->priv->large_mode_changed_id = 0;
+		}
+
 		gedit_multi_notebook_set_active_tab (multi, NULL);
 	}
 
@@ -2141,11 +2350,12 @@ on_tab_removed (GeditMultiNotebook *multi,
 		gtk_widget_hide (window->priv->line_col_button);
 		gtk_widget_hide (window->priv->tab_width_button);
 		gtk_widget_hide (window->priv->language_button);
+		gtk_widget_hide (window->priv->large_mode_button);
 	}
 
 	if (!window->priv->dispose_has_run)
 	{
-		push_last_closed_doc (window, doc);
+		push_last_closed_tab (window, tab);
 
 		if ((!window->priv->removing_tabs &&
 		    gtk_notebook_get_n_pages (GTK_NOTEBOOK (notebook)) > 0) ||
@@ -2761,7 +2971,9 @@ gedit_window_init (GeditWindow *window)
 	window->priv->dispose_has_run = FALSE;
 	window->priv->fullscreen_controls = NULL;
 	window->priv->direct_save_uri = NULL;
-	window->priv->closed_docs_stack = NULL;
+	window->priv->closed_tabs_stack = NULL;
+	window->priv->n_tabs_to_remove = 0;
+	window->priv->file_watcher = gedit_file_watcher_new ();
 	window->priv->editor_settings = g_settings_new ("org.gnome.gedit.preferences.editor");
 	window->priv->ui_settings = g_settings_new ("org.gnome.gedit.preferences.ui");
 
@@ -3133,6 +3345,39 @@ gedit_window_create_tab_from_location (GeditWindow             *window,
 	return process_create_tab (window, notebook, tab, jump_to);
 }
 
+/* Creates a tab in the background which loads @location only when it is shown
+ * for the first time. Used when opening many files at once.
+ */
+GeditTab *
+_gedit_window_create_placeholder_tab (GeditWindow             *window,
+				      GFile                   *location,
+				      const GtkSourceEncoding *encoding,
+				      gint                     line_pos,
+				      gint                     column_pos,
+				      gboolean                 create)
+{
+	GtkWidget *notebook;
+	GeditTab *tab;
+
+	g_return_val_if_fail (GEDIT_IS_WINDOW (window), NULL);
+	g_return_val_if_fail (G_IS_FILE (location), NULL);
+
+	gedit_debug (DEBUG_WINDOW);
+
+	tab = _gedit_tab_new ();
+
+	_gedit_tab_load_placeholder (tab,
+				     location,
+				     encoding,
+				     line_pos,
+				     column_pos,
+				     create);
+
+	notebook = _gedit_window_get_notebook (window);
+
+	return process_create_tab (window, notebook, tab, FALSE);
+}
+
 /**
  * gedit_window_create_tab_from_stream:
  * @window: a #GeditWindow
@@ -3173,6 +3418,43 @@ gedit_window_create_tab_from_stream (GeditWindow             *window,
 	return process_create_tab (window, notebook, tab, jump_to);
 }
 
+/* Like gedit_window_create_tab_from_stream(), for a closed tab reopened from
+ * the snapshot of its @location. @mtime is the modification time of the file
+ * when the snapshot was taken.
+ */
+GeditTab *
+_gedit_window_create_tab_from_snapshot (GeditWindow             *window,
+					GFile                   *location,
+					GInputStream            *stream,
+					const GtkSourceEncoding *encoding,
+					const GTimeVal          *mtime,
+					gint                     line_pos,
+					gint                     column_pos)
+{
+	GtkWidget *notebook;
+	GeditTab *tab;
+
+	gedit_debug (DEBUG_WINDOW);
+
+	g_return_val_if_fail (GEDIT_IS_WINDOW (window), NULL);
+	g_return_val_if_fail (G_IS_FILE (location), NULL);
+	g_return_val_if_fail (G_IS_INPUT_STREAM (stream), NULL);
+
+	tab = _gedit_tab_new ();
+
+	_gedit_tab_load_snapshot (tab,
+				  location,
+				  stream,
+				  encoding,
+				  mtime,
+				  line_pos,
+				  column_pos);
+
+	notebook = _gedit_window_get_notebook (window);
+
+	return process_create_tab (window, notebook, tab, TRUE);
+}
+
 /**
  * gedit_window_get_active_tab:
  * @window: a GeditWindow
@@ -3213,6 +3495,31 @@ add_document (GeditTab  *tab,
  */
 GList *
 gedit_window_get_documents (GeditWindow *window)
+{
+	GList *res;
+	GList *l;
+
+	g_return_val_if_fail (GEDIT_IS_WINDOW (window), NULL);
+
+	res = _gedit_window_peek_documents (window);
+
+	/* The caller expects the contents of the documents, so the tabs
+	 * opened in the background and not shown yet are loaded now.
+	 */
+	for (l = res; l != NULL; l = g_list_next (l))
+	{
+		_gedit_tab_materialize (gedit_tab_get_from_document (l->data));
+	}
+
+	return res;
+}
+
+/* Like gedit_window_get_documents(), but the placeholder tabs are not loaded:
+ * their documents are still empty. For the callers that need only the
+ * locations or the settings of the documents.
+ */
+GList *
+_gedit_window_peek_documents (GeditWindow *window)
 {
 	GList *res = NULL;
 
@@ -3299,10 +3606,12 @@ gedit_window_close_all_tabs (GeditWindow *window)
 	g_return_if_fail (!(window->priv->state & GEDIT_WINDOW_STATE_SAVING));
 
 	window->priv->removing_tabs = TRUE;
+	window->priv->n_tabs_to_remove = gedit_multi_notebook_get_n_tabs (window->priv->multi_notebook);
 
 	gedit_multi_notebook_close_all_tabs (window->priv->multi_notebook);
 
 	window->priv->removing_tabs = FALSE;
+	window->priv->n_tabs_to_remove = 0;
 }
 
 /**
@@ -3320,10 +3629,12 @@ gedit_window_close_tabs (GeditWindow *window,
 	g_return_if_fail (!(window->priv->state & GEDIT_WINDOW_STATE_SAVING));
 
 	window->priv->removing_tabs = TRUE;
+	window->priv->n_tabs_to_remove = g_list_length ((GList *) tabs);
 
 	gedit_multi_notebook_close_tabs (window->priv->multi_notebook, tabs);
 
 	window->priv->removing_tabs = FALSE;
+	window->priv->n_tabs_to_remove = 0;
 }
 
 GeditWindow *
@@ -3595,40 +3906,24 @@ gedit_window_get_tab_from_location (GeditWindow *window,
 {
 	GList *tabs;
 	GList *l;
-	GeditTab *ret = NULL;
 
 	g_return_val_if_fail (GEDIT_IS_WINDOW (window), NULL);
 	g_return_val_if_fail (G_IS_FILE (location), NULL);
 
-	tabs = gedit_multi_notebook_get_all_tabs (window->priv->multi_notebook);
+	tabs = _gedit_app_get_tabs_from_location (GEDIT_APP (g_application_get_default ()),
+						  location);
 
 	for (l = tabs; l != NULL; l = g_list_next (l))
 	{
-		GeditDocument *doc;
-		GtkSourceFile *file;
-		GeditTab *tab;
-		GFile *cur_location;
-
-		tab = GEDIT_TAB (l->data);
-		doc = gedit_tab_get_document (tab);
-		file = gedit_document_get_file (doc);
-		cur_location = gtk_source_file_get_location (file);
+		GeditTab *tab = GEDIT_TAB (l->data);
 
-		if (cur_location != NULL)
+		if (gtk_widget_get_toplevel (GTK_WIDGET (tab)) == GTK_WIDGET (window))
 		{
-			gboolean found = g_file_equal (location, cur_location);
-
-			if (found)
-			{
-				ret = tab;
-				break;
-			}
+			return tab;
 		}
 	}
 
-	g_list_free (tabs);
-
-	return ret;
+	return NULL;
 }
 
 /**
@@ -165,7 +165,22 @@ gboolean	 _gedit_window_is_fullscreen		(GeditWindow         *window);
 
 GList		*_gedit_window_get_all_tabs		(GeditWindow         *window);
 
-GFile		*_gedit_window_pop_last_closed_doc	(GeditWindow         *window);
+GList		*_gedit_window_peek_documents		(GeditWindow         *window);
+
+GeditTab	*_gedit_window_create_placeholder_tab	(GeditWindow             *window,
+							 GFile                   *location,
+							 const GtkSourceEncoding *encoding,
+							 gint                     line_pos,
+							 gint                     column_pos,
+							 gboolean                 create);
+
+GeditTab	*_gedit_window_create_tab_from_snapshot	(GeditWindow             *window,
+							 GFile                   *location,
+							 GInputStream            *stream,
+							 const GtkSourceEncoding *encoding,
+							 const GTimeVal          *mtime,
+							 gint                     line_pos,
+							 gint                     column_pos);
 
 G_END_DECLS
 
@@ -94,6 +94,7 @@ static void	auto_spell_change_state_cb	(GSimpleAction *action, GVariant *state,
 
 static void	on_document_loaded		(GeditDocument *doc, ViewData *data);
 static void	on_document_saved		(GeditDocument *doc, ViewData *data);
+static void	on_large_mode_changed		(GeditDocument *doc, GParamSpec *pspec, ViewData *data);
 static void	set_auto_spell_from_metadata	(ViewData *data);
 
 static GActionEntry action_entries[] =
@@ -129,6 +130,11 @@ view_data_new (GeditSpellPlugin *plugin,
 			  G_CALLBACK (on_document_saved),
 			  data);
 
+	g_signal_connect (data->doc,
+			  "notify::large-mode",
+			  G_CALLBACK (on_large_mode_changed),
+			  data);
+
 	set_auto_spell_from_metadata (data);
 
 	return data;
@@ -146,6 +152,7 @@ view_data_free (ViewData *data)
 	{
 		g_signal_handlers_disconnect_by_func (data->doc, on_document_loaded, data);
 		g_signal_handlers_disconnect_by_func (data->doc, on_document_saved, data);
+		g_signal_handlers_disconnect_by_func (data->doc, on_large_mode_changed, data);
 
 		g_object_unref (data->doc);
 	}
@@ -589,6 +596,14 @@ set_auto_spell_from_metadata (ViewData *data)
 		g_free (active_str);
 	}
 
+	/* Checking a large document as a whole is too slow, the automatic
+	 * spell checking is deferred until the user asks for it.
+	 */
+	if (gedit_document_get_large_mode (data->doc))
+	{
+		active = FALSE;
+	}
+
 	set_auto_spell (data, active);
 
 	/* In case that the view is the active one we mark the spell action */
@@ -649,12 +664,33 @@ on_document_saved (GeditDocument *doc,
 		key = NULL;
 	}
 
-	gedit_document_set_metadata (doc,
-	                             GEDIT_METADATA_ATTRIBUTE_SPELL_ENABLED,
-				     data->auto_spell != NULL ? SPELL_ENABLED_STR : NULL,
-	                             GEDIT_METADATA_ATTRIBUTE_SPELL_LANGUAGE,
-	                             key,
-	                             NULL);
+	/* In large mode the automatic spell checking may only be deferred, the
+	 * user choice is saved when the action is activated.
+	 */
+	if (gedit_document_get_large_mode (doc))
+	{
+		gedit_document_set_metadata (doc,
+		                             GEDIT_METADATA_ATTRIBUTE_SPELL_LANGUAGE,
+		                             key,
+		                             NULL);
+	}
+	else
+	{
+		gedit_document_set_metadata (doc,
+		                             GEDIT_METADATA_ATTRIBUTE_SPELL_ENABLED,
+					     data->auto_spell != NULL ? SPELL_ENABLED_STR : NULL,
+		                             GEDIT_METADATA_ATTRIBUTE_SPELL_LANGUAGE,
+		                             key,
+		                             NULL);
+	}
+}
+
+static void
+on_large_mode_changed (GeditDocument *doc,
+		       GParamSpec    *pspec,
+		       ViewData      *data)
+{
+	set_auto_spell_from_metadata (data);
 }
 
 static void